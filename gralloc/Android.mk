@@ -15,6 +15,25 @@
 
 LOCAL_PATH := $(call my-dir)
 
+# Board options, shared with the host benchmark in tests/
+gralloc_board_cflags :=
+
+ifeq ($(BOARD_USE_BGRA_8888_FB),true)
+gralloc_board_cflags += -DUSE_BGRA_8888
+endif
+
+# Allocate the planes of software-only multi-plane YUV buffers from one ION
+# buffer. Buffers with any hardware usage keep one ION buffer per plane.
+ifeq ($(BOARD_USES_GRALLOC_SINGLE_ALLOC),true)
+gralloc_board_cflags += -DGRALLOC_SINGLE_ALLOC
+endif
+
+# Give read-only software locks of 64x32 tiled buffers a linear copy of
+# the planes instead of the raw tiles.
+ifeq ($(BOARD_USES_GRALLOC_LINEAR_TILED),true)
+gralloc_board_cflags += -DGRALLOC_LINEAR_TILED
+endif
+
 # HAL module implemenation stored in
 # hw/<OVERLAY_HARDWARE_MODULE_ID>.<ro.product.board>.so
 include $(CLEAR_VARS)
@@ -31,16 +50,19 @@ LOCAL_SRC_FILES := 	\
 	gralloc.cpp 	\
 	gralloc_vsync.cpp \
 	framebuffer.cpp \
-	mapper.cpp
-
-LOCAL_CFLAGS := -DLOG_TAG=\"gralloc\"
+	mapper.cpp \
+	gralloc_fb_copy.cpp \
+	gralloc_pacing.cpp \
+	gralloc_detile.cpp \
+	gralloc_tiled.cpp \
+	gralloc_stats.cpp
 
-ifeq ($(BOARD_USE_BGRA_8888_FB),true)
-LOCAL_CFLAGS += -DUSE_BGRA_8888
-endif
+LOCAL_CFLAGS := -DLOG_TAG=\"gralloc\" $(gralloc_board_cflags)
 
 LOCAL_MODULE := gralloc.exynos5
 LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE_OWNER := samsung_arm
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(LOCAL_PATH)/tests/Android.mk
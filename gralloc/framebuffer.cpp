@@ -43,6 +43,8 @@
 
 #include "gralloc_priv.h"
 #include "gralloc_vsync.h"
+#include "gralloc_fb_copy.h"
+#include "gralloc_pacing.h"
 
 inline size_t roundUpToPageSize(size_t x) {
     return (x + (PAGE_SIZE-1)) & ~(PAGE_SIZE-1);
@@ -62,27 +64,31 @@ typedef android::Vector<struct hwc_callback_entry> hwc_callback_queue_t;
 
 struct fb_context_t {
     framebuffer_device_t  device;
+    /* rows damaged since the last post, set by fb_setUpdateRect */
+    int update_top;
+    int update_bottom;
 };
 
 /*****************************************************************************/
 
 /*
  * Copy buffer to the front if page flip is not available/allowed because of
- * size constraints.
+ * size constraints. Only rows [top, bottom) are locked and copied.
  */
-inline void memcpy_buffer(private_module_t* m, buffer_handle_t &buffer) {
+inline void memcpy_buffer(private_module_t* m, buffer_handle_t &buffer,
+                          int top, int bottom) {
     void* fb_vaddr;
     void* buffer_vaddr;
+    size_t offset = m->finfo.line_length * top;
 
     m->base.lock(&m->base, m->framebuffer, GRALLOC_USAGE_SW_WRITE_RARELY,
-                 0, 0, m->info.xres, m->info.yres, &fb_vaddr);
+                 0, top, m->info.xres, bottom - top, &fb_vaddr);
 
     m->base.lock(&m->base, buffer, GRALLOC_USAGE_SW_READ_RARELY,
-                 0, 0, m->info.xres, m->info.yres, &buffer_vaddr);
+                 0, top, m->info.xres, bottom - top, &buffer_vaddr);
 
-    // Do a direct copy.
-    // TODO: Implement a copybit HAL for this
-    memcpy(fb_vaddr, buffer_vaddr, m->finfo.line_length * m->info.yres);
+    gralloc_fb_copy((char *)fb_vaddr + offset, (char *)buffer_vaddr + offset,
+                    m->finfo.line_length * (bottom - top));
     m->base.unlock(&m->base, buffer);
     m->base.unlock(&m->base, m->framebuffer);
 }
@@ -128,6 +134,10 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
     private_handle_t const* hnd = reinterpret_cast<private_handle_t const*>(buffer);
     private_module_t* m = reinterpret_cast<private_module_t*>(dev->common.module);
 
+    if (m->swapInterval)
+        gralloc_pacing_wait();
+    int64_t start = gralloc_pacing_now();
+
     if (m->flags & PAGE_FLIP) {
         hwc_callback_queue_t *queue = reinterpret_cast<hwc_callback_queue_t *>(m->queue);
         pthread_mutex_lock(&m->queue_lock);
@@ -141,14 +151,54 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
             entry.callback(entry.data, hnd);
         }
     } else {
-        // If we can't do the page_flip, just copy the buffer to the front
-        // FIXME: use copybit HAL instead of memcpy
-        memcpy_buffer(m, buffer);
+        // If we can't do the page_flip, copy the damaged rows to the front
+        fb_context_t* ctx = reinterpret_cast<fb_context_t*>(dev);
+        int top = 0;
+        int bottom = m->info.yres;
+
+        if (ctx->update_bottom > ctx->update_top) {
+            top = ctx->update_top;
+            bottom = ctx->update_bottom;
+        }
+        ctx->update_top = 0;
+        ctx->update_bottom = 0;
+
+        memcpy_buffer(m, buffer, top, bottom);
+    }
+
+    gralloc_pacing_post_done(start, gralloc_pacing_now());
+
+    return 0;
+}
+
+static int fb_setUpdateRect(struct framebuffer_device_t* dev,
+                            int l __unused, int t, int w, int h)
+{
+    fb_context_t* ctx = reinterpret_cast<fb_context_t*>(dev);
+    private_module_t* m = reinterpret_cast<private_module_t*>(dev->common.module);
+    int bottom = t + h;
+
+    if (t < 0 || w <= 0 || h <= 0 || bottom > (int)m->info.yres)
+        return -EINVAL;
+
+    /* accumulate until the next post */
+    if (ctx->update_bottom > ctx->update_top) {
+        if (ctx->update_top < t)
+            t = ctx->update_top;
+        if (ctx->update_bottom > bottom)
+            bottom = ctx->update_bottom;
     }
+    ctx->update_top = t;
+    ctx->update_bottom = bottom;
 
     return 0;
 }
 
+static void fb_dump(struct framebuffer_device_t* dev __unused, char *buff, int buff_len)
+{
+    gralloc_pacing_dump(buff, buff_len);
+}
+
 /*****************************************************************************/
 
 static int fb_close(struct hw_device_t *dev)
@@ -309,24 +359,29 @@ int fb_device_open(hw_module_t const* module, const char* name __unused,
         return status;
     }
 
-    framebuffer_device_t *dev = (framebuffer_device_t *)malloc(sizeof(framebuffer_device_t));
-    if (dev == NULL) {
+    fb_context_t *ctx = (fb_context_t *)malloc(sizeof(fb_context_t));
+    if (ctx == NULL) {
         ALOGE("Failed to allocate memory for dev");
         gralloc_close(gralloc_device);
-        return status;
+        return -ENOMEM;
     }
+    framebuffer_device_t *dev = &ctx->device;
 
     private_module_t* m = (private_module_t*)module;
     status = init_fb(m);
     if (status < 0) {
         ALOGE("Fail to init framebuffer");
-        free(dev);
+        free(ctx);
         gralloc_close(gralloc_device);
         return status;
     }
 
+    if (!(m->flags & PAGE_FLIP))
+        gralloc_fb_copy_init();
+    gralloc_pacing_init(m->fps);
+
     /* initialize our state here */
-    memset(dev, 0, sizeof(*dev));
+    memset(ctx, 0, sizeof(*ctx));
 
     /* initialize the procs */
     dev->common.tag = HARDWARE_DEVICE_TAG;
@@ -335,8 +390,9 @@ int fb_device_open(hw_module_t const* module, const char* name __unused,
     dev->common.close = fb_close;
     dev->setSwapInterval = fb_setSwapInterval;
     dev->post = fb_post;
-    dev->setUpdateRect = 0;
+    dev->setUpdateRect = fb_setUpdateRect;
     dev->compositionComplete = fb_compositionComplete;
+    dev->dump = fb_dump;
     m->queue = new hwc_callback_queue_t;
     pthread_mutex_init(&m->queue_lock, NULL);
 
@@ -36,7 +36,9 @@
 #include <hardware/gralloc.h>
 
 #include "gralloc_priv.h"
+#include "gralloc_stats.h"
 #include "exynos_format.h"
+#include "exynos_format_layout.h"
 
 #define ION_HEAP_EXYNOS_CONTIG_MASK     (1 << 4)
 #define ION_EXYNOS_FIMD_VIDEO_MASK  (1 << 28)
@@ -87,6 +89,8 @@ extern int gralloc_register_buffer(gralloc_module_t const* module,
 extern int gralloc_unregister_buffer(gralloc_module_t const* module,
                                      buffer_handle_t handle);
 
+extern void gralloc_init_layout(private_handle_t *hnd);
+
 /*****************************************************************************/
 
 static struct hw_module_methods_t gralloc_module_methods = {
@@ -138,9 +142,11 @@ static unsigned int _select_heap(int usage)
 static int gralloc_alloc_rgb(int ionfd, int w, int h, int format, int usage,
                              unsigned int ion_flags, private_handle_t **hnd, int *stride)
 {
-    size_t size, bpr, alignment = 0, ext_size=256;
-    int bpp = 0, vstride, fd, err;
+    size_t size, alignment = 0;
+    int fd, err;
     unsigned int heap_mask = _select_heap(usage);
+    const struct exynos_format_layout *layout;
+    struct exynos_plane_layout planes;
 
     if (format == HAL_PIXEL_FORMAT_RGBA_8888) {
         bool sw_usage = !!(usage & (GRALLOC_USAGE_SW_READ_MASK |
@@ -157,46 +163,19 @@ static int gralloc_alloc_rgb(int ionfd, int w, int h, int format, int usage,
         }
     }
 
-    switch (format) {
-        case HAL_PIXEL_FORMAT_EXYNOS_ARGB_8888:
-        case HAL_PIXEL_FORMAT_RGBA_8888:
-        case HAL_PIXEL_FORMAT_RGBX_8888:
-        case HAL_PIXEL_FORMAT_BGRA_8888:
-        case HAL_PIXEL_FORMAT_sRGB_A_8888:
-        case HAL_PIXEL_FORMAT_sRGB_X_8888:
-            bpp = 4;
-            break;
-        case HAL_PIXEL_FORMAT_RGB_888:
-            bpp = 3;
-            break;
-        case HAL_PIXEL_FORMAT_RGB_565:
-        case HAL_PIXEL_FORMAT_RAW16:
-            bpp = 2;
-            break;
-        case HAL_PIXEL_FORMAT_BLOB:
-            *stride = w;
-            vstride = h;
-            size = w * h;
-            break;
-        default:
-            return -EINVAL;
-    }
+    /* YUV formats, single plane YCbCr_422_I included, go to gralloc_alloc_yuv */
+    layout = exynos_format_layout_find(format);
+    if (!layout || layout->planes != 1 || format == HAL_PIXEL_FORMAT_YCbCr_422_I)
+        return -EINVAL;
 
-    if (format != HAL_PIXEL_FORMAT_BLOB) {
-        if ((usage & GRALLOC_USAGE_HW_VIDEO_ENCODER) || (format == HAL_PIXEL_FORMAT_BGRA_8888)) {
-            bpr = ALIGN(w, 16)* bpp;
-            vstride = ALIGN(h, 16);
-        } else {
-            bpr = ALIGN(w*bpp, 64);
-            vstride = h;
-        }
-        if (vstride < h + 2)
-            size = bpr * (h + 2);
-        else
-            size = bpr * vstride;
-        *stride = bpr / bpp;
-        size = ALIGN(size, PAGE_SIZE)+ext_size;
-    }
+    memset(&planes, 0, sizeof(planes));
+    exynos_format_plane_layout(layout, w, h, usage & GRALLOC_USAGE_HW_VIDEO_ENCODER,
+                               &planes);
+    *stride = planes.stride;
+    size = planes.luma_size;
+    /* BLOB buffers keep their exact size, camera blobs end with a header */
+    if (layout->ext_pad)
+        size = ALIGN(size, PAGE_SIZE) + EXYNOS_LAYOUT_EXT_SIZE;
 
     if (usage & GRALLOC_USAGE_PROTECTED) {
 #ifdef GRALLOC_USAGE_PRIVATE_NONSECURE
@@ -228,7 +207,7 @@ static int gralloc_alloc_rgb(int ionfd, int w, int h, int format, int usage,
             return err;
     }
     *hnd = new private_handle_t(fd, size, usage, w, h, format, *stride,
-                                vstride);
+                                planes.vstride);
 
     return err;
 }
@@ -237,43 +216,99 @@ static int gralloc_alloc_framework_yuv(int ionfd, int w, int h, int format,
                                        int usage, unsigned int ion_flags,
                                        private_handle_t **hnd, int *stride)
 {
-    size_t size=0, ext_size=256;
+    size_t size;
     int err, fd;
     unsigned int heap_mask = _select_heap(usage);
+    const struct exynos_format_layout *layout = exynos_format_layout_find(format);
+    struct exynos_plane_layout planes;
 
-    switch (format) {
-        case HAL_PIXEL_FORMAT_YV12:
-        case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_P:
-            *stride = ALIGN(w, 16);
-            size = (*stride * h) + (ALIGN(*stride / 2, 16) * h) + ext_size;
-            break;
-        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
-            *stride = w;
-            size = *stride * ALIGN(h, 16) * 3 / 2 + ext_size;
-            break;
-        default:
-            ALOGE("invalid yuv format %d\n", format);
-            return -EINVAL;
+    if (!layout || !layout->contiguous) {
+        ALOGE("invalid yuv format %d\n", format);
+        return -EINVAL;
     }
 
+    memset(&planes, 0, sizeof(planes));
+    exynos_format_plane_layout(layout, w, h, 0, &planes);
+    *stride = planes.stride;
+    size = exynos_format_buffer_size(layout, &planes);
+
     err = ion_alloc_fd(ionfd, size, 0, heap_mask, ion_flags, &fd);
     if (err)
         return err;
 
-    *hnd = new private_handle_t(fd, size, usage, w, h, format, *stride, h);
+    *hnd = new private_handle_t(fd, size, usage, w, h, format, *stride,
+                                planes.vstride);
+    return err;
+}
+
+#ifdef GRALLOC_SINGLE_ALLOC
+/*
+ * Only gralloc's own lock() honors the plane offsets of a single-allocation
+ * buffer. Camera, GSC, MFC and HWC pass fd1 and fd2 to their drivers as if
+ * each plane started at offset 0, so any hardware usage keeps one ION
+ * buffer per plane.
+ */
+#define GRALLOC_SINGLE_ALLOC_USAGE  (GRALLOC_USAGE_SW_READ_MASK | GRALLOC_USAGE_SW_WRITE_MASK)
+
+/*
+ * Carves all planes of a multi-plane buffer from one ION allocation. Each
+ * plane starts on a page boundary so it can be mapped on its own, and only
+ * the last plane keeps the ext_size pad. fd1 and fd2 are dup'ed fds of the
+ * whole buffer; the plane offsets in the handle say where each plane starts.
+ */
+static int gralloc_alloc_yuv_single(int ionfd, size_t luma_size, size_t chroma_size,
+                                    int planes, unsigned int heap_mask,
+                                    unsigned int ion_flags,
+                                    int *fd, int *fd1, int *fd2,
+                                    int *offset1, int *offset2)
+{
+    size_t ext_size = EXYNOS_LAYOUT_EXT_SIZE;
+    size_t luma_span = ALIGN(luma_size - ext_size, PAGE_SIZE);
+    size_t chroma_span = ALIGN(chroma_size - ext_size, PAGE_SIZE);
+    size_t size = luma_span + chroma_span * (planes - 1) + ext_size;
+    int err;
+
+    err = ion_alloc_fd(ionfd, size, 0, heap_mask, ion_flags, fd);
+    if (err)
+        return err;
+
+    *fd1 = dup(*fd);
+    if (*fd1 < 0) {
+        err = -errno;
+        goto err_dup;
+    }
+    *offset1 = luma_span;
+
+    if (planes == 3) {
+        *fd2 = dup(*fd);
+        if (*fd2 < 0) {
+            err = -errno;
+            close(*fd1);
+            *fd1 = -1;
+            goto err_dup;
+        }
+        *offset2 = luma_span + chroma_span;
+    }
+    return 0;
+
+err_dup:
+    ALOGE("%s: could not dup plane fd (%s)", __func__, strerror(-err));
+    close(*fd);
+    *fd = -1;
     return err;
 }
+#endif
 
 static int gralloc_alloc_yuv(int ionfd, int w, int h, int format,
                              int usage, unsigned int ion_flags,
                              private_handle_t **hnd, int *stride)
 {
-    size_t luma_size=0, chroma_size=0, ext_size=256;
+    size_t luma_size=0, chroma_size=0;
     int err, planes, fd = -1, fd1 = -1, fd2 = -1;
     size_t luma_vstride;
     unsigned int heap_mask = _select_heap(usage);
-
-    *stride = ALIGN(w, 16);
+    const struct exynos_format_layout *layout;
+    struct exynos_plane_layout plane_layout;
 
     if (format == HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED) {
         ALOGV("HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED : usage(%x), flags(%x)\n", usage, ion_flags);
@@ -288,53 +323,44 @@ static int gralloc_alloc_yuv(int ionfd, int w, int h, int format,
     if (usage & GRALLOC_USAGE_PROTECTED)
         ion_flags |= ION_EXYNOS_MFC_OUTPUT_MASK;
 
-    switch (format) {
-        case HAL_PIXEL_FORMAT_EXYNOS_YV12_M:
-        case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_P_M:
-            {
-                *stride = ALIGN(w, 32);
-                luma_vstride = ALIGN(h, 16);
-                luma_size = luma_vstride * *stride + ext_size;
-                chroma_size = (luma_vstride / 2) * ALIGN(*stride / 2, 16) + ext_size;
-                planes = 3;
-                break;
-            }
-        case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_TILED:
-            {
-                size_t chroma_vstride = ALIGN(h / 2, 32);
-                luma_vstride = ALIGN(h, 32);
-                luma_size = luma_vstride * *stride + ext_size;
-                chroma_size = chroma_vstride * *stride + ext_size;
-                planes = 2;
-                break;
-            }
-        case HAL_PIXEL_FORMAT_YV12:
-        case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_P:
-        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
-            return gralloc_alloc_framework_yuv(ionfd, w, h, format, usage,
-                                               ion_flags, hnd, stride);
-        case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M:
-        case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M_FULL:
-        case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M:
-            {
-                luma_vstride = ALIGN(h, 16);
-                luma_size = *stride * luma_vstride+ext_size;
-                chroma_size = *stride * ALIGN(luma_vstride / 2, 8)+ext_size;
-                planes = 2;
-                break;
-            }
-        case HAL_PIXEL_FORMAT_YCbCr_422_I:
-            {
-                luma_vstride = h;
-                luma_size = luma_vstride * *stride * 2+ext_size;
-                chroma_size = 0;
-                planes = 1;
-                break;
-            }
-        default:
-            ALOGE("invalid yuv format %d\n", format);
-            return -EINVAL;
+    layout = exynos_format_layout_find(format);
+    if (!layout) {
+        ALOGE("invalid yuv format %d\n", format);
+        return -EINVAL;
+    }
+    if (layout->contiguous)
+        return gralloc_alloc_framework_yuv(ionfd, w, h, format, usage,
+                                           ion_flags, hnd, stride);
+
+    memset(&plane_layout, 0, sizeof(plane_layout));
+    exynos_format_plane_layout(layout, w, h, 0, &plane_layout);
+    *stride = plane_layout.stride;
+    luma_vstride = plane_layout.vstride;
+    luma_size = exynos_format_buffer_size(layout, &plane_layout);
+    chroma_size = exynos_format_chroma_buffer_size(layout, &plane_layout);
+    planes = layout->planes;
+
+#ifdef GRALLOC_SINGLE_ALLOC
+    if (planes > 1 && !(usage & ~GRALLOC_SINGLE_ALLOC_USAGE)) {
+        int offset1 = 0, offset2 = 0;
+
+        err = gralloc_alloc_yuv_single(ionfd, luma_size, chroma_size, planes,
+                                       heap_mask, ion_flags,
+                                       &fd, &fd1, &fd2, &offset1, &offset2);
+        if (err)
+            return err;
+
+        if (planes == 3)
+            *hnd = new private_handle_t(fd, fd1, fd2, luma_size, usage, w, h,
+                                        format, *stride, luma_vstride);
+        else
+            *hnd = new private_handle_t(fd, fd1, luma_size, usage, w, h, format,
+                                        *stride, luma_vstride);
+        (*hnd)->plane_offset1 = offset1;
+        (*hnd)->plane_offset2 = offset2;
+        return 0;
     }
+#endif
 
     err = ion_alloc_fd(ionfd, luma_size, 0, heap_mask, ion_flags, &fd);
     if (err)
@@ -379,6 +405,8 @@ static int gralloc_alloc(alloc_device_t* dev,
     if (!pHandle || !pStride || w <= 0 || h <= 0)
         return -EINVAL;
 
+    int64_t start = gralloc_stats_begin();
+
     if( (usage & GRALLOC_USAGE_SW_READ_MASK) == GRALLOC_USAGE_SW_READ_OFTEN )
         ion_flags = ION_FLAG_CACHED | ION_FLAG_CACHED_NEEDS_SYNC | ION_FLAG_PRESERVE_KMAP;
 
@@ -398,6 +426,11 @@ static int gralloc_alloc(alloc_device_t* dev,
     if (err)
         goto err;
 
+    gralloc_init_layout(hnd);
+
+    gralloc_stats_fds(1 + (hnd->fd1 >= 0) + (hnd->fd2 >= 0));
+    gralloc_stats_end(GRALLOC_STATS_ALLOC, start);
+
     *pHandle = hnd;
     *pStride = stride;
     return 0;
@@ -422,9 +455,11 @@ static int gralloc_free(alloc_device_t* dev,
     private_handle_t const* hnd = reinterpret_cast<private_handle_t const*>(handle);
     gralloc_module_t* module = reinterpret_cast<gralloc_module_t*>(
                                                                    dev->common.module);
+    int64_t start = gralloc_stats_begin();
 
     gralloc_unregister_buffer(module, hnd);
 
+    gralloc_stats_fds(-(1 + (hnd->fd1 >= 0) + (hnd->fd2 >= 0)));
     close(hnd->fd);
     if (hnd->fd1 >= 0)
         close(hnd->fd1);
@@ -432,9 +467,15 @@ static int gralloc_free(alloc_device_t* dev,
         close(hnd->fd2);
 
     delete hnd;
+    gralloc_stats_end(GRALLOC_STATS_FREE, start);
     return 0;
 }
 
+static void gralloc_dump(alloc_device_t* dev __unused, char *buff, int buff_len)
+{
+    gralloc_stats_dump(buff, buff_len);
+}
+
 /*****************************************************************************/
 
 static int gralloc_close(struct hw_device_t *dev)
@@ -470,12 +511,13 @@ int gralloc_device_open(const hw_module_t* module, const char* name,
 
         /* initialize the procs */
         dev->device.common.tag = HARDWARE_DEVICE_TAG;
-        dev->device.common.version = 0;
+        dev->device.common.version = 1;
         dev->device.common.module = const_cast<hw_module_t*>(module);
         dev->device.common.close = gralloc_close;
 
         dev->device.alloc = gralloc_alloc;
         dev->device.free = gralloc_free;
+        dev->device.dump = gralloc_dump;
 
         private_module_t *p = reinterpret_cast<private_module_t*>(dev->device.common.module);
         pthread_mutex_lock(&p->lock);
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include <utils/KeyedVector.h>
+
+#include "gralloc_priv.h"
+#include "gralloc_detile.h"
+#include "gralloc_tiled.h"
+#include "exynos_format.h"
+
+/*
+ * Linear views of HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_TILED buffers.
+ * Software readers get a linear copy of both planes with a pitch of
+ * hnd->stride instead of the raw tiles. The tiles are mostly written by
+ * MFC or the camera, which never lock the buffer, so there is no signal
+ * that the copy went stale: every read lock de-tiles again, and only the
+ * copy buffers are kept between locks.
+ *
+ * sDetileLock only guards the handle lookup; each shadow has its own lock,
+ * so de-tiling one buffer does not hold up locks of other buffers.
+ */
+
+struct detile_shadow {
+    pthread_mutex_t lock;           /* guards the copies below */
+    void *luma;
+    void *chroma;
+    size_t luma_size;
+    size_t chroma_size;
+    int refs;                       /* users, under sDetileLock */
+    bool released;                  /* removed by gralloc_detile_release */
+};
+
+static pthread_mutex_t sDetileLock = PTHREAD_MUTEX_INITIALIZER;
+static android::KeyedVector<private_handle_t *, struct detile_shadow *> sShadows;
+
+static void free_planes(struct detile_shadow *shadow)
+{
+    free(shadow->luma);
+    free(shadow->chroma);
+    shadow->luma = NULL;
+    shadow->chroma = NULL;
+    shadow->luma_size = 0;
+    shadow->chroma_size = 0;
+}
+
+/* Returns the shadow of hnd with a reference held, creating it if needed. */
+static struct detile_shadow *get_shadow(private_handle_t *hnd)
+{
+    struct detile_shadow *shadow;
+
+    pthread_mutex_lock(&sDetileLock);
+    ssize_t index = sShadows.indexOfKey(hnd);
+    if (index >= 0) {
+        shadow = sShadows.valueAt(index);
+    } else {
+        shadow = (struct detile_shadow *)calloc(1, sizeof(*shadow));
+        if (!shadow) {
+            pthread_mutex_unlock(&sDetileLock);
+            return NULL;
+        }
+        pthread_mutex_init(&shadow->lock, NULL);
+        sShadows.add(hnd, shadow);
+    }
+    shadow->refs++;
+    pthread_mutex_unlock(&sDetileLock);
+
+    return shadow;
+}
+
+static void put_shadow(struct detile_shadow *shadow)
+{
+    pthread_mutex_lock(&sDetileLock);
+    bool last = --shadow->refs == 0 && shadow->released;
+    pthread_mutex_unlock(&sDetileLock);
+
+    if (last) {
+        free_planes(shadow);
+        pthread_mutex_destroy(&shadow->lock);
+        free(shadow);
+    }
+}
+
+int gralloc_detile_lock(private_handle_t *hnd, void **vaddr)
+{
+    int x_tiles = ALIGN(hnd->stride, GRALLOC_TILE_W * 2) / GRALLOC_TILE_W;
+    int luma_tiles_y = ALIGN(hnd->vstride, GRALLOC_TILE_H) / GRALLOC_TILE_H;
+    int chroma_height = hnd->vstride / 2;
+    int chroma_tiles_y = ALIGN(chroma_height, GRALLOC_TILE_H) / GRALLOC_TILE_H;
+    size_t luma_size = (size_t)hnd->stride * hnd->vstride;
+    size_t chroma_size = (size_t)hnd->stride * chroma_height;
+    int err = 0;
+
+    if (hnd->format != HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_TILED ||
+        !hnd->base || !hnd->base1)
+        return -EINVAL;
+
+    /* buffers not padded to whole tile pairs can't be walked safely */
+    if ((size_t)x_tiles * luma_tiles_y * GRALLOC_TILE_SIZE > (size_t)hnd->size ||
+        (size_t)x_tiles * chroma_tiles_y * GRALLOC_TILE_SIZE > (size_t)hnd->chroma_size)
+        return -EINVAL;
+
+    struct detile_shadow *shadow = get_shadow(hnd);
+    if (!shadow)
+        return -ENOMEM;
+
+    pthread_mutex_lock(&shadow->lock);
+    if (!shadow->luma || shadow->luma_size != luma_size ||
+        shadow->chroma_size != chroma_size) {
+        free_planes(shadow);
+        shadow->luma = malloc(luma_size);
+        shadow->chroma = malloc(chroma_size);
+        shadow->luma_size = luma_size;
+        shadow->chroma_size = chroma_size;
+        if (!shadow->luma || !shadow->chroma) {
+            ALOGE("%s: could not allocate %u byte linear view", __func__,
+                  (unsigned int)(luma_size + chroma_size));
+            free_planes(shadow);
+            err = -ENOMEM;
+        }
+    }
+
+    if (!err) {
+        gralloc_detile_plane((uint8_t *)shadow->luma, (const uint8_t *)hnd->base,
+                             hnd->stride, hnd->width, hnd->vstride,
+                             x_tiles, luma_tiles_y);
+        gralloc_detile_plane((uint8_t *)shadow->chroma, (const uint8_t *)hnd->base1,
+                             hnd->stride, hnd->width, chroma_height,
+                             x_tiles, chroma_tiles_y);
+
+        vaddr[0] = shadow->luma;
+        vaddr[1] = shadow->chroma;
+    }
+    pthread_mutex_unlock(&shadow->lock);
+
+    put_shadow(shadow);
+    return err;
+}
+
+void gralloc_detile_release(private_handle_t *hnd)
+{
+    struct detile_shadow *shadow = NULL;
+
+    pthread_mutex_lock(&sDetileLock);
+    ssize_t index = sShadows.indexOfKey(hnd);
+    if (index >= 0) {
+        shadow = sShadows.valueAt(index);
+        sShadows.removeItemsAt(index);
+        shadow->released = true;
+        /* a lock still de-tiling frees the shadow when it is done */
+        if (shadow->refs)
+            shadow = NULL;
+    }
+    pthread_mutex_unlock(&sDetileLock);
+
+    if (shadow) {
+        free_planes(shadow);
+        pthread_mutex_destroy(&shadow->lock);
+        free(shadow);
+    }
+}
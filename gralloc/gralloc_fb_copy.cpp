@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include "gralloc_fb_copy.h"
+
+/*
+ * Framebuffer copy backends. "stripe" splits the copy into one stripe per
+ * online core (up to FB_COPY_MAX_THREADS) and streams each stripe with
+ * NEON; "memcpy" is the plain copy. The backend is chosen with the
+ * debug.gralloc.fb_copy property.
+ */
+
+#define FB_COPY_MAX_THREADS     4
+#define FB_COPY_MIN_STRIPE      (64 * 1024)
+#define FB_COPY_PRELOAD         256
+
+struct fb_copy_backend {
+    const char *name;
+    int (*init)(void);
+    void (*copy)(void *dst, const void *src, size_t len);
+};
+
+/*****************************************************************************/
+
+static void memcpy_copy(void *dst, const void *src, size_t len)
+{
+    memcpy(dst, src, len);
+}
+
+/*****************************************************************************/
+
+/*
+ * ARMv7 has no non-temporal stores; the loop instead preloads well ahead of
+ * the reads and moves 64 bytes per iteration through NEON registers.
+ */
+static void stream_copy(void *dst, const void *src, size_t len)
+{
+#ifdef __ARM_NEON__
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+
+    while (len >= 64) {
+        __builtin_prefetch(s + FB_COPY_PRELOAD);
+        uint8x16_t v0 = vld1q_u8(s);
+        uint8x16_t v1 = vld1q_u8(s + 16);
+        uint8x16_t v2 = vld1q_u8(s + 32);
+        uint8x16_t v3 = vld1q_u8(s + 48);
+        vst1q_u8(d, v0);
+        vst1q_u8(d + 16, v1);
+        vst1q_u8(d + 32, v2);
+        vst1q_u8(d + 48, v3);
+        s += 64;
+        d += 64;
+        len -= 64;
+    }
+
+    if (len)
+        memcpy(d, s, len);
+#else
+    memcpy(dst, src, len);
+#endif
+}
+
+struct stripe_job {
+    uint8_t *dst;
+    const uint8_t *src;
+    size_t len;
+};
+
+static pthread_mutex_t sStripeLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sStripeStart = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t sStripeDone = PTHREAD_COND_INITIALIZER;
+static struct stripe_job sStripeJobs[FB_COPY_MAX_THREADS];
+static unsigned int sStripeGeneration = 0;
+static int sStripePending = 0;
+static int sStripeWorkers = 0;
+static bool sStripeStarted = false;
+
+static void *stripe_worker(void *arg)
+{
+    int index = (int)(intptr_t)arg;
+    unsigned int generation = 0;
+
+    pthread_mutex_lock(&sStripeLock);
+    for (;;) {
+        while (generation == sStripeGeneration)
+            pthread_cond_wait(&sStripeStart, &sStripeLock);
+        generation = sStripeGeneration;
+        struct stripe_job job = sStripeJobs[index];
+        pthread_mutex_unlock(&sStripeLock);
+
+        if (job.len)
+            stream_copy(job.dst, job.src, job.len);
+
+        pthread_mutex_lock(&sStripeLock);
+        if (--sStripePending == 0)
+            pthread_cond_signal(&sStripeDone);
+    }
+
+    return NULL;
+}
+
+static int stripe_init(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (sStripeStarted)
+        return 0;
+    sStripeStarted = true;
+
+    if (cpus > FB_COPY_MAX_THREADS)
+        cpus = FB_COPY_MAX_THREADS;
+
+    /* the posting thread copies the first stripe itself */
+    for (int i = 1; i < cpus; i++) {
+        pthread_t thread;
+        pthread_attr_t attr;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, stripe_worker, (void *)(intptr_t)i)) {
+            ALOGW("%s: could not start copy thread %d", __func__, i);
+            pthread_attr_destroy(&attr);
+            break;
+        }
+        pthread_attr_destroy(&attr);
+        sStripeWorkers++;
+    }
+
+    return 0;
+}
+
+static void stripe_copy(void *dst, const void *src, size_t len)
+{
+    int stripes = sStripeWorkers + 1;
+
+    if (stripes == 1 || len < FB_COPY_MIN_STRIPE * 2) {
+        stream_copy(dst, src, len);
+        return;
+    }
+
+    if ((size_t)stripes > len / FB_COPY_MIN_STRIPE)
+        stripes = len / FB_COPY_MIN_STRIPE;
+
+    /* cache line aligned stripes, the last one takes the remainder */
+    size_t stripe_len = (len / stripes) & ~(size_t)63;
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+
+    pthread_mutex_lock(&sStripeLock);
+    for (int i = 0; i <= sStripeWorkers; i++) {
+        size_t offset = i * stripe_len;
+
+        sStripeJobs[i].dst = d + offset;
+        sStripeJobs[i].src = s + offset;
+        if (i >= stripes)
+            sStripeJobs[i].len = 0;
+        else if (i == stripes - 1)
+            sStripeJobs[i].len = len - offset;
+        else
+            sStripeJobs[i].len = stripe_len;
+    }
+    sStripePending = sStripeWorkers;
+    sStripeGeneration++;
+    pthread_cond_broadcast(&sStripeStart);
+    pthread_mutex_unlock(&sStripeLock);
+
+    stream_copy(sStripeJobs[0].dst, sStripeJobs[0].src, sStripeJobs[0].len);
+
+    pthread_mutex_lock(&sStripeLock);
+    while (sStripePending)
+        pthread_cond_wait(&sStripeDone, &sStripeLock);
+    pthread_mutex_unlock(&sStripeLock);
+}
+
+/*****************************************************************************/
+
+static const struct fb_copy_backend sBackends[] = {
+    { "stripe", stripe_init, stripe_copy },
+    { "memcpy", NULL, memcpy_copy },
+};
+
+static const struct fb_copy_backend *sBackend = &sBackends[0];
+
+int gralloc_fb_copy_select(const char *name)
+{
+    const struct fb_copy_backend *backend = NULL;
+
+    for (size_t i = 0; i < sizeof(sBackends) / sizeof(sBackends[0]); i++) {
+        if (!strcmp(name, sBackends[i].name)) {
+            backend = &sBackends[i];
+            break;
+        }
+    }
+    if (!backend)
+        return -EINVAL;
+
+    if (backend->init && backend->init()) {
+        ALOGW("%s: %s backend failed, using memcpy", __func__, backend->name);
+        backend = &sBackends[1];
+    }
+
+    ALOGI("framebuffer copy backend: %s", backend->name);
+    sBackend = backend;
+    return 0;
+}
+
+void gralloc_fb_copy_init(void)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get("debug.gralloc.fb_copy", value, sBackends[0].name);
+    if (gralloc_fb_copy_select(value))
+        gralloc_fb_copy_select(sBackends[0].name);
+}
+
+void gralloc_fb_copy(void *dst, const void *src, size_t len)
+{
+    sBackend->copy(dst, src, len);
+}
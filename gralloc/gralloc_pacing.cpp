@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "gralloc_pacing.h"
+
+/*
+ * Frame pacing for the framebuffer device. Vsync timestamps come from
+ * gralloc_wait_for_vsync and from the timestamp the fb driver exports in
+ * sysfs while vsync interrupts are enabled. The period is refined from
+ * them, and posts are timed against the predicted vsync. Deferring posts to
+ * just before the vsync is opt-in via debug.gralloc.fb_pacing.
+ */
+
+#define VSYNC_TIMESTAMP_PATH    "/sys/devices/platform/exynos5-fb.1/vsync"
+
+#define PACING_HISTORY          128
+#define PACING_MARGIN_NS        1000000LL   /* 1 ms of slack before vsync */
+#define PACING_MAX_DRIFT        10          /* % the period may drift from nominal */
+
+struct pacing_record {
+    int64_t start;
+    int64_t latency;
+    int missed;
+};
+
+static pthread_mutex_t sPacingLock = PTHREAD_MUTEX_INITIALIZER;
+static int sVsyncFd = -1;
+static bool sDefer = false;
+
+static int64_t sNominalPeriod = 16666667LL;
+static int64_t sPeriod = 16666667LL;
+static int64_t sLastVsync = 0;
+static int64_t sLatencyAvg = 0;     /* moving average of post latency */
+
+static struct pacing_record sHistory[PACING_HISTORY];
+static unsigned int sPosts = 0;
+static unsigned int sMissed = 0;
+static unsigned int sVsyncs = 0;
+
+int64_t gralloc_pacing_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* must be called with sPacingLock held */
+static void record_vsync_locked(int64_t timestamp)
+{
+    if (timestamp <= sLastVsync)
+        return;
+
+    if (sLastVsync) {
+        int64_t delta = timestamp - sLastVsync;
+        int64_t periods = (delta + sPeriod / 2) / sPeriod;
+
+        /* refine the period from the interval, folding in missed vsyncs */
+        if (periods >= 1) {
+            int64_t sample = delta / periods;
+            int64_t limit = sNominalPeriod * PACING_MAX_DRIFT / 100;
+
+            if (sample > sNominalPeriod - limit && sample < sNominalPeriod + limit)
+                sPeriod += (sample - sPeriod) / 16;
+        }
+    }
+
+    sLastVsync = timestamp;
+    sVsyncs++;
+}
+
+/* must be called with sPacingLock held */
+static void read_vsync_locked(void)
+{
+    char buf[32];
+
+    if (sVsyncFd < 0)
+        return;
+
+    ssize_t len = pread(sVsyncFd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0)
+        return;
+
+    buf[len] = '\0';
+    record_vsync_locked(strtoll(buf, NULL, 0));
+}
+
+/* must be called with sPacingLock held */
+static int64_t next_vsync_locked(int64_t now)
+{
+    if (!sLastVsync)
+        return now + sPeriod;
+
+    int64_t elapsed = now - sLastVsync;
+    if (elapsed < 0)
+        return sLastVsync;
+
+    return sLastVsync + (elapsed / sPeriod + 1) * sPeriod;
+}
+
+void gralloc_pacing_init(float fps)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    pthread_mutex_lock(&sPacingLock);
+    if (fps > 0)
+        sNominalPeriod = (int64_t)(1000000000.0f / fps);
+    sPeriod = sNominalPeriod;
+    sLastVsync = 0;
+    sLatencyAvg = 0;
+    sPosts = 0;
+    sMissed = 0;
+    sVsyncs = 0;
+    memset(sHistory, 0, sizeof(sHistory));
+
+    if (sVsyncFd < 0) {
+        sVsyncFd = open(VSYNC_TIMESTAMP_PATH, O_RDONLY);
+        if (sVsyncFd < 0)
+            ALOGW("%s: no vsync timestamps from %s (%s)", __func__,
+                  VSYNC_TIMESTAMP_PATH, strerror(errno));
+    }
+
+    property_get("debug.gralloc.fb_pacing", value, "0");
+    sDefer = atoi(value) != 0;
+    pthread_mutex_unlock(&sPacingLock);
+}
+
+void gralloc_pacing_vsync(int64_t timestamp)
+{
+    pthread_mutex_lock(&sPacingLock);
+    record_vsync_locked(timestamp);
+    pthread_mutex_unlock(&sPacingLock);
+}
+
+int64_t gralloc_pacing_next_vsync(int64_t now)
+{
+    pthread_mutex_lock(&sPacingLock);
+    read_vsync_locked();
+    int64_t next = next_vsync_locked(now);
+    pthread_mutex_unlock(&sPacingLock);
+
+    return next;
+}
+
+void gralloc_pacing_wait(void)
+{
+    int64_t now = gralloc_pacing_now();
+
+    pthread_mutex_lock(&sPacingLock);
+    if (!sDefer || !sLastVsync) {
+        pthread_mutex_unlock(&sPacingLock);
+        return;
+    }
+
+    read_vsync_locked();
+    int64_t lead = sLatencyAvg + sLatencyAvg / 2 + PACING_MARGIN_NS;
+    int64_t deadline = next_vsync_locked(now + lead) - lead;
+    pthread_mutex_unlock(&sPacingLock);
+
+    if (deadline > now) {
+        struct timespec ts;
+
+        ts.tv_sec = deadline / 1000000000LL;
+        ts.tv_nsec = deadline % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+    }
+}
+
+void gralloc_pacing_post_done(int64_t start, int64_t end)
+{
+    pthread_mutex_lock(&sPacingLock);
+    read_vsync_locked();
+
+    int64_t latency = end - start;
+    struct pacing_record *record = &sHistory[sPosts % PACING_HISTORY];
+
+    /* a post misses its frame when it ends after the vsync following its start */
+    record->start = start;
+    record->latency = latency;
+    record->missed = sLastVsync && end > next_vsync_locked(start);
+    if (record->missed)
+        sMissed++;
+    sPosts++;
+
+    if (!sLatencyAvg)
+        sLatencyAvg = latency;
+    else
+        sLatencyAvg += (latency - sLatencyAvg) / 8;
+    pthread_mutex_unlock(&sPacingLock);
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    int64_t la = *(const int64_t *)a;
+    int64_t lb = *(const int64_t *)b;
+
+    return (la > lb) - (la < lb);
+}
+
+void gralloc_pacing_dump(char *buff, int buff_len)
+{
+    int64_t latencies[PACING_HISTORY];
+    unsigned int count, missed = 0;
+    int64_t sum = 0;
+
+    pthread_mutex_lock(&sPacingLock);
+    count = sPosts < PACING_HISTORY ? sPosts : PACING_HISTORY;
+    for (unsigned int i = 0; i < count; i++) {
+        latencies[i] = sHistory[i].latency;
+        sum += latencies[i];
+        missed += sHistory[i].missed;
+    }
+
+    int64_t period = sPeriod;
+    int64_t last_vsync = sLastVsync;
+    unsigned int posts = sPosts, total_missed = sMissed, vsyncs = sVsyncs;
+    bool defer = sDefer;
+    pthread_mutex_unlock(&sPacingLock);
+
+    qsort(latencies, count, sizeof(latencies[0]), compare_latency);
+
+    snprintf(buff, buff_len,
+             "Framebuffer pacing (%s):\n"
+             "  vsync period %.3f ms, last vsync %lld, %u vsyncs seen\n"
+             "  posts %u, missed %u\n"
+             "  last %u posts: missed %u, latency avg %.3f ms, p50 %.3f ms,"
+             " p95 %.3f ms, max %.3f ms\n",
+             defer ? "deferred posts" : "statistics only",
+             period / 1000000.0, (long long)last_vsync, vsyncs,
+             posts, total_missed,
+             count, missed,
+             count ? sum / count / 1000000.0 : 0.0,
+             count ? latencies[count / 2] / 1000000.0 : 0.0,
+             count ? latencies[count * 95 / 100] / 1000000.0 : 0.0,
+             count ? latencies[count - 1] / 1000000.0 : 0.0);
+}
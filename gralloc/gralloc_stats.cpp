@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "gralloc_stats.h"
+
+/*
+ * Cost of the allocator and mapper entry points, as seen on the device.
+ * Latencies go into power-of-two microsecond buckets, so percentiles are
+ * reported as the upper bound of the bucket they fall in.
+ */
+
+#define STATS_BUCKETS           20  /* 1 us .. 512 ms, the last one open */
+
+struct op_stats {
+    unsigned int count;
+    unsigned int buckets[STATS_BUCKETS];
+    int64_t total_us;
+    int64_t max_us;
+};
+
+static const char *const sOpNames[GRALLOC_STATS_NUM_OPS] = {
+    "alloc", "free", "register", "unregister", "lock", "unlock",
+};
+
+static pthread_mutex_t sStatsLock = PTHREAD_MUTEX_INITIALIZER;
+static struct op_stats sOps[GRALLOC_STATS_NUM_OPS];
+static int sFds = 0;
+static int sPeakFds = 0;
+static int64_t sMapped = 0;
+static int64_t sPeakMapped = 0;
+
+int64_t gralloc_stats_begin(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+void gralloc_stats_end(enum gralloc_stats_op op, int64_t start)
+{
+    int64_t us = gralloc_stats_begin() - start;
+    int bucket = 0;
+
+    while (bucket < STATS_BUCKETS - 1 && us >= (1LL << bucket))
+        bucket++;
+
+    pthread_mutex_lock(&sStatsLock);
+    sOps[op].count++;
+    sOps[op].buckets[bucket]++;
+    sOps[op].total_us += us;
+    if (us > sOps[op].max_us)
+        sOps[op].max_us = us;
+    pthread_mutex_unlock(&sStatsLock);
+}
+
+void gralloc_stats_fds(int delta)
+{
+    pthread_mutex_lock(&sStatsLock);
+    sFds += delta;
+    if (sFds > sPeakFds)
+        sPeakFds = sFds;
+    pthread_mutex_unlock(&sStatsLock);
+}
+
+void gralloc_stats_mapped(ssize_t delta)
+{
+    pthread_mutex_lock(&sStatsLock);
+    sMapped += delta;
+    if (sMapped > sPeakMapped)
+        sPeakMapped = sMapped;
+    pthread_mutex_unlock(&sStatsLock);
+}
+
+/* must be called with sStatsLock held */
+static long long percentile_us(const struct op_stats *stats, unsigned int pct)
+{
+    unsigned int target = (stats->count * pct + 99) / 100;
+    unsigned int seen = 0;
+
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        seen += stats->buckets[i];
+        if (seen >= target)
+            return i == STATS_BUCKETS - 1 ? stats->max_us : 1LL << i;
+    }
+    return stats->max_us;
+}
+
+void gralloc_stats_dump(char *buff, int buff_len)
+{
+    int len;
+
+    pthread_mutex_lock(&sStatsLock);
+    len = snprintf(buff, buff_len,
+                   "gralloc statistics:\n"
+                   "  fds %d (peak %d), mapped %lld KB (peak %lld KB)\n",
+                   sFds, sPeakFds, (long long)(sMapped / 1024),
+                   (long long)(sPeakMapped / 1024));
+
+    for (int op = 0; op < GRALLOC_STATS_NUM_OPS && len < buff_len; op++) {
+        const struct op_stats *stats = &sOps[op];
+
+        if (!stats->count)
+            continue;
+        len += snprintf(buff + len, buff_len - len,
+                        "  %-10s %8u calls, avg %lld us, p50 <%lld us, p95 <%lld us,"
+                        " p99 <%lld us, max %lld us\n",
+                        sOpNames[op], stats->count,
+                        (long long)(stats->total_us / stats->count),
+                        percentile_us(stats, 50), percentile_us(stats, 95),
+                        percentile_us(stats, 99), (long long)stats->max_us);
+    }
+    pthread_mutex_unlock(&sStatsLock);
+}
+
+void gralloc_stats_counts(int *fds, int *peak_fds, int64_t *mapped, int64_t *peak_mapped)
+{
+    pthread_mutex_lock(&sStatsLock);
+    *fds = sFds;
+    *peak_fds = sPeakFds;
+    *mapped = sMapped;
+    *peak_mapped = sPeakMapped;
+    pthread_mutex_unlock(&sStatsLock);
+}
+
+void gralloc_stats_reset(void)
+{
+    pthread_mutex_lock(&sStatsLock);
+    memset(sOps, 0, sizeof(sOps));
+    sPeakFds = sFds;
+    sPeakMapped = sMapped;
+    pthread_mutex_unlock(&sStatsLock);
+}
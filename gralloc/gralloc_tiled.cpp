@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include "gralloc_tiled.h"
+
+#define DETILE_MAX_THREADS      4
+#define DETILE_MIN_TILE_ROWS    8   /* tile rows per thread */
+
+struct detile_job {
+    uint8_t *dst;
+    const uint8_t *src;
+    int pitch;
+    int width;
+    int height;
+    int x_tiles;
+    int y_tiles;
+    int first_row;
+    int last_row;
+};
+
+static inline void copy_tile_row(uint8_t *dst, const uint8_t *src, int len)
+{
+#ifdef __ARM_NEON__
+    if (len == GRALLOC_TILE_W) {
+        uint8x16_t v0 = vld1q_u8(src);
+        uint8x16_t v1 = vld1q_u8(src + 16);
+        uint8x16_t v2 = vld1q_u8(src + 32);
+        uint8x16_t v3 = vld1q_u8(src + 48);
+        vst1q_u8(dst, v0);
+        vst1q_u8(dst + 16, v1);
+        vst1q_u8(dst + 32, v2);
+        vst1q_u8(dst + 48, v3);
+        return;
+    }
+#endif
+    memcpy(dst, src, len);
+}
+
+static void detile_rows(const struct detile_job *job)
+{
+    for (int ty = job->first_row; ty < job->last_row; ty++) {
+        int rows = job->height - ty * GRALLOC_TILE_H;
+        if (rows > GRALLOC_TILE_H)
+            rows = GRALLOC_TILE_H;
+
+        for (int tx = 0; tx * GRALLOC_TILE_W < job->width; tx++) {
+            const uint8_t *tile = job->src +
+                    gralloc_tile_offset(tx, ty, job->x_tiles, job->y_tiles);
+            uint8_t *dst = job->dst + ty * GRALLOC_TILE_H * job->pitch +
+                    tx * GRALLOC_TILE_W;
+            int len = job->width - tx * GRALLOC_TILE_W;
+            if (len > GRALLOC_TILE_W)
+                len = GRALLOC_TILE_W;
+
+            __builtin_prefetch(tile + GRALLOC_TILE_SIZE);
+            for (int r = 0; r < rows; r++)
+                copy_tile_row(dst + r * job->pitch, tile + r * GRALLOC_TILE_W, len);
+        }
+    }
+}
+
+static void *detile_worker(void *arg)
+{
+    detile_rows((const struct detile_job *)arg);
+    return NULL;
+}
+
+/* Up to DETILE_MAX_THREADS threads share the tile rows; the caller takes the first part. */
+void gralloc_detile_plane(uint8_t *dst, const uint8_t *src, int pitch,
+                          int width, int height, int x_tiles, int y_tiles)
+{
+    struct detile_job jobs[DETILE_MAX_THREADS];
+    pthread_t threads[DETILE_MAX_THREADS];
+    int tile_rows = (height + GRALLOC_TILE_H - 1) / GRALLOC_TILE_H;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int parts = tile_rows / DETILE_MIN_TILE_ROWS;
+    int started = 0;
+
+    if (parts > cpus)
+        parts = cpus;
+    if (parts > DETILE_MAX_THREADS)
+        parts = DETILE_MAX_THREADS;
+    if (parts < 1)
+        parts = 1;
+
+    for (int i = 0; i < parts; i++) {
+        jobs[i].dst = dst;
+        jobs[i].src = src;
+        jobs[i].pitch = pitch;
+        jobs[i].width = width;
+        jobs[i].height = height;
+        jobs[i].x_tiles = x_tiles;
+        jobs[i].y_tiles = y_tiles;
+        jobs[i].first_row = tile_rows * i / parts;
+        jobs[i].last_row = tile_rows * (i + 1) / parts;
+    }
+
+    for (int i = 1; i < parts; i++) {
+        if (pthread_create(&threads[i], NULL, detile_worker, &jobs[i]))
+            break;
+        started = i;
+    }
+
+    /* parts that could not get a thread run here as well */
+    detile_rows(&jobs[0]);
+    for (int i = started + 1; i < parts; i++)
+        detile_rows(&jobs[i]);
+
+    for (int i = 1; i <= started; i++)
+        pthread_join(threads[i], NULL);
+}
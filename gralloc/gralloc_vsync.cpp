@@ -21,6 +21,7 @@
 #include "gralloc_priv.h"
 #include "gralloc_vsync.h"
 #include "gralloc_vsync_report.h"
+#include "gralloc_pacing.h"
 
 #include <sys/ioctl.h>
 
@@ -62,6 +63,7 @@ int gralloc_wait_for_vsync(framebuffer_device_t *dev)
             return -errno;
         }
         gralloc_mali_vsync_report(MALI_VSYNC_EVENT_END_WAIT);
+        gralloc_pacing_vsync(gralloc_pacing_now());
     }
 
     return 0;
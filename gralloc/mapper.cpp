@@ -31,119 +31,140 @@
 #include <hardware/gralloc.h>
 
 #include "gralloc_priv.h"
+#include "gralloc_detile.h"
+#include "gralloc_stats.h"
 #include "exynos_format.h"
+#include "exynos_format_layout.h"
 
 #include <ion/ion.h>
 #include <linux/ion.h>
 
 /*****************************************************************************/
 
-static int gralloc_map(gralloc_module_t const* module, buffer_handle_t handle)
+int getIonFd(gralloc_module_t const *module);
+
+/*
+ * Computes the chroma plane size of a buffer once, when it is allocated or
+ * registered, so the mapper does not have to switch on the format again.
+ */
+void gralloc_init_layout(private_handle_t *hnd)
 {
-    size_t chroma_vstride = 0;
-    size_t chroma_size = 0;
-    size_t ext_size = 256;
+    const struct exynos_format_layout *layout = exynos_format_layout_find(hnd->format);
 
-    private_handle_t *hnd = (private_handle_t*)handle;
+    hnd->chroma_size = 0;
 
-    switch (hnd->format) {
-    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_TILED:
-        chroma_vstride = ALIGN(hnd->height / 2, 32);
-        chroma_size = chroma_vstride * hnd->stride + ext_size;
-        break;
-    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M:
-    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M_FULL:
-    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M:
-        chroma_size = hnd->stride * ALIGN(hnd->vstride / 2, 8) + ext_size;
-        break;
-    case HAL_PIXEL_FORMAT_EXYNOS_YV12_M:
-    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_P_M:
-        chroma_size = (hnd->vstride / 2) * ALIGN(hnd->stride / 2, 16) + ext_size;
-        break;
-    default:
-        ALOGV("%s: unknown format: 0x%x", __func__, hnd->format);
-        break;
+    if (layout) {
+        struct exynos_plane_layout planes;
+
+        memset(&planes, 0, sizeof(planes));
+        planes.stride = hnd->stride;
+        planes.vstride = hnd->vstride;
+        exynos_format_plane_layout(layout, hnd->width, hnd->height, 0, &planes);
+        hnd->chroma_size = exynos_format_chroma_buffer_size(layout, &planes);
     }
+}
 
-    void* mappedAddress = mmap(0, hnd->size, PROT_READ|PROT_WRITE, MAP_SHARED,
-                               hnd->fd, 0);
+/* plane_offset is where the plane starts in fd, page aligned */
+static int gralloc_map_plane(int fd, size_t plane_offset, size_t plane_size, void **base)
+{
+    void *mappedAddress = mmap(0, plane_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                               fd, plane_offset);
     if (mappedAddress == MAP_FAILED) {
         ALOGE("%s: could not mmap %s", __func__, strerror(errno));
         return -errno;
     }
-    ALOGV("%s: base %p %d %d %d %d\n", __func__, mappedAddress, hnd->size,
-          hnd->width, hnd->height, hnd->stride);
-    hnd->base = mappedAddress;
-
-    if (hnd->fd1 >= 0) {
-        void *mappedAddress1 = (void*)mmap(0, chroma_size, PROT_READ|PROT_WRITE,
-                                            MAP_SHARED, hnd->fd1, 0);
-        hnd->base1 = mappedAddress1;
-    }
-    if (hnd->fd2 >= 0) {
-        void *mappedAddress2 = (void*)mmap(0, chroma_size, PROT_READ|PROT_WRITE,
-                                            MAP_SHARED, hnd->fd2, 0);
-        hnd->base2 = mappedAddress2;
-    }
 
+    *base = mappedAddress;
+    gralloc_stats_mapped(plane_size);
     return 0;
 }
 
+static void gralloc_unmap_plane(void **base, size_t plane_size)
+{
+    if (!*base)
+        return;
+
+    if (munmap(*base, plane_size) < 0) {
+        ALOGE("%s :could not unmap %s %p %d", __func__, strerror(errno),
+              *base, (int)plane_size);
+    } else {
+        gralloc_stats_mapped(-(ssize_t)plane_size);
+    }
+    *base = 0;
+}
+
+/* must be called with sMapLock held and the buffer unlocked */
 static int gralloc_unmap(gralloc_module_t const* module, buffer_handle_t handle)
 {
     private_handle_t* hnd = (private_handle_t*)handle;
-    size_t chroma_vstride = 0;
-    size_t chroma_size = 0;
-    size_t ext_size = 256;
-
-    switch (hnd->format) {
-    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_TILED:
-        chroma_vstride = ALIGN(hnd->height / 2, 32);
-        chroma_size = chroma_vstride * hnd->stride + ext_size;
-        break;
-    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M:
-    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M_FULL:
-    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M:
-        chroma_size = hnd->stride * ALIGN(hnd->vstride / 2, 8) + ext_size;
-        break;
-    case HAL_PIXEL_FORMAT_EXYNOS_YV12_M:
-    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_P_M:
-        chroma_size = (hnd->vstride / 2) * ALIGN(hnd->stride / 2, 16) + ext_size;
-        break;
-    default:
-        ALOGV("%s: unknown format: 0x%x", __func__, hnd->format);
-        break;
-    }
 
     if (!hnd->base)
         return 0;
 
-    if (munmap(hnd->base, hnd->size) < 0) {
-        ALOGE("%s :could not unmap %s %p %d", __func__, strerror(errno),
-              hnd->base, hnd->size);
-    }
     ALOGV("%s: base %p %d %d %d %d\n", __func__, hnd->base, hnd->size,
           hnd->width, hnd->height, hnd->stride);
-    hnd->base = 0;
+
+    gralloc_unmap_plane(&hnd->base, hnd->size);
+    if (hnd->fd1 >= 0)
+        gralloc_unmap_plane(&hnd->base1, hnd->chroma_size);
+    if (hnd->fd2 >= 0)
+        gralloc_unmap_plane(&hnd->base2, hnd->chroma_size);
+    return 0;
+}
+
+/*
+ * Maps every plane as a whole on the first lock. The mapping is kept until
+ * the buffer is unregistered, so pointers handed out by earlier locks stay
+ * valid. Must be called with sMapLock held.
+ */
+static int gralloc_map(gralloc_module_t const* module, buffer_handle_t handle)
+{
+    private_handle_t *hnd = (private_handle_t*)handle;
+    int err;
+
+    if (hnd->base)
+        return 0;
+
+    err = gralloc_map_plane(hnd->fd, 0, hnd->size, &hnd->base);
+    if (err)
+        return err;
+
     if (hnd->fd1 >= 0) {
-        if (!hnd->base1)
-            return 0;
-        if (munmap(hnd->base1, chroma_size) < 0) {
-            ALOGE("%s :could not unmap %s %p %d", __func__, strerror(errno),
-                  hnd->base1, chroma_size);
-        }
-        hnd->base1 = 0;
+        err = gralloc_map_plane(hnd->fd1, hnd->plane_offset1, hnd->chroma_size,
+                                &hnd->base1);
+        if (err)
+            goto err_luma;
     }
     if (hnd->fd2 >= 0) {
-        if (!hnd->base2)
-            return 0;
-        if (munmap(hnd->base2, chroma_size) < 0) {
-            ALOGE("%s :could not unmap %s %p %d", __func__, strerror(errno),
-                  hnd->base2, chroma_size);
-        }
-        hnd->base2 = 0;
+        err = gralloc_map_plane(hnd->fd2, hnd->plane_offset2, hnd->chroma_size,
+                                &hnd->base2);
+        if (err)
+            goto err_chroma;
     }
+
+    ALOGV("%s: base %p %d %d %d %d\n", __func__, hnd->base, hnd->size,
+          hnd->width, hnd->height, hnd->stride);
     return 0;
+
+err_chroma:
+    if (hnd->fd1 >= 0)
+        gralloc_unmap_plane(&hnd->base1, hnd->chroma_size);
+err_luma:
+    gralloc_unmap_plane(&hnd->base, hnd->size);
+    return err;
+}
+
+/* Cleans and invalidates the CPU cache of every plane of a cached buffer. */
+static void gralloc_sync(gralloc_module_t const* module, private_handle_t *hnd)
+{
+    ion_sync_fd(getIonFd(module), hnd->fd);
+    /* planes carved from fd were synced along with it */
+    if (hnd->plane_offset1)
+        return;
+    if (hnd->fd1 >= 0)
+        ion_sync_fd(getIonFd(module), hnd->fd1);
+    if (hnd->fd2 >= 0)
+        ion_sync_fd(getIonFd(module), hnd->fd2);
 }
 
 /*****************************************************************************/
@@ -156,6 +177,7 @@ int getIonFd(gralloc_module_t const *module)
     return m->ionfd;
 }
 
+/* protects the mapping and lock state of all handles */
 static pthread_mutex_t sMapLock = PTHREAD_MUTEX_INITIALIZER;
 
 /*****************************************************************************/
@@ -167,24 +189,34 @@ int gralloc_register_buffer(gralloc_module_t const* module,
         return -EINVAL;
 
     private_handle_t* hnd = (private_handle_t*)handle;
+    int64_t start = gralloc_stats_begin();
     ALOGV("%s: base %p %d %d %d %d\n", __func__, hnd->base, hnd->size,
           hnd->width, hnd->height, hnd->stride);
 
+    /* mapping state that came along with the handle belongs to the sender */
+    hnd->base = 0;
+    hnd->base1 = 0;
+    hnd->base2 = 0;
+    hnd->lock_usage = 0;
+    hnd->lock_count = 0;
+    gralloc_init_layout(hnd);
+
     int ret;
     ret = ion_import(getIonFd(module), hnd->fd, &hnd->handle);
     if (ret)
         ALOGE("error importing handle %d %x\n", hnd->fd, hnd->format);
-    if (hnd->fd1 >= 0) {
+    if (hnd->fd1 >= 0 && !hnd->plane_offset1) {
         ret = ion_import(getIonFd(module), hnd->fd1, &hnd->handle1);
         if (ret)
             ALOGE("error importing handle1 %d %x\n", hnd->fd1, hnd->format);
     }
-    if (hnd->fd2 >= 0) {
+    if (hnd->fd2 >= 0 && !hnd->plane_offset2) {
         ret = ion_import(getIonFd(module), hnd->fd2, &hnd->handle2);
         if (ret)
             ALOGE("error importing handle2 %d %x\n", hnd->fd2, hnd->format);
     }
 
+    gralloc_stats_end(GRALLOC_STATS_REGISTER, start);
     return ret;
 }
 
@@ -195,10 +227,18 @@ int gralloc_unregister_buffer(gralloc_module_t const* module,
         return -EINVAL;
 
     private_handle_t* hnd = (private_handle_t*)handle;
+    int64_t start = gralloc_stats_begin();
     ALOGV("%s: base %p %d %d %d %d\n", __func__, hnd->base, hnd->size,
           hnd->width, hnd->height, hnd->stride);
 
+    pthread_mutex_lock(&sMapLock);
+    if (hnd->lock_count)
+        ALOGW("%s: %p is still locked %d times", __func__, hnd, hnd->lock_count);
     gralloc_unmap(module, handle);
+    pthread_mutex_unlock(&sMapLock);
+#ifdef GRALLOC_LINEAR_TILED
+    gralloc_detile_release(hnd);
+#endif
 
     if (hnd->handle)
         ion_free(getIonFd(module), hnd->handle);
@@ -207,6 +247,7 @@ int gralloc_unregister_buffer(gralloc_module_t const* module,
     if (hnd->handle2)
         ion_free(getIonFd(module), hnd->handle2);
 
+    gralloc_stats_end(GRALLOC_STATS_UNREGISTER, start);
     return 0;
 }
 
@@ -216,19 +257,23 @@ int gralloc_lock(gralloc_module_t const* module,
                  void** vaddr)
 {
     // this is called when a buffer is being locked for software
-    // access. in thin implementation we have nothing to do since
-    // not synchronization with the h/w is needed.
-    // typically this is used to wait for the h/w to finish with
-    // this buffer if relevant. the data cache may need to be
-    // flushed or invalidated depending on the usage bits and the
-    // hardware.
+    // access. the planes are mapped once and stay mapped until the
+    // buffer is unregistered, and the data cache of cached buffers is
+    // invalidated before the CPU reads.
 
     if (private_handle_t::validate(handle) < 0)
         return -EINVAL;
 
     private_handle_t* hnd = (private_handle_t*)handle;
-    if (!hnd->base)
-        gralloc_map(module, hnd);
+    int64_t start = gralloc_stats_begin();
+
+    pthread_mutex_lock(&sMapLock);
+    int err = gralloc_map(module, hnd);
+    if (err) {
+        pthread_mutex_unlock(&sMapLock);
+        return err;
+    }
+
     *vaddr = (void*)hnd->base;
 
     if (hnd->fd1 >= 0)
@@ -236,27 +281,49 @@ int gralloc_lock(gralloc_module_t const* module,
     if (hnd->fd2 >= 0)
         vaddr[2] = (void*)hnd->base2;
 
+    /* usages of all outstanding locks, so unlock syncs while any of them writes */
+    hnd->lock_usage |= usage;
+    hnd->lock_count++;
+    pthread_mutex_unlock(&sMapLock);
+
+    if (((hnd->flags & GRALLOC_USAGE_SW_READ_MASK) == GRALLOC_USAGE_SW_READ_OFTEN) &&
+        (usage & GRALLOC_USAGE_SW_READ_MASK))
+        gralloc_sync(module, hnd);
+
+#ifdef GRALLOC_LINEAR_TILED
+    /* read-only locks of tiled buffers see a linear copy */
+    if (hnd->format == HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_TILED &&
+        (usage & GRALLOC_USAGE_SW_READ_MASK) && !(usage & GRALLOC_USAGE_SW_WRITE_MASK)) {
+        if (gralloc_detile_lock(hnd, vaddr))
+            ALOGW("%s: handing out raw tiles of %p", __func__, hnd);
+    }
+#endif
+
+    gralloc_stats_end(GRALLOC_STATS_LOCK, start);
     return 0;
 }
 
 int gralloc_unlock(gralloc_module_t const* module,
                    buffer_handle_t handle)
 {
-    // we're done with a software buffer. nothing to do in this
-    // implementation. typically this is used to flush the data cache.
+    // we're done with a software buffer. cached buffers written by
+    // the CPU are flushed so that the h/w sees the new data.
     if (private_handle_t::validate(handle) < 0)
         return -EINVAL;
 
     private_handle_t* hnd = (private_handle_t*)handle;
+    int64_t start = gralloc_stats_begin();
 
-    if (!((hnd->flags & GRALLOC_USAGE_SW_READ_MASK) == GRALLOC_USAGE_SW_READ_OFTEN))
-        return 0;
+    pthread_mutex_lock(&sMapLock);
+    int usage = hnd->lock_usage;
+    if (hnd->lock_count > 0 && --hnd->lock_count == 0)
+        hnd->lock_usage = 0;
+    pthread_mutex_unlock(&sMapLock);
 
-    ion_sync_fd(getIonFd(module), hnd->fd);
-    if (hnd->fd1 >= 0)
-        ion_sync_fd(getIonFd(module), hnd->fd1);
-    if (hnd->fd2 >= 0)
-        ion_sync_fd(getIonFd(module), hnd->fd2);
+    if (((hnd->flags & GRALLOC_USAGE_SW_READ_MASK) == GRALLOC_USAGE_SW_READ_OFTEN) &&
+        (usage & GRALLOC_USAGE_SW_WRITE_MASK))
+        gralloc_sync(module, hnd);
 
+    gralloc_stats_end(GRALLOC_STATS_UNLOCK, start);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,108 @@
+# Copyright (C) 2013 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+# Framebuffer copy backend benchmark, on the host and on the device
+include $(CLEAR_VARS)
+LOCAL_MODULE := gralloc_fb_copy_benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../include
+LOCAL_SRC_FILES := fb_copy_benchmark.cpp ../gralloc_fb_copy.cpp
+LOCAL_CFLAGS := -DLOG_TAG=\"gralloc_bench\"
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := gralloc_fb_copy_benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../include
+LOCAL_SRC_FILES := fb_copy_benchmark.cpp ../gralloc_fb_copy.cpp
+LOCAL_CFLAGS := -DLOG_TAG=\"gralloc_bench\"
+LOCAL_SHARED_LIBRARIES := libcutils liblog
+include $(BUILD_EXECUTABLE)
+
+# 64x32 tile layout and de-tiler tests, on the host and on the device
+include $(CLEAR_VARS)
+LOCAL_MODULE := gralloc_tiled_test
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../include
+LOCAL_SRC_FILES := tiled_test.cpp ../gralloc_tiled.cpp
+LOCAL_LDLIBS := -lpthread
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := gralloc_tiled_test
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../include
+LOCAL_SRC_FILES := tiled_test.cpp ../gralloc_tiled.cpp
+include $(BUILD_NATIVE_TEST)
+
+# De-tiler benchmark, on the host and on the device
+include $(CLEAR_VARS)
+LOCAL_MODULE := gralloc_detile_benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../include
+LOCAL_SRC_FILES := detile_benchmark.cpp ../gralloc_tiled.cpp
+LOCAL_LDLIBS := -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := gralloc_detile_benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../include
+LOCAL_SRC_FILES := detile_benchmark.cpp ../gralloc_tiled.cpp
+include $(BUILD_EXECUTABLE)
+
+# Format layout table tests, on the host and on the device
+include $(CLEAR_VARS)
+LOCAL_MODULE := gralloc_format_layout_test
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/../../include \
+	$(TOP)/hardware/samsung_slsi-cm/exynos/include
+LOCAL_SRC_FILES := format_layout_test.cpp
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := gralloc_format_layout_test
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/../../include \
+	$(TOP)/hardware/samsung_slsi-cm/exynos/include
+LOCAL_SRC_FILES := format_layout_test.cpp
+include $(BUILD_NATIVE_TEST)
+
+# Allocation trace benchmark, on the host against the fake ION in fake_ion.cpp
+include $(CLEAR_VARS)
+LOCAL_MODULE := gralloc_alloc_benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/fake_ion \
+	$(LOCAL_PATH)/../../include \
+	$(TOP)/hardware/samsung_slsi-cm/exynos/include \
+	$(TOP)/hardware/samsung_slsi-cm/exynos5/include
+LOCAL_SRC_FILES := \
+	alloc_benchmark.cpp \
+	fake_ion.cpp \
+	../gralloc.cpp \
+	../mapper.cpp \
+	../gralloc_detile.cpp \
+	../gralloc_tiled.cpp \
+	../gralloc_stats.cpp
+LOCAL_CFLAGS := -DLOG_TAG=\"gralloc_bench\" -DPAGE_SIZE=4096 $(gralloc_board_cflags)
+LOCAL_STATIC_LIBRARIES := libutils libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays buffer allocation traces through the gralloc module on the host,
+ * with ION replaced by the memfd-backed fake in fake_ion.cpp. Each trace
+ * reports the alloc, free, register, unregister, lock and unlock latencies,
+ * the peak mapped memory and the peak and leaked fd counts.
+ *
+ * Buffers are handed to a consumer the way binder does it: the consumer
+ * registers a copy of the handle with its own fds, locks that copy, and
+ * unregisters it before the producer frees the buffer.
+ *
+ * usage: gralloc_alloc_benchmark [rounds] [frames]
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+
+#include <hardware/hardware.h>
+#include <hardware/gralloc.h>
+
+#include "gralloc_priv.h"
+#include "gralloc_stats.h"
+#include "exynos_format.h"
+#include "fake_ion.h"
+
+extern struct private_module_t HAL_MODULE_INFO_SYM;
+
+/* the framebuffer is not part of what this measures */
+int fb_device_open(const hw_module_t*, const char*, hw_device_t**)
+{
+    return -ENODEV;
+}
+
+#define MAX_BUFFERS     32
+
+struct buffer_set {
+    const char *name;
+    int w;
+    int h;
+    int format;
+    int usage;
+    int count;
+    int lock_usage;             /* software lock of one buffer per frame, or 0 */
+};
+
+struct trace {
+    const char *name;
+    /* configurations replayed in order, each a list of sets ending with count 0 */
+    const struct buffer_set *configs[4];
+};
+
+#define SF_USAGE        (GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | \
+                         GRALLOC_USAGE_HW_COMPOSER)
+#define PREVIEW_USAGE   (GRALLOC_USAGE_HW_CAMERA_WRITE | GRALLOC_USAGE_HW_TEXTURE | \
+                         GRALLOC_USAGE_HW_COMPOSER)
+#define CALLBACK_USAGE  (GRALLOC_USAGE_HW_CAMERA_WRITE | GRALLOC_USAGE_SW_READ_OFTEN)
+#define HDMI_USAGE      (GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_COMPOSER | \
+                         GRALLOC_USAGE_EXTERNAL_DISP)
+
+/* an app in the foreground, then a second one, on a 2560x1600 panel */
+static const struct buffer_set sAppWindows[] = {
+    { "app",       2560, 1600, HAL_PIXEL_FORMAT_RGBA_8888, SF_USAGE, 3, 0 },
+    { "statusbar", 2560,   48, HAL_PIXEL_FORMAT_RGBA_8888,
+      GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_HW_TEXTURE, 3, GRALLOC_USAGE_SW_WRITE_OFTEN },
+    { "navbar",    2560,   96, HAL_PIXEL_FORMAT_RGBA_8888, SF_USAGE, 3, 0 },
+    { NULL, 0, 0, 0, 0, 0, 0 },
+};
+
+static const struct buffer_set sSecondApp[] = {
+    { "app",       2560, 1600, HAL_PIXEL_FORMAT_RGBX_8888, SF_USAGE, 3, 0 },
+    { "dialog",    1280,  800, HAL_PIXEL_FORMAT_RGB_565, SF_USAGE, 3, 0 },
+    { "statusbar", 2560,   48, HAL_PIXEL_FORMAT_RGBA_8888,
+      GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_HW_TEXTURE, 3, GRALLOC_USAGE_SW_WRITE_OFTEN },
+    { NULL, 0, 0, 0, 0, 0, 0 },
+};
+
+static const struct buffer_set sCameraPreview[] = {
+    { "preview",   1920, 1080, HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M, PREVIEW_USAGE, 8, 0 },
+    { "callback",  1920, 1080, HAL_PIXEL_FORMAT_YV12, CALLBACK_USAGE, 3,
+      GRALLOC_USAGE_SW_READ_OFTEN },
+    { NULL, 0, 0, 0, 0, 0, 0 },
+};
+
+static const struct buffer_set sCameraVideo[] = {
+    { "preview",   1920, 1080, HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M, PREVIEW_USAGE, 8, 0 },
+    { "video",     1920, 1080, HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M,
+      GRALLOC_USAGE_HW_CAMERA_WRITE | GRALLOC_USAGE_HW_VIDEO_ENCODER, 8, 0 },
+    { NULL, 0, 0, 0, 0, 0, 0 },
+};
+
+static const struct buffer_set sCameraZsl[] = {
+    { "preview",   1920, 1080, HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M, PREVIEW_USAGE, 8, 0 },
+    { "zsl",       4128, 3096, HAL_PIXEL_FORMAT_YCbCr_422_I,
+      GRALLOC_USAGE_HW_CAMERA_ZSL | GRALLOC_USAGE_SW_READ_OFTEN, 5, GRALLOC_USAGE_SW_READ_OFTEN },
+    { "jpeg",      4128 * 3096 * 2, 1, HAL_PIXEL_FORMAT_BLOB,
+      GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN, 1,
+      GRALLOC_USAGE_SW_WRITE_OFTEN },
+    { NULL, 0, 0, 0, 0, 0, 0 },
+};
+
+/*
+ * decoded video in MFC tiles, with thumbnails read back by the CPU, and
+ * the software-only frames of a software decoder
+ */
+static const struct buffer_set sPlayback[] = {
+    { "decoder",   1920, 1088, HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_TILED,
+      GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER | GRALLOC_USAGE_SW_READ_OFTEN, 8,
+      GRALLOC_USAGE_SW_READ_OFTEN },
+    { "swdecoder", 1280,  720, HAL_PIXEL_FORMAT_EXYNOS_YV12_M,
+      GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN, 4,
+      GRALLOC_USAGE_SW_WRITE_OFTEN },
+    { NULL, 0, 0, 0, 0, 0, 0 },
+};
+
+/* the panel mirrored to a 1080p HDMI sink */
+static const struct buffer_set sHdmi[] = {
+    { "mirror",    1920, 1080, HAL_PIXEL_FORMAT_RGBA_8888, HDMI_USAGE, 3, 0 },
+    { "video",     1920, 1080, HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M,
+      GRALLOC_USAGE_HW_COMPOSER | GRALLOC_USAGE_EXTERNAL_DISP, 3, 0 },
+    { NULL, 0, 0, 0, 0, 0, 0 },
+};
+
+static const struct trace sTraces[] = {
+    { "surfaceflinger", { sAppWindows, sSecondApp, NULL } },
+    { "camera",         { sCameraPreview, sCameraVideo, sCameraPreview, sCameraZsl } },
+    { "playback",       { sPlayback, NULL } },
+    { "hdmi",           { sHdmi, sAppWindows, NULL } },
+};
+
+struct samples {
+    int64_t *us;
+    int count;
+    int capacity;
+};
+
+static const char *const sOpNames[GRALLOC_STATS_NUM_OPS] = {
+    "alloc", "free", "register", "unregister", "lock", "unlock",
+};
+
+static struct samples sSamples[GRALLOC_STATS_NUM_OPS];
+static int sPeakFds;
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int compare_us(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void record(enum gralloc_stats_op op, int64_t start)
+{
+    int64_t us = now_us() - start;
+    struct samples *s = &sSamples[op];
+
+    if (s->count == s->capacity) {
+        int capacity = s->capacity ? s->capacity * 2 : 1024;
+        int64_t *grown = (int64_t *)realloc(s->us, capacity * sizeof(int64_t));
+        if (!grown)
+            return;
+        s->us = grown;
+        s->capacity = capacity;
+    }
+    s->us[s->count++] = us;
+}
+
+static void sample_fds(void)
+{
+    int fds = fake_ion_open_fds();
+
+    if (fds > sPeakFds)
+        sPeakFds = fds;
+}
+
+/* A consumer's copy of a handle, with its own fds as binder would pass them. */
+static private_handle_t *clone_handle(const private_handle_t *hnd)
+{
+    private_handle_t *copy = new private_handle_t(*hnd);
+
+    copy->fd = dup(hnd->fd);
+    copy->fd1 = hnd->fd1 >= 0 ? dup(hnd->fd1) : -1;
+    copy->fd2 = hnd->fd2 >= 0 ? dup(hnd->fd2) : -1;
+    return copy;
+}
+
+static void delete_clone(private_handle_t *copy)
+{
+    close(copy->fd);
+    if (copy->fd1 >= 0)
+        close(copy->fd1);
+    if (copy->fd2 >= 0)
+        close(copy->fd2);
+    delete copy;
+}
+
+static int replay_config(alloc_device_t *dev, const struct buffer_set *sets, int frames)
+{
+    gralloc_module_t *module = &HAL_MODULE_INFO_SYM.base;
+    buffer_handle_t buffers[MAX_BUFFERS];
+    private_handle_t *clones[MAX_BUFFERS];
+    int first[MAX_BUFFERS];
+    int num = 0, ret = 0;
+
+    for (int i = 0; sets[i].count; i++) {
+        const struct buffer_set *set = &sets[i];
+
+        first[i] = num;
+        for (int j = 0; j < set->count && num < MAX_BUFFERS; j++) {
+            int stride;
+            int64_t start = now_us();
+            int err = dev->alloc(dev, set->w, set->h, set->format, set->usage,
+                                 &buffers[num], &stride);
+            record(GRALLOC_STATS_ALLOC, start);
+            if (err) {
+                fprintf(stderr, "%s: %dx%d format 0x%x alloc failed: %d\n",
+                        set->name, set->w, set->h, set->format, err);
+                ret = -1;
+                goto free_buffers;
+            }
+
+            clones[num] = clone_handle((const private_handle_t *)buffers[num]);
+            start = now_us();
+            err = module->registerBuffer(module, clones[num]);
+            record(GRALLOC_STATS_REGISTER, start);
+            if (err) {
+                fprintf(stderr, "%s: register failed: %d\n", set->name, err);
+                ret = -1;
+            }
+            num++;
+            sample_fds();
+        }
+    }
+
+    for (int frame = 0; frame < frames; frame++) {
+        for (int i = 0; sets[i].count; i++) {
+            const struct buffer_set *set = &sets[i];
+
+            if (!set->lock_usage)
+                continue;
+
+            private_handle_t *hnd = clones[first[i] + frame % set->count];
+            void *vaddr[3] = { NULL, NULL, NULL };
+            int64_t start = now_us();
+            int err = module->lock(module, hnd, set->lock_usage, 0, 0, set->w, set->h, vaddr);
+            record(GRALLOC_STATS_LOCK, start);
+            if (err || !vaddr[0]) {
+                fprintf(stderr, "%s: lock failed: %d\n", set->name, err);
+                ret = -1;
+                continue;
+            }
+
+            /* what the CPU would touch first */
+            if (set->lock_usage & GRALLOC_USAGE_SW_WRITE_MASK)
+                ((volatile uint8_t *)vaddr[0])[0] = (uint8_t)frame;
+            else
+                (void)((volatile uint8_t *)vaddr[0])[0];
+
+            start = now_us();
+            module->unlock(module, hnd);
+            record(GRALLOC_STATS_UNLOCK, start);
+        }
+    }
+
+free_buffers:
+    for (int i = 0; i < num; i++) {
+        int64_t start = now_us();
+        module->unregisterBuffer(module, clones[i]);
+        record(GRALLOC_STATS_UNREGISTER, start);
+        delete_clone(clones[i]);
+
+        start = now_us();
+        dev->free(dev, buffers[i]);
+        record(GRALLOC_STATS_FREE, start);
+    }
+    return ret;
+}
+
+static int replay(const struct trace *trace, int rounds, int frames)
+{
+    hw_module_t *module = &HAL_MODULE_INFO_SYM.base.common;
+    hw_device_t *device;
+    int baseline_fds = fake_ion_open_fds();
+    int ret = 0;
+
+    for (int op = 0; op < GRALLOC_STATS_NUM_OPS; op++)
+        sSamples[op].count = 0;
+    sPeakFds = baseline_fds;
+    gralloc_stats_reset();
+    fake_ion_reset();
+
+    int err = module->methods->open(module, GRALLOC_HARDWARE_GPU0, &device);
+    if (err) {
+        fprintf(stderr, "cannot open the allocator: %d\n", err);
+        return -1;
+    }
+    alloc_device_t *dev = (alloc_device_t *)device;
+
+    for (int round = 0; round < rounds; round++)
+        for (int i = 0; i < 4 && trace->configs[i]; i++)
+            ret |= replay_config(dev, trace->configs[i], frames);
+
+    struct fake_ion_counts counts;
+    int fds, peak_fds;
+    int64_t mapped, peak_mapped;
+
+    fake_ion_counts(&counts);
+    gralloc_stats_counts(&fds, &peak_fds, &mapped, &peak_mapped);
+    device->close(device);
+    int leaked_fds = fake_ion_open_fds() - baseline_fds;
+
+    printf("%s: %d rounds, %d frames per configuration\n", trace->name, rounds, frames);
+    for (int op = 0; op < GRALLOC_STATS_NUM_OPS; op++) {
+        struct samples *s = &sSamples[op];
+
+        if (!s->count)
+            continue;
+        qsort(s->us, s->count, sizeof(s->us[0]), compare_us);
+        printf("  %-10s %6d calls  p50 %6lld us  p90 %6lld us  p99 %6lld us  max %6lld us\n",
+               sOpNames[op], s->count, (long long)s->us[s->count / 2],
+               (long long)s->us[s->count * 9 / 10], (long long)s->us[s->count * 99 / 100],
+               (long long)s->us[s->count - 1]);
+    }
+    printf("  peak mapped %lld KB, peak fds %d over %d at start\n",
+           (long long)(peak_mapped / 1024), sPeakFds - baseline_fds, baseline_fds);
+    printf("  ion allocs %u (%lld MB), syncs %u, imports %u\n",
+           counts.allocs, (long long)(counts.alloc_bytes >> 20), counts.syncs, counts.imports);
+
+    if (leaked_fds || counts.live_handles || mapped) {
+        printf("  LEAK: %d fds, %d ion handles, %lld KB mapped\n",
+               leaked_fds, counts.live_handles, (long long)(mapped / 1024));
+        ret = -1;
+    }
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 20;
+    int frames = argc > 2 ? atoi(argv[2]) : 30;
+    int ret = 0;
+
+    if (rounds <= 0)
+        rounds = 20;
+    if (frames <= 0)
+        frames = 30;
+
+    for (size_t i = 0; i < sizeof(sTraces) / sizeof(sTraces[0]); i++)
+        ret |= replay(&sTraces[i], rounds, frames);
+
+    for (int op = 0; op < GRALLOC_STATS_NUM_OPS; op++)
+        free(sSamples[op].us);
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures gralloc_detile_plane on NV12 tiled frames against a per-byte
+ * de-tiler, for the sizes the decoder typically produces.
+ *
+ * usage: gralloc_detile_benchmark [iterations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gralloc_tiled.h"
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* One byte at a time, the way readers de-tiled before the linear view. */
+static void detile_bytes(uint8_t *dst, const uint8_t *src, int pitch,
+                         int width, int height, int x_tiles, int y_tiles)
+{
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            dst[y * pitch + x] = src[gralloc_tile_offset(x / GRALLOC_TILE_W,
+                                                         y / GRALLOC_TILE_H,
+                                                         x_tiles, y_tiles) +
+                                     (y % GRALLOC_TILE_H) * GRALLOC_TILE_W +
+                                     x % GRALLOC_TILE_W];
+}
+
+typedef void (*detile_fn)(uint8_t *, const uint8_t *, int, int, int, int, int);
+
+static int64_t run(detile_fn fn, int width, int height, int iterations)
+{
+    int x_tiles = (width + GRALLOC_TILE_W * 2 - 1) / (GRALLOC_TILE_W * 2) * 2;
+    int y_tiles = (height + GRALLOC_TILE_H - 1) / GRALLOC_TILE_H;
+    int chroma_tiles_y = (height / 2 + GRALLOC_TILE_H - 1) / GRALLOC_TILE_H;
+    size_t luma_tiled = (size_t)x_tiles * y_tiles * GRALLOC_TILE_SIZE;
+    size_t chroma_tiled = (size_t)x_tiles * chroma_tiles_y * GRALLOC_TILE_SIZE;
+    int pitch = x_tiles * GRALLOC_TILE_W;
+    uint8_t *src = (uint8_t *)malloc(luma_tiled + chroma_tiled);
+    uint8_t *dst = (uint8_t *)malloc((size_t)pitch * (height + height / 2));
+    int64_t best = -1;
+
+    if (!src || !dst) {
+        free(src);
+        free(dst);
+        return -1;
+    }
+    memset(src, 0x40, luma_tiled + chroma_tiled);
+
+    for (int i = 0; i < iterations; i++) {
+        int64_t start = now_us();
+        fn(dst, src, pitch, width, height, x_tiles, y_tiles);
+        fn(dst + (size_t)pitch * height, src + luma_tiled, pitch, width, height / 2,
+           x_tiles, chroma_tiles_y);
+        int64_t us = now_us() - start;
+        if (best < 0 || us < best)
+            best = us;
+    }
+
+    free(src);
+    free(dst);
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    static const int sizes[][2] = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+
+    if (iterations <= 0)
+        iterations = 20;
+
+    printf("best of %d, NV12 frame (luma + chroma)\n", iterations);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int width = sizes[i][0], height = sizes[i][1];
+        int64_t bytes = run(detile_bytes, width, height, iterations);
+        int64_t plane = run(gralloc_detile_plane, width, height, iterations);
+
+        if (bytes < 0 || plane < 0) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        printf("%4dx%-4d  per-byte %6lld us  gralloc_detile_plane %6lld us  %5.1fx\n",
+               width, height, (long long)bytes, (long long)plane,
+               plane ? (double)bytes / plane : 0.0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A stand-in for libion on the host. Buffers are memfds of the requested
+ * size, so gralloc maps, clears and shares them the way it does ION fds.
+ * Their pages are populated and zeroed at allocation, as the ION heaps do,
+ * so allocations cost what the page allocation costs. Cache maintenance
+ * only validates the fd and is counted.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <ion/ion.h>
+
+#include "fake_ion.h"
+
+#ifndef __NR_memfd_create
+#if defined(__x86_64__)
+#define __NR_memfd_create       319
+#elif defined(__i386__)
+#define __NR_memfd_create       356
+#endif
+#endif
+
+#define MFD_CLOEXEC_FLAG        0x0001U
+
+static pthread_mutex_t sFakeLock = PTHREAD_MUTEX_INITIALIZER;
+static struct fake_ion_counts sCounts;
+static int sNextHandle = 1;
+
+static int create_buffer_fd(void)
+{
+    int fd = -1;
+
+#ifdef __NR_memfd_create
+    fd = syscall(__NR_memfd_create, "fake_ion", MFD_CLOEXEC_FLAG);
+    if (fd >= 0 || errno != ENOSYS)
+        return fd;
+#endif
+
+    /* kernels without memfd get an unlinked file */
+    char path[] = "/tmp/fake_ion.XXXXXX";
+    fd = mkstemp(path);
+    if (fd >= 0) {
+        unlink(path);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+}
+
+static bool valid_buffer_fd(int fd)
+{
+    struct stat st;
+
+    return fd >= 0 && !fstat(fd, &st) && S_ISREG(st.st_mode);
+}
+
+int ion_open()
+{
+    return open("/dev/null", O_RDWR | O_CLOEXEC);
+}
+
+int ion_close(int fd)
+{
+    return close(fd);
+}
+
+int ion_alloc_fd(int fd, size_t len, size_t align __attribute__((unused)),
+                 unsigned int heap_mask, unsigned int flags __attribute__((unused)),
+                 int *handle_fd)
+{
+    if (fd < 0 || !len || !heap_mask || !handle_fd)
+        return -EINVAL;
+
+    int buffer_fd = create_buffer_fd();
+    if (buffer_fd < 0)
+        return -errno;
+    if (ftruncate(buffer_fd, len) < 0) {
+        int err = -errno;
+        close(buffer_fd);
+        return err;
+    }
+
+    void *pages = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, buffer_fd, 0);
+    if (pages == MAP_FAILED) {
+        int err = -errno;
+        close(buffer_fd);
+        return err;
+    }
+    memset(pages, 0, len);
+    munmap(pages, len);
+
+    pthread_mutex_lock(&sFakeLock);
+    sCounts.allocs++;
+    sCounts.alloc_bytes += len;
+    pthread_mutex_unlock(&sFakeLock);
+
+    *handle_fd = buffer_fd;
+    return 0;
+}
+
+int ion_sync_fd(int fd, int handle_fd)
+{
+    if (fd < 0 || !valid_buffer_fd(handle_fd))
+        return -EINVAL;
+
+    pthread_mutex_lock(&sFakeLock);
+    sCounts.syncs++;
+    pthread_mutex_unlock(&sFakeLock);
+    return 0;
+}
+
+int ion_import(int fd, int share_fd, int *handle)
+{
+    if (fd < 0 || !handle || !valid_buffer_fd(share_fd))
+        return -EINVAL;
+
+    pthread_mutex_lock(&sFakeLock);
+    sCounts.imports++;
+    sCounts.live_handles++;
+    *handle = sNextHandle++;
+    pthread_mutex_unlock(&sFakeLock);
+    return 0;
+}
+
+int ion_free(int fd, int handle)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&sFakeLock);
+    if (fd < 0 || handle <= 0 || !sCounts.live_handles)
+        ret = -EINVAL;
+    else
+        sCounts.live_handles--;
+    pthread_mutex_unlock(&sFakeLock);
+    return ret;
+}
+
+void fake_ion_counts(struct fake_ion_counts *counts)
+{
+    pthread_mutex_lock(&sFakeLock);
+    *counts = sCounts;
+    pthread_mutex_unlock(&sFakeLock);
+}
+
+void fake_ion_reset(void)
+{
+    pthread_mutex_lock(&sFakeLock);
+    int live_handles = sCounts.live_handles;
+    memset(&sCounts, 0, sizeof(sCounts));
+    sCounts.live_handles = live_handles;
+    pthread_mutex_unlock(&sFakeLock);
+}
+
+int fake_ion_open_fds(void)
+{
+    DIR *dir = opendir("/proc/self/fd");
+    int count = 0;
+
+    if (!dir)
+        return -1;
+    while (struct dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] != '.')
+            count++;
+    }
+    closedir(dir);
+    /* the directory itself */
+    return count - 1;
+}
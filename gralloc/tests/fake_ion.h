@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FAKE_ION_H_
+#define _FAKE_ION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* What the fake ION has been asked to do since the last fake_ion_reset(). */
+struct fake_ion_counts {
+    unsigned int allocs;        /* buffers handed out by ion_alloc_fd() */
+    int64_t alloc_bytes;        /* their total size */
+    unsigned int syncs;         /* ion_sync_fd() calls */
+    unsigned int imports;       /* ion_import() calls */
+    int live_handles;           /* imported handles not freed yet */
+};
+
+void fake_ion_counts(struct fake_ion_counts *counts);
+void fake_ion_reset(void);
+
+/* Returns the number of fds this process has open. */
+int fake_ion_open_fds(void);
+
+#endif /* _FAKE_ION_H_ */
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * libion entry points gralloc calls, implemented by fake_ion.cpp on top of
+ * memfd for host builds.
+ */
+
+#ifndef _FAKE_ION_ION_H_
+#define _FAKE_ION_ION_H_
+
+#include <stddef.h>
+#include <sys/cdefs.h>
+
+#include <linux/ion.h>
+
+__BEGIN_DECLS
+
+int ion_open();
+int ion_close(int fd);
+int ion_alloc_fd(int fd, size_t len, size_t align, unsigned int heap_mask,
+                 unsigned int flags, int *handle_fd);
+int ion_sync_fd(int fd, int handle_fd);
+int ion_import(int fd, int share_fd, int *handle);
+int ion_free(int fd, int handle);
+
+__END_DECLS
+
+#endif /* _FAKE_ION_ION_H_ */
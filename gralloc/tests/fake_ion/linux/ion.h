@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ION heap and flag bits of the kernel, for host builds against the fake
+ * ION in fake_ion.cpp. gralloc defines the Exynos heap bits itself.
+ */
+
+#ifndef _FAKE_LINUX_ION_H_
+#define _FAKE_LINUX_ION_H_
+
+#define ION_HEAP_TYPE_SYSTEM            0
+#define ION_HEAP_SYSTEM_MASK            (1 << ION_HEAP_TYPE_SYSTEM)
+
+#define ION_FLAG_CACHED                 1
+#define ION_FLAG_CACHED_NEEDS_SYNC      2
+#define ION_FLAG_PRESERVE_KMAP          4
+
+#endif /* _FAKE_LINUX_ION_H_ */
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the framebuffer copy backends on a 2560x1600 RGBA frame, both for
+ * full posts and for a damaged band of rows, as fb_post copies them when
+ * the framebuffer cannot page flip.
+ *
+ * usage: gralloc_fb_copy_benchmark [iterations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gralloc_fb_copy.h"
+
+#define FB_WIDTH        2560
+#define FB_HEIGHT       1600
+#define FB_BPP          4
+#define DAMAGE_ROWS     200
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int compare_us(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int run(const char *backend, uint8_t *dst, const uint8_t *src,
+               int top, int bottom, int iterations, int64_t *samples)
+{
+    size_t line_length = FB_WIDTH * FB_BPP;
+    size_t offset = line_length * top;
+    size_t len = line_length * (bottom - top);
+
+    if (gralloc_fb_copy_select(backend)) {
+        fprintf(stderr, "unknown backend %s\n", backend);
+        return -1;
+    }
+
+    /* warm up the threads and the page tables */
+    gralloc_fb_copy(dst + offset, src + offset, len);
+
+    for (int i = 0; i < iterations; i++) {
+        int64_t start = now_us();
+        gralloc_fb_copy(dst + offset, src + offset, len);
+        samples[i] = now_us() - start;
+    }
+
+    if (memcmp(dst + offset, src + offset, len)) {
+        fprintf(stderr, "%s: copy mismatch\n", backend);
+        return -1;
+    }
+
+    qsort(samples, iterations, sizeof(samples[0]), compare_us);
+    int64_t p50 = samples[iterations / 2];
+    printf("%-8s rows %4d-%-4d  p50 %6lld us  p90 %6lld us  max %6lld us  %7.1f MB/s\n",
+           backend, top, bottom, (long long)p50,
+           (long long)samples[iterations * 9 / 10],
+           (long long)samples[iterations - 1],
+           p50 ? (double)len / p50 : 0.0);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *backends[] = { "memcpy", "stripe" };
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    size_t size = (size_t)FB_WIDTH * FB_HEIGHT * FB_BPP;
+    int ret = 0;
+
+    if (iterations <= 0)
+        iterations = 200;
+
+    uint8_t *src = (uint8_t *)malloc(size);
+    uint8_t *dst = (uint8_t *)malloc(size);
+    int64_t *samples = (int64_t *)malloc(iterations * sizeof(int64_t));
+    if (!src || !dst || !samples) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < size; i++)
+        src[i] = (uint8_t)(i * 7 + (i >> 12));
+    memset(dst, 0, size);
+
+    printf("%dx%d, %d iterations\n", FB_WIDTH, FB_HEIGHT, iterations);
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        ret |= run(backends[i], dst, src, 0, FB_HEIGHT, iterations, samples);
+        ret |= run(backends[i], dst, src, (FB_HEIGHT - DAMAGE_ROWS) / 2,
+                   (FB_HEIGHT + DAMAGE_ROWS) / 2, iterations, samples);
+    }
+
+    free(samples);
+    free(dst);
+    free(src);
+    return ret ? 1 : 0;
+}
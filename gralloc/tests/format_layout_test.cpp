@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the format layout table that gralloc and the camera HAL size their
+ * buffers from, for every format it lists.
+ */
+
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "exynos_format_layout.h"
+
+#define ALIGN_TO(x, a)  (((x) + (a) - 1) / (a) * (a))
+
+/*
+ * Buffer sizes as gralloc computed them before the layout table, with the
+ * ext pad; RGB sizes are taken before page alignment. These are the sizes
+ * existing users were written against.
+ */
+struct legacy_size {
+    int stride;
+    int vstride;
+    size_t size;
+    size_t chroma_size;
+};
+
+static bool legacy_layout(int format, int w, int h, bool encoder, struct legacy_size *out)
+{
+    size_t ext_size = 256;
+    int bpp = 0;
+
+    memset(out, 0, sizeof(*out));
+
+    switch (format) {
+    case HAL_PIXEL_FORMAT_EXYNOS_ARGB_8888:
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+    case HAL_PIXEL_FORMAT_BGRA_8888:
+    case HAL_PIXEL_FORMAT_sRGB_A_8888:
+    case HAL_PIXEL_FORMAT_sRGB_X_8888:
+        bpp = 4;
+        break;
+    case HAL_PIXEL_FORMAT_RGB_888:
+        bpp = 3;
+        break;
+    case HAL_PIXEL_FORMAT_RGB_565:
+    case HAL_PIXEL_FORMAT_RAW16:
+        bpp = 2;
+        break;
+    case HAL_PIXEL_FORMAT_BLOB:
+        out->stride = w;
+        out->vstride = h;
+        out->size = w * h;
+        return true;
+    case HAL_PIXEL_FORMAT_YV12:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_P:
+        out->stride = ALIGN_TO(w, 16);
+        out->vstride = h;
+        out->size = out->stride * h + ALIGN_TO(out->stride / 2, 16) * h + ext_size;
+        return true;
+    case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+        out->stride = w;
+        out->vstride = h;
+        out->size = out->stride * ALIGN_TO(h, 16) * 3 / 2 + ext_size;
+        return true;
+    case HAL_PIXEL_FORMAT_EXYNOS_YV12_M:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_P_M:
+        out->stride = ALIGN_TO(w, 32);
+        out->vstride = ALIGN_TO(h, 16);
+        out->size = out->vstride * out->stride + ext_size;
+        out->chroma_size = (out->vstride / 2) * ALIGN_TO(out->stride / 2, 16) + ext_size;
+        return true;
+    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_TILED:
+        out->stride = ALIGN_TO(w, 16);
+        out->vstride = ALIGN_TO(h, 32);
+        out->size = out->vstride * out->stride + ext_size;
+        out->chroma_size = ALIGN_TO(h / 2, 32) * out->stride + ext_size;
+        return true;
+    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M_FULL:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M:
+        out->stride = ALIGN_TO(w, 16);
+        out->vstride = ALIGN_TO(h, 16);
+        out->size = out->stride * out->vstride + ext_size;
+        out->chroma_size = out->stride * ALIGN_TO(out->vstride / 2, 8) + ext_size;
+        return true;
+    case HAL_PIXEL_FORMAT_YCbCr_422_I:
+        out->stride = ALIGN_TO(w, 16);
+        out->vstride = h;
+        out->size = out->vstride * out->stride * 2 + ext_size;
+        return true;
+    default:
+        return false;
+    }
+
+    size_t bpr;
+    if (encoder || format == HAL_PIXEL_FORMAT_BGRA_8888) {
+        bpr = ALIGN_TO(w, 16) * bpp;
+        out->vstride = ALIGN_TO(h, 16);
+    } else {
+        bpr = ALIGN_TO(w * bpp, 64);
+        out->vstride = h;
+    }
+    if (out->vstride < h + 2)
+        out->size = bpr * (h + 2);
+    else
+        out->size = bpr * out->vstride;
+    out->stride = bpr / bpp;
+    out->size += ext_size;
+    return true;
+}
+
+static const int sFormats[] = {
+    HAL_PIXEL_FORMAT_RGBA_8888, HAL_PIXEL_FORMAT_RGBX_8888, HAL_PIXEL_FORMAT_BGRA_8888,
+    HAL_PIXEL_FORMAT_EXYNOS_ARGB_8888, HAL_PIXEL_FORMAT_sRGB_A_8888,
+    HAL_PIXEL_FORMAT_sRGB_X_8888, HAL_PIXEL_FORMAT_RGB_888, HAL_PIXEL_FORMAT_RGB_565,
+    HAL_PIXEL_FORMAT_RAW16, HAL_PIXEL_FORMAT_BLOB, HAL_PIXEL_FORMAT_YV12,
+    HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_P, HAL_PIXEL_FORMAT_YCrCb_420_SP,
+    HAL_PIXEL_FORMAT_EXYNOS_YV12_M, HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_P_M,
+    HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_TILED, HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M,
+    HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M_FULL, HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M,
+    HAL_PIXEL_FORMAT_YCbCr_422_I,
+};
+
+#define NUM_FORMATS     (sizeof(sFormats) / sizeof(sFormats[0]))
+
+TEST(ExynosFormatLayout, EveryFormatHasOneEntry)
+{
+    EXPECT_EQ(NUM_FORMATS, sizeof(exynos_format_layouts) / sizeof(exynos_format_layouts[0]));
+
+    for (size_t i = 0; i < NUM_FORMATS; i++) {
+        const struct exynos_format_layout *layout = exynos_format_layout_find(sFormats[i]);
+        ASSERT_TRUE(layout != NULL) << "format 0x" << std::hex << sFormats[i];
+        EXPECT_EQ(sFormats[i], layout->format);
+    }
+}
+
+TEST(ExynosFormatLayout, UnknownFormat)
+{
+    EXPECT_TRUE(exynos_format_layout_find(0) == NULL);
+    EXPECT_TRUE(exynos_format_layout_find(HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED) == NULL);
+    EXPECT_TRUE(exynos_format_layout_find(-1) == NULL);
+}
+
+/*
+ * Every format and size gets the stride, vstride and sizes gralloc used to
+ * allocate, except where the old copies were too small:
+ *  - tiled chroma rows follow the luma vstride, so the chroma plane is never
+ *    smaller than the 32-row aligned half of the luma plane;
+ *  - contiguous 4:2:0 formats with an odd height round the chroma rows up.
+ */
+TEST(ExynosFormatLayout, MatchesLegacySizes)
+{
+    for (size_t f = 0; f < NUM_FORMATS; f++) {
+        int format = sFormats[f];
+        const struct exynos_format_layout *layout = exynos_format_layout_find(format);
+
+        ASSERT_TRUE(layout != NULL);
+        for (int encoder = 0; encoder < 2; encoder++) {
+            for (int w = 1; w <= 700; w += (w < 80 ? 1 : 37)) {
+                for (int h = 1; h <= 600; h += (h < 80 ? 1 : 29)) {
+                    struct legacy_size legacy;
+                    struct exynos_plane_layout planes;
+
+                    ASSERT_TRUE(legacy_layout(format, w, h, encoder, &legacy));
+                    memset(&planes, 0, sizeof(planes));
+                    exynos_format_plane_layout(layout, w, h, encoder, &planes);
+
+                    SCOPED_TRACE(testing::Message() << "format 0x" << std::hex << format
+                                 << std::dec << " " << w << "x" << h << " encoder " << encoder);
+                    EXPECT_EQ(legacy.stride, planes.stride);
+                    EXPECT_EQ(legacy.vstride, planes.vstride);
+
+                    size_t size = exynos_format_buffer_size(layout, &planes);
+                    size_t chroma = exynos_format_chroma_buffer_size(layout, &planes);
+
+                    if (layout->tiled) {
+                        EXPECT_EQ(legacy.size, size);
+                        EXPECT_GE(chroma, legacy.chroma_size);
+                        EXPECT_EQ(planes.chroma_pitch *
+                                  ALIGN_TO(planes.vstride / 2, 32) + EXYNOS_LAYOUT_EXT_SIZE,
+                                  (int)chroma);
+                    } else if (layout->contiguous && layout->planes == 3 && (h & 1)) {
+                        EXPECT_EQ(legacy.size + ALIGN_TO(planes.stride / 2, 16), size);
+                    } else {
+                        EXPECT_EQ(legacy.size, size);
+                        EXPECT_EQ(legacy.chroma_size, chroma);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* The planes hold every pixel of the image at the stride and vstride in the handle. */
+TEST(ExynosFormatLayout, PlanesHoldImage)
+{
+    for (size_t f = 0; f < NUM_FORMATS; f++) {
+        const struct exynos_format_layout *layout = exynos_format_layout_find(sFormats[f]);
+
+        for (int w = 2; w <= 4096; w = w * 3 / 2 + 1) {
+            for (int h = 2; h <= 2304; h = h * 3 / 2 + 1) {
+                struct exynos_plane_layout planes;
+
+                memset(&planes, 0, sizeof(planes));
+                exynos_format_plane_layout(layout, w, h, 0, &planes);
+
+                SCOPED_TRACE(testing::Message() << "format 0x" << std::hex << sFormats[f]
+                             << std::dec << " " << w << "x" << h);
+                ASSERT_GE(planes.stride, w);
+                ASSERT_GE(planes.vstride, h);
+                ASSERT_GE(planes.luma_pitch, planes.stride * layout->bpp);
+                ASSERT_GE(planes.luma_size, (size_t)planes.luma_pitch * planes.vstride);
+                if (layout->planes > 1) {
+                    ASSERT_GE(planes.chroma_pitch * layout->chroma_pitch_div, planes.stride);
+                    ASSERT_GE(planes.chroma_size,
+                              (size_t)planes.chroma_pitch * ((planes.vstride + 1) / 2));
+                } else {
+                    ASSERT_EQ(0u, planes.chroma_size);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * The camera's 16x16 tiled NV12M: both planes hold whole 16x16 tiles, and
+ * are never smaller than the camera HAL's old 16-aligned sizes.
+ */
+TEST(ExynosFormatLayout, Nv12mt16x16HoldsWholeTiles)
+{
+    const struct exynos_format_layout *layout = &exynos_nv12mt_16x16_layout;
+
+    for (int w = 2; w <= 4096; w = w * 3 / 2 + 1) {
+        for (int h = 2; h <= 2304; h = h * 3 / 2 + 1) {
+            struct exynos_plane_layout planes;
+
+            memset(&planes, 0, sizeof(planes));
+            exynos_format_plane_layout(layout, w, h, 0, &planes);
+
+            SCOPED_TRACE(testing::Message() << w << "x" << h);
+            size_t legacy_luma = (size_t)ALIGN_TO(w, 16) * ALIGN_TO(h, 16);
+
+            EXPECT_EQ(0, planes.stride % 16);
+            EXPECT_EQ(0, planes.vstride % 16);
+            EXPECT_EQ(legacy_luma, planes.luma_size);
+            EXPECT_EQ((size_t)planes.chroma_pitch * ALIGN_TO(planes.vstride / 2, 16),
+                      planes.chroma_size);
+            EXPECT_GE(planes.chroma_size, ALIGN_TO(legacy_luma / 2, 256));
+            EXPECT_EQ(planes.luma_size, exynos_format_buffer_size(layout, &planes));
+            EXPECT_EQ(planes.chroma_size, exynos_format_chroma_buffer_size(layout, &planes));
+        }
+    }
+
+    /* the 64x32 tiled entry differs, so the camera must not fall back on it */
+    const struct exynos_format_layout *tiled =
+            exynos_format_layout_find(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_TILED);
+    struct exynos_plane_layout planes, tiled_planes;
+
+    memset(&planes, 0, sizeof(planes));
+    memset(&tiled_planes, 0, sizeof(tiled_planes));
+    exynos_format_plane_layout(layout, 1280, 720, 0, &planes);
+    exynos_format_plane_layout(tiled, 1280, 720, 0, &tiled_planes);
+    EXPECT_EQ(720, planes.vstride);
+    EXPECT_EQ(736, tiled_planes.vstride);
+    EXPECT_EQ((size_t)1280 * 368, planes.chroma_size);
+    EXPECT_EQ((size_t)1280 * 384, tiled_planes.chroma_size);
+}
+
+/* A stride and vstride taken from a registered handle are kept as they are. */
+TEST(ExynosFormatLayout, KeepsHandleGeometry)
+{
+    const struct exynos_format_layout *layout =
+            exynos_format_layout_find(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M);
+    struct exynos_plane_layout planes;
+
+    memset(&planes, 0, sizeof(planes));
+    planes.stride = 2048;
+    planes.vstride = 1152;
+    exynos_format_plane_layout(layout, 1920, 1080, 0, &planes);
+
+    EXPECT_EQ(2048, planes.stride);
+    EXPECT_EQ(1152, planes.vstride);
+    EXPECT_EQ((size_t)2048 * 1152, planes.luma_size);
+    EXPECT_EQ((size_t)2048 * 576, planes.chroma_size);
+}
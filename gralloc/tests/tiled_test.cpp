@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "gralloc_tiled.h"
+
+/*
+ * Reference byte address of (x, y) in a 64x32 tiled plane, written the way
+ * the MFC documentation describes it: 8 KB groups of four 2 KB tiles, with
+ * the bank inside a group picked by the low bits of the tile coordinates.
+ * A last unpaired tile row is stored linearly.
+ */
+static size_t reference_address(int width, int height, int x, int y)
+{
+    int x_addr = x >> 2;
+    int groups_per_row = ((width - 1) >> 7) + 1;
+    int linear_addr0 = ((y & 0x1f) << 4) | (x_addr & 0xf);
+    int linear_addr1;
+    int bank;
+
+    if (height <= y + 32 && y < height &&
+        (((height - 1) >> 5) & 1) == 0 && ((y >> 5) & 1) == 0)
+        linear_addr1 = ((y >> 6) & 0xff) * groups_per_row + ((x_addr >> 6) & 0x3f);
+    else
+        linear_addr1 = ((y >> 6) & 0xff) * groups_per_row + ((x_addr >> 5) & 0x7f);
+
+    if (((x_addr >> 5) & 1) == ((y >> 5) & 1))
+        bank = (x_addr >> 4) & 1;
+    else
+        bank = 2 | ((x_addr >> 4) & 1);
+
+    return ((size_t)linear_addr1 << 13) | (bank << 11) | (linear_addr0 << 2) | (x & 3);
+}
+
+struct tiled_plane {
+    int width;
+    int height;
+    int x_tiles;
+    int y_tiles;
+    std::vector<uint8_t> linear;
+    std::vector<uint8_t> tiled;
+};
+
+/* Fills a random linear plane and its tiled copy, built with the reference. */
+static void make_plane(struct tiled_plane *plane, int width, int height, unsigned int seed)
+{
+    plane->width = width;
+    plane->height = height;
+    plane->x_tiles = (width + GRALLOC_TILE_W * 2 - 1) / (GRALLOC_TILE_W * 2) * 2;
+    plane->y_tiles = (height + GRALLOC_TILE_H - 1) / GRALLOC_TILE_H;
+    plane->linear.resize((size_t)width * height);
+    plane->tiled.assign((size_t)plane->x_tiles * plane->y_tiles * GRALLOC_TILE_SIZE, 0);
+
+    srand(seed);
+    for (size_t i = 0; i < plane->linear.size(); i++)
+        plane->linear[i] = rand() & 0xff;
+
+    int tiled_width = plane->x_tiles * GRALLOC_TILE_W;
+    int tiled_height = plane->y_tiles * GRALLOC_TILE_H;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            plane->tiled[reference_address(tiled_width, tiled_height, x, y)] =
+                    plane->linear[(size_t)y * width + x];
+}
+
+TEST(GrallocTiled, TileOffsetMatchesReference)
+{
+    static const int sizes[][2] = {
+        { 128, 32 }, { 128, 64 }, { 256, 96 }, { 512, 288 }, { 1920, 1088 }, { 1280, 736 },
+    };
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int width = sizes[i][0], height = sizes[i][1];
+        int x_tiles = width / GRALLOC_TILE_W, y_tiles = height / GRALLOC_TILE_H;
+
+        for (int ty = 0; ty < y_tiles; ty++)
+            for (int tx = 0; tx < x_tiles; tx++)
+                ASSERT_EQ(reference_address(width, height, tx * GRALLOC_TILE_W,
+                                            ty * GRALLOC_TILE_H),
+                          gralloc_tile_offset(tx, ty, x_tiles, y_tiles))
+                        << width << "x" << height << " tile " << tx << "," << ty;
+    }
+}
+
+TEST(GrallocTiled, TilesCoverPlaneOnce)
+{
+    int x_tiles = 30, y_tiles = 17;
+    std::vector<int> used(x_tiles * y_tiles, 0);
+
+    for (int ty = 0; ty < y_tiles; ty++)
+        for (int tx = 0; tx < x_tiles; tx++) {
+            size_t offset = gralloc_tile_offset(tx, ty, x_tiles, y_tiles);
+            ASSERT_EQ(0u, offset % GRALLOC_TILE_SIZE);
+            ASSERT_LT(offset / GRALLOC_TILE_SIZE, used.size());
+            used[offset / GRALLOC_TILE_SIZE]++;
+        }
+
+    for (size_t i = 0; i < used.size(); i++)
+        EXPECT_EQ(1, used[i]) << "tile slot " << i;
+}
+
+TEST(GrallocTiled, DetileRoundTrip)
+{
+    /* odd tile rows, partial tiles and planes large enough to be threaded */
+    static const int sizes[][2] = {
+        { 64, 32 }, { 100, 40 }, { 176, 144 }, { 320, 240 }, { 720, 480 },
+        { 1280, 720 }, { 1920, 1080 }, { 1920, 540 },
+    };
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        struct tiled_plane plane;
+        int pitch = sizes[i][0] + 16;
+
+        make_plane(&plane, sizes[i][0], sizes[i][1], i + 1);
+
+        std::vector<uint8_t> out((size_t)pitch * plane.height, 0xa5);
+        gralloc_detile_plane(&out[0], &plane.tiled[0], pitch, plane.width,
+                             plane.height, plane.x_tiles, plane.y_tiles);
+
+        for (int y = 0; y < plane.height; y++) {
+            ASSERT_EQ(0, memcmp(&out[(size_t)y * pitch],
+                                &plane.linear[(size_t)y * plane.width], plane.width))
+                    << plane.width << "x" << plane.height << " row " << y;
+            /* the padding past width is left alone */
+            for (int x = plane.width; x < pitch; x++)
+                ASSERT_EQ(0xa5, out[(size_t)y * pitch + x]);
+        }
+    }
+}
@@ -205,6 +205,7 @@ public:
     int updateConfig(void);
 
     int setQuality(int iQuality);
+    int updateQuality(void);
     int getJpegSize(void);
 
     int encode(void);
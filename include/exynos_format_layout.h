@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _EXYNOS_FORMAT_LAYOUT_H_
+#define _EXYNOS_FORMAT_LAYOUT_H_
+
+#include <stddef.h>
+
+#include <system/graphics.h>
+
+#include "exynos_format.h"
+
+/*
+ * Plane layout rules of every format gralloc allocates. The allocator, the
+ * mapper and the camera HAL all size buffers from this table, so a buffer
+ * is always allocated with the layout its users expect.
+ */
+
+#define EXYNOS_LAYOUT_EXT_SIZE      256     /* pad after each plane */
+
+struct exynos_format_layout {
+    int format;
+    int planes;
+    int contiguous;             /* all planes in one buffer, one fd */
+    int bpp;                    /* bytes per luma pixel */
+    int stride_align;
+    int pitch_align;            /* luma row bytes aligned to this instead, if set */
+    int vstride_align;
+    int encoder_align;          /* stride and vstride alignment for video encoder input */
+    int extra_rows;             /* the luma plane holds at least height + extra_rows */
+    int size_rows_align;        /* buffer sized for rows aligned to this, if set */
+    int chroma_pitch_div;       /* chroma pitch is stride / div ... */
+    int chroma_pitch_align;     /* ... aligned to this */
+    int chroma_rows_align;
+    int ext_pad;                /* EXYNOS_LAYOUT_EXT_SIZE after each buffer */
+    int tiled;                  /* planes can only be mapped whole */
+};
+
+struct exynos_plane_layout {
+    int stride;
+    int vstride;
+    int luma_pitch;
+    int chroma_pitch;
+    size_t luma_size;           /* without the ext pad */
+    size_t chroma_size;         /* per chroma plane, without the ext pad */
+};
+
+static const struct exynos_format_layout exynos_format_layouts[] = {
+    /* format                                    planes contig bpp stride pitch vstride enc rows sizerows cdiv calign crows pad tiled */
+    { HAL_PIXEL_FORMAT_RGBA_8888,                     1, 0, 4, 1, 64,  1, 16, 2,  0, 0,  0,  0, 1, 0 },
+    { HAL_PIXEL_FORMAT_RGBX_8888,                     1, 0, 4, 1, 64,  1, 16, 2,  0, 0,  0,  0, 1, 0 },
+    { HAL_PIXEL_FORMAT_BGRA_8888,                     1, 0, 4, 16, 0, 16, 16, 2,  0, 0,  0,  0, 1, 0 },
+    { HAL_PIXEL_FORMAT_EXYNOS_ARGB_8888,              1, 0, 4, 1, 64,  1, 16, 2,  0, 0,  0,  0, 1, 0 },
+    { HAL_PIXEL_FORMAT_sRGB_A_8888,                   1, 0, 4, 1, 64,  1, 16, 2,  0, 0,  0,  0, 1, 0 },
+    { HAL_PIXEL_FORMAT_sRGB_X_8888,                   1, 0, 4, 1, 64,  1, 16, 2,  0, 0,  0,  0, 1, 0 },
+    { HAL_PIXEL_FORMAT_RGB_888,                       1, 0, 3, 1, 64,  1, 16, 2,  0, 0,  0,  0, 1, 0 },
+    { HAL_PIXEL_FORMAT_RGB_565,                       1, 0, 2, 1, 64,  1, 16, 2,  0, 0,  0,  0, 1, 0 },
+    { HAL_PIXEL_FORMAT_RAW16,                         1, 0, 2, 1, 64,  1, 16, 2,  0, 0,  0,  0, 1, 0 },
+    { HAL_PIXEL_FORMAT_BLOB,                          1, 0, 1, 1,  0,  1,  0, 0,  0, 0,  0,  0, 0, 0 },
+    { HAL_PIXEL_FORMAT_YV12,                          3, 1, 1, 16, 0,  1,  0, 0,  0, 2, 16,  1, 1, 0 },
+    { HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_P,            3, 1, 1, 16, 0,  1,  0, 0,  0, 2, 16,  1, 1, 0 },
+    { HAL_PIXEL_FORMAT_YCrCb_420_SP,                  2, 1, 1, 1,  0,  1,  0, 0, 16, 1,  1,  1, 1, 0 },
+    { HAL_PIXEL_FORMAT_EXYNOS_YV12_M,                 3, 0, 1, 32, 0, 16,  0, 0,  0, 2, 16,  1, 1, 0 },
+    { HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_P_M,          3, 0, 1, 32, 0, 16,  0, 0,  0, 2, 16,  1, 1, 0 },
+    { HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_TILED,   2, 0, 1, 16, 0, 32,  0, 0,  0, 1,  1, 32, 1, 1 },
+    { HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M,         2, 0, 1, 16, 0, 16,  0, 0,  0, 1,  1,  8, 1, 0 },
+    { HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M_FULL,    2, 0, 1, 16, 0, 16,  0, 0,  0, 1,  1,  8, 1, 0 },
+    { HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M,         2, 0, 1, 16, 0, 16,  0, 0,  0, 1,  1,  8, 1, 0 },
+    { HAL_PIXEL_FORMAT_YCbCr_422_I,                   1, 0, 2, 16, 0,  1,  0, 0,  0, 0,  0,  0, 1, 0 },
+};
+
+/*
+ * V4L2_PIX_FMT_NV12MT_16X16, the camera's NV12M in 16x16 tiles. gralloc
+ * does not allocate it, so it is kept out of the table; the camera HAL sizes
+ * its own buffers from it. Each plane holds whole tiles.
+ */
+static const struct exynos_format_layout exynos_nv12mt_16x16_layout =
+    /* format                                    planes contig bpp stride pitch vstride enc rows sizerows cdiv calign crows pad tiled */
+    { 0,                                              2, 0, 1, 16, 0, 16,  0, 0,  0, 1,  1, 16, 0, 1 };
+
+static inline int exynos_layout_align(int value, int align)
+{
+    return align > 1 ? (value + align - 1) / align * align : value;
+}
+
+/* Returns the layout rules of format, or NULL if gralloc does not allocate it. */
+static inline const struct exynos_format_layout *exynos_format_layout_find(int format)
+{
+    for (size_t i = 0; i < sizeof(exynos_format_layouts) / sizeof(exynos_format_layouts[0]); i++)
+        if (exynos_format_layouts[i].format == format)
+            return &exynos_format_layouts[i];
+    return NULL;
+}
+
+/*
+ * Fills in the plane geometry of a w x h buffer, aligned for the video
+ * encoder if encoder is set. A non-zero stride or vstride in planes is kept
+ * instead of being derived from w and h.
+ */
+static inline void exynos_format_plane_layout(const struct exynos_format_layout *layout,
+                                              int w, int h, int encoder,
+                                              struct exynos_plane_layout *planes)
+{
+    int stride_align = layout->stride_align;
+    int pitch_align = layout->pitch_align;
+    int vstride_align = layout->vstride_align;
+    int rows;
+
+    if (encoder && layout->encoder_align) {
+        stride_align = vstride_align = layout->encoder_align;
+        pitch_align = 0;
+    }
+
+    if (!planes->stride) {
+        if (pitch_align)
+            planes->stride = exynos_layout_align(w * layout->bpp, pitch_align) / layout->bpp;
+        else
+            planes->stride = exynos_layout_align(w, stride_align);
+    }
+    if (!planes->vstride)
+        planes->vstride = exynos_layout_align(h, vstride_align);
+
+    planes->luma_pitch = exynos_layout_align(planes->stride * layout->bpp, pitch_align);
+
+    rows = planes->vstride;
+    if (layout->size_rows_align)
+        rows = exynos_layout_align(rows, layout->size_rows_align);
+    if (rows < h + layout->extra_rows)
+        rows = h + layout->extra_rows;
+    planes->luma_size = (size_t)planes->luma_pitch * rows;
+
+    planes->chroma_pitch = 0;
+    planes->chroma_size = 0;
+
+    if (layout->planes > 1) {
+        int chroma_rows = layout->size_rows_align ? rows : planes->vstride;
+
+        planes->chroma_pitch = exynos_layout_align(planes->stride / layout->chroma_pitch_div,
+                                                   layout->chroma_pitch_align);
+        planes->chroma_size = (size_t)planes->chroma_pitch *
+                              exynos_layout_align((chroma_rows + 1) / 2,
+                                                  layout->chroma_rows_align);
+    }
+}
+
+/* Bytes of the buffer that holds the luma plane, with its ext pad. */
+static inline size_t exynos_format_buffer_size(const struct exynos_format_layout *layout,
+                                               const struct exynos_plane_layout *planes)
+{
+    size_t size = planes->luma_size;
+
+    if (layout->contiguous)
+        size += planes->chroma_size * (layout->planes - 1);
+    return size + (layout->ext_pad ? EXYNOS_LAYOUT_EXT_SIZE : 0);
+}
+
+/* Bytes of each separate chroma buffer, with its ext pad; 0 if there is none. */
+static inline size_t exynos_format_chroma_buffer_size(const struct exynos_format_layout *layout,
+                                                      const struct exynos_plane_layout *planes)
+{
+    if (layout->planes == 1 || layout->contiguous)
+        return 0;
+    return planes->chroma_size + (layout->ext_pad ? EXYNOS_LAYOUT_EXT_SIZE : 0);
+}
+
+#endif /* _EXYNOS_FORMAT_LAYOUT_H_ */
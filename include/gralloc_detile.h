@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GRALLOC_DETILE_H_
+#define _GRALLOC_DETILE_H_
+
+#include "gralloc_priv.h"
+
+/*
+ * De-tiles the planes of a mapped 64x32 tiled buffer into linear copies and
+ * returns them in vaddr[0] and vaddr[1]. Returns a negative error if the
+ * buffer can not be presented linearly.
+ */
+int gralloc_detile_lock(private_handle_t *hnd, void **vaddr);
+/* Frees the linear copies of hnd. */
+void gralloc_detile_release(private_handle_t *hnd);
+
+#endif /* _GRALLOC_DETILE_H_ */
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GRALLOC_FB_COPY_H_
+#define _GRALLOC_FB_COPY_H_
+
+#include <stddef.h>
+
+/* Selects the backend used to copy posted buffers to the framebuffer. */
+void gralloc_fb_copy_init(void);
+/* Selects a backend by name, "stripe" or "memcpy"; -EINVAL if unknown. */
+int gralloc_fb_copy_select(const char *name);
+/* Copies len bytes from src to dst with the selected backend. */
+void gralloc_fb_copy(void *dst, const void *src, size_t len);
+
+#endif /* _GRALLOC_FB_COPY_H_ */
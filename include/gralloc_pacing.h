@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GRALLOC_PACING_H_
+#define _GRALLOC_PACING_H_
+
+#include <stdint.h>
+
+/* Resets the pacing state for a display refreshing at fps. */
+void gralloc_pacing_init(float fps);
+/* Records a vsync at timestamp (CLOCK_MONOTONIC, ns). */
+void gralloc_pacing_vsync(int64_t timestamp);
+/* Returns the predicted time of the first vsync after now. */
+int64_t gralloc_pacing_next_vsync(int64_t now);
+/* Delays a post so that it completes just before the next vsync it can make. */
+void gralloc_pacing_wait(void);
+/* Records a post that ran from start to end. */
+void gralloc_pacing_post_done(int64_t start, int64_t end);
+/* Writes the pacing statistics to buff. */
+void gralloc_pacing_dump(char *buff, int buff_len);
+/* Returns the CLOCK_MONOTONIC time in ns. */
+int64_t gralloc_pacing_now(void);
+
+#endif /* _GRALLOC_PACING_H_ */
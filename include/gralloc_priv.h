@@ -100,6 +100,16 @@ struct private_handle_t {
     ion_user_handle_t handle1;
     ion_user_handle_t handle2;
 
+    // new fields go below this point, prebuilt readers rely on the offsets above
+    // plane offsets within fd when all planes share one allocation, 0 otherwise
+    int     plane_offset1;
+    int     plane_offset2;
+
+    // per-process mapping state, initialized by gralloc_register_buffer
+    int     chroma_size;
+    int     lock_usage;
+    int     lock_count;
+
 #ifdef __cplusplus
     static const int sNumFds = 3;
     static const int sNumInts = 34;
@@ -109,7 +119,8 @@ struct private_handle_t {
         fd(fd), fd1(-1), fd2(-1), magic(sMagic), flags(flags), size(size),
         offset(0), format(0), width(0), height(0), stride(0),
         vstride(0), base(0), base1(0), base2(0), handle(0), handle1(0),
-        handle2(0)
+        handle2(0), plane_offset1(0), plane_offset2(0), chroma_size(0),
+        lock_usage(0), lock_count(0)
     {
         version = sizeof(native_handle);
         numInts = sNumInts + 2;
@@ -121,7 +132,8 @@ struct private_handle_t {
         fd(fd), fd1(-1), fd2(-1), magic(sMagic), flags(flags), size(size),
         offset(0), format(format), width(w), height(h), stride(stride),
         vstride(vstride), base(0), base1(0), base2(0), handle(0), handle1(0),
-        handle2(0)
+        handle2(0), plane_offset1(0), plane_offset2(0), chroma_size(0),
+        lock_usage(0), lock_count(0)
     {
         version = sizeof(native_handle);
         numInts = sNumInts + 2;
@@ -133,7 +145,8 @@ struct private_handle_t {
         fd(fd), fd1(fd1), fd2(-1), magic(sMagic), flags(flags), size(size),
         offset(0), format(format), width(w), height(h), stride(stride),
         vstride(vstride), base(0), base1(0), base2(0), handle(0), handle1(0),
-        handle2(0)
+        handle2(0), plane_offset1(0), plane_offset2(0), chroma_size(0),
+        lock_usage(0), lock_count(0)
     {
         version = sizeof(native_handle);
         numInts = sNumInts + 1;
@@ -145,7 +158,8 @@ struct private_handle_t {
         fd(fd), fd1(fd1), fd2(fd2), magic(sMagic), flags(flags), size(size),
         offset(0), format(format), width(w), height(h), stride(stride),
         vstride(vstride), base(0), base1(0), base2(0), handle(0), handle1(0),
-        handle2(0)
+        handle2(0), plane_offset1(0), plane_offset2(0), chroma_size(0),
+        lock_usage(0), lock_count(0)
     {
         version = sizeof(native_handle);
         numInts = sNumInts;
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GRALLOC_STATS_H_
+#define _GRALLOC_STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum gralloc_stats_op {
+    GRALLOC_STATS_ALLOC,
+    GRALLOC_STATS_FREE,
+    GRALLOC_STATS_REGISTER,
+    GRALLOC_STATS_UNREGISTER,
+    GRALLOC_STATS_LOCK,
+    GRALLOC_STATS_UNLOCK,
+    GRALLOC_STATS_NUM_OPS,
+};
+
+/* Returns a start time for gralloc_stats_end(). */
+int64_t gralloc_stats_begin(void);
+/* Records one op that started at start. */
+void gralloc_stats_end(enum gralloc_stats_op op, int64_t start);
+/* Tracks the fds owned by the allocator; delta may be negative. */
+void gralloc_stats_fds(int delta);
+/* Tracks the bytes mapped by this process; delta may be negative. */
+void gralloc_stats_mapped(ssize_t delta);
+/* Writes the statistics to buff. */
+void gralloc_stats_dump(char *buff, int buff_len);
+/* Reads the current and peak fd and mapped byte counts. */
+void gralloc_stats_counts(int *fds, int *peak_fds, int64_t *mapped, int64_t *peak_mapped);
+/* Clears the op statistics and restarts the peaks from the current counts. */
+void gralloc_stats_reset(void);
+
+#endif /* _GRALLOC_STATS_H_ */
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GRALLOC_TILED_H_
+#define _GRALLOC_TILED_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * 64x32 byte tiles of HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_TILED planes,
+ * stored in the MFC "Z-flip-Z" order: pairs of tile rows are laid out in
+ * groups of four tiles that alternate between a Z and a flipped Z. A last
+ * unpaired tile row is stored linearly.
+ */
+#define GRALLOC_TILE_W      64
+#define GRALLOC_TILE_H      32
+#define GRALLOC_TILE_SIZE   (GRALLOC_TILE_W * GRALLOC_TILE_H)
+
+/* Byte offset of tile (x, y) in a plane x_tiles wide and y_tiles high. */
+static inline size_t gralloc_tile_offset(int x, int y, int x_tiles, int y_tiles)
+{
+    size_t index = (y & ~1) * x_tiles + x;
+
+    if (y & 1)
+        index += (x & ~3) + 2;
+    else if (!(y_tiles & 1) || y != y_tiles - 1)
+        index += (x + 2) & ~3;
+
+    return index * GRALLOC_TILE_SIZE;
+}
+
+/*
+ * De-tiles the top-left width x height bytes of a plane into dst, which
+ * has a pitch of pitch bytes. Large planes are split by tile rows across
+ * several threads.
+ */
+void gralloc_detile_plane(uint8_t *dst, const uint8_t *src, int pitch,
+                          int width, int height, int x_tiles, int y_tiles);
+
+#endif /* _GRALLOC_TILED_H_ */
@@ -5975,6 +5975,12 @@ bool ExynosCamera::yuv2Jpeg(ExynosBuffer *yuvBuf,
         goto jpeg_encode_done;
     }
 
+    /* lower the quality rather than overflow the picture buffer */
+    if (jpegEnc.setTargetSize(jpegBuf->size.extS[0] + jpegBuf->size.extS[1] + jpegBuf->size.extS[2])) {
+        CLOGE("ERR(%s):jpegEnc.setTargetSize() fail", __func__);
+        goto jpeg_encode_done;
+    }
+
     if (jpegEnc.encode((int *)&jpegBuf->size.s, &mExifInfo)) {
         CLOGE("ERR(%s):jpegEnc.encode() fail", __func__);
         goto jpeg_encode_done;
@@ -22,6 +22,7 @@
 #include "ExynosCameraParameters.h"
 #include "ExynosCameraHWImpl.h"
 #include "exynos_format.h"
+#include "exynos_format_layout.h"
 
 #define VIDEO_COMMENT_MARKER_H          (0xFFBE)
 #define VIDEO_COMMENT_MARKER_L          (0xFFBF)
@@ -6749,11 +6750,20 @@ int ExynosCameraHWImpl::m_getAlignedYUVSize(int colorFormat, int w, int h, Exyno
         buf->size.extS[2] = 0;
         break;
     // 2p
+    case V4L2_PIX_FMT_NV12M :
+    case V4L2_PIX_FMT_NV21M :
+        if (flagAndroidColorFormat == true) {
+            buf->size.extS[0] = w * h;
+            buf->size.extS[1] = w * h / 2;
+            buf->size.extS[2] = 0;
+        } else if (m_getLayoutYUVSize(colorFormat, w, h, buf) == false) {
+            return 0;
+        }
+        CLOGV("V4L2_PIX_FMT_NV21M buf->size.extS[0] %d buf->size.extS[1] %d", buf->size.extS[0], buf->size.extS[1]);
+        break;
     case V4L2_PIX_FMT_NV12 :
     case V4L2_PIX_FMT_NV12T :
     case V4L2_PIX_FMT_NV21 :
-    case V4L2_PIX_FMT_NV12M :
-    case V4L2_PIX_FMT_NV21M :
         if (flagAndroidColorFormat == true) {
             buf->size.extS[0] = w * h;
             buf->size.extS[1] = w * h / 2;
@@ -6770,12 +6780,10 @@ int ExynosCameraHWImpl::m_getAlignedYUVSize(int colorFormat, int w, int h, Exyno
             buf->size.extS[0] = w * h;
             buf->size.extS[1] = w * h / 2;
             buf->size.extS[2] = 0;
-        } else {
-            buf->size.extS[0] = ALIGN_UP(w, 16) * ALIGN_UP(h, 16);
-            buf->size.extS[1] = ALIGN(buf->size.extS[0] / 2, 256);
-            buf->size.extS[2] = 0;
+        } else if (m_getLayoutYUVSize(colorFormat, w, h, buf) == false) {
+            return 0;
         }
-        CLOGV("V4L2_PIX_FMT_NV12M buf->size.extS[0] %d buf->size.extS[1] %d", buf->size.extS[0], buf->size.extS[1]);
+        CLOGV("V4L2_PIX_FMT_NV12MT_16X16 buf->size.extS[0] %d buf->size.extS[1] %d", buf->size.extS[0], buf->size.extS[1]);
         break;
     case V4L2_PIX_FMT_NV16 :
     case V4L2_PIX_FMT_NV61 :
@@ -6805,10 +6813,8 @@ int ExynosCameraHWImpl::m_getAlignedYUVSize(int colorFormat, int w, int h, Exyno
             buf->size.extS[0] = ALIGN_UP(w, 16) * h;
             buf->size.extS[1] = ALIGN_UP(w / 2, 16) * h / 2;
             buf->size.extS[2] = ALIGN_UP(w / 2, 16) * h / 2;
-        } else {
-            buf->size.extS[0] = ALIGN_UP(w,   32) * ALIGN_UP(h,  16);
-            buf->size.extS[1] = ALIGN_UP(w/2, 16) * ALIGN_UP(h/2, 8);
-            buf->size.extS[2] = ALIGN_UP(w/2, 16) * ALIGN_UP(h/2, 8);
+        } else if (m_getLayoutYUVSize(colorFormat, w, h, buf) == false) {
+            return 0;
         }
         CLOGV("V4L2_PIX_FMT_YUV420M buf->size.extS[0] %d buf->size.extS[1] %d buf->size.extS[2] %d", buf->size.extS[0], buf->size.extS[1], buf->size.extS[2]);
         break;
@@ -6839,6 +6845,33 @@ int ExynosCameraHWImpl::m_getAlignedYUVSize(int colorFormat, int w, int h, Exyno
     return FrameSize;
 }
 
+/* Sizes the planes the way gralloc allocates them for the same format. */
+bool ExynosCameraHWImpl::m_getLayoutYUVSize(int colorFormat, int w, int h, ExynosBuffer *buf)
+{
+    const struct exynos_format_layout *layout;
+    struct exynos_plane_layout planes;
+
+    /* its HAL format is the 64x32 tiled one, which has other alignments */
+    if (colorFormat == V4L2_PIX_FMT_NV12MT_16X16)
+        layout = &exynos_nv12mt_16x16_layout;
+    else
+        layout = exynos_format_layout_find(V4L2_PIX_2_HAL_PIXEL_FORMAT(colorFormat));
+
+    if (layout == NULL) {
+        CLOGE("ERR(%s):no plane layout for colorFormat(%d)", __func__, colorFormat);
+        return false;
+    }
+
+    memset(&planes, 0, sizeof(planes));
+    exynos_format_plane_layout(layout, w, h, 0, &planes);
+
+    buf->size.extS[0] = planes.luma_size;
+    buf->size.extS[1] = planes.chroma_size;
+    buf->size.extS[2] = layout->planes == 3 ? planes.chroma_size : 0;
+
+    return true;
+}
+
 bool ExynosCameraHWImpl::m_getSupportedFpsList(String8 & string8Buf, int min, int max)
 {
     bool ret = false;
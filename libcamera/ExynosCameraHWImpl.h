@@ -365,6 +365,7 @@ private:
     bool        m_isSupportedVideoSize(const int width, const int height) const;
 
     int         m_getAlignedYUVSize(int colorFormat, int w, int h, ExynosBuffer *buf, bool flagAndroidColorFormat = false);
+    bool        m_getLayoutYUVSize(int colorFormat, int w, int h, ExynosBuffer *buf);
 
     bool        m_getSupportedFpsList(String8 & string8Buf, int min, int max);
     bool        m_getSupportedVariableFpsList(int min, int max, int *newMin, int *newMax);
@@ -32,6 +32,40 @@ static const char ExifAsciiPrefix[] = { 0x41, 0x53, 0x43, 0x49, 0x49, 0x0, 0x0,
 #define MAX_INPUT_BUFFER_PLANE_NUM (3)
 #define MAX_OUTPUT_BUFFER_PLANE_NUM (1)
 
+/* luma sampling grid and fallback value of estimateLumaActivity() */
+#define LUMA_ACTIVITY_ROW_STEP (8)
+#define LUMA_ACTIVITY_COL_STEP (4)
+#define LUMA_ACTIVITY_DEFAULT (12)
+
+/*
+ * Size model of each H/W quality level, best first. The predicted size is
+ * width * height * (bppBase + bppSlope * luma activity) / 8000 bytes.
+ * The figures are rough estimates, not yet calibrated against the H/W
+ * encoder; the re-encode in encodeToTargetSize() absorbs the error.
+ */
+struct jpeg_size_model {
+    int quality;    /* setQuality() value selecting the level */
+    int bppBase;    /* 1/1000 bits per pixel of a flat image */
+    int bppSlope;   /* 1/1000 bits per pixel per unit of luma activity */
+};
+
+static const jpeg_size_model JpegSizeModel[] = {
+    { 96, 800, 220 },
+    { 92, 600, 150 },
+    { 38, 350,  85 },
+    { 30, 250,  60 },
+    {  1, 200,  45 },
+};
+
+#define JPEG_SIZE_MODEL_NUM (int)(sizeof(JpegSizeModel) / sizeof(JpegSizeModel[0]))
+
+static int predictJpegSize(int level, int width, int height, int activity)
+{
+    long long bpp = JpegSizeModel[level].bppBase + JpegSizeModel[level].bppSlope * activity;
+
+    return (int)(((long long)width * height * bpp) / 8000);
+}
+
 ExynosJpegEncoderForCamera::ExynosJpegEncoderForCamera()
 {
     m_flagCreate = false;
@@ -42,6 +76,11 @@ ExynosJpegEncoderForCamera::ExynosJpegEncoderForCamera()
     m_thumbnailQuality = JPEG_THUMBNAIL_QUALITY;
     m_exynosThumbCSC = NULL;
     m_ionJpegClient = 0;
+    m_quality = 100;
+    m_targetSize = 0;
+    m_encodedSize = 0;
+    m_encodedQuality = 0;
+    m_encodeCount = 0;
     memset(&m_stThumbInBuf, 0, sizeof(m_stThumbInBuf));
     memset(&m_stThumbOutBuf, 0, sizeof(m_stThumbOutBuf));
     initJpegMemory(&m_stThumbInBuf, MAX_IMAGE_PLANE_NUM);
@@ -123,6 +162,8 @@ int ExynosJpegEncoderForCamera::destroy(void)
     m_thumbnailW = 0;
     m_thumbnailH = 0;
     m_thumbnailQuality = JPEG_THUMBNAIL_QUALITY;
+    m_quality = 100;
+    m_targetSize = 0;
     return ERROR_NONE;
 }
 
@@ -140,7 +181,11 @@ int ExynosJpegEncoderForCamera::setQuality(int quality)
     if (m_flagCreate == false)
         return ERROR_NOT_YET_CREATED;
 
-    return m_jpegMain->setQuality(quality);
+    int ret = m_jpegMain->setQuality(quality);
+    if (ret == ERROR_NONE)
+        m_quality = quality;
+
+    return ret;
 }
 
 int ExynosJpegEncoderForCamera::setColorFormat(int colorFormat)
@@ -262,7 +307,22 @@ int ExynosJpegEncoderForCamera::encode(int *size, exif_attribute_t *exifInfo)
     if (m_flagCreate == false)
         return ERROR_NOT_YET_CREATED;
 
-    ret = m_jpegMain->encode();
+    m_encodedSize = 0;
+    m_encodeCount = 0;
+
+    if (m_targetSize > 0) {
+        int budget = m_targetSize;
+
+        /* leave room for the APP1 segment inserted below */
+        if (exifInfo != NULL)
+            budget -= (exifInfo->enableThumb) ? EXIF_LIMIT_SIZE : EXIF_INFO_LIMIT_SIZE;
+
+        ret = encodeToTargetSize(budget);
+    } else {
+        /* a previous target-size encode may have left another quality set */
+        ret = encodeWithQuality(m_quality);
+    }
+
     if (ret) {
         ALOGE("encode failed");
         return ret;
@@ -376,10 +436,197 @@ int ExynosJpegEncoderForCamera::encode(int *size, exif_attribute_t *exifInfo)
         unmapJpegMemory(&iJpegBuffer, &pcJpegBuffer, &iOutputSize, MAX_OUTPUT_BUFFER_PLANE_NUM);
 
     *size = iJpegSize;
+    m_encodedSize = iJpegSize;
+
+    return ERROR_NONE;
+}
+
+int ExynosJpegEncoderForCamera::setTargetSize(int targetSize)
+{
+    if (m_flagCreate == false)
+        return ERROR_NOT_YET_CREATED;
+
+    if (targetSize < 0)
+        return ERROR_BUFFER_TOO_SMALL;
+
+    m_targetSize = targetSize;
+    return ERROR_NONE;
+}
+
+void ExynosJpegEncoderForCamera::getEncodeResult(int *size, int *quality, int *encodeCount)
+{
+    if (size != NULL)
+        *size = m_encodedSize;
+    if (quality != NULL)
+        *quality = m_encodedQuality;
+    if (encodeCount != NULL)
+        *encodeCount = m_encodeCount;
+}
+
+int ExynosJpegEncoderForCamera::encodeWithQuality(int quality)
+{
+    int ret = ERROR_NONE;
+
+    ret = m_jpegMain->setQuality(quality);
+    if (ret) {
+        ALOGE("ERR(%s):Fail setQuality(%d)", __func__, quality);
+        return ret;
+    }
+
+    ret = m_jpegMain->updateQuality();
+    if (ret) {
+        ALOGE("ERR(%s):Fail updateQuality(%d)", __func__, quality);
+        return ret;
+    }
+
+    m_encodedQuality = quality;
+    m_encodeCount++;
+
+    return m_jpegMain->encode();
+}
+
+/*
+ * Picks the best quality level predicted to fit in budget and encodes with it.
+ * If the result still overflows, the model is rescaled by the measured size
+ * and the frame is encoded once more on the same device and buffers. Fails
+ * with ERROR_OUT_BUFFER_SIZE_TOO_SMALL if even that does not fit.
+ */
+int ExynosJpegEncoderForCamera::encodeToTargetSize(int budget)
+{
+    int ret = ERROR_NONE;
+    int width = 0;
+    int height = 0;
+    int level = 0;
+    int last = JPEG_SIZE_MODEL_NUM - 1;
+
+    ret = m_jpegMain->getSize(&width, &height);
+    if (ret) {
+        ALOGE("ERR(%s):Fail getSize", __func__);
+        return ret;
+    }
+
+    int activity = estimateLumaActivity();
+
+    /* the quality set by the caller is the upper bound */
+    while (level < last && m_quality < JpegSizeModel[level].quality)
+        level++;
+
+    while (level < last && predictJpegSize(level, width, height, activity) > budget)
+        level++;
+
+    ret = encodeWithQuality(JpegSizeModel[level].quality);
+    if (ret)
+        return ret;
+
+    int jpegSize = m_jpegMain->getJpegSize();
+    if (jpegSize > budget && level < last) {
+        long long predicted = predictJpegSize(level, width, height, activity);
+
+        if (predicted <= 0)
+            predicted = 1;
+
+        do {
+            level++;
+        } while (level < last &&
+                 predictJpegSize(level, width, height, activity) * (long long)jpegSize / predicted > budget);
+
+        ALOGD("DEBUG(%s):size(%d) over budget(%d), re-encode with quality(%d)",
+            __func__, jpegSize, budget, JpegSizeModel[level].quality);
+
+        ret = encodeWithQuality(JpegSizeModel[level].quality);
+        if (ret)
+            return ret;
+
+        jpegSize = m_jpegMain->getJpegSize();
+    }
+
+    if (jpegSize > budget) {
+        ALOGE("ERR(%s):size(%d) over budget(%d) with quality(%d)",
+            __func__, jpegSize, budget, m_encodedQuality);
+        return ERROR_OUT_BUFFER_SIZE_TOO_SMALL;
+    }
 
     return ERROR_NONE;
 }
 
+/*
+ * Mean absolute horizontal and vertical luma difference over a sparse grid
+ * of the main input image, used as a cheap predictor of the encoded size.
+ */
+int ExynosJpegEncoderForCamera::estimateLumaActivity(void)
+{
+    int width = 0;
+    int height = 0;
+    int pixelStep = 0;
+    int iInputBuf[MAX_INPUT_BUFFER_PLANE_NUM] = {0,};
+    char *pcInputBuf[MAX_INPUT_BUFFER_PLANE_NUM] = {NULL,};
+    int iInputSize[MAX_INPUT_BUFFER_PLANE_NUM] = {0,};
+    int ret = ERROR_NONE;
+
+    switch (m_jpegMain->getColorFormat()) {
+    case V4L2_PIX_FMT_YUYV:
+        pixelStep = 2;
+        break;
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_NV16:
+    case V4L2_PIX_FMT_YUV420:
+        pixelStep = 1;
+        break;
+    default:
+        return LUMA_ACTIVITY_DEFAULT;
+    }
+
+    if (m_jpegMain->getSize(&width, &height) || width < 2 || height < 2)
+        return LUMA_ACTIVITY_DEFAULT;
+
+    if (m_jpegMain->checkInBufType() & JPEG_BUF_TYPE_USER_PTR)
+        ret = m_jpegMain->getInBuf(pcInputBuf, iInputSize, MAX_INPUT_BUFFER_PLANE_NUM);
+    else if (m_jpegMain->checkInBufType() & JPEG_BUF_TYPE_DMA_BUF)
+        ret = m_jpegMain->getInBuf(iInputBuf, iInputSize, MAX_INPUT_BUFFER_PLANE_NUM);
+    else
+        return LUMA_ACTIVITY_DEFAULT;
+
+    if (ret)
+        return LUMA_ACTIVITY_DEFAULT;
+
+    if (iInputSize[0] < width * height * pixelStep)
+        return LUMA_ACTIVITY_DEFAULT;
+
+    /* only the luma plane is read */
+    if (m_jpegMain->checkInBufType() & JPEG_BUF_TYPE_DMA_BUF) {
+        if (mmapJpegMemory(iInputBuf, pcInputBuf, iInputSize, 1) == false) {
+            unmapJpegMemory(iInputBuf, pcInputBuf, iInputSize, 1);
+            return LUMA_ACTIVITY_DEFAULT;
+        }
+    }
+
+    const unsigned char *luma = (const unsigned char *)pcInputBuf[0];
+    int lineSize = width * pixelStep;
+    unsigned long long sum = 0;
+    unsigned int count = 0;
+
+    for (int y = 0; y + 1 < height; y += LUMA_ACTIVITY_ROW_STEP) {
+        const unsigned char *cur = luma + y * lineSize;
+        const unsigned char *next = cur + lineSize;
+
+        for (int x = 0; x + 1 < width; x += LUMA_ACTIVITY_COL_STEP) {
+            int p = cur[x * pixelStep];
+
+            sum += abs(p - cur[(x + 1) * pixelStep]) + abs(p - next[x * pixelStep]);
+            count += 2;
+        }
+    }
+
+    if (m_jpegMain->checkInBufType() & JPEG_BUF_TYPE_DMA_BUF)
+        unmapJpegMemory(iInputBuf, pcInputBuf, iInputSize, 1);
+
+    if (count == 0)
+        return LUMA_ACTIVITY_DEFAULT;
+
+    return (int)(sum / count);
+}
+
 int ExynosJpegEncoderForCamera::makeExif (unsigned char *exifOut,
                               exif_attribute_t *exifInfo,
                               unsigned int *size,
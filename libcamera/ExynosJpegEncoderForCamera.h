@@ -104,6 +104,10 @@ public :
     void    setInBufType(int sel);
     int     getInBufType(void);
 
+    /* size control: 0 disables, otherwise the byte budget of the output file */
+    int     setTargetSize(int targetSize);
+    void    getEncodeResult(int *size, int *quality, int *encodeCount);
+
 private:
     inline void writeExifIfd(unsigned char **pCur,
                                          unsigned short tag,
@@ -138,6 +142,11 @@ private:
     // thumbnail
     int     encodeThumbnail(unsigned int *size, bool useMain = true);
 
+    // size control
+    int     encodeWithQuality(int quality);
+    int     encodeToTargetSize(int budget);
+    int     estimateLumaActivity(void);
+
     struct stJpegMem {
         ion_client ionClient;
         ion_buffer ionBuffer[MAX_IMAGE_PLANE_NUM];
@@ -167,6 +176,12 @@ private:
     int m_thumbnailH;
     int m_thumbnailQuality;
     void *m_exynosThumbCSC;
+
+    int m_quality;
+    int m_targetSize;
+    int m_encodedSize;
+    int m_encodedQuality;
+    int m_encodeCount;
 };
 
 #endif /* __SEC_JPG_ENC_H__ */
@@ -35,10 +35,13 @@ LOCAL_ADDITIONAL_DEPENDENCIES += \
 	$(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
 
 LOCAL_SRC_FILES := \
-	ExynosPrimaryDisplay.cpp
+	ExynosPrimaryDisplay.cpp \
+	ExynosCompositionPlanner.cpp
 
 LOCAL_MODULE_TAGS := eng
 LOCAL_MODULE := libdisplaymodule
 include $(BUILD_SHARED_LIBRARY)
 
+include $(LOCAL_PATH)/tests/Android.mk
+
 endif
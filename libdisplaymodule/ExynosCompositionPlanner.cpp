@@ -0,0 +1,396 @@
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include "ExynosCompositionPlanner.h"
+#include "gralloc_priv.h"
+#include "exynos_format.h"
+
+#define GSC_MAX_DOWNSCALE   16
+#define GSC_MAX_UPSCALE     8
+
+enum {
+    RUN_NONE = 0,
+    RUN_OPEN,
+    RUN_CLOSED,
+};
+
+#ifdef DUAL_VIDEO_OVERLAY_SUPPORT
+static const int NUM_FIMD_GSC = sizeof(FIMD_GSC_USAGE_IDX) / sizeof(FIMD_GSC_USAGE_IDX[0]);
+#else
+static const int NUM_FIMD_GSC = 1;
+#endif
+
+/* Bytes per pixel, times two so that 4:2:0 formats stay integral. */
+static int formatBytesX2(int format)
+{
+    switch (format) {
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+    case HAL_PIXEL_FORMAT_BGRA_8888:
+    case HAL_PIXEL_FORMAT_EXYNOS_ARGB_8888:
+        return 8;
+    case HAL_PIXEL_FORMAT_RGB_888:
+        return 6;
+    case HAL_PIXEL_FORMAT_RGB_565:
+    case HAL_PIXEL_FORMAT_YCbCr_422_I:
+        return 4;
+    default:
+        return 3;
+    }
+}
+
+static inline int rectArea(const hwc_rect_t &r)
+{
+    return (r.right - r.left) * (r.bottom - r.top);
+}
+
+static inline uint32_t hashWord(uint32_t hash, uint32_t word)
+{
+    /* FNV-1a, one word at a time */
+    return (hash ^ word) * 16777619U;
+}
+
+ExynosCompositionPlanner::ExynosCompositionPlanner() :
+    mGeometryHash(0),
+    mNumHwLayers(0),
+    mPlanValid(false),
+    mXres(0),
+    mYres(0),
+    mCacheHits(0),
+    mSearches(0)
+{
+    mPlan.fbWindow = -1;
+    mPlan.numGles = 0;
+    mPlan.bandwidth = 0;
+    memset(mMaxBw, 0, sizeof(mMaxBw));
+    memset(mMaxOverlap, 0, sizeof(mMaxOverlap));
+}
+
+ExynosCompositionPlanner::~ExynosCompositionPlanner()
+{
+}
+
+uint32_t ExynosCompositionPlanner::hashGeometry(hwc_display_contents_1_t *contents,
+        int xres, int yres)
+{
+    uint32_t hash = hashWord(2166136261U, contents->numHwLayers);
+
+    hash = hashWord(hash, xres);
+    hash = hashWord(hash, yres);
+    for (size_t i = 0; i < contents->numHwLayers; i++) {
+        hwc_layer_1_t &layer = contents->hwLayers[i];
+        private_handle_t *handle = private_handle_t::dynamicCast(layer.handle);
+
+        /* prepare rewrites the other types every frame */
+        hash = hashWord(hash, layer.compositionType == HWC_FRAMEBUFFER_TARGET);
+        hash = hashWord(hash, layer.flags);
+        hash = hashWord(hash, layer.transform);
+        hash = hashWord(hash, layer.blending);
+        hash = hashWord(hash, layer.planeAlpha);
+        hash = hashWord(hash, (uint32_t)layer.sourceCropf.left);
+        hash = hashWord(hash, (uint32_t)layer.sourceCropf.top);
+        hash = hashWord(hash, (uint32_t)layer.sourceCropf.right);
+        hash = hashWord(hash, (uint32_t)layer.sourceCropf.bottom);
+        hash = hashWord(hash, layer.displayFrame.left);
+        hash = hashWord(hash, layer.displayFrame.top);
+        hash = hashWord(hash, layer.displayFrame.right);
+        hash = hashWord(hash, layer.displayFrame.bottom);
+        hash = hashWord(hash, handle ? handle->format : 0);
+        hash = hashWord(hash, handle ? (handle->flags & GRALLOC_USAGE_PROTECTED) : 0);
+    }
+
+    return hash;
+}
+
+void ExynosCompositionPlanner::describeLayers(hwc_display_contents_1_t *contents,
+        int xres, int yres)
+{
+    mLayers.clear();
+
+    for (size_t i = 0; i < contents->numHwLayers; i++) {
+        hwc_layer_1_t &layer = contents->hwLayers[i];
+        private_handle_t *handle = private_handle_t::dynamicCast(layer.handle);
+        LayerInfo info;
+
+        if (layer.compositionType == HWC_FRAMEBUFFER_TARGET)
+            break;
+
+        int srcW = (int)(layer.sourceCropf.right - layer.sourceCropf.left);
+        int srcH = (int)(layer.sourceCropf.bottom - layer.sourceCropf.top);
+        int dstW = layer.displayFrame.right - layer.displayFrame.left;
+        int dstH = layer.displayFrame.bottom - layer.displayFrame.top;
+        bool onScreen = layer.displayFrame.left >= 0 && layer.displayFrame.top >= 0 &&
+                        layer.displayFrame.right <= xres && layer.displayFrame.bottom <= yres &&
+                        dstW > 0 && dstH > 0;
+        bool usable = handle && !(layer.flags & HWC_SKIP_LAYER) && onScreen &&
+                      srcW > 0 && srcH > 0 &&
+                      halBlendingToSocBlending(layer.blending) != BLENDING_MAX;
+
+        info.frame = layer.displayFrame;
+        info.srcBytes = handle ? (uint64_t)srcW * srcH * formatBytesX2(handle->format) / 2 : 0;
+        info.dstBytes = usable ? (uint64_t)dstW * dstH * 4 : 0;
+        info.overlayOk = usable && !layer.transform && srcW == dstW && srcH == dstH &&
+                         halFormatToSocFormat(handle->format) != PIXEL_FORMAT_MAX;
+        info.gscOk = usable &&
+                     dstW * GSC_MAX_DOWNSCALE >= srcW && dstH * GSC_MAX_DOWNSCALE >= srcH &&
+                     srcW * GSC_MAX_UPSCALE >= dstW && srcH * GSC_MAX_UPSCALE >= dstH;
+        /* protected content can't be read back by the GPU */
+        info.glesOk = !handle || !(handle->flags & GRALLOC_USAGE_PROTECTED);
+
+        mLayers.add(info);
+    }
+}
+
+/* Checks the first count windows against the per DMA channel limits. */
+bool ExynosCompositionPlanner::checkDmaLimits(const hwc_rect_t *rects,
+        const int *windows, size_t count)
+{
+    uint64_t bw[MAX_NUM_FIMD_DMA_CH];
+
+    memset(bw, 0, sizeof(bw));
+    for (size_t i = 0; i < count; i++)
+        bw[FIMD_DMA_CH_IDX[windows[i]]] += rectArea(rects[i]);
+
+    for (size_t ch = 0; ch < MAX_NUM_FIMD_DMA_CH; ch++)
+        if (bw[ch] > mMaxBw[ch])
+            return false;
+
+    /* the deepest overlap starts at the top left corner of one of the rects */
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < count; j++) {
+            int x = rects[i].left;
+            int y = rects[j].top;
+            uint32_t depth[MAX_NUM_FIMD_DMA_CH];
+
+            memset(depth, 0, sizeof(depth));
+            for (size_t k = 0; k < count; k++) {
+                if (x >= rects[k].left && x < rects[k].right &&
+                    y >= rects[k].top && y < rects[k].bottom) {
+                    size_t ch = FIMD_DMA_CH_IDX[windows[k]];
+                    if (++depth[ch] > mMaxOverlap[ch])
+                        return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Gives units [unit, count), in z order, increasing windows from first on
+ * that satisfy the DMA channel limits. Windows may be skipped to move a
+ * unit to the other channel.
+ */
+bool ExynosCompositionPlanner::placeWindows(const hwc_rect_t *rects, size_t count,
+        int *windows, size_t unit, int first)
+{
+    if (unit == count)
+        return true;
+
+    for (int window = first; window + (count - unit) <= SOC_NUM_HW_WINDOWS; window++) {
+        windows[unit] = window;
+        if (checkDmaLimits(rects, windows, unit + 1) &&
+            placeWindows(rects, count, windows, unit + 1, window + 1))
+            return true;
+    }
+
+    return false;
+}
+
+bool ExynosCompositionPlanner::evaluate(const int *types, int *windows, uint64_t *bandwidth)
+{
+    hwc_rect_t rects[SOC_NUM_HW_WINDOWS];
+    int unitWindows[SOC_NUM_HW_WINDOWS];
+    int unitOf[SEARCH_MAX_LAYERS];
+    size_t units = 0;
+    int firstGles = -1, lastGles = -1;
+    uint64_t bytes = 0;
+
+    for (size_t i = 0; i < mLayers.size(); i++) {
+        if (types[i] == PLAN_GLES) {
+            if (firstGles < 0)
+                firstGles = i;
+            lastGles = i;
+        }
+    }
+
+    /* GLES layers are composed into one target, so they must be adjacent */
+    for (int i = firstGles; i >= 0 && i <= lastGles; i++) {
+        if (types[i] != PLAN_GLES)
+            return false;
+    }
+
+    for (size_t i = 0; i < mLayers.size(); i++) {
+        const LayerInfo &info = mLayers[i];
+
+        switch (types[i]) {
+        case PLAN_GLES:
+            bytes += info.srcBytes;
+            if ((int)i != firstGles) {
+                unitOf[i] = -1;
+                continue;
+            }
+            /* the target is a full screen window */
+            if (units == SOC_NUM_HW_WINDOWS)
+                return false;
+            rects[units].left = 0;
+            rects[units].top = 0;
+            rects[units].right = mXres;
+            rects[units].bottom = mYres;
+            bytes += (uint64_t)mXres * mYres * 4 * 2;
+            break;
+        case PLAN_OVERLAY:
+            bytes += info.srcBytes;
+            if (units == SOC_NUM_HW_WINDOWS)
+                return false;
+            rects[units] = info.frame;
+            break;
+        case PLAN_GSC:
+            bytes += info.srcBytes + info.dstBytes * 2;
+            if (units == SOC_NUM_HW_WINDOWS)
+                return false;
+            rects[units] = info.frame;
+            break;
+        }
+        unitOf[i] = units++;
+    }
+
+    if (units > SOC_NUM_HW_WINDOWS || !placeWindows(rects, units, unitWindows, 0, 0))
+        return false;
+
+    for (size_t i = 0; i < mLayers.size(); i++)
+        windows[i] = unitOf[i] >= 0 ? unitWindows[unitOf[i]] : -1;
+    if (firstGles >= 0)
+        windows[mLayers.size()] = unitWindows[unitOf[firstGles]];
+    else
+        windows[mLayers.size()] = -1;
+
+    *bandwidth = bytes;
+    return true;
+}
+
+/*
+ * Depth first over the layers in z order. hw counts the windows taken by
+ * overlay and GSC layers; run tracks the GLES layers seen so far, which
+ * have to stay adjacent (RUN_NONE, RUN_OPEN, RUN_CLOSED).
+ */
+void ExynosCompositionPlanner::search(SearchState *state, size_t index, int numGles,
+        int numGsc, int hw, int run)
+{
+    if (numGles > state->bestGles)
+        return;
+    if (hw + (numGles ? 1 : 0) > (int)SOC_NUM_HW_WINDOWS)
+        return;
+
+    if (index == mLayers.size()) {
+        int windows[SEARCH_MAX_LAYERS + 1];
+        uint64_t bandwidth;
+
+        if (!evaluate(state->types, windows, &bandwidth))
+            return;
+        if (state->found && numGles == state->bestGles && bandwidth >= state->bestBandwidth)
+            return;
+
+        memcpy(state->bestTypes, state->types, sizeof(state->types));
+        memcpy(state->bestWindows, windows, sizeof(windows));
+        state->bestGles = numGles;
+        state->bestBandwidth = bandwidth;
+        state->found = true;
+        return;
+    }
+
+    const LayerInfo &info = mLayers[index];
+    int hwRun = run == RUN_OPEN ? RUN_CLOSED : run;
+
+    if (info.overlayOk) {
+        state->types[index] = PLAN_OVERLAY;
+        search(state, index + 1, numGles, numGsc, hw + 1, hwRun);
+    }
+    if (info.gscOk && numGsc < NUM_FIMD_GSC) {
+        state->types[index] = PLAN_GSC;
+        search(state, index + 1, numGles, numGsc + 1, hw + 1, hwRun);
+    }
+    if (info.glesOk && run != RUN_CLOSED) {
+        state->types[index] = PLAN_GLES;
+        search(state, index + 1, numGles + 1, numGsc, hw, RUN_OPEN);
+    }
+}
+
+void ExynosCompositionPlanner::buildFallback(ExynosCompositionPlan *plan)
+{
+    plan->layers.clear();
+    for (size_t i = 0; i < mLayers.size(); i++) {
+        ExynosLayerPlan layer = { PLAN_GLES, -1, -1 };
+        plan->layers.add(layer);
+    }
+    plan->fbWindow = mLayers.size() ? 0 : -1;
+    plan->numGles = mLayers.size();
+    plan->bandwidth = 0;
+}
+
+const ExynosCompositionPlan *ExynosCompositionPlanner::plan(hwc_display_contents_1_t *contents,
+        int xres, int yres)
+{
+    uint32_t hash = hashGeometry(contents, xres, yres);
+
+    /* the hash alone can collide, so a flagged change always searches again */
+    if (mPlanValid && !(contents->flags & HWC_GEOMETRY_CHANGED) &&
+        contents->numHwLayers == mNumHwLayers && hash == mGeometryHash) {
+        mCacheHits++;
+        return &mPlan;
+    }
+
+    if (xres != mXres || yres != mYres) {
+        mXres = xres;
+        mYres = yres;
+#ifdef FIMD_BW_OVERLAP_CHECK
+        fimd_bw_overlap_limits_init(xres, yres, mMaxBw, mMaxOverlap);
+#else
+        for (size_t ch = 0; ch < MAX_NUM_FIMD_DMA_CH; ch++) {
+            mMaxBw[ch] = UINT32_MAX;
+            mMaxOverlap[ch] = UINT32_MAX;
+        }
+#endif
+    }
+
+    describeLayers(contents, xres, yres);
+    mSearches++;
+
+    if (mLayers.size() > SEARCH_MAX_LAYERS) {
+        ALOGV("%s: %u layers, composing all with GLES", __func__,
+              (unsigned int)mLayers.size());
+        buildFallback(&mPlan);
+    } else {
+        SearchState state;
+
+        memset(&state, 0, sizeof(state));
+        state.bestGles = mLayers.size();
+        search(&state, 0, 0, 0, 0, RUN_NONE);
+
+        if (!state.found) {
+            buildFallback(&mPlan);
+        } else {
+            int gsc = 0;
+
+            mPlan.layers.clear();
+            for (size_t i = 0; i < mLayers.size(); i++) {
+                ExynosLayerPlan layer;
+
+                layer.type = state.bestTypes[i];
+                layer.window = state.bestTypes[i] == PLAN_GLES ? -1 : state.bestWindows[i];
+                layer.gsc = state.bestTypes[i] == PLAN_GSC ? gsc++ : -1;
+                mPlan.layers.add(layer);
+            }
+            mPlan.fbWindow = state.bestWindows[mLayers.size()];
+            mPlan.numGles = state.bestGles;
+            mPlan.bandwidth = state.bestBandwidth;
+        }
+    }
+
+    mGeometryHash = hash;
+    mNumHwLayers = contents->numHwLayers;
+    mPlanValid = true;
+    return &mPlan;
+}
@@ -0,0 +1,97 @@
+#ifndef EXYNOS_COMPOSITION_PLANNER_H
+#define EXYNOS_COMPOSITION_PLANNER_H
+
+#include <hardware/hwcomposer.h>
+#include <utils/Vector.h>
+
+#include "ExynosHWCModule.h"
+
+/*
+ * Picks, for every layer of a frame, whether it is scanned out by a FIMD
+ * window directly, through a GSC scaler, or composed by GLES into the
+ * framebuffer target. The plan with the fewest GLES layers wins; ties are
+ * broken by the memory bandwidth of the frame. Every plan respects the
+ * window count, the FIMD GSC units and the per DMA channel bandwidth and
+ * overlap limits of ExynosHWCModule.h.
+ */
+
+enum {
+    PLAN_GLES = 0,
+    PLAN_OVERLAY,
+    PLAN_GSC,
+};
+
+struct ExynosLayerPlan {
+    int type;           /* PLAN_GLES, PLAN_OVERLAY or PLAN_GSC */
+    int window;         /* FIMD window, -1 for GLES layers */
+    int gsc;            /* index into FIMD_GSC_USAGE_IDX, -1 without GSC */
+};
+
+struct ExynosCompositionPlan {
+    android::Vector<ExynosLayerPlan> layers;
+    int fbWindow;       /* window of the framebuffer target, -1 if unused */
+    int numGles;
+    uint64_t bandwidth; /* bytes read and written per frame */
+};
+
+class ExynosCompositionPlanner {
+    public:
+        ExynosCompositionPlanner();
+        ~ExynosCompositionPlanner();
+
+        /*
+         * Returns the plan for contents on an xres x yres display. The
+         * previous plan is returned unless SurfaceFlinger flagged a
+         * geometry change or the layer count or geometry hash differ.
+         */
+        const ExynosCompositionPlan *plan(hwc_display_contents_1_t *contents,
+                int xres, int yres);
+
+        unsigned int cacheHits() const { return mCacheHits; }
+        unsigned int searches() const { return mSearches; }
+
+    private:
+        enum { SEARCH_MAX_LAYERS = 12 };
+
+        struct LayerInfo {
+            hwc_rect_t frame;
+            uint64_t srcBytes;
+            uint64_t dstBytes;
+            bool overlayOk;
+            bool gscOk;
+            bool glesOk;
+        };
+
+        struct SearchState {
+            int types[SEARCH_MAX_LAYERS];
+            int bestTypes[SEARCH_MAX_LAYERS];
+            int bestWindows[SEARCH_MAX_LAYERS + 1];   /* last one is the FB target */
+            int bestGles;
+            uint64_t bestBandwidth;
+            bool found;
+        };
+
+        uint32_t hashGeometry(hwc_display_contents_1_t *contents, int xres, int yres);
+        void describeLayers(hwc_display_contents_1_t *contents, int xres, int yres);
+        void search(SearchState *state, size_t index, int numGles, int numGsc,
+                int hw, int run);
+        bool evaluate(const int *types, int *windows, uint64_t *bandwidth);
+        bool placeWindows(const hwc_rect_t *rects, size_t count, int *windows,
+                size_t unit, int first);
+        bool checkDmaLimits(const hwc_rect_t *rects, const int *windows, size_t count);
+        void buildFallback(ExynosCompositionPlan *plan);
+
+        android::Vector<LayerInfo> mLayers;
+        ExynosCompositionPlan mPlan;
+        uint32_t mGeometryHash;
+        size_t mNumHwLayers;
+        bool mPlanValid;
+        int mXres;
+        int mYres;
+        uint32_t mMaxBw[MAX_NUM_FIMD_DMA_CH];
+        uint32_t mMaxOverlap[MAX_NUM_FIMD_DMA_CH];
+        unsigned int mCacheHits;
+        unsigned int mSearches;
+};
+
+#endif
@@ -1,6 +1,8 @@
 #include "ExynosPrimaryDisplay.h"
 #include "ExynosHWCModule.h"
 
+#include <utils/Vector.h>
+
 ExynosPrimaryDisplay::ExynosPrimaryDisplay(int numGSCs, struct exynos5_hwc_composer_device_1_t *pdev) :
     ExynosOverlayDisplay(numGSCs, pdev)
 {
@@ -9,3 +11,37 @@ ExynosPrimaryDisplay::ExynosPrimaryDisplay(int numGSCs, struct exynos5_hwc_compo
 ExynosPrimaryDisplay::~ExynosPrimaryDisplay()
 {
 }
+
+int ExynosPrimaryDisplay::prepare(hwc_display_contents_1_t *contents)
+{
+    const ExynosCompositionPlan *plan = planComposition(contents);
+    android::Vector<size_t> skipped;
+
+    /*
+     * A plan without any hardware layer is no better than what the overlay
+     * assignment finds on its own, so it is left alone.
+     */
+    if (plan->numGles < (int)plan->layers.size()) {
+        for (size_t i = 0; i < plan->layers.size() && i < contents->numHwLayers; i++) {
+            hwc_layer_1_t &layer = contents->hwLayers[i];
+
+            if (plan->layers[i].type != PLAN_GLES || (layer.flags & HWC_SKIP_LAYER))
+                continue;
+            layer.flags |= HWC_SKIP_LAYER;
+            skipped.add(i);
+        }
+    }
+
+    int ret = ExynosOverlayDisplay::prepare(contents);
+
+    /* the flags belong to SurfaceFlinger */
+    for (size_t i = 0; i < skipped.size(); i++)
+        contents->hwLayers[skipped[i]].flags &= ~HWC_SKIP_LAYER;
+
+    return ret;
+}
+
+const ExynosCompositionPlan *ExynosPrimaryDisplay::planComposition(hwc_display_contents_1_t *contents)
+{
+    return mPlanner.plan(contents, mXres, mYres);
+}
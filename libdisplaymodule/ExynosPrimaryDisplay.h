@@ -2,11 +2,24 @@
 #define EXYNOS_DISPLAY_MODULE_H
 
 #include "ExynosOverlayDisplay.h"
+#include "ExynosCompositionPlanner.h"
 
 class ExynosPrimaryDisplay : public ExynosOverlayDisplay {
     public:
         ExynosPrimaryDisplay(int numGSCs, struct exynos5_hwc_composer_device_1_t *pdev);
         ~ExynosPrimaryDisplay();
+
+        /*
+         * Layers the composition plan leaves to GLES reach the overlay
+         * assignment as skip layers, so it only places the others.
+         */
+        virtual int prepare(hwc_display_contents_1_t *contents);
+
+        /* Window, GSC and GLES assignment for the layers of contents. */
+        const ExynosCompositionPlan *planComposition(hwc_display_contents_1_t *contents);
+
+    private:
+        ExynosCompositionPlanner mPlanner;
 };
 
 #endif
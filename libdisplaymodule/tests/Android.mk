@@ -0,0 +1,35 @@
+# Copyright (C) 2008 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH:= $(call my-dir)
+
+# Composition planner tests on synthetic layer stacks, on the host. The
+# kernel's s3c-fb.h is replaced by the subset in tests/include.
+include $(CLEAR_VARS)
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/include \
+	$(LOCAL_PATH)/.. \
+	$(TOP)/hardware/samsung_slsi-cm/exynos/include \
+	$(TOP)/hardware/samsung_slsi-cm/$(TARGET_SOC)/include \
+	$(TOP)/hardware/samsung_slsi-cm/$(TARGET_SOC)/libhwcmodule
+
+LOCAL_SRC_FILES := \
+	composition_planner_test.cpp \
+	../ExynosCompositionPlanner.cpp
+
+LOCAL_STATIC_LIBRARIES := libutils libcutils liblog
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := libdisplaymodule_planner_test
+include $(BUILD_HOST_NATIVE_TEST)
@@ -0,0 +1,442 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+
+#include "ExynosCompositionPlanner.h"
+#include "gralloc_priv.h"
+#include "exynos_format.h"
+
+/*
+ * Synthetic layer stacks for ExynosCompositionPlanner. Every plan is checked
+ * against the FIMD limits of ExynosHWCModule.h, and random stacks against
+ * an exhaustive search for the fewest GLES layers.
+ */
+
+#ifdef DUAL_VIDEO_OVERLAY_SUPPORT
+static const int NUM_FIMD_GSC = sizeof(FIMD_GSC_USAGE_IDX) / sizeof(FIMD_GSC_USAGE_IDX[0]);
+#else
+static const int NUM_FIMD_GSC = 1;
+#endif
+
+enum LayerKind {
+    KIND_RGBA,          /* unscaled RGBA, any path */
+    KIND_VIDEO,         /* scaled YUV, GSC or GLES */
+    KIND_SECURE,        /* scaled protected YUV, GSC only */
+    KIND_SKIP,          /* GLES only */
+    NUM_KINDS,
+};
+
+class CompositionPlannerTest : public testing::Test {
+    protected:
+        CompositionPlannerTest() :
+            mContents(NULL),
+            mRgba(-1, 0, 0, 0, 0, HAL_PIXEL_FORMAT_RGBA_8888, 0, 0),
+            mVideo(-1, 0, 0, 0, 0, HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M, 0, 0),
+            mSecure(-1, 0, GRALLOC_USAGE_PROTECTED, 0, 0,
+                    HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M, 0, 0)
+        {
+        }
+
+        ~CompositionPlannerTest()
+        {
+            free(mContents);
+        }
+
+        void setLayers(size_t count)
+        {
+            free(mContents);
+            mContents = (hwc_display_contents_1_t *)calloc(1,
+                    sizeof(hwc_display_contents_1_t) + (count + 1) * sizeof(hwc_layer_1_t));
+            mContents->numHwLayers = count + 1;
+            memset(mKinds, 0, sizeof(mKinds));
+
+            hwc_layer_1_t &target = mContents->hwLayers[count];
+            target.compositionType = HWC_FRAMEBUFFER_TARGET;
+        }
+
+        void setLayer(size_t i, LayerKind kind, int left, int top, int right, int bottom)
+        {
+            hwc_layer_1_t &layer = mContents->hwLayers[i];
+            int w = right - left, h = bottom - top;
+
+            mKinds[i] = kind;
+            layer.compositionType = HWC_FRAMEBUFFER;
+            layer.flags = kind == KIND_SKIP ? HWC_SKIP_LAYER : 0;
+            layer.transform = 0;
+            layer.blending = HWC_BLENDING_PREMULT;
+            layer.planeAlpha = 255;
+            layer.displayFrame.left = left;
+            layer.displayFrame.top = top;
+            layer.displayFrame.right = right;
+            layer.displayFrame.bottom = bottom;
+            layer.sourceCropf.left = 0;
+            layer.sourceCropf.top = 0;
+            switch (kind) {
+            case KIND_VIDEO:
+            case KIND_SECURE:
+                layer.handle = kind == KIND_VIDEO ? &mVideo : &mSecure;
+                layer.sourceCropf.right = w / 2 ? w / 2 : 1;
+                layer.sourceCropf.bottom = h / 2 ? h / 2 : 1;
+                break;
+            default:
+                layer.handle = &mRgba;
+                layer.sourceCropf.right = w;
+                layer.sourceCropf.bottom = h;
+                break;
+            }
+        }
+
+        static bool allowed(LayerKind kind, int type)
+        {
+            switch (kind) {
+            case KIND_RGBA:
+                return true;
+            case KIND_VIDEO:
+                return type != PLAN_OVERLAY;
+            case KIND_SECURE:
+                return type == PLAN_GSC;
+            default:
+                return type == PLAN_GLES;
+            }
+        }
+
+        /* Deepest stack of rects per DMA channel, over the cells between their edges. */
+        static void overlapDepth(const hwc_rect_t *rects, const int *windows, size_t count,
+                uint32_t *depth)
+        {
+            memset(depth, 0, sizeof(uint32_t) * MAX_NUM_FIMD_DMA_CH);
+            for (size_t i = 0; i < count; i++) {
+                for (size_t j = 0; j < count; j++) {
+                    int x = rects[i].left, y = rects[j].top;
+                    uint32_t cell[MAX_NUM_FIMD_DMA_CH] = { 0 };
+
+                    for (size_t k = 0; k < count; k++)
+                        if (x >= rects[k].left && x < rects[k].right &&
+                            y >= rects[k].top && y < rects[k].bottom)
+                            cell[FIMD_DMA_CH_IDX[windows[k]]]++;
+                    for (size_t ch = 0; ch < MAX_NUM_FIMD_DMA_CH; ch++)
+                        if (cell[ch] > depth[ch])
+                            depth[ch] = cell[ch];
+                }
+            }
+        }
+
+        /* The windows of the units in z order fit the FIMD limits. */
+        bool windowsFit(const hwc_rect_t *rects, const int *windows, size_t count)
+        {
+            uint64_t area[MAX_NUM_FIMD_DMA_CH] = { 0 };
+            uint32_t depth[MAX_NUM_FIMD_DMA_CH];
+
+            for (size_t i = 0; i < count; i++) {
+                if (windows[i] < 0 || windows[i] >= (int)SOC_NUM_HW_WINDOWS)
+                    return false;
+                if (i && windows[i] <= windows[i - 1])
+                    return false;
+                area[FIMD_DMA_CH_IDX[windows[i]]] +=
+                        (uint64_t)(rects[i].right - rects[i].left) *
+                        (rects[i].bottom - rects[i].top);
+            }
+            overlapDepth(rects, windows, count, depth);
+            for (size_t ch = 0; ch < MAX_NUM_FIMD_DMA_CH; ch++)
+                if (area[ch] > mMaxBw[ch] || depth[ch] > mMaxOverlap[ch])
+                    return false;
+            return true;
+        }
+
+        /* The units of types in z order; the GLES target takes the slot of the first GLES layer. */
+        size_t units(const int *types, size_t count, hwc_rect_t *rects)
+        {
+            size_t n = 0;
+            bool target = false;
+
+            for (size_t i = 0; i < count; i++) {
+                if (types[i] == PLAN_GLES) {
+                    if (target)
+                        continue;
+                    target = true;
+                    rects[n].left = 0;
+                    rects[n].top = 0;
+                    rects[n].right = mXres;
+                    rects[n].bottom = mYres;
+                } else {
+                    rects[n] = mContents->hwLayers[i].displayFrame;
+                }
+                n++;
+            }
+            return n;
+        }
+
+        bool typesValid(const int *types, size_t count)
+        {
+            int gsc = 0, first = -1, last = -1;
+
+            for (size_t i = 0; i < count; i++) {
+                if (!allowed(mKinds[i], types[i]))
+                    return false;
+                if (types[i] == PLAN_GSC)
+                    gsc++;
+                if (types[i] == PLAN_GLES) {
+                    if (first < 0)
+                        first = i;
+                    last = i;
+                }
+            }
+            for (int i = first; i >= 0 && i <= last; i++)
+                if (types[i] != PLAN_GLES)
+                    return false;
+            return gsc <= NUM_FIMD_GSC;
+        }
+
+        bool anyWindowsFit(const hwc_rect_t *rects, size_t count, int *windows,
+                size_t unit, int first)
+        {
+            if (unit == count)
+                return windowsFit(rects, windows, count);
+            for (int w = first; w < (int)SOC_NUM_HW_WINDOWS; w++) {
+                windows[unit] = w;
+                if (anyWindowsFit(rects, count, windows, unit + 1, w + 1))
+                    return true;
+            }
+            return false;
+        }
+
+        /* Fewest GLES layers over every type and window assignment. */
+        int exhaustiveMinGles(size_t count)
+        {
+            int types[16];
+            int best = count;
+            int combos = 1;
+
+            for (size_t i = 0; i < count; i++)
+                combos *= 3;
+            for (int c = 0; c < combos; c++) {
+                int gles = 0;
+
+                for (size_t i = 0, v = c; i < count; i++, v /= 3) {
+                    types[i] = v % 3;
+                    gles += types[i] == PLAN_GLES;
+                }
+                if (gles >= best || !typesValid(types, count))
+                    continue;
+
+                hwc_rect_t rects[16];
+                int windows[16];
+                size_t n = units(types, count, rects);
+                if (n <= SOC_NUM_HW_WINDOWS && anyWindowsFit(rects, n, windows, 0, 0))
+                    best = gles;
+            }
+            return best;
+        }
+
+        /* The plan is one the hardware can scan out. */
+        void expectValid(const ExynosCompositionPlan *plan, size_t count)
+        {
+            int types[16];
+            hwc_rect_t rects[16];
+            int windows[16];
+            size_t n = 0;
+            int gles = 0;
+
+            ASSERT_EQ(count, plan->layers.size());
+            for (size_t i = 0; i < count; i++) {
+                const ExynosLayerPlan &layer = plan->layers[i];
+
+                types[i] = layer.type;
+                if (layer.type == PLAN_GLES) {
+                    EXPECT_EQ(-1, layer.window);
+                    if (!gles++)
+                        windows[n++] = plan->fbWindow;
+                } else {
+                    windows[n++] = layer.window;
+                }
+                if (layer.type == PLAN_GSC) {
+                    EXPECT_GE(layer.gsc, 0);
+                    EXPECT_LT(layer.gsc, NUM_FIMD_GSC);
+                } else {
+                    EXPECT_EQ(-1, layer.gsc);
+                }
+            }
+            EXPECT_EQ(gles, plan->numGles);
+            if (gles) {
+                EXPECT_GE(plan->fbWindow, 0);
+            }
+            EXPECT_TRUE(typesValid(types, count));
+            EXPECT_EQ(n, units(types, count, rects));
+            EXPECT_TRUE(windowsFit(rects, windows, n));
+        }
+
+        void setDisplay(int xres, int yres)
+        {
+            mXres = xres;
+            mYres = yres;
+            fimd_bw_overlap_limits_init(xres, yres, mMaxBw, mMaxOverlap);
+        }
+
+        hwc_display_contents_1_t *mContents;
+        LayerKind mKinds[16];
+        private_handle_t mRgba;
+        private_handle_t mVideo;
+        private_handle_t mSecure;
+        ExynosCompositionPlanner mPlanner;
+        int mXres;
+        int mYres;
+        uint32_t mMaxBw[MAX_NUM_FIMD_DMA_CH];
+        uint32_t mMaxOverlap[MAX_NUM_FIMD_DMA_CH];
+};
+
+TEST_F(CompositionPlannerTest, BarsAndAppOverlay)
+{
+    setDisplay(1920, 1080);
+    setLayers(3);
+    setLayer(0, KIND_RGBA, 0, 0, 1920, 1080);
+    setLayer(1, KIND_RGBA, 0, 0, 1920, 50);
+    setLayer(2, KIND_RGBA, 0, 1000, 1920, 1080);
+
+    const ExynosCompositionPlan *plan = mPlanner.plan(mContents, mXres, mYres);
+    expectValid(plan, 3);
+    EXPECT_EQ(0, plan->numGles);
+    EXPECT_EQ(-1, plan->fbWindow);
+    for (size_t i = 0; i < 3; i++)
+        EXPECT_EQ(PLAN_OVERLAY, plan->layers[i].type);
+}
+
+TEST_F(CompositionPlannerTest, ScaledVideoTakesGsc)
+{
+    setDisplay(1920, 1080);
+    setLayers(2);
+    setLayer(0, KIND_VIDEO, 0, 0, 1920, 1080);
+    setLayer(1, KIND_RGBA, 0, 980, 1920, 1080);
+
+    const ExynosCompositionPlan *plan = mPlanner.plan(mContents, mXres, mYres);
+    expectValid(plan, 2);
+    EXPECT_EQ(PLAN_GSC, plan->layers[0].type);
+    EXPECT_EQ(0, plan->layers[0].gsc);
+    EXPECT_EQ(PLAN_OVERLAY, plan->layers[1].type);
+}
+
+TEST_F(CompositionPlannerTest, ProtectedVideoNeverGoesToGles)
+{
+    setDisplay(1920, 1080);
+    setLayers(6);
+    for (size_t i = 0; i < 6; i++)
+        setLayer(i, KIND_RGBA, 0, 0, 1920, 1080);
+    setLayer(2, KIND_SECURE, 0, 0, 1920, 1080);
+
+    const ExynosCompositionPlan *plan = mPlanner.plan(mContents, mXres, mYres);
+    expectValid(plan, 6);
+    EXPECT_EQ(PLAN_GSC, plan->layers[2].type);
+}
+
+TEST_F(CompositionPlannerTest, SkipLayersAreComposedTogether)
+{
+    setDisplay(1920, 1080);
+    setLayers(4);
+    setLayer(0, KIND_RGBA, 0, 0, 1920, 1080);
+    setLayer(1, KIND_SKIP, 100, 100, 400, 400);
+    setLayer(2, KIND_RGBA, 500, 500, 700, 700);
+    setLayer(3, KIND_SKIP, 800, 100, 900, 200);
+
+    const ExynosCompositionPlan *plan = mPlanner.plan(mContents, mXres, mYres);
+    expectValid(plan, 4);
+    /* the layer between the skip layers has to join them */
+    EXPECT_EQ(3, plan->numGles);
+}
+
+TEST_F(CompositionPlannerTest, FullScreenLayersSplitAcrossChannels)
+{
+    /* above 1080p the first DMA channel takes one full screen layer at a time */
+    setDisplay(2560, 1600);
+    setLayers(2);
+    setLayer(0, KIND_RGBA, 0, 0, 2560, 1600);
+    setLayer(1, KIND_RGBA, 0, 0, 2560, 1600);
+
+    const ExynosCompositionPlan *plan = mPlanner.plan(mContents, mXres, mYres);
+    expectValid(plan, 2);
+    EXPECT_EQ(0, plan->numGles);
+    EXPECT_NE(FIMD_DMA_CH_IDX[plan->layers[0].window],
+              FIMD_DMA_CH_IDX[plan->layers[1].window]);
+}
+
+TEST_F(CompositionPlannerTest, ReusesPlanForSameGeometry)
+{
+    setDisplay(1920, 1080);
+    setLayers(2);
+    setLayer(0, KIND_RGBA, 0, 0, 1920, 1080);
+    setLayer(1, KIND_VIDEO, 0, 0, 1280, 720);
+
+    mPlanner.plan(mContents, mXres, mYres);
+    EXPECT_EQ(1u, mPlanner.searches());
+
+    /* a new buffer of the same format, and the types prepare wrote back */
+    private_handle_t other(-1, 0, 0, 0, 0, HAL_PIXEL_FORMAT_RGBA_8888, 0, 0);
+    mContents->hwLayers[0].handle = &other;
+    mContents->hwLayers[0].compositionType = HWC_OVERLAY;
+    mContents->hwLayers[1].compositionType = HWC_OVERLAY;
+    mPlanner.plan(mContents, mXres, mYres);
+    EXPECT_EQ(1u, mPlanner.searches());
+    EXPECT_EQ(1u, mPlanner.cacheHits());
+
+    mContents->hwLayers[1].displayFrame.right = 1300;
+    mPlanner.plan(mContents, mXres, mYres);
+    EXPECT_EQ(2u, mPlanner.searches());
+
+    /* a flagged geometry change searches again even with the same hash */
+    mContents->flags |= HWC_GEOMETRY_CHANGED;
+    mPlanner.plan(mContents, mXres, mYres);
+    EXPECT_EQ(3u, mPlanner.searches());
+    mContents->flags &= ~HWC_GEOMETRY_CHANGED;
+    mPlanner.plan(mContents, mXres, mYres);
+    EXPECT_EQ(3u, mPlanner.searches());
+    EXPECT_EQ(2u, mPlanner.cacheHits());
+}
+
+TEST_F(CompositionPlannerTest, RandomStacksMatchExhaustiveSearch)
+{
+    static const int sizes[][2] = { { 1920, 1080 }, { 2560, 1600 } };
+    unsigned int seed = 1;
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        setDisplay(sizes[s][0], sizes[s][1]);
+
+        for (int iteration = 0; iteration < 400; iteration++) {
+            size_t count = 1 + iteration % 6;
+
+            setLayers(count);
+            for (size_t i = 0; i < count; i++) {
+                seed = seed * 1103515245 + 12345;
+                LayerKind kind = (LayerKind)((seed >> 16) % NUM_KINDS);
+                seed = seed * 1103515245 + 12345;
+                int w = 64 + (seed >> 16) % (mXres - 64);
+                seed = seed * 1103515245 + 12345;
+                int h = 64 + (seed >> 16) % (mYres - 64);
+                seed = seed * 1103515245 + 12345;
+                int x = (seed >> 16) % (mXres - w + 1);
+                seed = seed * 1103515245 + 12345;
+                int y = (seed >> 16) % (mYres - h + 1);
+
+                /* full screen layers are common and stress the limits */
+                if (((seed >> 8) & 3) == 0) {
+                    x = y = 0;
+                    w = mXres;
+                    h = mYres;
+                }
+                setLayer(i, kind, x, y, x + w, y + h);
+            }
+
+            SCOPED_TRACE(testing::Message() << mXres << "x" << mYres
+                         << " iteration " << iteration);
+            const ExynosCompositionPlan *plan = mPlanner.plan(mContents, mXres, mYres);
+            bool secure = false;
+            for (size_t i = 0; i < count; i++)
+                secure |= mKinds[i] == KIND_SECURE;
+
+            int best = exhaustiveMinGles(count);
+            if (best == (int)count && secure)
+                continue;   /* nothing scans out the protected layers */
+            expectValid(plan, count);
+            EXPECT_EQ(best, plan->numGles);
+        }
+    }
+}
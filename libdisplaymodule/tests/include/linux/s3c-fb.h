@@ -0,0 +1,41 @@
+#ifndef __S3C_FB_HOST_H__
+#define __S3C_FB_HOST_H__
+
+/*
+ * The parts of the kernel's s3c-fb.h that ExynosHWCModule.h uses, for host
+ * builds of the composition planner tests.
+ */
+
+#define S3C_FB_MAX_WIN  5
+
+enum s3c_fb_pixel_format {
+    S3C_FB_PIXEL_FORMAT_RGBA_8888 = 0,
+    S3C_FB_PIXEL_FORMAT_RGBX_8888 = 1,
+    S3C_FB_PIXEL_FORMAT_RGBA_5551 = 2,
+    S3C_FB_PIXEL_FORMAT_RGB_565 = 3,
+    S3C_FB_PIXEL_FORMAT_BGRA_8888 = 4,
+    S3C_FB_PIXEL_FORMAT_BGRX_8888 = 5,
+    S3C_FB_PIXEL_FORMAT_MAX = 6,
+};
+
+enum s3c_fb_blending {
+    S3C_FB_BLENDING_NONE = 0,
+    S3C_FB_BLENDING_PREMULT = 1,
+    S3C_FB_BLENDING_COVERAGE = 2,
+    S3C_FB_BLENDING_MAX = 3,
+};
+
+struct s3c_fb_win_config {
+    enum {
+        S3C_FB_WIN_STATE_DISABLED = 0,
+        S3C_FB_WIN_STATE_COLOR,
+        S3C_FB_WIN_STATE_BUFFER,
+    } state;
+};
+
+struct s3c_fb_win_config_data {
+    int fence;
+    struct s3c_fb_win_config config[S3C_FB_MAX_WIN];
+};
+
+#endif
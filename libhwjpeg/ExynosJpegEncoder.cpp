@@ -204,6 +204,31 @@ int ExynosJpegEncoder::setQuality(int iV4l2Quality)
     return ERROR_NONE;
 }
 
+/*
+ * Applies the current quality to the already configured device so that
+ * encode() can run again on the same buffers without reopening the node.
+ */
+int ExynosJpegEncoder::updateQuality(void)
+{
+    if (t_bFlagCreate == false)
+        return ERROR_JPEG_DEVICE_NOT_CREATE_YET;
+
+    if (t_iJpegFd <= 0)
+        return ERROR_JPEG_DEVICE_ALREADY_CLOSED;
+
+    if (t_bFlagExcute) {
+        t_v4l2StreamOff(t_iJpegFd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE);
+        t_v4l2StreamOff(t_iJpegFd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE);
+    }
+
+    if (t_v4l2SetJpegcomp(t_iJpegFd, t_stJpegConfig.enc_qual) < 0) {
+        JPEG_ERROR_LOG("[%s]: S_JPEGCOMP failed\n", __func__);
+        return ERROR_INVALID_JPEG_CONFIG;
+    }
+
+    return ERROR_NONE;
+}
+
 int ExynosJpegEncoder::getJpegSize(void)
 {
     if (t_bFlagCreate == false)
@@ -16,6 +16,7 @@
  */
 
 #include <errno.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdint.h>
 
@@ -26,6 +27,7 @@
 #include <openssl/bio.h>
 #include <openssl/rsa.h>
 #include <openssl/err.h>
+#include <openssl/sha.h>
 #include <openssl/x509.h>
 
 #include <UniquePtr.h>
@@ -233,6 +235,78 @@ static int exynos_km_import_keypair(const keymaster0_device_t* dev,
     return 0;
 }
 
+/*
+ * The public half of a wrapped key never changes, so the X.509 encoding
+ * exported for a blob is kept, keyed by the SHA-256 of the blob. A blob
+ * that changes hashes to a new entry; the stale one ages out of the LRU.
+ */
+#define PUBKEY_CACHE_SIZE     16
+
+struct pubkey_cache_entry {
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    uint8_t* x509_data;     /* NULL when the entry is empty */
+    size_t x509_data_length;
+    uint32_t last_use;
+};
+
+static pthread_mutex_t pubkey_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pubkey_cache_entry pubkey_cache[PUBKEY_CACHE_SIZE];
+static uint32_t pubkey_cache_uses;
+
+/* Returns a malloc'd copy of the cached encoding for digest, or NULL. */
+static uint8_t* pubkey_cache_get(const uint8_t* digest, size_t* x509_data_length) {
+    uint8_t* data = NULL;
+
+    pthread_mutex_lock(&pubkey_cache_lock);
+    for (size_t i = 0; i < PUBKEY_CACHE_SIZE; i++) {
+        pubkey_cache_entry* entry = &pubkey_cache[i];
+        if (entry->x509_data == NULL ||
+                memcmp(entry->digest, digest, SHA256_DIGEST_LENGTH) != 0)
+            continue;
+
+        data = reinterpret_cast<uint8_t*>(malloc(entry->x509_data_length));
+        if (data != NULL) {
+            memcpy(data, entry->x509_data, entry->x509_data_length);
+            *x509_data_length = entry->x509_data_length;
+            entry->last_use = ++pubkey_cache_uses;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&pubkey_cache_lock);
+
+    return data;
+}
+
+static void pubkey_cache_put(const uint8_t* digest, const uint8_t* x509_data,
+        size_t x509_data_length) {
+    uint8_t* data = reinterpret_cast<uint8_t*>(malloc(x509_data_length));
+    if (data == NULL)
+        return;
+    memcpy(data, x509_data, x509_data_length);
+
+    pthread_mutex_lock(&pubkey_cache_lock);
+    pubkey_cache_entry* victim = &pubkey_cache[0];
+    for (size_t i = 0; i < PUBKEY_CACHE_SIZE; i++) {
+        pubkey_cache_entry* entry = &pubkey_cache[i];
+        if (entry->x509_data != NULL &&
+                memcmp(entry->digest, digest, SHA256_DIGEST_LENGTH) == 0) {
+            /* another thread got here first */
+            victim = entry;
+            break;
+        }
+        if (victim->x509_data != NULL &&
+                (entry->x509_data == NULL || entry->last_use < victim->last_use))
+            victim = entry;
+    }
+
+    free(victim->x509_data);
+    memcpy(victim->digest, digest, SHA256_DIGEST_LENGTH);
+    victim->x509_data = data;
+    victim->x509_data_length = x509_data_length;
+    victim->last_use = ++pubkey_cache_uses;
+    pthread_mutex_unlock(&pubkey_cache_lock);
+}
+
 static int exynos_km_get_keypair_public(const keymaster0_device_t* dev,
         const uint8_t* key_blob, const size_t key_blob_length,
         uint8_t** x509_data, size_t* x509_data_length) {
@@ -245,6 +319,18 @@ static int exynos_km_get_keypair_public(const keymaster0_device_t* dev,
         return -1;
     }
 
+    if (key_blob == NULL) {
+        ALOGE("key blob == NULL");
+        return -1;
+    }
+
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256(key_blob, key_blob_length, digest);
+
+    *x509_data = pubkey_cache_get(digest, x509_data_length);
+    if (*x509_data != NULL)
+        return 0;
+
     UniquePtr<uint8_t> binModPtr(reinterpret_cast<uint8_t*>(malloc(RSA_KEY_MAX_SIZE)));
     if (binModPtr.get() == NULL) {
         ALOGE("memory allocation is failed");
@@ -326,6 +412,8 @@ static int exynos_km_get_keypair_public(const keymaster0_device_t* dev,
         return -1;
     }
 
+    pubkey_cache_put(digest, key.get(), len);
+
     *x509_data_length = len;
     *x509_data = key.release();
 
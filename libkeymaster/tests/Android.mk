@@ -0,0 +1,34 @@
+# Copyright (C) 2012 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+# Key blob cache benchmark, on the host against the simulated MobiCore driver
+# in fake_mobicore.cpp. The TLC hands secure addresses to the trustlet as
+# 32-bit words, so it is built 32-bit like on the device.
+include $(CLEAR_VARS)
+LOCAL_MODULE := keymaster_key_cache_benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/.. \
+	$(MOBICORE_PATH)/daemon/ClientLib/public \
+	$(MOBICORE_PATH)/common/MobiCore/inc/
+LOCAL_SRC_FILES := \
+	key_cache_benchmark.cpp \
+	fake_mobicore.cpp \
+	../tlcTeeKeymaster_if.c
+LOCAL_MULTILIB := 32
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS := -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,456 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A MobiCore client library for the host: just enough of
+ * MobiCoreDriverApi.h for the keymaster TLC, with a keymaster trustlet
+ * that runs in the calling thread.
+ *
+ * Bulk mappings follow the rules of the real driver: at most
+ * FAKE_MAX_BULK_MAPS per session, at most 1 MiB each, and a buffer can
+ * only be mapped once per session. The trustlet only reaches buffers
+ * through their secure addresses, so a command naming a buffer that is
+ * not mapped fails. Map, unmap and notification spin for roughly what the
+ * daemon and world switch cost on the device; the trustlet's crypto is
+ * free, so the numbers are TLC and driver overhead only.
+ */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "MobiCoreDriverApi.h"
+#include "tlTeeKeymaster_Api.h"
+#include "tlcTeeKeymaster_if.h"
+
+#include "fake_mobicore.h"
+
+#define FAKE_MAX_SESSIONS       8
+#define FAKE_MAX_BULK_MAPS      6
+#define FAKE_MAX_BULK_LEN       (1024 * 1024)
+#define FAKE_PAGE_SIZE          4096
+#define FAKE_SECURE_BASE        0x100000u
+
+#define MAP_COST_US             80      /* daemon round trip, L2 table, MCP map */
+#define MAP_PAGE_COST_US        1
+#define UNMAP_COST_US           50
+#define NOTIFY_COST_US          20      /* world switch each way */
+
+#define RSA_SIGNATURE_LEN       256
+#define RSA_EXPONENT_LEN        3
+
+struct fake_map {
+    uint8_t *buf;               /* NULL when the slot is free */
+    uint32_t len;
+    uint32_t secure_addr;
+};
+
+struct fake_session {
+    bool open;
+    tciMessage_t *tci;
+    bool notified;
+    struct fake_map maps[FAKE_MAX_BULK_MAPS];
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static bool device_open;
+static struct fake_session sessions[FAKE_MAX_SESSIONS];
+static struct fake_mobicore_counts counts;
+
+static void spin_us(unsigned int us)
+{
+    struct timespec start, now;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec) * 1000000LL +
+             (now.tv_nsec - start.tv_nsec) / 1000 < us);
+}
+
+static struct fake_session *find_session(const mcSessionHandle_t *session)
+{
+    if (!session || session->sessionId < 1 || session->sessionId > FAKE_MAX_SESSIONS)
+        return NULL;
+
+    struct fake_session *s = &sessions[session->sessionId - 1];
+    return s->open ? s : NULL;
+}
+
+/* Resolves a secure address range, as the trustlet would through its MMU. */
+static uint8_t *secure_to_buf(struct fake_session *s, uint32_t addr, uint32_t len)
+{
+    for (int i = 0; i < FAKE_MAX_BULK_MAPS; i++) {
+        struct fake_map *m = &s->maps[i];
+        if (m->buf && addr >= m->secure_addr &&
+                (uint64_t)addr + len <= (uint64_t)m->secure_addr + m->len)
+            return m->buf + (addr - m->secure_addr);
+    }
+
+    counts.bad_buffers++;
+    return NULL;
+}
+
+void fake_trustlet_sign(const uint8_t *key, uint32_t key_len,
+                        const uint8_t *plain, uint32_t plain_len,
+                        uint8_t *signature, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (uint32_t i = 0; i < key_len; i++)
+        hash = (hash ^ key[i]) * 16777619u;
+    for (uint32_t i = 0; i < plain_len; i++)
+        hash = (hash ^ plain[i]) * 16777619u;
+
+    for (uint32_t i = 0; i < len; i++) {
+        hash = (hash ^ i) * 16777619u;
+        signature[i] = (uint8_t)(hash >> 24);
+    }
+}
+
+/* Checks a signature the way the trustlet made it. */
+static bool signature_matches(const uint8_t *key, uint32_t key_len,
+                              const uint8_t *plain, uint32_t plain_len,
+                              const uint8_t *signature, uint32_t len)
+{
+    uint8_t expected[RSA_SIGNATURE_LEN];
+
+    if (len > sizeof(expected))
+        return false;
+    fake_trustlet_sign(key, key_len, plain, plain_len, expected, len);
+    return !memcmp(expected, signature, len);
+}
+
+static tciReturnCode_t trustlet_sign(struct fake_session *s, uint32_t keydata,
+                                     uint32_t keydatalen, uint32_t plaindata,
+                                     uint32_t plaindatalen, uint32_t signaturedata,
+                                     uint32_t *signaturedatalen, uint32_t len)
+{
+    uint8_t *key = secure_to_buf(s, keydata, keydatalen);
+    uint8_t *plain = secure_to_buf(s, plaindata, plaindatalen);
+    uint8_t *signature = secure_to_buf(s, signaturedata, *signaturedatalen);
+
+    if (!key || !plain || !signature)
+        return RET_ERR_INVALID_BUFFER;
+    if (*signaturedatalen < len)
+        return RET_ERR_INVALID_LENGTH;
+
+    fake_trustlet_sign(key, keydatalen, plain, plaindatalen, signature, len);
+    *signaturedatalen = len;
+    return RET_OK;
+}
+
+static tciReturnCode_t trustlet_verify(struct fake_session *s, uint32_t keydata,
+                                       uint32_t keydatalen, uint32_t plaindata,
+                                       uint32_t plaindatalen, uint32_t signaturedata,
+                                       uint32_t signaturedatalen, bool *validity)
+{
+    uint8_t *key = secure_to_buf(s, keydata, keydatalen);
+    uint8_t *plain = secure_to_buf(s, plaindata, plaindatalen);
+    uint8_t *signature = secure_to_buf(s, signaturedata, signaturedatalen);
+
+    if (!key || !plain || !signature)
+        return RET_ERR_INVALID_BUFFER;
+
+    *validity = signature_matches(key, keydatalen, plain, plaindatalen,
+                                  signature, signaturedatalen);
+    return RET_OK;
+}
+
+static tciReturnCode_t trustlet_get_pub_key(struct fake_session *s)
+{
+    getpubkey_t *cmd = &s->tci->getpubkey;
+    uint8_t *key = secure_to_buf(s, cmd->keydata, cmd->keydatalen);
+    uint8_t *modulus = secure_to_buf(s, cmd->modulus, cmd->moduluslen);
+    uint8_t *exponent = secure_to_buf(s, cmd->exponent, cmd->exponentlen);
+    static const uint8_t no_data = 0;
+
+    if (!key || !modulus || !exponent)
+        return RET_ERR_INVALID_BUFFER;
+    if (cmd->moduluslen < RSA_SIGNATURE_LEN || cmd->exponentlen < RSA_EXPONENT_LEN)
+        return RET_ERR_INVALID_LENGTH;
+
+    fake_trustlet_sign(key, cmd->keydatalen, &no_data, 0, modulus, RSA_SIGNATURE_LEN);
+    exponent[0] = 1;
+    exponent[1] = 0;
+    exponent[2] = 1;
+    cmd->moduluslen = RSA_SIGNATURE_LEN;
+    cmd->exponentlen = RSA_EXPONENT_LEN;
+    return RET_OK;
+}
+
+static void trustlet_run(struct fake_session *s)
+{
+    tciMessage_t *tci = s->tci;
+    tciCommandId_t id = tci->command.header.commandId;
+    tciReturnCode_t ret;
+
+    switch (id) {
+    case CMD_ID_TEE_RSA_SIGN:
+        ret = trustlet_sign(s, tci->rsasign.keydata, tci->rsasign.keydatalen,
+                            tci->rsasign.plaindata, tci->rsasign.plaindatalen,
+                            tci->rsasign.signaturedata,
+                            &tci->rsasign.signaturedatalen, RSA_SIGNATURE_LEN);
+        break;
+    case CMD_ID_TEE_RSA_VERIFY:
+        ret = trustlet_verify(s, tci->rsaverify.keydata, tci->rsaverify.keydatalen,
+                              tci->rsaverify.plaindata, tci->rsaverify.plaindatalen,
+                              tci->rsaverify.signaturedata,
+                              tci->rsaverify.signaturedatalen,
+                              &tci->rsaverify.validity);
+        break;
+    case CMD_ID_TEE_HMAC_SIGN:
+        ret = trustlet_sign(s, tci->hmacsign.keydata, tci->hmacsign.keydatalen,
+                            tci->hmacsign.plaindata, tci->hmacsign.plaindatalen,
+                            tci->hmacsign.signaturedata,
+                            &tci->hmacsign.signaturedatalen,
+                            tci->hmacsign.digest == TEE_DIGEST_SHA1 ? 20 : 32);
+        break;
+    case CMD_ID_TEE_HMAC_VERIFY:
+        ret = trustlet_verify(s, tci->hmacverify.keydata, tci->hmacverify.keydatalen,
+                              tci->hmacverify.plaindata, tci->hmacverify.plaindatalen,
+                              tci->hmacverify.signaturedata,
+                              tci->hmacverify.signaturedatalen,
+                              &tci->hmacverify.validity);
+        break;
+    case CMD_ID_TEE_GET_PUB_KEY:
+        ret = trustlet_get_pub_key(s);
+        break;
+    default:
+        ret = RET_ERR_UNKNOWN_CMD;
+        break;
+    }
+
+    tci->response.header.responseId = RSP_ID(id);
+    tci->response.header.returnCode = ret;
+}
+
+void fake_mobicore_counts(struct fake_mobicore_counts *out)
+{
+    pthread_mutex_lock(&lock);
+    *out = counts;
+    out->live_maps = 0;
+    for (int i = 0; i < FAKE_MAX_SESSIONS; i++) {
+        if (!sessions[i].open)
+            continue;
+        for (int j = 0; j < FAKE_MAX_BULK_MAPS; j++)
+            out->live_maps += sessions[i].maps[j].buf != NULL;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void fake_mobicore_reset(void)
+{
+    pthread_mutex_lock(&lock);
+    memset(&counts, 0, sizeof(counts));
+    pthread_mutex_unlock(&lock);
+}
+
+mcResult_t mcOpenDevice(uint32_t deviceId)
+{
+    mcResult_t ret = MC_DRV_OK;
+
+    if (deviceId != MC_DEVICE_ID_DEFAULT)
+        return MC_DRV_ERR_UNKNOWN_DEVICE;
+
+    pthread_mutex_lock(&lock);
+    if (device_open)
+        ret = MC_DRV_ERR_DEVICE_ALREADY_OPEN;
+    device_open = true;
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+mcResult_t mcCloseDevice(uint32_t deviceId)
+{
+    if (deviceId != MC_DEVICE_ID_DEFAULT)
+        return MC_DRV_ERR_UNKNOWN_DEVICE;
+
+    pthread_mutex_lock(&lock);
+    device_open = false;
+    pthread_mutex_unlock(&lock);
+    return MC_DRV_OK;
+}
+
+mcResult_t mcMallocWsm(uint32_t deviceId, uint32_t, uint32_t len, uint8_t **wsm, uint32_t)
+{
+    if (deviceId != MC_DEVICE_ID_DEFAULT)
+        return MC_DRV_ERR_UNKNOWN_DEVICE;
+    if (!wsm || !len)
+        return MC_DRV_ERR_INVALID_PARAMETER;
+
+    *wsm = (uint8_t *)memalign(FAKE_PAGE_SIZE, len);
+    if (!*wsm)
+        return MC_DRV_ERR_NO_FREE_MEMORY;
+    memset(*wsm, 0, len);
+    return MC_DRV_OK;
+}
+
+mcResult_t mcFreeWsm(uint32_t deviceId, uint8_t *wsm)
+{
+    if (deviceId != MC_DEVICE_ID_DEFAULT)
+        return MC_DRV_ERR_UNKNOWN_DEVICE;
+
+    free(wsm);
+    return MC_DRV_OK;
+}
+
+mcResult_t mcOpenSession(mcSessionHandle_t *session, const mcUuid_t *uuid,
+                         uint8_t *tci, uint32_t tciLen)
+{
+    mcResult_t ret = MC_DRV_ERR_OUT_OF_RESOURCES;
+
+    if (!session || !uuid || !tci || tciLen < sizeof(tciMessage_t))
+        return MC_DRV_ERR_INVALID_PARAMETER;
+
+    pthread_mutex_lock(&lock);
+    if (!device_open) {
+        pthread_mutex_unlock(&lock);
+        return MC_DRV_ERR_DAEMON_DEVICE_NOT_OPEN;
+    }
+    for (int i = 0; i < FAKE_MAX_SESSIONS; i++) {
+        if (sessions[i].open)
+            continue;
+        memset(&sessions[i], 0, sizeof(sessions[i]));
+        sessions[i].open = true;
+        sessions[i].tci = (tciMessage_t *)tci;
+        session->sessionId = i + 1;
+        counts.sessions++;
+        ret = MC_DRV_OK;
+        break;
+    }
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+mcResult_t mcCloseSession(mcSessionHandle_t *session)
+{
+    pthread_mutex_lock(&lock);
+    struct fake_session *s = find_session(session);
+    if (s)
+        memset(s, 0, sizeof(*s));
+    pthread_mutex_unlock(&lock);
+    return s ? MC_DRV_OK : MC_DRV_ERR_UNKNOWN_SESSION;
+}
+
+mcResult_t mcNotify(mcSessionHandle_t *session)
+{
+    pthread_mutex_lock(&lock);
+    struct fake_session *s = find_session(session);
+    if (s) {
+        trustlet_run(s);
+        s->notified = true;
+        counts.notifications++;
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (!s)
+        return MC_DRV_ERR_UNKNOWN_SESSION;
+    spin_us(2 * NOTIFY_COST_US);
+    return MC_DRV_OK;
+}
+
+mcResult_t mcWaitNotification(mcSessionHandle_t *session, int32_t)
+{
+    mcResult_t ret = MC_DRV_ERR_UNKNOWN_SESSION;
+
+    pthread_mutex_lock(&lock);
+    struct fake_session *s = find_session(session);
+    if (s) {
+        ret = s->notified ? MC_DRV_OK : MC_DRV_ERR_TIMEOUT;
+        s->notified = false;
+    }
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+mcResult_t mcMap(mcSessionHandle_t *session, void *buf, uint32_t len, mcBulkMap_t *mapInfo)
+{
+    mcResult_t ret = MC_DRV_ERR_BULK_MAPPING;
+    struct fake_map *slot = NULL;
+    int index = 0;
+
+    if (!buf || !len || len > FAKE_MAX_BULK_LEN || !mapInfo)
+        return MC_DRV_ERR_INVALID_PARAMETER;
+
+    pthread_mutex_lock(&lock);
+    struct fake_session *s = find_session(session);
+    if (!s) {
+        pthread_mutex_unlock(&lock);
+        return MC_DRV_ERR_UNKNOWN_SESSION;
+    }
+
+    for (int i = 0; i < FAKE_MAX_BULK_MAPS; i++) {
+        if (s->maps[i].buf == buf) {
+            slot = NULL;
+            break;
+        }
+        if (!s->maps[i].buf && !slot) {
+            slot = &s->maps[i];
+            index = i;
+        }
+    }
+
+    if (slot) {
+        /* Each slot gets 2 MiB of secure addresses, enough for 1 MiB at any offset */
+        uint32_t offset = (uintptr_t)buf & (FAKE_PAGE_SIZE - 1);
+        slot->buf = (uint8_t *)buf;
+        slot->len = len;
+        slot->secure_addr = FAKE_SECURE_BASE + index * 2 * FAKE_MAX_BULK_LEN + offset;
+        mapInfo->sVirtualAddr = (void *)(uintptr_t)slot->secure_addr;
+        mapInfo->sVirtualLen = len;
+        counts.maps++;
+        ret = MC_DRV_OK;
+    } else {
+        counts.map_failures++;
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (ret == MC_DRV_OK)
+        spin_us(MAP_COST_US + MAP_PAGE_COST_US *
+                ((len + FAKE_PAGE_SIZE - 1) / FAKE_PAGE_SIZE));
+    return ret;
+}
+
+mcResult_t mcUnmap(mcSessionHandle_t *session, void *buf, mcBulkMap_t *mapInfo)
+{
+    mcResult_t ret = MC_DRV_ERR_BLK_BUFF_NOT_FOUND;
+
+    if (!buf || !mapInfo)
+        return MC_DRV_ERR_INVALID_PARAMETER;
+
+    pthread_mutex_lock(&lock);
+    struct fake_session *s = find_session(session);
+    if (!s) {
+        pthread_mutex_unlock(&lock);
+        return MC_DRV_ERR_UNKNOWN_SESSION;
+    }
+
+    for (int i = 0; i < FAKE_MAX_BULK_MAPS; i++) {
+        if (s->maps[i].buf == buf) {
+            memset(&s->maps[i], 0, sizeof(s->maps[i]));
+            counts.unmaps++;
+            ret = MC_DRV_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (ret == MC_DRV_OK)
+        spin_us(UNMAP_COST_US);
+    return ret;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FAKE_MOBICORE_H_
+#define _FAKE_MOBICORE_H_
+
+#include <stdint.h>
+
+/* What the fake driver has been asked to do since the last fake_mobicore_reset(). */
+struct fake_mobicore_counts {
+    unsigned int maps;          /* successful mcMap() calls */
+    unsigned int unmaps;        /* successful mcUnmap() calls */
+    unsigned int map_failures;  /* mcMap() calls refused */
+    unsigned int notifications; /* commands run by the fake trustlet */
+    unsigned int bad_buffers;   /* commands that named an unmapped buffer */
+    unsigned int sessions;      /* mcOpenSession() calls */
+    int live_maps;              /* bulk mappings of open sessions */
+};
+
+void fake_mobicore_counts(struct fake_mobicore_counts *counts);
+void fake_mobicore_reset(void);
+
+/*
+ * The signature the fake trustlet produces for a key blob and plain data,
+ * filling len bytes of signature.
+ */
+void fake_trustlet_sign(const uint8_t *key, uint32_t key_len,
+                        const uint8_t *plain, uint32_t plain_len,
+                        uint8_t *signature, uint32_t len);
+
+#endif /* _FAKE_MOBICORE_H_ */
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the keymaster TLC against the simulated MobiCore driver in
+ * fake_mobicore.cpp: signing latency and bulk maps per operation with the
+ * key blob cache hot, with more keys than it holds, with data too large to
+ * stage, and with every buffer mapped per call as before the cache. Every
+ * result is checked against the fake trustlet, and the run fails if the
+ * TLC ever asks for more bulk mappings than a session takes.
+ *
+ * usage: keymaster_key_cache_benchmark [iterations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "MobiCoreDriverApi.h"
+#include "tlTeeKeymaster_Api.h"
+#include "tlcTeeKeymaster_if.h"
+
+#include "fake_mobicore.h"
+
+#define KEY_COUNT           8
+#define KEY_LEN             1160    /* RSA-2048 CRT secure object */
+#define PLAIN_LEN           256
+#define LARGE_PLAIN_LEN     (64 * 1024)
+#define SIGNATURE_LEN       256
+#define HMAC_SHA256_LEN     32
+#define EXPONENT_LEN        4
+
+enum op {
+    OP_RSA_SIGN,
+    OP_HMAC_SIGN,
+    OP_GET_PUB_KEY,
+    OP_PER_CALL_RSA_SIGN,
+};
+
+struct scenario {
+    const char *name;
+    enum op op;
+    int keys;                   /* keys used round robin */
+    uint32_t plain_len;
+};
+
+static const struct scenario scenarios[] = {
+    { "rsa sign, 1 key",            OP_RSA_SIGN,            1, PLAIN_LEN },
+    { "rsa sign, 4 keys",           OP_RSA_SIGN,            4, PLAIN_LEN },
+    { "rsa sign, 8 keys",           OP_RSA_SIGN,            8, PLAIN_LEN },
+    { "rsa sign, 64K data",         OP_RSA_SIGN,            1, LARGE_PLAIN_LEN },
+    { "hmac sign, 1 key",           OP_HMAC_SIGN,           1, PLAIN_LEN },
+    { "get pub key, 4 keys",        OP_GET_PUB_KEY,         4, 0 },
+    { "rsa sign, per-call map",     OP_PER_CALL_RSA_SIGN,   1, PLAIN_LEN },
+};
+
+static uint8_t keys[KEY_COUNT][KEY_LEN];
+static uint8_t *plain;
+
+static mcSessionHandle_t per_call_session;
+static tciMessage_t *per_call_tci;
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int compare_us(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* TEE_RSASign as it was before the key cache, on a session of its own */
+static teeResult_t per_call_rsa_sign(const uint8_t *key, uint32_t key_len,
+                                     const uint8_t *data, uint32_t data_len,
+                                     uint8_t *signature, uint32_t *signature_len)
+{
+    mcSessionHandle_t *session = &per_call_session;
+    tciMessage_t *tci = per_call_tci;
+    mcBulkMap_t key_map, data_map, signature_map;
+
+    if (mcMap(session, (void *)key, key_len, &key_map) != MC_DRV_OK)
+        return TEE_ERR_MAP;
+    if (mcMap(session, (void *)data, data_len, &data_map) != MC_DRV_OK)
+        return TEE_ERR_MAP;
+    if (mcMap(session, signature, *signature_len, &signature_map) != MC_DRV_OK)
+        return TEE_ERR_MAP;
+
+    tci->command.header.commandId = CMD_ID_TEE_RSA_SIGN;
+    tci->rsasign.keydata = (uint32_t)(uintptr_t)key_map.sVirtualAddr;
+    tci->rsasign.keydatalen = key_len;
+    tci->rsasign.plaindata = (uint32_t)(uintptr_t)data_map.sVirtualAddr;
+    tci->rsasign.plaindatalen = data_len;
+    tci->rsasign.signaturedata = (uint32_t)(uintptr_t)signature_map.sVirtualAddr;
+    tci->rsasign.signaturedatalen = *signature_len;
+    tci->rsasign.algorithm = TEE_RSA_NODIGEST_NOPADDING;
+
+    if (mcNotify(session) != MC_DRV_OK ||
+            mcWaitNotification(session, MC_INFINITE_TIMEOUT) != MC_DRV_OK)
+        return TEE_ERR_NOTIFICATION;
+
+    if (mcUnmap(session, (void *)key, &key_map) != MC_DRV_OK ||
+            mcUnmap(session, (void *)data, &data_map) != MC_DRV_OK ||
+            mcUnmap(session, signature, &signature_map) != MC_DRV_OK)
+        return TEE_ERR_MAP;
+
+    if (tci->response.header.returnCode != RET_OK)
+        return TEE_ERR_FAIL;
+
+    *signature_len = tci->rsasign.signaturedatalen;
+    return TEE_ERR_NONE;
+}
+
+/* Runs one operation and checks its output against the fake trustlet. */
+static int run_op(const struct scenario *sc, const uint8_t *key)
+{
+    uint8_t out[SIGNATURE_LEN], expected[SIGNATURE_LEN];
+    uint8_t exponent[EXPONENT_LEN];
+    uint32_t out_len = sizeof(out), exponent_len = sizeof(exponent);
+    uint32_t expected_len = SIGNATURE_LEN;
+    teeResult_t ret;
+
+    switch (sc->op) {
+    case OP_RSA_SIGN:
+        ret = TEE_RSASign(key, KEY_LEN, plain, sc->plain_len, out, &out_len,
+                          TEE_RSA_NODIGEST_NOPADDING);
+        break;
+    case OP_HMAC_SIGN:
+        ret = TEE_HMACSign(key, KEY_LEN, plain, sc->plain_len, out, &out_len,
+                           TEE_DIGEST_SHA256);
+        expected_len = HMAC_SHA256_LEN;
+        break;
+    case OP_GET_PUB_KEY:
+        ret = TEE_GetPubKey(key, KEY_LEN, out, &out_len, exponent, &exponent_len);
+        break;
+    default:
+        ret = per_call_rsa_sign(key, KEY_LEN, plain, sc->plain_len, out, &out_len);
+        break;
+    }
+
+    if (ret != TEE_ERR_NONE) {
+        fprintf(stderr, "%s: failed with %d\n", sc->name, ret);
+        return -1;
+    }
+
+    fake_trustlet_sign(key, KEY_LEN, plain, sc->plain_len, expected, expected_len);
+    if (out_len != expected_len || memcmp(out, expected, expected_len)) {
+        fprintf(stderr, "%s: wrong result\n", sc->name);
+        return -1;
+    }
+    return 0;
+}
+
+static int run(const struct scenario *sc, int iterations, int64_t *samples)
+{
+    struct fake_mobicore_counts counts;
+
+    /* Warm up the sessions and the cache; only the steady state is timed */
+    for (int i = 0; i < sc->keys; i++)
+        if (run_op(sc, keys[i]))
+            return -1;
+
+    fake_mobicore_reset();
+    for (int i = 0; i < iterations; i++) {
+        int64_t start = now_us();
+        if (run_op(sc, keys[i % sc->keys]))
+            return -1;
+        samples[i] = now_us() - start;
+    }
+    fake_mobicore_counts(&counts);
+
+    qsort(samples, iterations, sizeof(samples[0]), compare_us);
+    printf("%-24s p50 %5lld us  p90 %5lld us  max %5lld us  maps/op %.2f  unmaps/op %.2f\n",
+           sc->name, (long long)samples[iterations / 2],
+           (long long)samples[iterations * 9 / 10],
+           (long long)samples[iterations - 1],
+           (double)counts.maps / iterations, (double)counts.unmaps / iterations);
+
+    if (counts.map_failures || counts.bad_buffers) {
+        fprintf(stderr, "%s: %u refused maps, %u unmapped buffers\n",
+                sc->name, counts.map_failures, counts.bad_buffers);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const mcUuid_t uuid = TEE_KEYMASTER_TL_UUID;
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+    struct fake_mobicore_counts counts;
+    int ret = 0;
+
+    if (iterations <= 0)
+        iterations = 1000;
+
+    int64_t *samples = (int64_t *)malloc(iterations * sizeof(int64_t));
+    plain = (uint8_t *)malloc(LARGE_PLAIN_LEN);
+    if (!samples || !plain) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (int k = 0; k < KEY_COUNT; k++)
+        for (int i = 0; i < KEY_LEN; i++)
+            keys[k][i] = (uint8_t)(i * 31 + k * 7 + (i >> 8));
+    for (int i = 0; i < LARGE_PLAIN_LEN; i++)
+        plain[i] = (uint8_t)(i * 13 + (i >> 10));
+
+    mcResult_t mcRet = mcOpenDevice(MC_DEVICE_ID_DEFAULT);
+    if (mcRet != MC_DRV_OK && mcRet != MC_DRV_ERR_DEVICE_ALREADY_OPEN) {
+        fprintf(stderr, "mcOpenDevice failed: %u\n", mcRet);
+        return 1;
+    }
+    memset(&per_call_session, 0, sizeof(per_call_session));
+    if (mcMallocWsm(MC_DEVICE_ID_DEFAULT, 0, sizeof(tciMessage_t),
+                    (uint8_t **)&per_call_tci, 0) != MC_DRV_OK ||
+            mcOpenSession(&per_call_session, &uuid, (uint8_t *)per_call_tci,
+                          sizeof(tciMessage_t)) != MC_DRV_OK) {
+        fprintf(stderr, "cannot open the per-call session\n");
+        return 1;
+    }
+
+    printf("%d iterations, %d byte key blobs\n", iterations, KEY_LEN);
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+        ret |= run(&scenarios[i], iterations, samples);
+
+    mcCloseSession(&per_call_session);
+    fake_mobicore_counts(&counts);
+    printf("bulk maps left on open sessions %d\n", counts.live_maps);
+
+    free(plain);
+    free(samples);
+    return ret ? 1 : 0;
+}
@@ -29,7 +29,10 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <malloc.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "MobiCoreDriverApi.h"
 #include "tlTeeKeymaster_Api.h"
@@ -41,53 +44,546 @@
 static const uint32_t gDeviceId = MC_DEVICE_ID_DEFAULT;
 static const mcUuid_t gUuid = TEE_KEYMASTER_TL_UUID;
 
+/*
+ * Sessions to the trustlet are kept open between calls and handed out by
+ * TEE_Open, so a command costs one notification round trip instead of a
+ * device open, a WSM allocation and a session open. A session that saw a
+ * transport error is closed by TEE_Close and reopened on its next use.
+ */
+#define TEE_SESSION_POOL_SIZE   2
+#define TEE_SESSION_INVALID     0xffffffff
+
+/*
+ * Each session also keeps the last key blobs it used copied into buffers
+ * that stay mapped to the trustlet, plus one mapped staging buffer for the
+ * plain data and one for the signature. Signing again with a cached key
+ * then maps nothing at all. Buffers above TEE_STAGING_MAX are mapped per
+ * call as before.
+ */
+#define TEE_KEY_CACHE_SIZE      4
+#define TEE_STAGING_MAX         (16 * 1024)
+#define TEE_PAGE_SIZE           4096
+
+/*
+ * The trustlet takes at most six bulk mappings per session. When a command
+ * needs more, cached key blobs other than the one it uses are unmapped,
+ * least recently used first.
+ */
+#define TEE_MAX_BULK_MAPS       6
+
+enum {
+    TEE_STAGING_PLAIN = 0,
+    TEE_STAGING_SIGNATURE,
+    TEE_STAGING_COUNT
+};
+
+typedef struct {
+    uint8_t             *buf;       /* page aligned, NULL when unused */
+    uint32_t            size;
+    mcBulkMap_t         mapInfo;
+} teeStaging_t;
+
+typedef struct {
+    uint32_t            hash;
+    uint32_t            len;        /* 0 when the entry is empty */
+    uint32_t            lastUse;
+    teeStaging_t        staging;
+} teeKeyBlob_t;
+
+typedef struct {
+    uint32_t            sVirtualAddr;
+    void                *data;      /* caller buffer */
+    uint32_t            len;
+    teeStaging_t        *pStaging;  /* NULL when data itself is mapped */
+    mcBulkMap_t         mapInfo;
+} teeBulk_t;
+
+typedef struct {
+    mcSessionHandle_t   handle;
+    tciMessage_ptr      pTci;
+    bool                open;
+    bool                busy;
+    teeKeyBlob_t        keys[TEE_KEY_CACHE_SIZE];
+    teeKeyBlob_t        *pKeyInUse; /* blob of the running command */
+    uint32_t            useCount;
+    uint32_t            mapCount;   /* live bulk mappings */
+    teeStaging_t        staging[TEE_STAGING_COUNT];
+} teeSession_t;
+
+static pthread_mutex_t  gSessionLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   gSessionFree = PTHREAD_COND_INITIALIZER;
+static teeSession_t     gSessions[TEE_SESSION_POOL_SIZE];
+static bool             gDeviceOpen = false;
+
+
 /**
- * TEE_Open
+ * TEE_FindSession
  *
- * Open session to the TEE Keymaster trustlet
+ * Return the busy pool slot of a session handle, or NULL.
+ * Called with gSessionLock held.
  *
- * @param  pSessionHandle  [out] Return pointer to the session handle
+ * @param  pSessionHandle  [in] Session handle
  */
-static tciMessage_ptr TEE_Open(
-    mcSessionHandle_t *pSessionHandle
+static teeSession_t *TEE_FindSession(
+    const mcSessionHandle_t *pSessionHandle
 ){
-    tciMessage_ptr pTci = NULL;
-    mcResult_t     mcRet;
+    int i;
 
-    do
+    for (i = 0; i < TEE_SESSION_POOL_SIZE; i++)
+    {
+        if (gSessions[i].busy &&
+            gSessions[i].handle.sessionId == pSessionHandle->sessionId)
+        {
+            return &gSessions[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * TEE_Session
+ *
+ * Return the pool slot of a session handle taken with TEE_Open. The slot
+ * belongs to the caller until TEE_Close, so its caches need no locking.
+ *
+ * @param  pSessionHandle  [in] Session handle
+ */
+static teeSession_t *TEE_Session(
+    const mcSessionHandle_t *pSessionHandle
+){
+    teeSession_t *pSession;
+
+    pthread_mutex_lock(&gSessionLock);
+    pSession = TEE_FindSession(pSessionHandle);
+    pthread_mutex_unlock(&gSessionLock);
+
+    return pSession;
+}
+
+
+/**
+ * TEE_ReleaseStaging
+ *
+ * Unmap and free a staging buffer.
+ *
+ * @param  pSession  [in] Session the buffer is mapped to
+ * @param  pStaging  [in] Staging buffer
+ */
+static void TEE_ReleaseStaging(
+    teeSession_t *pSession,
+    teeStaging_t *pStaging
+){
+    mcResult_t mcRet;
+
+    if (!pStaging->buf)
+        return;
+
+    mcRet = mcUnmap(&pSession->handle, pStaging->buf, &pStaging->mapInfo);
+    if (MC_DRV_OK != mcRet)
     {
+        LOG_W("TEE_ReleaseStaging(): mcUnmap returned: %d\n", mcRet);
+    }
+
+    free(pStaging->buf);
+    memset(pStaging, 0, sizeof(teeStaging_t));
+    pSession->mapCount--;
+}
+
+
+/**
+ * TEE_EvictKeys
+ *
+ * Unmap cached key blobs until count more bulk mappings fit in the session.
+ * The blob of the running command is kept; if that is not enough, the
+ * mapping that follows fails as it would have without the cache.
+ *
+ * @param  pSession  [in] Pool slot
+ * @param  count     [in] Number of mappings about to be made
+ */
+static void TEE_EvictKeys(
+    teeSession_t *pSession,
+    uint32_t     count
+){
+    teeKeyBlob_t *pVictim;
+    int          i;
 
-        /* Validate session handle */
-        if (!pSessionHandle)
+    while (pSession->mapCount + count > TEE_MAX_BULK_MAPS)
+    {
+        pVictim = NULL;
+        for (i = 0; i < TEE_KEY_CACHE_SIZE; i++)
         {
-            LOG_E("TEE_Open(): Invalid session handle\n");
-            break;
+            teeKeyBlob_t *pEntry = &pSession->keys[i];
+
+            if (!pEntry->staging.buf || pEntry == pSession->pKeyInUse)
+                continue;
+            if (!pVictim || pEntry->lastUse < pVictim->lastUse)
+                pVictim = pEntry;
         }
+        if (!pVictim)
+            break;
+
+        TEE_ReleaseStaging(pSession, &pVictim->staging);
+        pVictim->len = 0;
+    }
+}
 
-        /* Initialize session handle data */
-        memset(pSessionHandle, 0, sizeof(mcSessionHandle_t));
 
-        /* Open MobiCore device */
-        mcRet = mcOpenDevice(gDeviceId);
-        if (MC_DRV_OK != mcRet)
+/**
+ * TEE_MakeRoom
+ *
+ * TEE_EvictKeys for commands that map their buffers with mcMap directly.
+ *
+ * @param  pSessionHandle  [in] Session handle
+ * @param  count           [in] Number of mappings about to be made
+ */
+static void TEE_MakeRoom(
+    const mcSessionHandle_t *pSessionHandle,
+    uint32_t                count
+){
+    teeSession_t *pSession = TEE_Session(pSessionHandle);
+
+    if (pSession)
+    {
+        pSession->pKeyInUse = NULL;
+        TEE_EvictKeys(pSession, count);
+    }
+}
+
+
+/**
+ * TEE_ReserveStaging
+ *
+ * Make sure a staging buffer of at least len bytes is mapped.
+ *
+ * @param  pSession  [in] Session to map the buffer to
+ * @param  pStaging  [in] Staging buffer
+ * @param  len       [in] Needed length
+ */
+static mcResult_t TEE_ReserveStaging(
+    teeSession_t *pSession,
+    teeStaging_t *pStaging,
+    uint32_t     len
+){
+    mcResult_t mcRet;
+    void       *buf = NULL;
+    uint32_t   size;
+
+    if (pStaging->buf && pStaging->size >= len)
+        return MC_DRV_OK;
+
+    TEE_ReleaseStaging(pSession, pStaging);
+
+    size = (len + TEE_PAGE_SIZE - 1) & ~(TEE_PAGE_SIZE - 1);
+    if (!size)
+        size = TEE_PAGE_SIZE;
+
+    buf = memalign(TEE_PAGE_SIZE, size);
+    if (!buf)
+    {
+        LOG_E("TEE_ReserveStaging(): No memory for %u bytes\n", size);
+        return MC_DRV_ERR_NO_FREE_MEMORY;
+    }
+
+    TEE_EvictKeys(pSession, 1);
+    mcRet = mcMap(&pSession->handle, buf, size, &pStaging->mapInfo);
+    if (MC_DRV_OK != mcRet)
+    {
+        LOG_E("TEE_ReserveStaging(): mcMap returned: %d\n", mcRet);
+        free(buf);
+        return mcRet;
+    }
+
+    pSession->mapCount++;
+    pStaging->buf = (uint8_t *) buf;
+    pStaging->size = size;
+
+    return MC_DRV_OK;
+}
+
+
+/**
+ * TEE_FlushSession
+ *
+ * Drop the key blob cache and the staging buffers of a session.
+ *
+ * @param  pSession  [in] Pool slot
+ */
+static void TEE_FlushSession(
+    teeSession_t *pSession
+){
+    int i;
+
+    for (i = 0; i < TEE_KEY_CACHE_SIZE; i++)
+    {
+        TEE_ReleaseStaging(pSession, &pSession->keys[i].staging);
+        pSession->keys[i].len = 0;
+    }
+
+    for (i = 0; i < TEE_STAGING_COUNT; i++)
+    {
+        TEE_ReleaseStaging(pSession, &pSession->staging[i]);
+    }
+}
+
+
+/**
+ * TEE_MapBulkTo
+ *
+ * Give the trustlet access to a caller buffer, through a staging buffer
+ * when one is given and the data fits, or by mapping the buffer itself.
+ *
+ * @param  pSession  [in]  Pool slot
+ * @param  pStaging  [in]  Staging buffer to use, or NULL
+ * @param  data      [in]  Caller buffer
+ * @param  len       [in]  Caller buffer length
+ * @param  copyIn    [in]  Whether the trustlet reads the buffer
+ * @param  pBulk     [out] Mapping to pass to TEE_UnmapBulk
+ */
+static mcResult_t TEE_MapBulkTo(
+    teeSession_t *pSession,
+    teeStaging_t *pStaging,
+    void         *data,
+    uint32_t     len,
+    bool         copyIn,
+    teeBulk_t    *pBulk
+){
+    mcResult_t mcRet;
+
+    memset(pBulk, 0, sizeof(teeBulk_t));
+    pBulk->data = data;
+    pBulk->len = len;
+
+    if (!pStaging || len > TEE_STAGING_MAX)
+    {
+        TEE_EvictKeys(pSession, 1);
+        mcRet = mcMap(&pSession->handle, data, len, &pBulk->mapInfo);
+        if (MC_DRV_OK == mcRet)
+            pSession->mapCount++;
+        pBulk->sVirtualAddr = (uint32_t)pBulk->mapInfo.sVirtualAddr;
+        return mcRet;
+    }
+
+    mcRet = TEE_ReserveStaging(pSession, pStaging, len);
+    if (MC_DRV_OK != mcRet)
+        return mcRet;
+
+    if (copyIn)
+        memcpy(pStaging->buf, data, len);
+
+    pBulk->pStaging = pStaging;
+    pBulk->sVirtualAddr = (uint32_t)pStaging->mapInfo.sVirtualAddr;
+
+    return MC_DRV_OK;
+}
+
+
+/**
+ * TEE_MapBulk
+ *
+ * TEE_MapBulkTo with one of the staging buffers of the session.
+ *
+ * @param  pSessionHandle  [in]  Session handle
+ * @param  staging         [in]  TEE_STAGING_PLAIN or TEE_STAGING_SIGNATURE
+ * @param  data            [in]  Caller buffer
+ * @param  len             [in]  Caller buffer length
+ * @param  copyIn          [in]  Whether the trustlet reads the buffer
+ * @param  pBulk           [out] Mapping to pass to TEE_UnmapBulk
+ */
+static mcResult_t TEE_MapBulk(
+    const mcSessionHandle_t *pSessionHandle,
+    int                     staging,
+    void                    *data,
+    uint32_t                len,
+    bool                    copyIn,
+    teeBulk_t               *pBulk
+){
+    teeSession_t *pSession = TEE_Session(pSessionHandle);
+
+    if (!pSession)
+        return MC_DRV_ERR_UNKNOWN_SESSION;
+
+    return TEE_MapBulkTo(pSession, &pSession->staging[staging], data, len,
+                         copyIn, pBulk);
+}
+
+
+/**
+ * TEE_MapKey
+ *
+ * Give the trustlet access to a key blob. Blobs are cached by content, so
+ * a key used again on the same session is neither copied nor mapped.
+ *
+ * @param  pSessionHandle  [in]  Session handle
+ * @param  keyData         [in]  Key blob
+ * @param  keyDataLength   [in]  Key blob length
+ * @param  pBulk           [out] Mapping to pass to TEE_UnmapBulk
+ */
+static mcResult_t TEE_MapKey(
+    const mcSessionHandle_t *pSessionHandle,
+    const uint8_t           *keyData,
+    uint32_t                keyDataLength,
+    teeBulk_t               *pBulk
+){
+    teeSession_t *pSession = TEE_Session(pSessionHandle);
+    teeKeyBlob_t *pBlob = NULL;
+    mcResult_t   mcRet;
+    uint32_t     hash = 2166136261u;
+    uint32_t     i;
+
+    if (!pSession)
+        return MC_DRV_ERR_UNKNOWN_SESSION;
+
+    pSession->pKeyInUse = NULL;
+
+    if (keyDataLength > TEE_STAGING_MAX)
+        return TEE_MapBulkTo(pSession, NULL, (void*)keyData, keyDataLength, true, pBulk);
+
+    /* FNV-1a of the blob */
+    for (i = 0; i < keyDataLength; i++)
+    {
+        hash = (hash ^ keyData[i]) * 16777619u;
+    }
+
+    pSession->useCount++;
+
+    for (i = 0; i < TEE_KEY_CACHE_SIZE; i++)
+    {
+        teeKeyBlob_t *pEntry = &pSession->keys[i];
+
+        if (pEntry->len && pEntry->len == keyDataLength && pEntry->hash == hash &&
+            !memcmp(pEntry->staging.buf, keyData, keyDataLength))
         {
-            LOG_E("TEE_Open(): mcOpenDevice returned: %d\n", mcRet);
+            pBlob = pEntry;
             break;
         }
+    }
+
+    if (!pBlob)
+    {
+        /* Take an empty entry, else the least recently used one */
+        pBlob = &pSession->keys[0];
+        for (i = 0; i < TEE_KEY_CACHE_SIZE && pBlob->len; i++)
+        {
+            if (!pSession->keys[i].len ||
+                pSession->keys[i].lastUse < pBlob->lastUse)
+            {
+                pBlob = &pSession->keys[i];
+            }
+        }
 
-        /* Allocating WSM for TCI */
-        mcRet = mcMallocWsm(gDeviceId, 0, sizeof(tciMessage_t), (uint8_t **) &pTci, 0);
+        pBlob->len = 0;
+        pSession->pKeyInUse = pBlob;
+        mcRet = TEE_ReserveStaging(pSession, &pBlob->staging, keyDataLength);
         if (MC_DRV_OK != mcRet)
+            return mcRet;
+
+        memcpy(pBlob->staging.buf, keyData, keyDataLength);
+        pBlob->hash = hash;
+        pBlob->len = keyDataLength;
+    }
+
+    pBlob->lastUse = pSession->useCount;
+    pSession->pKeyInUse = pBlob;
+
+    memset(pBulk, 0, sizeof(teeBulk_t));
+    pBulk->data = (void*)keyData;
+    pBulk->len = keyDataLength;
+    pBulk->pStaging = &pBlob->staging;
+    pBulk->sVirtualAddr = (uint32_t)pBlob->staging.mapInfo.sVirtualAddr;
+
+    return MC_DRV_OK;
+}
+
+
+/**
+ * TEE_UnmapBulk
+ *
+ * Finish a mapping from TEE_MapBulk or TEE_MapKey. Staged data written by
+ * the trustlet is copied back to the caller buffer.
+ *
+ * @param  pSessionHandle  [in] Session handle
+ * @param  pBulk           [in] Mapping
+ * @param  copyOut         [in] Number of bytes to copy back
+ */
+static mcResult_t TEE_UnmapBulk(
+    mcSessionHandle_t *pSessionHandle,
+    teeBulk_t         *pBulk,
+    uint32_t          copyOut
+){
+    teeSession_t *pSession;
+    mcResult_t   mcRet;
+
+    if (!pBulk->pStaging)
+    {
+        mcRet = mcUnmap(pSessionHandle, pBulk->data, &pBulk->mapInfo);
+        pSession = TEE_Session(pSessionHandle);
+        if (MC_DRV_OK == mcRet && pSession)
+            pSession->mapCount--;
+        return mcRet;
+    }
+
+    if (copyOut > pBulk->len)
+        copyOut = pBulk->len;
+    if (copyOut)
+        memcpy(pBulk->data, pBulk->pStaging->buf, copyOut);
+
+    return MC_DRV_OK;
+}
+
+
+/**
+ * TEE_OpenSlot
+ *
+ * Open the device and the trustlet session of a pool slot if needed.
+ * Called with gSessionLock held.
+ *
+ * @param  pSession  [in] Pool slot
+ */
+static mcResult_t TEE_OpenSlot(
+    teeSession_t *pSession
+){
+    mcResult_t mcRet = MC_DRV_OK;
+
+    do
+    {
+
+        /* Open MobiCore device, once per process */
+        if (!gDeviceOpen)
         {
-            LOG_E("TEE_Open(): mcMallocWsm returned: %d\n", mcRet);
-            break;
+            mcRet = mcOpenDevice(gDeviceId);
+            if (MC_DRV_ERR_DEVICE_ALREADY_OPEN == mcRet)
+            {
+                mcRet = MC_DRV_OK;
+            }
+            if (MC_DRV_OK != mcRet)
+            {
+                LOG_E("TEE_Open(): mcOpenDevice returned: %d\n", mcRet);
+                break;
+            }
+            gDeviceOpen = true;
+        }
+
+        /* Allocating WSM for TCI, kept across session reopens */
+        if (!pSession->pTci)
+        {
+            mcRet = mcMallocWsm(gDeviceId, 0, sizeof(tciMessage_t),
+                                (uint8_t **) &pSession->pTci, 0);
+            if (MC_DRV_OK != mcRet)
+            {
+                LOG_E("TEE_Open(): mcMallocWsm returned: %d\n", mcRet);
+                pSession->pTci = NULL;
+                break;
+            }
         }
 
         /* Open session the TEE Keymaster trustlet */
-        pSessionHandle->deviceId = gDeviceId;
-        mcRet = mcOpenSession(pSessionHandle,
+        memset(&pSession->handle, 0, sizeof(mcSessionHandle_t));
+        pSession->handle.deviceId = gDeviceId;
+        mcRet = mcOpenSession(&pSession->handle,
                               &gUuid,
-                              (uint8_t *) pTci,
+                              (uint8_t *) pSession->pTci,
                               (uint32_t) sizeof(tciMessage_t));
         if (MC_DRV_OK != mcRet)
         {
@@ -95,8 +591,65 @@ static tciMessage_ptr TEE_Open(
             break;
         }
 
+        pSession->open = true;
+
     } while (false);
 
+    return mcRet;
+}
+
+
+/**
+ * TEE_Open
+ *
+ * Take a session to the TEE Keymaster trustlet from the pool, opening it
+ * if needed. Blocks while every session of the pool is in use.
+ *
+ * @param  pSessionHandle  [out] Return pointer to the session handle
+ */
+static tciMessage_ptr TEE_Open(
+    mcSessionHandle_t *pSessionHandle
+){
+    tciMessage_ptr pTci = NULL;
+    teeSession_t   *pSession = NULL;
+    int            i;
+
+    /* Validate session handle */
+    if (!pSessionHandle)
+    {
+        LOG_E("TEE_Open(): Invalid session handle\n");
+        return NULL;
+    }
+
+    pSessionHandle->sessionId = TEE_SESSION_INVALID;
+    pSessionHandle->deviceId = gDeviceId;
+
+    pthread_mutex_lock(&gSessionLock);
+
+    for (;;)
+    {
+        /* Prefer a session that is already open */
+        for (i = 0; i < TEE_SESSION_POOL_SIZE; i++)
+        {
+            if (gSessions[i].busy)
+                continue;
+            if (!pSession || (gSessions[i].open && !pSession->open))
+                pSession = &gSessions[i];
+        }
+        if (pSession)
+            break;
+        pthread_cond_wait(&gSessionFree, &gSessionLock);
+    }
+
+    if (pSession->open || MC_DRV_OK == TEE_OpenSlot(pSession))
+    {
+        pSession->busy = true;
+        *pSessionHandle = pSession->handle;
+        pTci = pSession->pTci;
+    }
+
+    pthread_mutex_unlock(&gSessionLock);
+
     return pTci;
 }
 
@@ -104,43 +657,59 @@ static tciMessage_ptr TEE_Open(
 /**
  * TEE_Close
  *
- * Close session to the TEE Keymaster trustlet
+ * Give a session back to the pool. The session is closed when the command
+ * failed in a way that may have left mappings behind or the trustlet in a
+ * bad state; it is reopened by the next TEE_Open.
  *
- * @param  sessionHandle  [in] Session handle
+ * @param  pSessionHandle  [in] Session handle
+ * @param  result          [in] Result of the command run on the session
  */
 static void TEE_Close(
-    mcSessionHandle_t *pSessionHandle
+    mcSessionHandle_t *pSessionHandle,
+    teeResult_t       result
 ){
-    teeResult_t   ret = TEE_ERR_NONE;
+    teeSession_t  *pSession = NULL;
     mcResult_t    mcRet;
 
-    do {
+    /* Validate session handle */
+    if (!pSessionHandle)
+    {
+        LOG_E("TEE_Close(): Invalid session handle\n");
+        return;
+    }
 
-        /* Validate session handle */
-        if (!pSessionHandle)
-        {
-            LOG_E("TEE_Close(): Invalid session handle\n");
-            break;
-        }
+    /* Nothing to give back if TEE_Open failed */
+    if (TEE_SESSION_INVALID == pSessionHandle->sessionId)
+        return;
 
-        /* Close session */
-        mcRet = mcCloseSession(pSessionHandle);
+    pthread_mutex_lock(&gSessionLock);
+
+    pSession = TEE_FindSession(pSessionHandle);
+    if (!pSession)
+    {
+        LOG_E("TEE_Close(): Unknown session %u\n", pSessionHandle->sessionId);
+        pthread_mutex_unlock(&gSessionLock);
+        return;
+    }
+
+    /* TEE_ERR_FAIL comes from the trustlet after everything was unmapped */
+    if (TEE_ERR_NONE != result && TEE_ERR_FAIL != result)
+    {
+        TEE_FlushSession(pSession);
+        mcRet = mcCloseSession(&pSession->handle);
         if (MC_DRV_OK != mcRet)
         {
             LOG_E("TEE_Close(): mcCloseSession returned: %d\n", mcRet);
-            ret = TEE_ERR_SESSION;
-            break;
         }
+        pSession->open = false;
+        pSession->mapCount = 0;
+    }
 
-        /* Close MobiCore device */
-        mcRet = mcCloseDevice(gDeviceId);
-        if (MC_DRV_OK != mcRet)
-        {
-            LOG_E("TEE_Close(): mcCloseDevice returned: %d\n", mcRet);
-            ret = TEE_ERR_MC_DEVICE;
-        }
+    pSession->pKeyInUse = NULL;
+    pSession->busy = false;
+    pthread_cond_signal(&gSessionFree);
 
-    } while (false);
+    pthread_mutex_unlock(&gSessionLock);
 }
 
 
@@ -180,6 +749,7 @@ teeResult_t TEE_RSAGenerateKeyPair(
         }
 
         /* Map memory to the secure world */
+        TEE_MakeRoom(&sessionHandle, 1);
         mcRet = mcMap(&sessionHandle, keyData, keyDataLength, &mapInfo);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
@@ -231,7 +801,7 @@ teeResult_t TEE_RSAGenerateKeyPair(
     } while (false);
 
     /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    TEE_Close(&sessionHandle, ret);
 
     return ret;
 }
@@ -262,9 +832,9 @@ teeResult_t TEE_RSASign(
     teeResult_t        ret = TEE_ERR_NONE;
     tciMessage_ptr     pTci = NULL;
     mcSessionHandle_t  sessionHandle;
-    mcBulkMap_t        keyMapInfo;
-    mcBulkMap_t        plainMapInfo;
-    mcBulkMap_t        signatureMapInfo;
+    teeBulk_t          keyBulk;
+    teeBulk_t          plainBulk;
+    teeBulk_t          signatureBulk;
     mcResult_t         mcRet;
 
     do {
@@ -277,19 +847,21 @@ teeResult_t TEE_RSASign(
         }
 
         /* Map memory to the secure world */
-        mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
+        mcRet = TEE_MapKey(&sessionHandle, keyData, keyDataLength, &keyBulk);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcMap(&sessionHandle, (void*)plainData, plainDataLength, &plainMapInfo);
+        mcRet = TEE_MapBulk(&sessionHandle, TEE_STAGING_PLAIN, (void*)plainData,
+                            plainDataLength, true, &plainBulk);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcMap(&sessionHandle, (void*)signatureData, *signatureDataLength, &signatureMapInfo);
+        mcRet = TEE_MapBulk(&sessionHandle, TEE_STAGING_SIGNATURE, (void*)signatureData,
+                            *signatureDataLength, false, &signatureBulk);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
@@ -297,13 +869,13 @@ teeResult_t TEE_RSASign(
 
         /* Update TCI buffer */
         pTci->command.header.commandId = CMD_ID_TEE_RSA_SIGN;
-        pTci->rsasign.keydata = (uint32_t)keyMapInfo.sVirtualAddr;
+        pTci->rsasign.keydata = keyBulk.sVirtualAddr;
         pTci->rsasign.keydatalen = keyDataLength;
 
-        pTci->rsasign.plaindata = (uint32_t)plainMapInfo.sVirtualAddr;
+        pTci->rsasign.plaindata = plainBulk.sVirtualAddr;
         pTci->rsasign.plaindatalen = plainDataLength;
 
-        pTci->rsasign.signaturedata = (uint32_t)signatureMapInfo.sVirtualAddr;
+        pTci->rsasign.signaturedata = signatureBulk.sVirtualAddr;
         pTci->rsasign.signaturedatalen = *signatureDataLength;
 
         pTci->rsasign.algorithm = algorithm;
@@ -324,21 +896,23 @@ teeResult_t TEE_RSASign(
         }
 
         /* Unmap memory */
-        mcRet = mcUnmap(&sessionHandle, (void*)keyData, &keyMapInfo);
+        mcRet = TEE_UnmapBulk(&sessionHandle, &keyBulk, 0);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcUnmap(&sessionHandle, (void*)plainData, &plainMapInfo);
+        mcRet = TEE_UnmapBulk(&sessionHandle, &plainBulk, 0);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcUnmap(&sessionHandle, (void*)signatureData, &signatureMapInfo);
+        mcRet = TEE_UnmapBulk(&sessionHandle, &signatureBulk,
+                              RET_OK == pTci->response.header.returnCode ?
+                              pTci->rsasign.signaturedatalen : 0);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_MAP;
@@ -359,7 +933,7 @@ teeResult_t TEE_RSASign(
     } while (false);
 
     /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    TEE_Close(&sessionHandle, ret);
 
     return ret;
 }
@@ -392,9 +966,9 @@ teeResult_t TEE_RSAVerify(
     teeResult_t        ret = TEE_ERR_NONE;
     tciMessage_ptr     pTci = NULL;
     mcSessionHandle_t  sessionHandle;
-    mcBulkMap_t        keyMapInfo;
-    mcBulkMap_t        plainMapInfo;
-    mcBulkMap_t        signatureMapInfo;
+    teeBulk_t          keyBulk;
+    teeBulk_t          plainBulk;
+    teeBulk_t          signatureBulk;
     mcResult_t         mcRet;
 
     do {
@@ -407,19 +981,21 @@ teeResult_t TEE_RSAVerify(
         }
 
         /* Map memory to the secure world */
-        mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
+        mcRet = TEE_MapKey(&sessionHandle, keyData, keyDataLength, &keyBulk);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcMap(&sessionHandle, (void*)plainData, plainDataLength, &plainMapInfo);
+        mcRet = TEE_MapBulk(&sessionHandle, TEE_STAGING_PLAIN, (void*)plainData,
+                            plainDataLength, true, &plainBulk);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcMap(&sessionHandle, (void*)signatureData, signatureDataLength, &signatureMapInfo);
+        mcRet = TEE_MapBulk(&sessionHandle, TEE_STAGING_SIGNATURE, (void*)signatureData,
+                            signatureDataLength, true, &signatureBulk);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
@@ -427,13 +1003,13 @@ teeResult_t TEE_RSAVerify(
 
         /* Update TCI buffer */
         pTci->command.header.commandId = CMD_ID_TEE_RSA_VERIFY;
-        pTci->rsaverify.keydata = (uint32_t)keyMapInfo.sVirtualAddr;
+        pTci->rsaverify.keydata = keyBulk.sVirtualAddr;
         pTci->rsaverify.keydatalen = keyDataLength;
 
-        pTci->rsaverify.plaindata = (uint32_t)plainMapInfo.sVirtualAddr;
+        pTci->rsaverify.plaindata = plainBulk.sVirtualAddr;
         pTci->rsaverify.plaindatalen = plainDataLength;
 
-        pTci->rsaverify.signaturedata = (uint32_t)signatureMapInfo.sVirtualAddr;
+        pTci->rsaverify.signaturedata = signatureBulk.sVirtualAddr;
         pTci->rsaverify.signaturedatalen = signatureDataLength;
 
         pTci->rsaverify.algorithm = algorithm;
@@ -455,21 +1031,21 @@ teeResult_t TEE_RSAVerify(
         }
 
         /* Unmap memory */
-        mcRet = mcUnmap(&sessionHandle, (void*)keyData, &keyMapInfo);
+        mcRet = TEE_UnmapBulk(&sessionHandle, &keyBulk, 0);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcUnmap(&sessionHandle, (void*)plainData, &plainMapInfo);
+        mcRet = TEE_UnmapBulk(&sessionHandle, &plainBulk, 0);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcUnmap(&sessionHandle, (void*)signatureData, &signatureMapInfo);
+        mcRet = TEE_UnmapBulk(&sessionHandle, &signatureBulk, 0);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_MAP;
@@ -489,7 +1065,7 @@ teeResult_t TEE_RSAVerify(
     } while (false);
 
     /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    TEE_Close(&sessionHandle, ret);
 
     return ret;
 }
@@ -526,6 +1102,7 @@ teeResult_t TEE_HMACKeyGenerate(
         }
 
         /* Map memory to the secure world */
+        TEE_MakeRoom(&sessionHandle, 1);
         mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
@@ -573,7 +1150,7 @@ teeResult_t TEE_HMACKeyGenerate(
     }while (false);
 
     /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    TEE_Close(&sessionHandle, ret);
 
     return ret;
 }
@@ -603,9 +1180,9 @@ teeResult_t TEE_HMACSign(
     teeResult_t        ret = TEE_ERR_NONE;
     tciMessage_ptr     pTci = NULL;
     mcSessionHandle_t  sessionHandle;
-    mcBulkMap_t        keyMapInfo;
-    mcBulkMap_t        plainMapInfo;
-    mcBulkMap_t        signatureMapInfo;
+    teeBulk_t          keyBulk;
+    teeBulk_t          plainBulk;
+    teeBulk_t          signatureBulk;
     mcResult_t         mcRet;
 
     do {
@@ -618,19 +1195,21 @@ teeResult_t TEE_HMACSign(
         }
 
         /* Map memory to the secure world */
-        mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
+        mcRet = TEE_MapKey(&sessionHandle, keyData, keyDataLength, &keyBulk);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcMap(&sessionHandle, (void*)plainData, plainDataLength, &plainMapInfo);
+        mcRet = TEE_MapBulk(&sessionHandle, TEE_STAGING_PLAIN, (void*)plainData,
+                            plainDataLength, true, &plainBulk);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcMap(&sessionHandle, (void*)signatureData, *signatureDataLength, &signatureMapInfo);
+        mcRet = TEE_MapBulk(&sessionHandle, TEE_STAGING_SIGNATURE, (void*)signatureData,
+                            *signatureDataLength, false, &signatureBulk);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
@@ -638,13 +1217,13 @@ teeResult_t TEE_HMACSign(
 
         /* Update TCI buffer */
         pTci->command.header.commandId = CMD_ID_TEE_HMAC_SIGN;
-        pTci->hmacsign.keydata = (uint32_t)keyMapInfo.sVirtualAddr;
+        pTci->hmacsign.keydata = keyBulk.sVirtualAddr;
         pTci->hmacsign.keydatalen = keyDataLength;
 
-        pTci->hmacsign.plaindata = (uint32_t)plainMapInfo.sVirtualAddr;
+        pTci->hmacsign.plaindata = plainBulk.sVirtualAddr;
         pTci->hmacsign.plaindatalen = plainDataLength;
 
-        pTci->hmacsign.signaturedata = (uint32_t)signatureMapInfo.sVirtualAddr;
+        pTci->hmacsign.signaturedata = signatureBulk.sVirtualAddr;
         pTci->hmacsign.signaturedatalen = *signatureDataLength;
 
         pTci->hmacsign.digest = digest;
@@ -665,21 +1244,23 @@ teeResult_t TEE_HMACSign(
         }
 
         /* Unmap memory */
-        mcRet = mcUnmap(&sessionHandle, (void*)keyData, &keyMapInfo);
+        mcRet = TEE_UnmapBulk(&sessionHandle, &keyBulk, 0);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcUnmap(&sessionHandle, (void*)plainData, &plainMapInfo);
+        mcRet = TEE_UnmapBulk(&sessionHandle, &plainBulk, 0);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcUnmap(&sessionHandle, (void*)signatureData, &signatureMapInfo);
+        mcRet = TEE_UnmapBulk(&sessionHandle, &signatureBulk,
+                              RET_OK == pTci->response.header.returnCode ?
+                              pTci->hmacsign.signaturedatalen : 0);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_MAP;
@@ -700,7 +1281,7 @@ teeResult_t TEE_HMACSign(
     } while (false);
 
     /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    TEE_Close(&sessionHandle, ret);
 
     return ret;
 }
@@ -731,9 +1312,9 @@ teeResult_t TEE_HMACVerify(
     teeResult_t        ret = TEE_ERR_NONE;
     tciMessage_ptr     pTci = NULL;
     mcSessionHandle_t  sessionHandle;
-    mcBulkMap_t        keyMapInfo;
-    mcBulkMap_t        plainMapInfo;
-    mcBulkMap_t        signatureMapInfo;
+    teeBulk_t          keyBulk;
+    teeBulk_t          plainBulk;
+    teeBulk_t          signatureBulk;
     mcResult_t         mcRet;
 
     do {
@@ -746,19 +1327,21 @@ teeResult_t TEE_HMACVerify(
         }
 
         /* Map memory to the secure world */
-        mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
+        mcRet = TEE_MapKey(&sessionHandle, keyData, keyDataLength, &keyBulk);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcMap(&sessionHandle, (void*)plainData, plainDataLength, &plainMapInfo);
+        mcRet = TEE_MapBulk(&sessionHandle, TEE_STAGING_PLAIN, (void*)plainData,
+                            plainDataLength, true, &plainBulk);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcMap(&sessionHandle, (void*)signatureData, signatureDataLength, &signatureMapInfo);
+        mcRet = TEE_MapBulk(&sessionHandle, TEE_STAGING_SIGNATURE, (void*)signatureData,
+                            signatureDataLength, true, &signatureBulk);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
@@ -766,13 +1349,13 @@ teeResult_t TEE_HMACVerify(
 
         /* Update TCI buffer */
         pTci->command.header.commandId = CMD_ID_TEE_HMAC_VERIFY;
-        pTci->hmacverify.keydata = (uint32_t)keyMapInfo.sVirtualAddr;
+        pTci->hmacverify.keydata = keyBulk.sVirtualAddr;
         pTci->hmacverify.keydatalen = keyDataLength;
 
-        pTci->hmacverify.plaindata = (uint32_t)plainMapInfo.sVirtualAddr;
+        pTci->hmacverify.plaindata = plainBulk.sVirtualAddr;
         pTci->hmacverify.plaindatalen = plainDataLength;
 
-        pTci->hmacverify.signaturedata = (uint32_t)signatureMapInfo.sVirtualAddr;
+        pTci->hmacverify.signaturedata = signatureBulk.sVirtualAddr;
         pTci->hmacverify.signaturedatalen = signatureDataLength;
 
         pTci->hmacverify.digest = digest;
@@ -794,21 +1377,21 @@ teeResult_t TEE_HMACVerify(
         }
 
         /* Unmap memory */
-        mcRet = mcUnmap(&sessionHandle, (void*)keyData, &keyMapInfo);
+        mcRet = TEE_UnmapBulk(&sessionHandle, &keyBulk, 0);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcUnmap(&sessionHandle, (void*)plainData, &plainMapInfo);
+        mcRet = TEE_UnmapBulk(&sessionHandle, &plainBulk, 0);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcUnmap(&sessionHandle, (void*)signatureData, &signatureMapInfo);
+        mcRet = TEE_UnmapBulk(&sessionHandle, &signatureBulk, 0);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_MAP;
@@ -828,7 +1411,7 @@ teeResult_t TEE_HMACVerify(
     } while (false);
 
     /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    TEE_Close(&sessionHandle, ret);
 
     return ret;
 }
@@ -882,6 +1465,7 @@ teeResult_t TEE_KeyImport(
         }
 
         /* Map memory to the secure world */
+        TEE_MakeRoom(&sessionHandle, 2);
         mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
@@ -945,7 +1529,7 @@ teeResult_t TEE_KeyImport(
     } while (false);
 
     /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    TEE_Close(&sessionHandle, ret);
 
     return ret;
 }
@@ -988,6 +1572,7 @@ teeResult_t TEE_GetPubKey(
         }
 
         /* Map memory to the secure world */
+        TEE_MakeRoom(&sessionHandle, 3);
         mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
@@ -1067,7 +1652,7 @@ teeResult_t TEE_GetPubKey(
     } while (false);
 
     /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    TEE_Close(&sessionHandle, ret);
 
     return ret;
 }
@@ -17,7 +17,7 @@ ifeq ($(filter-out exynos5,$(TARGET_BOARD_PLATFORM)),)
 LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
-LOCAL_SHARED_LIBRARIES := liblog libutils libcutils libexynosutils libexynosv4l2 libsync libexynosdisplay libvirtualdisplay
+LOCAL_SHARED_LIBRARIES := liblog libutils libcutils libexynosutils libexynosv4l2 libsync libexynosdisplay libvirtualdisplay libhardware
 
 LOCAL_CFLAGS += -DUSES_VIRTUAL_DISPLAY
 
@@ -37,10 +37,14 @@ LOCAL_ADDITIONAL_DEPENDENCIES += \
 	$(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
 
 LOCAL_SRC_FILES := \
-	ExynosVirtualDisplayModule.cpp
+	ExynosVirtualDisplayModule.cpp \
+	ExynosNV12Converter.cpp \
+	ExynosSinkDamage.cpp
 
 LOCAL_MODULE_TAGS := eng
 LOCAL_MODULE := libvirtualdisplaymodule
 include $(BUILD_SHARED_LIBRARY)
 
+include $(LOCAL_PATH)/tests/Android.mk
+
 endif
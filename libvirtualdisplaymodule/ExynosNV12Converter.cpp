@@ -0,0 +1,260 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include "ExynosNV12Converter.h"
+
+#define MIN_ROWS_PER_THREAD     64
+
+/* limited range coefficients, scaled by 256: Y, Cb and Cr rows of R, G, B */
+static const int16_t BT601_COEFFS[9] = {
+     66, 129,  25,
+    -38, -74, 112,
+    112, -94, -18,
+};
+
+static const int16_t BT709_COEFFS[9] = {
+     47, 157,  16,
+    -26, -87, 112,
+    112, -102, -10,
+};
+
+static inline uint8_t clampToByte(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+ExynosNV12Converter::ExynosNV12Converter(int threads) :
+    mMaxThreads(threads),
+    mNumWorkers(0),
+    mPending(0),
+    mGeneration(0),
+    mExit(false),
+    mStarted(false)
+{
+    pthread_mutex_init(&mConvertLock, NULL);
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mStart, NULL);
+    pthread_cond_init(&mDone, NULL);
+}
+
+ExynosNV12Converter::~ExynosNV12Converter()
+{
+    pthread_mutex_lock(&mLock);
+    mExit = true;
+    pthread_cond_broadcast(&mStart);
+    pthread_mutex_unlock(&mLock);
+
+    for (int i = 1; i <= mNumWorkers; i++)
+        pthread_join(mThreads[i], NULL);
+
+    pthread_cond_destroy(&mDone);
+    pthread_cond_destroy(&mStart);
+    pthread_mutex_destroy(&mLock);
+    pthread_mutex_destroy(&mConvertLock);
+}
+
+void ExynosNV12Converter::startWorkers()
+{
+    long cpus = mMaxThreads > 0 ? mMaxThreads : sysconf(_SC_NPROCESSORS_ONLN);
+
+    mStarted = true;
+    if (cpus > MAX_THREADS)
+        cpus = MAX_THREADS;
+
+    /* the calling thread converts the first part itself */
+    for (int i = 1; i < cpus; i++) {
+        mWorkers[i].owner = this;
+        mWorkers[i].index = i;
+        if (pthread_create(&mThreads[i], NULL, workerLoop, &mWorkers[i])) {
+            ALOGW("%s: could not start conversion thread %d", __func__, i);
+            break;
+        }
+        mNumWorkers++;
+    }
+}
+
+void *ExynosNV12Converter::workerLoop(void *arg)
+{
+    Worker *worker = (Worker *)arg;
+    ExynosNV12Converter *owner = worker->owner;
+    unsigned int generation = 0;
+
+    pthread_mutex_lock(&owner->mLock);
+    for (;;) {
+        while (generation == owner->mGeneration && !owner->mExit)
+            pthread_cond_wait(&owner->mStart, &owner->mLock);
+        if (owner->mExit)
+            break;
+        generation = owner->mGeneration;
+        Job job = owner->mJobs[worker->index];
+        pthread_mutex_unlock(&owner->mLock);
+
+        if (job.bottom > job.top)
+            convertRows(job);
+
+        pthread_mutex_lock(&owner->mLock);
+        if (--owner->mPending == 0)
+            pthread_cond_signal(&owner->mDone);
+    }
+    pthread_mutex_unlock(&owner->mLock);
+
+    return NULL;
+}
+
+void ExynosNV12Converter::convertRows(const Job &job)
+{
+    const Frame &frame = *job.frame;
+    const int16_t *c = job.coeffs;
+
+    for (int y = job.top; y < job.bottom; y += 2) {
+        const uint8_t *src0 = frame.rgba + (size_t)y * frame.rgbaStride * 4;
+        const uint8_t *src1 = src0 + (size_t)frame.rgbaStride * 4;
+        uint8_t *dstY0 = frame.y + (size_t)y * frame.yStride;
+        uint8_t *dstY1 = dstY0 + frame.yStride;
+        uint8_t *dstUV = frame.uv + (size_t)(y / 2) * frame.yStride;
+        int x = job.left;
+
+#ifdef __ARM_NEON__
+        const uint8x8_t yr = vdup_n_u8(c[0]);
+        const uint8x8_t yg = vdup_n_u8(c[1]);
+        const uint8x8_t yb = vdup_n_u8(c[2]);
+        const uint8x16_t yOffset = vdupq_n_u8(16);
+        const int16x8_t uvOffset = vdupq_n_s16(128);
+
+        for (; x + 16 <= job.right; x += 16) {
+            uint8x16x4_t p0 = vld4q_u8(src0 + x * 4);
+            uint8x16x4_t p1 = vld4q_u8(src1 + x * 4);
+            const uint8x16x4_t *rows[2] = { &p0, &p1 };
+            uint8_t *dstY[2] = { dstY0, dstY1 };
+
+            for (int r = 0; r < 2; r++) {
+                const uint8x16x4_t &p = *rows[r];
+                uint16x8_t lo = vmull_u8(vget_low_u8(p.val[0]), yr);
+                uint16x8_t hi = vmull_u8(vget_high_u8(p.val[0]), yr);
+                lo = vmlal_u8(lo, vget_low_u8(p.val[1]), yg);
+                hi = vmlal_u8(hi, vget_high_u8(p.val[1]), yg);
+                lo = vmlal_u8(lo, vget_low_u8(p.val[2]), yb);
+                hi = vmlal_u8(hi, vget_high_u8(p.val[2]), yb);
+                uint8x16_t luma = vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8));
+                vst1q_u8(dstY[r] + x, vaddq_u8(luma, yOffset));
+            }
+
+            /* average each 2x2 block */
+            int16x8_t r = vreinterpretq_s16_u16(vrshrq_n_u16(
+                    vpadalq_u8(vpaddlq_u8(p0.val[0]), p1.val[0]), 2));
+            int16x8_t g = vreinterpretq_s16_u16(vrshrq_n_u16(
+                    vpadalq_u8(vpaddlq_u8(p0.val[1]), p1.val[1]), 2));
+            int16x8_t b = vreinterpretq_s16_u16(vrshrq_n_u16(
+                    vpadalq_u8(vpaddlq_u8(p0.val[2]), p1.val[2]), 2));
+
+            int16x8_t u = vmulq_n_s16(r, c[3]);
+            u = vmlaq_n_s16(u, g, c[4]);
+            u = vmlaq_n_s16(u, b, c[5]);
+            int16x8_t v = vmulq_n_s16(r, c[6]);
+            v = vmlaq_n_s16(v, g, c[7]);
+            v = vmlaq_n_s16(v, b, c[8]);
+
+            uint8x8x2_t uv;
+            uv.val[0] = vqmovun_s16(vaddq_s16(vrshrq_n_s16(u, 8), uvOffset));
+            uv.val[1] = vqmovun_s16(vaddq_s16(vrshrq_n_s16(v, 8), uvOffset));
+            vst2_u8(dstUV + x, uv);
+        }
+#endif
+
+        for (; x < job.right; x += 2) {
+            const uint8_t *p[4] = { src0 + x * 4, src0 + x * 4 + 4,
+                                    src1 + x * 4, src1 + x * 4 + 4 };
+            uint8_t *dst[4] = { dstY0 + x, dstY0 + x + 1, dstY1 + x, dstY1 + x + 1 };
+            int r = 0, g = 0, b = 0;
+
+            for (int i = 0; i < 4; i++) {
+                *dst[i] = clampToByte(((c[0] * p[i][0] + c[1] * p[i][1] +
+                                        c[2] * p[i][2] + 128) >> 8) + 16);
+                r += p[i][0];
+                g += p[i][1];
+                b += p[i][2];
+            }
+            r = (r + 2) >> 2;
+            g = (g + 2) >> 2;
+            b = (b + 2) >> 2;
+            dstUV[x] = clampToByte(((c[3] * r + c[4] * g + c[5] * b + 128) >> 8) + 128);
+            dstUV[x + 1] = clampToByte(((c[6] * r + c[7] * g + c[8] * b + 128) >> 8) + 128);
+        }
+    }
+}
+
+int ExynosNV12Converter::convert(const Frame &frame, int left, int top, int right,
+        int bottom, int colorspace)
+{
+    if (!frame.rgba || !frame.y || !frame.uv || frame.width <= 0 || frame.height <= 0)
+        return -EINVAL;
+
+    /* chroma is subsampled 2x2, so work on whole blocks */
+    left = left < 0 ? 0 : left & ~1;
+    top = top < 0 ? 0 : top & ~1;
+    right = right > frame.width ? frame.width : right;
+    bottom = bottom > frame.height ? frame.height : bottom;
+    right = (right + 1) & ~1;
+    bottom = (bottom + 1) & ~1;
+    if (right > (frame.width & ~1))
+        right = frame.width & ~1;
+    if (bottom > (frame.height & ~1))
+        bottom = frame.height & ~1;
+    if (left >= right || top >= bottom)
+        return 0;
+
+    const int16_t *coeffs = colorspace == COLORSPACE_BT709 ? BT709_COEFFS : BT601_COEFFS;
+    int rows = bottom - top;
+
+    /* the jobs and the worker generation belong to one call at a time */
+    pthread_mutex_lock(&mConvertLock);
+    pthread_mutex_lock(&mLock);
+    if (!mStarted)
+        startWorkers();
+
+    int parts = rows / MIN_ROWS_PER_THREAD;
+    if (parts > mNumWorkers + 1)
+        parts = mNumWorkers + 1;
+    if (parts < 1)
+        parts = 1;
+
+    for (int i = 0; i <= mNumWorkers; i++) {
+        mJobs[i].frame = &frame;
+        mJobs[i].coeffs = coeffs;
+        mJobs[i].left = left;
+        mJobs[i].right = right;
+        if (i < parts) {
+            mJobs[i].top = top + (rows / 2 * i / parts) * 2;
+            mJobs[i].bottom = top + (rows / 2 * (i + 1) / parts) * 2;
+        } else {
+            mJobs[i].top = mJobs[i].bottom = 0;
+        }
+    }
+
+    Job first = mJobs[0];
+    if (parts > 1) {
+        mPending = mNumWorkers;
+        mGeneration++;
+        pthread_cond_broadcast(&mStart);
+    }
+    pthread_mutex_unlock(&mLock);
+
+    convertRows(first);
+
+    if (parts > 1) {
+        pthread_mutex_lock(&mLock);
+        while (mPending)
+            pthread_cond_wait(&mDone, &mLock);
+        pthread_mutex_unlock(&mLock);
+    }
+    pthread_mutex_unlock(&mConvertLock);
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef EXYNOS_NV12_CONVERTER_H
+#define EXYNOS_NV12_CONVERTER_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+/*
+ * RGBA_8888 to NV12M conversion on the CPU, for virtual display frames
+ * that can't go through the WFD GSC. Rows are split across worker threads
+ * and converted with NEON; only the dirty rectangle is converted.
+ */
+
+class ExynosNV12Converter {
+    public:
+        enum {
+            COLORSPACE_BT601 = 0,
+            COLORSPACE_BT709,
+        };
+
+        enum { MAX_THREADS = 4 };
+
+        struct Frame {
+            const uint8_t *rgba;
+            int rgbaStride;     /* in pixels */
+            uint8_t *y;
+            uint8_t *uv;
+            int yStride;        /* in bytes, also used for uv */
+            int width;
+            int height;
+        };
+
+        /* threads is capped at MAX_THREADS, 0 takes one per online CPU */
+        ExynosNV12Converter(int threads = 0);
+        ~ExynosNV12Converter();
+
+        /*
+         * Converts rect [left, right) x [top, bottom) of frame, widened to
+         * even coordinates. Returns 0 or a negative error. Calls from
+         * several threads are run one after the other.
+         */
+        int convert(const Frame &frame, int left, int top, int right, int bottom,
+                int colorspace);
+
+    private:
+        struct Job {
+            const Frame *frame;
+            const int16_t *coeffs;
+            int left;
+            int right;
+            int top;            /* even */
+            int bottom;         /* even */
+        };
+
+        struct Worker {
+            ExynosNV12Converter *owner;
+            int index;
+        };
+
+        static void *workerLoop(void *arg);
+        static void convertRows(const Job &job);
+        void startWorkers();
+
+        pthread_mutex_t mConvertLock;   /* held for a whole convert() */
+        pthread_mutex_t mLock;
+        pthread_cond_t mStart;
+        pthread_cond_t mDone;
+        pthread_t mThreads[MAX_THREADS];
+        Worker mWorkers[MAX_THREADS];
+        Job mJobs[MAX_THREADS];
+        int mMaxThreads;
+        int mNumWorkers;
+        int mPending;
+        unsigned int mGeneration;
+        bool mExit;
+        bool mStarted;
+};
+
+#endif
@@ -0,0 +1,145 @@
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include "ExynosSinkDamage.h"
+#include "gralloc_priv.h"
+
+static inline bool isEmpty(const hwc_rect_t &rect)
+{
+    return rect.left >= rect.right || rect.top >= rect.bottom;
+}
+
+static void unionRect(hwc_rect_t *dst, const hwc_rect_t &src)
+{
+    if (isEmpty(src))
+        return;
+    if (isEmpty(*dst)) {
+        *dst = src;
+        return;
+    }
+    if (src.left < dst->left)
+        dst->left = src.left;
+    if (src.top < dst->top)
+        dst->top = src.top;
+    if (src.right > dst->right)
+        dst->right = src.right;
+    if (src.bottom > dst->bottom)
+        dst->bottom = src.bottom;
+}
+
+ExynosSinkDamage::ExynosSinkDamage() :
+    mNumSinks(0),
+    mNextSink(0),
+    mNumLayers(-1),
+    mWidth(0),
+    mHeight(0)
+{
+    memset(mSinks, 0, sizeof(mSinks));
+    memset(mLayers, 0, sizeof(mLayers));
+}
+
+void ExynosSinkDamage::addFrame(hwc_display_contents_1_t *contents, int width, int height)
+{
+    hwc_rect_t full = { 0, 0, width, height };
+    hwc_rect_t damage = { 0, 0, 0, 0 };
+    int numLayers = 0;
+
+    for (size_t i = 0; i < contents->numHwLayers; i++)
+        if (contents->hwLayers[i].compositionType != HWC_FRAMEBUFFER_TARGET)
+            numLayers++;
+
+    bool whole = (contents->flags & HWC_GEOMETRY_CHANGED) || numLayers != mNumLayers ||
+                 numLayers > MAX_LAYERS || width != mWidth || height != mHeight;
+
+    /* a new sink size means new sink buffers, whatever their handles */
+    if (width != mWidth || height != mHeight) {
+        mNumSinks = 0;
+        mNextSink = 0;
+    }
+
+    int index = 0;
+    for (size_t i = 0; i < contents->numHwLayers; i++) {
+        hwc_layer_1_t &layer = contents->hwLayers[i];
+
+        if (layer.compositionType == HWC_FRAMEBUFFER_TARGET)
+            continue;
+        if (!whole && ((layer.flags & HWC_SKIP_LAYER) || layer.handle != mLayers[index]))
+            unionRect(&damage, layer.displayFrame);
+        if (index < MAX_LAYERS)
+            mLayers[index] = layer.handle;
+        index++;
+    }
+
+    mNumLayers = numLayers;
+    mWidth = width;
+    mHeight = height;
+
+    if (whole)
+        damage = full;
+    for (int i = 0; i < mNumSinks; i++)
+        unionRect(&mSinks[i].dirty, damage);
+}
+
+ExynosSinkDamage::Sink *ExynosSinkDamage::find(buffer_handle_t sink)
+{
+    private_handle_t *handle = private_handle_t::dynamicCast(sink);
+
+    if (!handle)
+        return NULL;
+
+    /* a freed handle can come back at the same address for a new buffer */
+    for (int i = 0; i < mNumSinks; i++)
+        if (mSinks[i].handle == sink && mSinks[i].fd == handle->fd &&
+            mSinks[i].base == handle->base)
+            return &mSinks[i];
+    return NULL;
+}
+
+bool ExynosSinkDamage::dirty(buffer_handle_t sink, hwc_rect_t *dirty)
+{
+    Sink *tracked = find(sink);
+
+    if (!tracked) {
+        dirty->left = 0;
+        dirty->top = 0;
+        dirty->right = mWidth;
+        dirty->bottom = mHeight;
+        return true;
+    }
+
+    *dirty = tracked->dirty;
+    return !isEmpty(*dirty);
+}
+
+void ExynosSinkDamage::written(buffer_handle_t sink)
+{
+    private_handle_t *handle = private_handle_t::dynamicCast(sink);
+    Sink *tracked = find(sink);
+
+    if (!handle)
+        return;
+    if (!tracked) {
+        if (mNumSinks < MAX_SINKS) {
+            tracked = &mSinks[mNumSinks++];
+        } else {
+            tracked = &mSinks[mNextSink];
+            mNextSink = (mNextSink + 1) % MAX_SINKS;
+        }
+        tracked->handle = sink;
+        tracked->fd = handle->fd;
+        tracked->base = handle->base;
+    }
+    memset(&tracked->dirty, 0, sizeof(tracked->dirty));
+}
+
+void ExynosSinkDamage::forget(buffer_handle_t sink)
+{
+    Sink *tracked = find(sink);
+
+    if (!tracked)
+        return;
+    *tracked = mSinks[--mNumSinks];
+    if (mNextSink >= mNumSinks)
+        mNextSink = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef EXYNOS_SINK_DAMAGE_H
+#define EXYNOS_SINK_DAMAGE_H
+
+#include <hardware/hwcomposer.h>
+
+/*
+ * Tracks which part of each virtual display sink buffer is out of date.
+ * The sink BufferQueue cycles through a few buffers, so a buffer handed to
+ * set() last held the frame of several frames ago: its dirty rectangle is
+ * the union of the damage of every frame since it was last written.
+ *
+ * The damage of a frame is the display frame of every layer whose buffer
+ * changed, or of every skip layer, since the previous frame. A flagged
+ * geometry change, a new layer count or an untracked sink buffer damage
+ * the whole sink.
+ */
+
+class ExynosSinkDamage {
+    public:
+        enum { MAX_SINKS = 8, MAX_LAYERS = 32 };
+
+        ExynosSinkDamage();
+
+        /* Adds the damage of contents to every tracked sink buffer. */
+        void addFrame(hwc_display_contents_1_t *contents, int width, int height);
+
+        /*
+         * Returns in dirty the part of sink to rewrite for the current frame;
+         * the whole sink if it is not tracked. Returns false if sink already
+         * holds the current frame.
+         */
+        bool dirty(buffer_handle_t sink, hwc_rect_t *dirty);
+
+        /* sink now holds the current frame. */
+        void written(buffer_handle_t sink);
+
+        /* The contents of sink are unknown; its next use rewrites all of it. */
+        void forget(buffer_handle_t sink);
+
+    private:
+        struct Sink {
+            buffer_handle_t handle;
+            int fd;
+            void *base;
+            hwc_rect_t dirty;
+        };
+
+        Sink *find(buffer_handle_t sink);
+
+        Sink mSinks[MAX_SINKS];
+        int mNumSinks;
+        int mNextSink;                      /* replaced when all are in use */
+        buffer_handle_t mLayers[MAX_LAYERS];
+        int mNumLayers;                     /* layers of the last frame, -1 before the first */
+        int mWidth;
+        int mHeight;
+};
+
+#endif
@@ -1,7 +1,17 @@
+#include <errno.h>
+#include <unistd.h>
+
+#include <sync/sync.h>
+
 #include "ExynosVirtualDisplayModule.h"
+#include "ExynosHWCModule.h"
+#include "gralloc_priv.h"
+
+#define FENCE_TIMEOUT_MS    1000
 
 ExynosVirtualDisplayModule::ExynosVirtualDisplayModule(struct exynos5_hwc_composer_device_1_t *pdev)
-    : ExynosVirtualDisplay(pdev)
+    : ExynosVirtualDisplay(pdev),
+      mGrallocModule(NULL)
 {
     mGLESFormat = HAL_PIXEL_FORMAT_RGBA_8888;
 }
@@ -35,3 +45,207 @@ int32_t ExynosVirtualDisplayModule::getDisplayAttributes(const uint32_t attribut
     }
     return 0;
 }
+
+int ExynosVirtualDisplayModule::convertGLESOutput(buffer_handle_t src, buffer_handle_t dst,
+        const hwc_rect_t *dirty)
+{
+    private_handle_t *srcHandle = private_handle_t::dynamicCast(src);
+    private_handle_t *dstHandle = private_handle_t::dynamicCast(dst);
+    void *srcAddr[3] = { NULL, NULL, NULL };
+    void *dstAddr[3] = { NULL, NULL, NULL };
+    int ret;
+
+    if (!srcHandle || !dstHandle)
+        return -EINVAL;
+    if (srcHandle->format != HAL_PIXEL_FORMAT_RGBA_8888 &&
+        srcHandle->format != HAL_PIXEL_FORMAT_RGBX_8888) {
+        ALOGE("%s: unsupported source format %d", __func__, srcHandle->format);
+        return -EINVAL;
+    }
+    if (dstHandle->format != HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M) {
+        ALOGE("%s: unsupported sink format %d", __func__, dstHandle->format);
+        return -EINVAL;
+    }
+    /* the CPU can't write a protected sink */
+    if (mSinkUsage & GRALLOC_USAGE_PROTECTED)
+        return -EPERM;
+
+    if (!mGrallocModule &&
+        hw_get_module(GRALLOC_HARDWARE_MODULE_ID, (const hw_module_t **)&mGrallocModule)) {
+        ALOGE("%s: could not load the gralloc module", __func__);
+        mGrallocModule = NULL;
+        return -ENODEV;
+    }
+
+    int width = srcHandle->width < dstHandle->width ? srcHandle->width : dstHandle->width;
+    int height = srcHandle->height < dstHandle->height ? srcHandle->height : dstHandle->height;
+
+    ret = mGrallocModule->lock(mGrallocModule, src, GRALLOC_USAGE_SW_READ_OFTEN,
+            0, 0, width, height, srcAddr);
+    if (ret) {
+        ALOGE("%s: could not lock the GLES output (%d)", __func__, ret);
+        return ret;
+    }
+    ret = mGrallocModule->lock(mGrallocModule, dst, GRALLOC_USAGE_SW_WRITE_OFTEN,
+            0, 0, width, height, dstAddr);
+    if (ret) {
+        ALOGE("%s: could not lock the sink buffer (%d)", __func__, ret);
+        mGrallocModule->unlock(mGrallocModule, src);
+        return ret;
+    }
+
+    if (srcAddr[0] && dstAddr[0] && dstAddr[1]) {
+        ExynosNV12Converter::Frame frame;
+
+        frame.rgba = (const uint8_t *)srcAddr[0];
+        frame.rgbaStride = srcHandle->stride;
+        frame.y = (uint8_t *)dstAddr[0];
+        frame.uv = (uint8_t *)dstAddr[1];
+        frame.yStride = dstHandle->stride;
+        frame.width = width;
+        frame.height = height;
+
+        ret = mNV12Converter.convert(frame,
+                dirty ? dirty->left : 0, dirty ? dirty->top : 0,
+                dirty ? dirty->right : width, dirty ? dirty->bottom : height,
+                height >= 720 ? ExynosNV12Converter::COLORSPACE_BT709 :
+                                ExynosNV12Converter::COLORSPACE_BT601);
+    } else {
+        ALOGE("%s: buffers are not mapped", __func__);
+        ret = -EINVAL;
+    }
+
+    mGrallocModule->unlock(mGrallocModule, dst);
+    mGrallocModule->unlock(mGrallocModule, src);
+
+    return ret;
+}
+
+/* The framebuffer target when GLES composed every layer of the frame. */
+hwc_layer_1_t *ExynosVirtualDisplayModule::glesOnlyTarget(hwc_display_contents_1_t *contents)
+{
+    hwc_layer_1_t *target = NULL;
+
+    for (size_t i = 0; i < contents->numHwLayers; i++) {
+        hwc_layer_1_t &layer = contents->hwLayers[i];
+
+        if (layer.compositionType == HWC_FRAMEBUFFER_TARGET)
+            target = &layer;
+        else if (layer.compositionType == HWC_OVERLAY)
+            return NULL;
+    }
+
+    return target && target->handle ? target : NULL;
+}
+
+int ExynosVirtualDisplayModule::set(hwc_display_contents_1_t *contents)
+{
+    if (!contents || !contents->outbuf)
+        return ExynosVirtualDisplay::set(contents);
+
+    hwc_layer_1_t *target = glesOnlyTarget(contents);
+    private_handle_t *sink = private_handle_t::dynamicCast(contents->outbuf);
+
+    if (sink)
+        mSinkDamage.addFrame(contents, sink->width, sink->height);
+
+    if (!target || !sink || (mSinkUsage & GRALLOC_USAGE_PROTECTED)) {
+        int ret = ExynosVirtualDisplay::set(contents);
+
+        if (ret >= 0)
+            mSinkDamage.written(contents->outbuf);
+        else
+            mSinkDamage.forget(contents->outbuf);
+        return ret;
+    }
+
+    /* the WFD GSC writes NV12M sinks in GSC_W_ALIGNMENT wide rows */
+    if (!(sink->width % GSC_W_ALIGNMENT)) {
+        /* set() owns the fences, keep copies for the CPU if the GSC fails */
+        int targetFence = target->acquireFenceFd >= 0 ? dup(target->acquireFenceFd) : -1;
+        int sinkFence = contents->outbufAcquireFenceFd >= 0 ?
+                        dup(contents->outbufAcquireFenceFd) : -1;
+        bool fencesKept = (targetFence >= 0) == (target->acquireFenceFd >= 0) &&
+                          (sinkFence >= 0) == (contents->outbufAcquireFenceFd >= 0);
+
+        int ret = ExynosVirtualDisplay::set(contents);
+        if (ret >= 0) {
+            if (targetFence >= 0)
+                close(targetFence);
+            if (sinkFence >= 0)
+                close(sinkFence);
+            mSinkDamage.written(contents->outbuf);
+            return ret;
+        }
+
+        if (target->releaseFenceFd >= 0)
+            close(target->releaseFenceFd);
+        if (contents->retireFenceFd >= 0)
+            close(contents->retireFenceFd);
+        target->releaseFenceFd = -1;
+        contents->retireFenceFd = -1;
+        target->acquireFenceFd = targetFence;
+        contents->outbufAcquireFenceFd = sinkFence;
+        mSinkDamage.forget(contents->outbuf);
+
+        /* without the fences the CPU can't tell when the buffers are ready */
+        if (!fencesKept) {
+            ALOGE("%s: WFD GSC failed (%d), dropping the frame", __func__, ret);
+            if (targetFence >= 0)
+                close(targetFence);
+            if (sinkFence >= 0)
+                close(sinkFence);
+            target->acquireFenceFd = -1;
+            contents->outbufAcquireFenceFd = -1;
+            return ret;
+        }
+        ALOGW("%s: WFD GSC failed (%d), converting on the CPU", __func__, ret);
+    }
+
+    return setOnCpu(contents, *target);
+}
+
+/* Waits for fence and closes it. Returns 0, or a negative error on timeout. */
+static int waitFence(int &fence, const char *what)
+{
+    int ret = 0;
+
+    if (fence < 0)
+        return 0;
+    if (sync_wait(fence, FENCE_TIMEOUT_MS) < 0) {
+        ret = -errno;
+        ALOGE("%s fence did not signal (%d)", what, ret);
+    }
+    close(fence);
+    fence = -1;
+    return ret;
+}
+
+int ExynosVirtualDisplayModule::setOnCpu(hwc_display_contents_1_t *contents,
+        hwc_layer_1_t &target)
+{
+    int ret = waitFence(target.acquireFenceFd, "GLES output");
+    int sinkRet = waitFence(contents->outbufAcquireFenceFd, "sink buffer");
+    hwc_rect_t dirty;
+
+    /* the CPU is done with both buffers when this returns */
+    target.releaseFenceFd = -1;
+    contents->retireFenceFd = -1;
+
+    /* GLES or the sink consumer still owns a buffer, drop the frame */
+    if (ret || sinkRet)
+        return ret ? ret : sinkRet;
+
+    if (!mSinkDamage.dirty(contents->outbuf, &dirty))
+        return 0;
+
+    ret = convertGLESOutput(target.handle, contents->outbuf, &dirty);
+    if (ret) {
+        ALOGE("%s: could not convert the GLES output (%d)", __func__, ret);
+        mSinkDamage.forget(contents->outbuf);
+        return ret;
+    }
+
+    mSinkDamage.written(contents->outbuf);
+    return 0;
+}
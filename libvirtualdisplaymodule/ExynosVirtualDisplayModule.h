@@ -2,6 +2,8 @@
 #define EXYNOS_VIRTUAL_DISPLAY_MODULE_H
 
 #include "ExynosVirtualDisplay.h"
+#include "ExynosNV12Converter.h"
+#include "ExynosSinkDamage.h"
 
 class ExynosVirtualDisplayModule : public ExynosVirtualDisplay {
     public:
@@ -9,6 +11,30 @@ class ExynosVirtualDisplayModule : public ExynosVirtualDisplay {
         ~ExynosVirtualDisplayModule();
 
         virtual int32_t getDisplayAttributes(const uint32_t attribute);
+
+        /*
+         * GLES frames are converted on the CPU when the WFD GSC can't write
+         * the sink or ExynosVirtualDisplay::set() fails with them; everything
+         * else goes to ExynosVirtualDisplay::set(). The CPU only rewrites
+         * the part of the sink buffer that changed since it was last written.
+         */
+        virtual int set(hwc_display_contents_1_t *contents);
+
+        /*
+         * Converts the RGBA GLES output src into the NV12M sink buffer dst on
+         * the CPU, for frames the WFD GSC can't take. Only dirty is converted
+         * when given.
+         */
+        int convertGLESOutput(buffer_handle_t src, buffer_handle_t dst,
+                const hwc_rect_t *dirty);
+
+    private:
+        hwc_layer_1_t *glesOnlyTarget(hwc_display_contents_1_t *contents);
+        int setOnCpu(hwc_display_contents_1_t *contents, hwc_layer_1_t &target);
+
+        ExynosNV12Converter mNV12Converter;
+        ExynosSinkDamage mSinkDamage;
+        const gralloc_module_t *mGrallocModule;
 };
 
 enum {
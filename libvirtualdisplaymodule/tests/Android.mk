@@ -0,0 +1,51 @@
+# Copyright (C) 2008 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH:= $(call my-dir)
+
+# NV12 converter tests, on the host (scalar) and on the device (NEON)
+include $(CLEAR_VARS)
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_SRC_FILES := \
+	nv12_converter_test.cpp \
+	../ExynosNV12Converter.cpp
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS := -lpthread
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := libvirtualdisplaymodule_nv12_test
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_SRC_FILES := \
+	nv12_converter_test.cpp \
+	../ExynosNV12Converter.cpp
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := libvirtualdisplaymodule_nv12_test
+include $(BUILD_NATIVE_TEST)
+
+# Sink damage tracking tests, on the host
+include $(CLEAR_VARS)
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/.. \
+	$(LOCAL_PATH)/../../include \
+	$(TOP)/hardware/samsung_slsi-cm/exynos/include
+LOCAL_SRC_FILES := \
+	sink_damage_test.cpp \
+	../ExynosSinkDamage.cpp
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := libvirtualdisplaymodule_sink_damage_test
+include $(BUILD_HOST_NATIVE_TEST)
@@ -0,0 +1,207 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "ExynosNV12Converter.h"
+
+/*
+ * ExynosNV12Converter against a per-pixel reference of the same limited
+ * range conversion, for whole frames, dirty rectangles and concurrent
+ * callers.
+ */
+
+static const int REF_COEFFS[2][9] = {
+    {  66, 129,  25, -38, -74, 112, 112,  -94, -18 },    /* BT.601 */
+    {  47, 157,  16, -26, -87, 112, 112, -102, -10 },    /* BT.709 */
+};
+
+static int clampByte(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+struct TestFrame {
+    int width;
+    int height;
+    int rgbaStride;
+    int yStride;
+    uint8_t *rgba;
+    uint8_t *y;
+    uint8_t *uv;
+
+    TestFrame(int w, int h, unsigned int seed) :
+        width(w), height(h), rgbaStride(w + 8), yStride((w + 15) & ~15)
+    {
+        rgba = (uint8_t *)malloc((size_t)rgbaStride * h * 4);
+        y = (uint8_t *)malloc((size_t)yStride * h);
+        uv = (uint8_t *)malloc((size_t)yStride * ((h + 1) / 2));
+        for (size_t i = 0; i < (size_t)rgbaStride * h * 4; i++) {
+            seed = seed * 1103515245 + 12345;
+            rgba[i] = seed >> 16;
+        }
+        clear(0xA5);
+    }
+
+    ~TestFrame()
+    {
+        free(rgba);
+        free(y);
+        free(uv);
+    }
+
+    void clear(uint8_t value)
+    {
+        memset(y, value, (size_t)yStride * height);
+        memset(uv, value, (size_t)yStride * ((height + 1) / 2));
+    }
+
+    ExynosNV12Converter::Frame frame() const
+    {
+        ExynosNV12Converter::Frame f;
+
+        f.rgba = rgba;
+        f.rgbaStride = rgbaStride;
+        f.y = y;
+        f.uv = uv;
+        f.yStride = yStride;
+        f.width = width;
+        f.height = height;
+        return f;
+    }
+
+    /* Checks [left, right) x [top, bottom) against the reference and the rest against fill. */
+    void expectConverted(int left, int top, int right, int bottom, int colorspace,
+            uint8_t fill) const
+    {
+        const int *c = REF_COEFFS[colorspace];
+
+        for (int row = 0; row < (height & ~1); row++) {
+            for (int x = 0; x < (width & ~1); x++) {
+                bool inside = x >= left && x < right && row >= top && row < bottom;
+                const uint8_t *p = rgba + ((size_t)row * rgbaStride + x) * 4;
+                int expected = inside ? clampByte(((c[0] * p[0] + c[1] * p[1] + c[2] * p[2] +
+                                                    128) >> 8) + 16) : fill;
+
+                ASSERT_EQ(expected, y[(size_t)row * yStride + x])
+                    << "luma at " << x << "," << row;
+            }
+        }
+
+        for (int row = 0; row < height / 2; row++) {
+            for (int x = 0; x < (width & ~1); x += 2) {
+                bool inside = x >= left && x < right && row * 2 >= top && row * 2 < bottom;
+                int sum[3] = { 0, 0, 0 };
+
+                for (int dy = 0; dy < 2; dy++)
+                    for (int dx = 0; dx < 2; dx++)
+                        for (int ch = 0; ch < 3; ch++)
+                            sum[ch] += rgba[((size_t)(row * 2 + dy) * rgbaStride + x + dx) * 4 + ch];
+                int r = (sum[0] + 2) >> 2, g = (sum[1] + 2) >> 2, b = (sum[2] + 2) >> 2;
+                int u = inside ? clampByte(((c[3] * r + c[4] * g + c[5] * b + 128) >> 8) + 128) : fill;
+                int v = inside ? clampByte(((c[6] * r + c[7] * g + c[8] * b + 128) >> 8) + 128) : fill;
+
+                ASSERT_EQ(u, uv[(size_t)row * yStride + x]) << "cb at " << x << "," << row * 2;
+                ASSERT_EQ(v, uv[(size_t)row * yStride + x + 1]) << "cr at " << x << "," << row * 2;
+            }
+        }
+    }
+};
+
+TEST(NV12Converter, WholeFrames)
+{
+    static const int sizes[][2] = {
+        { 1920, 1080 }, { 1280, 720 }, { 854, 480 }, { 720, 480 }, { 33, 17 }, { 2, 2 },
+    };
+    ExynosNV12Converter converter(ExynosNV12Converter::MAX_THREADS);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (int cs = 0; cs < 2; cs++) {
+            TestFrame f(sizes[i][0], sizes[i][1], i * 2 + cs + 1);
+
+            SCOPED_TRACE(testing::Message() << sizes[i][0] << "x" << sizes[i][1]
+                         << " colorspace " << cs);
+            ASSERT_EQ(0, converter.convert(f.frame(), 0, 0, f.width, f.height, cs));
+            f.expectConverted(0, 0, f.width & ~1, f.height & ~1, cs, 0xA5);
+        }
+    }
+}
+
+TEST(NV12Converter, DirtyRectWidenedToChromaBlocks)
+{
+    ExynosNV12Converter converter;
+    TestFrame f(1280, 720, 7);
+
+    /* odd edges grow outwards to whole 2x2 blocks */
+    ASSERT_EQ(0, converter.convert(f.frame(), 101, 33, 731, 601,
+                                   ExynosNV12Converter::COLORSPACE_BT709));
+    f.expectConverted(100, 32, 732, 602, ExynosNV12Converter::COLORSPACE_BT709, 0xA5);
+
+    /* rects past the frame are clipped, empty ones touch nothing */
+    f.clear(0x11);
+    ASSERT_EQ(0, converter.convert(f.frame(), -20, 700, 5000, 5000,
+                                   ExynosNV12Converter::COLORSPACE_BT601));
+    f.expectConverted(0, 700, 1280, 720, ExynosNV12Converter::COLORSPACE_BT601, 0x11);
+    f.clear(0x11);
+    ASSERT_EQ(0, converter.convert(f.frame(), 300, 300, 300, 500,
+                                   ExynosNV12Converter::COLORSPACE_BT601));
+    f.expectConverted(0, 0, 0, 0, ExynosNV12Converter::COLORSPACE_BT601, 0x11);
+}
+
+TEST(NV12Converter, RejectsMissingPlanes)
+{
+    ExynosNV12Converter converter;
+    TestFrame f(64, 64, 3);
+    ExynosNV12Converter::Frame frame = f.frame();
+
+    frame.uv = NULL;
+    EXPECT_EQ(-EINVAL, converter.convert(frame, 0, 0, 64, 64, 0));
+}
+
+struct CallerArgs {
+    ExynosNV12Converter *converter;
+    TestFrame *frame;
+    int colorspace;
+    int result;
+};
+
+static void *convertRepeatedly(void *arg)
+{
+    CallerArgs *args = (CallerArgs *)arg;
+
+    args->result = 0;
+    for (int i = 0; i < 20 && !args->result; i++) {
+        args->frame->clear(0xA5);
+        args->result = args->converter->convert(args->frame->frame(), 0, 0,
+                args->frame->width, args->frame->height, args->colorspace);
+    }
+    return NULL;
+}
+
+/* Callers sharing a converter each get their own frame converted whole. */
+TEST(NV12Converter, ConcurrentCallers)
+{
+    enum { CALLERS = 4 };
+    ExynosNV12Converter converter(ExynosNV12Converter::MAX_THREADS);
+    TestFrame *frames[CALLERS];
+    CallerArgs args[CALLERS];
+    pthread_t threads[CALLERS];
+
+    for (int i = 0; i < CALLERS; i++) {
+        frames[i] = new TestFrame(1280 - 64 * i, 720 - 32 * i, 100 + i);
+        args[i].converter = &converter;
+        args[i].frame = frames[i];
+        args[i].colorspace = i & 1;
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, convertRepeatedly, &args[i]));
+    }
+    for (int i = 0; i < CALLERS; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < CALLERS; i++) {
+        SCOPED_TRACE(testing::Message() << "caller " << i);
+        EXPECT_EQ(0, args[i].result);
+        frames[i]->expectConverted(0, 0, frames[i]->width, frames[i]->height, i & 1, 0xA5);
+        delete frames[i];
+    }
+}
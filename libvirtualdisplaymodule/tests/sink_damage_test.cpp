@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+
+#include "ExynosSinkDamage.h"
+#include "gralloc_priv.h"
+#include "exynos_format.h"
+
+/*
+ * ExynosSinkDamage over a sink BufferQueue of three buffers: each buffer
+ * must be rewritten where any frame since its last write changed.
+ */
+
+#define SINK_W  1280
+#define SINK_H  720
+
+class SinkDamageTest : public testing::Test {
+    protected:
+        SinkDamageTest() :
+            mContents(NULL),
+            mLayerA(-1, 0, 0, SINK_W, SINK_H, HAL_PIXEL_FORMAT_RGBA_8888, 0, 0),
+            mLayerB(-1, 0, 0, SINK_W, SINK_H, HAL_PIXEL_FORMAT_RGBA_8888, 0, 0)
+        {
+            for (int i = 0; i < 3; i++)
+                mSinks[i] = new private_handle_t(-1, 0, 0, SINK_W, SINK_H,
+                        HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M, 0, 0);
+            setLayers(2);
+            setLayer(0, &mLayerA, 0, 0, SINK_W, SINK_H);
+            setLayer(1, &mLayerA, 100, 100, 300, 200);
+        }
+
+        ~SinkDamageTest()
+        {
+            for (int i = 0; i < 3; i++)
+                delete mSinks[i];
+            free(mContents);
+        }
+
+        void setLayers(size_t count)
+        {
+            free(mContents);
+            mContents = (hwc_display_contents_1_t *)calloc(1,
+                    sizeof(hwc_display_contents_1_t) + (count + 1) * sizeof(hwc_layer_1_t));
+            mContents->numHwLayers = count + 1;
+            mContents->hwLayers[count].compositionType = HWC_FRAMEBUFFER_TARGET;
+        }
+
+        void setLayer(size_t i, private_handle_t *handle, int left, int top, int right,
+                int bottom)
+        {
+            hwc_layer_1_t &layer = mContents->hwLayers[i];
+
+            layer.compositionType = HWC_FRAMEBUFFER;
+            layer.handle = handle;
+            layer.displayFrame.left = left;
+            layer.displayFrame.top = top;
+            layer.displayFrame.right = right;
+            layer.displayFrame.bottom = bottom;
+        }
+
+        /* Runs a frame into sink and returns what had to be written. */
+        hwc_rect_t frame(int sink)
+        {
+            hwc_rect_t dirty = { 0, 0, 0, 0 };
+
+            mDamage.addFrame(mContents, SINK_W, SINK_H);
+            if (mDamage.dirty(mSinks[sink], &dirty))
+                mDamage.written(mSinks[sink]);
+            mContents->flags = 0;
+            return dirty;
+        }
+
+        static void expectRect(const hwc_rect_t &rect, int left, int top, int right,
+                int bottom)
+        {
+            EXPECT_EQ(left, rect.left);
+            EXPECT_EQ(top, rect.top);
+            EXPECT_EQ(right, rect.right);
+            EXPECT_EQ(bottom, rect.bottom);
+        }
+
+        ExynosSinkDamage mDamage;
+        hwc_display_contents_1_t *mContents;
+        private_handle_t mLayerA;
+        private_handle_t mLayerB;
+        private_handle_t *mSinks[3];
+};
+
+TEST_F(SinkDamageTest, NewSinkBuffersAreWrittenWhole)
+{
+    for (int i = 0; i < 3; i++)
+        expectRect(frame(i), 0, 0, SINK_W, SINK_H);
+
+    /* nothing changed since each buffer was written */
+    hwc_rect_t dirty;
+    mDamage.addFrame(mContents, SINK_W, SINK_H);
+    EXPECT_FALSE(mDamage.dirty(mSinks[0], &dirty));
+}
+
+TEST_F(SinkDamageTest, DamageAccumulatesUntilTheBufferComesBack)
+{
+    for (int i = 0; i < 3; i++)
+        frame(i);
+
+    /* the small layer gets a new buffer */
+    mContents->hwLayers[1].handle = &mLayerB;
+    expectRect(frame(0), 100, 100, 300, 200);
+
+    /* then both layers */
+    mContents->hwLayers[1].handle = &mLayerA;
+    setLayer(0, &mLayerB, 0, 0, SINK_W, SINK_H);
+    expectRect(frame(1), 0, 0, SINK_W, SINK_H);
+
+    /* sink 2 missed both frames */
+    expectRect(frame(2), 0, 0, SINK_W, SINK_H);
+
+    /* sink 0 missed the second frame only, the third changed nothing */
+    expectRect(frame(0), 0, 0, SINK_W, SINK_H);
+    hwc_rect_t dirty;
+    mDamage.addFrame(mContents, SINK_W, SINK_H);
+    EXPECT_FALSE(mDamage.dirty(mSinks[1], &dirty));
+}
+
+TEST_F(SinkDamageTest, SkipLayersAreAlwaysDamaged)
+{
+    for (int i = 0; i < 3; i++)
+        frame(i);
+
+    mContents->hwLayers[1].flags = HWC_SKIP_LAYER;
+    frame(0);
+    expectRect(frame(0), 100, 100, 300, 200);
+}
+
+TEST_F(SinkDamageTest, GeometryChangesDamageTheWholeSink)
+{
+    for (int i = 0; i < 3; i++)
+        frame(i);
+
+    mContents->flags = HWC_GEOMETRY_CHANGED;
+    expectRect(frame(0), 0, 0, SINK_W, SINK_H);
+    expectRect(frame(1), 0, 0, SINK_W, SINK_H);
+
+    /* a new layer count is a geometry change even when not flagged */
+    setLayers(1);
+    setLayer(0, &mLayerA, 0, 0, SINK_W, SINK_H);
+    expectRect(frame(2), 0, 0, SINK_W, SINK_H);
+}
+
+TEST_F(SinkDamageTest, ForgottenSinksAreWrittenWhole)
+{
+    for (int i = 0; i < 3; i++)
+        frame(i);
+
+    mDamage.forget(mSinks[1]);
+    expectRect(frame(1), 0, 0, SINK_W, SINK_H);
+
+    /* a new buffer at the address of a freed one is not trusted */
+    mSinks[2]->fd = 42;
+    expectRect(frame(2), 0, 0, SINK_W, SINK_H);
+    mSinks[2]->fd = -1;
+}
+
+TEST_F(SinkDamageTest, NewSinkSizeForgetsEveryBuffer)
+{
+    for (int i = 0; i < 3; i++)
+        frame(i);
+
+    hwc_rect_t dirty;
+    mDamage.addFrame(mContents, SINK_W / 2, SINK_H / 2);
+    ASSERT_TRUE(mDamage.dirty(mSinks[0], &dirty));
+    expectRect(dirty, 0, 0, SINK_W / 2, SINK_H / 2);
+}
@@ -161,13 +161,13 @@ static void LOG_I_Buf(
 		{
 			index += sprintf(&buffer[index], "memory dump");
 		}
-		index += sprintf(&buffer[index], " (0x%08x, %d bytes)", (uint32_t)blob,sizeOfBlob);
+		index += sprintf(&buffer[index], " (%p, %zu bytes)", blob, sizeOfBlob);
 		LOG_I("%s", buffer);
 		index = 0;
 	}
 	else if (NULL == szDescriptor)
 	{
-		index += sprintf(&buffer[index], "Data at 0x%08x: ", (uint32_t)blob);
+		index += sprintf(&buffer[index], "Data at %p: ", blob);
 	}
 
 	if(sizeOfBlob == 0) {
@@ -130,3 +130,5 @@ LOCAL_CFLAGS += -DLOG_ANDROID
 
 LOCAL_SHARED_LIBRARIES += libMcClient
 include $(BUILD_SHARED_LIBRARY)
+
+include $(LOCAL_PATH)/tests/Android.mk
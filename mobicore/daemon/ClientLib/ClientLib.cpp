@@ -330,6 +330,7 @@ __MC_CLIENT_LIB_API mcResult_t mcOpenSession(
 
     do {
         uint32_t handle = 0;
+        uint32_t tciOffset = (uint32_t)(tci) & 0xFFF;
         CHECK_NOT_NULL(session);
         CHECK_NOT_NULL(uuid);
         CHECK_NOT_NULL(tci);
@@ -368,12 +369,14 @@ __MC_CLIENT_LIB_API mcResult_t mcOpenSession(
                 break;
             }
             handle = pWsm->handle;
+            // The TCI may be carved from a larger contiguous WSM
+            tciOffset = device->getContiguousWsmOffset(pWsm);
         }
 
         SEND_TO_DAEMON(devCon, MC_DRV_CMD_OPEN_SESSION,
                        session->deviceId,
                        *uuid,
-                       (uint32_t)(tci) & 0xFFF,
+                       tciOffset,
                        (uint32_t)handle,
                        len);
 
@@ -469,7 +472,7 @@ __MC_CLIENT_LIB_API mcResult_t mcOpenSession(
         // there is no payload.
 
         // Session has been established, new session object must be created
-        Session *sessionObj = device->createNewSession(session->sessionId, sessionConnection);
+        Session *sessionObj = device->createNewSession(session->sessionId, sessionConnection, tci);
         // If the session tci was a mapped buffer then register it
         if(bulkBuf)
             sessionObj->addBulkBuf(bulkBuf);
@@ -490,10 +493,16 @@ __MC_CLIENT_LIB_API mcResult_t mcOpenSession(
 }
 
 //------------------------------------------------------------------------------
-__MC_CLIENT_LIB_API mcResult_t mcOpenTrustlet(
+/**
+ * Common part of mcOpenTrustlet() and mcOpenTrustletFd(). The trustlet is
+ * sent inline from the trustlet buffer, or as the descriptor fd if that is
+ * not -1.
+ */
+static mcResult_t openTrustlet(
     mcSessionHandle_t  *session,
     mcSpid_t           spid,
     uint8_t            *trustlet,
+    int                fd,
     uint32_t           tlen,
     uint8_t            *tci,
     uint32_t           len
@@ -502,12 +511,14 @@ __MC_CLIENT_LIB_API mcResult_t mcOpenTrustlet(
     mcResult_t mcResult = MC_DRV_OK;
 
     devMutex.lock();
-    LOG_I("===%s()===", __FUNCTION__);
 
     do {
         uint32_t handle = 0;
+        uint32_t tciOffset = (uint32_t)(tci) & 0xFFF;
         CHECK_NOT_NULL(session);
-        CHECK_NOT_NULL(trustlet);
+        if (fd < 0) {
+            CHECK_NOT_NULL(trustlet);
+        }
         CHECK_NOT_NULL(tci);
 
         if (len > MC_MAX_TCI_LEN) {
@@ -544,22 +555,41 @@ __MC_CLIENT_LIB_API mcResult_t mcOpenTrustlet(
                 break;
             }
             handle = pWsm->handle;
+            // The TCI may be carved from a larger contiguous WSM
+            tciOffset = device->getContiguousWsmOffset(pWsm);
         }
 
-        SEND_TO_DAEMON(devCon, MC_DRV_CMD_OPEN_TRUSTLET,
-                       session->deviceId,
-                       spid,
-                       (uint32_t)tlen,
-                       (uint32_t)(tci) & 0xFFF,
-                       (uint32_t)handle,
-                       len);
-
-        // Send the full trustlet data
-        int ret = devCon->writeData(trustlet, tlen);
-        if(ret < 0) {
-            LOG_E("sending to Daemon failed."); \
-            mcResult = MC_DRV_ERR_SOCKET_WRITE; \
-            break;
+        if (fd >= 0) {
+            SEND_TO_DAEMON(devCon, MC_DRV_CMD_OPEN_TRUSTLET_FD,
+                           session->deviceId,
+                           spid,
+                           (uint32_t)tlen,
+                           tciOffset,
+                           (uint32_t)handle,
+                           len);
+
+            // The Daemon maps the trustlet from the descriptor
+            if (!devCon->writeFd(fd)) {
+                LOG_E("sending to Daemon failed.");
+                mcResult = MC_DRV_ERR_SOCKET_WRITE;
+                break;
+            }
+        } else {
+            SEND_TO_DAEMON(devCon, MC_DRV_CMD_OPEN_TRUSTLET,
+                           session->deviceId,
+                           spid,
+                           (uint32_t)tlen,
+                           tciOffset,
+                           (uint32_t)handle,
+                           len);
+
+            // Send the full trustlet data
+            int ret = devCon->writeData(trustlet, tlen);
+            if(ret < 0) {
+                LOG_E("sending to Daemon failed."); \
+                mcResult = MC_DRV_ERR_SOCKET_WRITE; \
+                break;
+            }
         }
 
         // Read command response
@@ -655,7 +685,7 @@ __MC_CLIENT_LIB_API mcResult_t mcOpenTrustlet(
         // there is no payload.
 
         // Session has been established, new session object must be created
-        Session *sessionObj = device->createNewSession(session->sessionId, sessionConnection);
+        Session *sessionObj = device->createNewSession(session->sessionId, sessionConnection, tci);
         // If the session tci was a mapped buffer then register it
         if(bulkBuf)
             sessionObj->addBulkBuf(bulkBuf);
@@ -675,6 +705,38 @@ __MC_CLIENT_LIB_API mcResult_t mcOpenTrustlet(
     return mcResult;
 }
 
+//------------------------------------------------------------------------------
+__MC_CLIENT_LIB_API mcResult_t mcOpenTrustlet(
+    mcSessionHandle_t  *session,
+    mcSpid_t           spid,
+    uint8_t            *trustlet,
+    uint32_t           tlen,
+    uint8_t            *tci,
+    uint32_t           len
+)
+{
+    LOG_I("===%s()===", __FUNCTION__);
+    return openTrustlet(session, spid, trustlet, -1, tlen, tci, len);
+}
+
+//------------------------------------------------------------------------------
+__MC_CLIENT_LIB_API mcResult_t mcOpenTrustletFd(
+    mcSessionHandle_t  *session,
+    mcSpid_t           spid,
+    int                fd,
+    uint32_t           tlen,
+    uint8_t            *tci,
+    uint32_t           len
+)
+{
+    LOG_I("===%s()===", __FUNCTION__);
+    if (fd < 0) {
+        LOG_E("invalid trustlet descriptor %d", fd);
+        return MC_DRV_ERR_INVALID_PARAMETER;
+    }
+    return openTrustlet(session, spid, NULL, fd, tlen, tci, len);
+}
+
 //------------------------------------------------------------------------------
 __MC_CLIENT_LIB_API mcResult_t mcCloseSession(mcSessionHandle_t *session)
 {
@@ -1202,6 +1264,55 @@ __MC_CLIENT_LIB_API mcResult_t mcGetMobiCoreVersion(
 }
 
 
+//------------------------------------------------------------------------------
+__MC_CLIENT_LIB_API mcResult_t mcGetDaemonStats(
+    uint32_t  deviceId,
+    mcDaemonStats_t *stats
+)
+{
+    mcResult_t mcResult = MC_DRV_OK;
+
+    devMutex.lock();
+    LOG_I("===%s()===", __FUNCTION__);
+
+    do {
+        Device *device = resolveDeviceId(deviceId);
+
+        // Is the device known
+        CHECK_DEVICE(device);
+
+        // Is the device opened.
+        CHECK_DEVICE_CLOSED(device, deviceId)
+
+        CHECK_NOT_NULL(stats);
+
+        Connection *devCon = device->connection;
+
+        SEND_TO_DAEMON(devCon, MC_DRV_CMD_GET_STATS);
+
+        // Read GET STATS response.
+
+        RECV_FROM_DAEMON(devCon, &mcResult);
+
+        if (mcResult != MC_DRV_OK) {
+            LOG_E("MC_DRV_CMD_GET_STATS bad response, respId=%d", mcResult);
+            mcResult = MC_DRV_ERR_DAEMON_UNREACHABLE;
+            break;
+        }
+
+        // Read payload.
+        mcDaemonStats_t stats_socket;
+        RECV_FROM_DAEMON(devCon, &stats_socket);
+
+        *stats = stats_socket;
+
+    } while (0);
+
+    devMutex.unlock();
+    return mcResult;
+}
+
+
 //------------------------------------------------------------------------------
 // Only called by mcOpenDevice()
 // Must be taken with devMutex locked.
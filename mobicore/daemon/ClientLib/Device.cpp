@@ -33,6 +33,7 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <stdint.h>
+#include <string.h>
 #include <vector>
 
 #include "mc_linux.h"
@@ -65,15 +66,30 @@ Device::~Device(void)
     }
 
     // Free all allocated WSM descriptors
-    wsmIterator_t  wsmIterator = wsmL2List.begin();
-    while (wsmIterator != wsmL2List.end()) {
-        CWsm_ptr pWsm = *wsmIterator;
+    for (wsmMap_t::iterator iterator = wsmMap.begin();
+            iterator != wsmMap.end();
+            ++iterator) {
+        CWsm_ptr pWsm = iterator->second.wsm;
+
+        // ignore return code
+        if (iterator->second.chunk == NULL) {
+            pMcKMod->free(pWsm->handle, pWsm->virtAddr, pWsm->len);
+        }
+
+        delete pWsm;
+    }
+    wsmMap.clear();
+
+    wsmChunkList_t::iterator chunkIterator = wsmChunks.begin();
+    while (chunkIterator != wsmChunks.end()) {
+        CWsm_ptr pWsm = (*chunkIterator)->wsm;
 
         // ignore return code
         pMcKMod->free(pWsm->handle, pWsm->virtAddr, pWsm->len);
 
-        delete (*wsmIterator);
-        wsmIterator = wsmL2List.erase(wsmIterator);
+        delete pWsm;
+        delete (*chunkIterator);
+        chunkIterator = wsmChunks.erase(chunkIterator);
     }
     delete connection;
     delete pMcKMod;
@@ -102,9 +118,16 @@ bool Device::hasSessions(void)
 
 
 //------------------------------------------------------------------------------
-Session *Device::createNewSession(uint32_t sessionId, Connection  *connection)
+Session *Device::createNewSession(uint32_t sessionId, Connection  *connection, addr_t tci)
 {
     Session *session = new Session(sessionId, pMcKMod, connection);
+
+    wsmMap_t::iterator iterator = wsmMap.find(tci);
+    if (iterator != wsmMap.end()) {
+        iterator->second.sessions++;
+        session->tciWsm = tci;
+    }
+
     sessionList.push_back(session);
     return session;
 }
@@ -118,6 +141,10 @@ bool Device::removeSession(uint32_t sessionId)
     sessionIterator_t interator = sessionList.begin();
     while (interator != sessionList.end()) {
         if ((*interator)->sessionId == sessionId) {
+            wsmMap_t::iterator wsmIterator = wsmMap.find((*interator)->tciWsm);
+            if (wsmIterator != wsmMap.end()) {
+                wsmIterator->second.sessions--;
+            }
             delete (*interator);
             interator = sessionList.erase(interator);
             ret = true;
@@ -148,6 +175,56 @@ Session *Device::resolveSessionId(uint32_t sessionId)
 }
 
 
+//------------------------------------------------------------------------------
+Device::wsmChunk_t *Device::allocateChunk(void)
+{
+    addr_t    virtAddr;
+    uint32_t  handle;
+    addr_t    physAddr;
+
+    if (pMcKMod->mapWsm(WSM_CHUNK_SIZE, &handle, &virtAddr, &physAddr) != MC_DRV_OK) {
+        return NULL;
+    }
+
+    LOG_I(" mapped WSM chunk handle %d to %p, phys=%p ", handle, virtAddr, physAddr);
+
+    wsmChunk_t *chunk = new wsmChunk_t;
+    chunk->wsm = new CWsm(virtAddr, WSM_CHUNK_SIZE, handle, physAddr);
+    chunk->usedMask = 0;
+    wsmChunks.push_back(chunk);
+
+    return chunk;
+}
+
+
+//------------------------------------------------------------------------------
+void Device::trimChunks(void)
+{
+    uint32_t spare = 0;
+
+    wsmChunkList_t::iterator iterator = wsmChunks.begin();
+    while (iterator != wsmChunks.end()) {
+        wsmChunk_t *chunk = *iterator;
+        if (chunk->usedMask != 0 || ++spare <= WSM_SPARE_CHUNKS) {
+            ++iterator;
+            continue;
+        }
+
+        LOG_I(" unmapping WSM chunk handle %d from %p", chunk->wsm->handle, chunk->wsm->virtAddr);
+
+        // The Secure World may still hold the chunk, try again next time
+        if (pMcKMod->free(chunk->wsm->handle, chunk->wsm->virtAddr, chunk->wsm->len) != MC_DRV_OK) {
+            ++iterator;
+            continue;
+        }
+
+        delete chunk->wsm;
+        delete chunk;
+        iterator = wsmChunks.erase(iterator);
+    }
+}
+
+
 //------------------------------------------------------------------------------
 mcResult_t Device::allocateContiguousWsm(uint32_t len, CWsm **wsm)
 {
@@ -163,6 +240,48 @@ mcResult_t Device::allocateContiguousWsm(uint32_t len, CWsm **wsm)
         return MC_DRV_ERR_INVALID_LENGTH;
     }
 
+    // Carve small allocations from a chunk instead of mapping each one
+    if (len <= WSM_CHUNK_SIZE / 2) {
+        const uint32_t chunkBlocks = WSM_CHUNK_SIZE / WSM_BLOCK_SIZE;
+        uint32_t blocks = (len + WSM_BLOCK_SIZE - 1) / WSM_BLOCK_SIZE;
+        uint32_t mask = (1U << blocks) - 1;
+        wsmChunk_t *chunk = NULL;
+        uint32_t first = 0;
+
+        for (wsmChunkList_t::iterator iterator = wsmChunks.begin();
+                iterator != wsmChunks.end() && chunk == NULL;
+                ++iterator) {
+            for (first = 0; first + blocks <= chunkBlocks; first++) {
+                if (((*iterator)->usedMask & (mask << first)) == 0) {
+                    chunk = *iterator;
+                    break;
+                }
+            }
+        }
+        if (chunk == NULL) {
+            chunk = allocateChunk();
+            first = 0;
+        }
+
+        if (chunk != NULL) {
+            wsmBlock_t block;
+            block.chunk = chunk;
+            block.offset = first * WSM_BLOCK_SIZE;
+            block.sessions = 0;
+            block.wsm = new CWsm((uint8_t *)chunk->wsm->virtAddr + block.offset, len,
+                                 chunk->wsm->handle, (uint8_t *)chunk->wsm->physAddr + block.offset);
+            chunk->usedMask |= mask << first;
+
+            // Blocks are reused, hand them out cleared like fresh kernel memory
+            memset(block.wsm->virtAddr, 0, blocks * WSM_BLOCK_SIZE);
+
+            wsmMap[block.wsm->virtAddr] = block;
+            *wsm = block.wsm;
+            return MC_DRV_OK;
+        }
+        LOG_W(" Mapping WSM chunk failed, mapping %u bytes on their own", len);
+    }
+
     ret = pMcKMod->mapWsm(len, &handle, &virtAddr, &physAddr);
     if (ret) {
         return ret;
@@ -171,11 +290,15 @@ mcResult_t Device::allocateContiguousWsm(uint32_t len, CWsm **wsm)
     LOG_I(" mapped handle %d to %p, phys=%p ", handle, virtAddr, physAddr);
 
     // Register (vaddr,paddr) with device
-    *wsm = new CWsm(virtAddr, len, handle, physAddr);
-
-    wsmL2List.push_back(*wsm);
+    wsmBlock_t block;
+    block.wsm = new CWsm(virtAddr, len, handle, physAddr);
+    block.chunk = NULL;
+    block.offset = 0;
+    block.sessions = 0;
+    wsmMap[virtAddr] = block;
 
     // Return pointer to the allocated memory
+    *wsm = block.wsm;
     return MC_DRV_OK;
 }
 
@@ -183,17 +306,28 @@ mcResult_t Device::allocateContiguousWsm(uint32_t len, CWsm **wsm)
 //------------------------------------------------------------------------------
 mcResult_t Device::freeContiguousWsm(CWsm_ptr  pWsm)
 {
-    mcResult_t ret = MC_DRV_ERR_WSM_NOT_FOUND;
-    wsmIterator_t iterator;
+    mcResult_t ret = MC_DRV_OK;
+    wsmMap_t::iterator iterator = wsmMap.find(pWsm->virtAddr);
 
-    for (iterator = wsmL2List.begin(); iterator != wsmL2List.end(); ++iterator) {
-        if (pWsm == *iterator) {
-            ret = MC_DRV_OK;
-            break;
-        }
-    }
     // We just looked this up using findContiguousWsm
-    assert(ret == MC_DRV_OK);
+    assert(iterator != wsmMap.end());
+
+    wsmBlock_t &block = iterator->second;
+    if (block.sessions != 0) {
+        LOG_E(" WSM %p is still the TCI of %u session(s)", pWsm->virtAddr, block.sessions);
+        return MC_DRV_ERR_FREE_MEMORY_FAILED;
+    }
+
+    if (block.chunk != NULL) {
+        uint32_t blocks = (pWsm->len + WSM_BLOCK_SIZE - 1) / WSM_BLOCK_SIZE;
+        block.chunk->usedMask &= ~(((1U << blocks) - 1) << (block.offset / WSM_BLOCK_SIZE));
+
+        wsmMap.erase(iterator);
+        delete pWsm;
+
+        trimChunks();
+        return MC_DRV_OK;
+    }
 
     LOG_I(" unmapping handle %d from %p, phys=%p",
           pWsm->handle, pWsm->virtAddr, pWsm->physAddr);
@@ -204,7 +338,7 @@ mcResult_t Device::freeContiguousWsm(CWsm_ptr  pWsm)
         return ret;
     }
 
-    iterator = wsmL2List.erase(iterator);
+    wsmMap.erase(iterator);
     delete pWsm;
 
     return ret;
@@ -214,19 +348,18 @@ mcResult_t Device::freeContiguousWsm(CWsm_ptr  pWsm)
 //------------------------------------------------------------------------------
 CWsm_ptr Device::findContiguousWsm(addr_t  virtAddr)
 {
-    CWsm_ptr pWsm = NULL;
+    wsmMap_t::iterator iterator = wsmMap.find(virtAddr);
 
-    for ( wsmIterator_t iterator = wsmL2List.begin();
-            iterator != wsmL2List.end();
-            ++iterator) {
-        CWsm_ptr pTmpWsm = *iterator;
-        if (virtAddr == pTmpWsm->virtAddr) {
-            pWsm = pTmpWsm;
-            break;
-        }
-    }
+    return (iterator != wsmMap.end()) ? iterator->second.wsm : NULL;
+}
+
+
+//------------------------------------------------------------------------------
+uint32_t Device::getContiguousWsmOffset(CWsm_ptr  pWsm)
+{
+    wsmMap_t::iterator iterator = wsmMap.find(pWsm->virtAddr);
 
-    return pWsm;
+    return (iterator != wsmMap.end()) ? iterator->second.offset : 0;
 }
 
 
@@ -37,18 +37,59 @@
 
 #include <stdint.h>
 #include <vector>
+#include <map>
 
 #include "public/MobiCoreDriverApi.h"
 #include "Session.h"
 #include "CWsm.h"
 
+/** Size of the contiguous WSM chunks small allocations are carved from. */
+#define WSM_CHUNK_SIZE      (64 * 1024)
+/** Allocation granularity inside a chunk. */
+#define WSM_BLOCK_SIZE      (4096)
+/** Empty chunks kept mapped for later allocations. */
+#define WSM_SPARE_CHUNKS    (1)
+
 
 class Device
 {
 
 private:
+    /** Contiguous WSM of the kernel module that is carved into blocks. */
+    typedef struct {
+        CWsm_ptr  wsm;          /**< WSM of the whole chunk */
+        uint32_t  usedMask;     /**< One bit per block in use */
+    } wsmChunk_t;
+
+    /** Allocated WSM, a kernel WSM of its own or blocks of a chunk. */
+    typedef struct {
+        CWsm_ptr    wsm;
+        wsmChunk_t  *chunk;     /**< NULL for a kernel WSM of its own */
+        uint32_t    offset;     /**< Offset inside the kernel WSM */
+        uint32_t    sessions;   /**< Sessions using the WSM as TCI */
+    } wsmBlock_t;
+
+    typedef std::map<addr_t, wsmBlock_t>    wsmMap_t;
+    typedef std::list<wsmChunk_t *>         wsmChunkList_t;
+
     sessionList_t   sessionList; /**< MobiCore Trustlet session associated with the device */
-    wsmList_t       wsmL2List; /**< WSM L2 Table  */
+    wsmMap_t        wsmMap; /**< Allocated contiguous WSM by virtual address */
+    wsmChunkList_t  wsmChunks; /**< Chunks small WSM allocations are carved from */
+
+    /**
+     * Map a new chunk from the kernel module.
+     * @return the chunk or NULL if mapping failed.
+     */
+    wsmChunk_t *allocateChunk(
+        void
+    );
+
+    /**
+     * Return empty chunks beyond WSM_SPARE_CHUNKS to the kernel module.
+     */
+    void trimChunks(
+        void
+    );
 
 
 public:
@@ -93,11 +134,14 @@ public:
      * Add a session to the device.
      * @param sessionId session ID
      * @param connection session connection
+     * @param tci TCI of the session. A contiguous WSM TCI can't be freed
+     * until the session has been removed.
      * @return Session object created
      */
     Session *createNewSession(
         uint32_t    sessionId,
-        Connection  *connection
+        Connection  *connection,
+        addr_t      tci = NULL
     );
 
     /**
@@ -149,6 +193,15 @@ public:
         addr_t  virtAddr
     );
 
+    /**
+     * Get the offset of a WSM object inside the kernel WSM of its handle.
+     * @param pWsm WSM object returned by findContiguousWsm().
+     * @return the offset, 0 unless the WSM was carved from a chunk.
+     */
+    uint32_t getContiguousWsmOffset(
+        CWsm_ptr  pWsm
+    );
+
     /**
      * Map a buffer from tlc VA to TL(Create L2 table for the buffer
      * @param buf The virtual address of hte buffer
@@ -34,10 +34,13 @@
 #include "log.h"
 #include "MobiCoreDriverApi.h"
 #include "Mci/mcinq.h"
+#include "Mci/mcimcp.h"
 #include <sys/mman.h>
 #include "GpTci.h"
 #include "string.h"
 #include "stdlib.h"
+#include <pthread.h>
+#include <list>
 
 //------------------------------------------------------------------------------
 // Macros
@@ -50,6 +53,23 @@
 #define _TEEC_PARAMETER_NUMBER      4
 
 
+//------------------------------------------------------------------------------
+// Bulk buffer mapping of a session, kept across operations
+typedef struct {
+    mcSessionHandle_t   handle;
+    uint8_t             *buffer;
+    uint32_t            size;
+    mcBulkMap_t         mapInfo;
+    bool                shared;     // buffer of a TEEC_SharedMemory
+    uint32_t            users;      // parameters of pending operations
+} _TEEC_Mapping;
+
+typedef std::list<_TEEC_Mapping>            _TEEC_MappingList;
+typedef _TEEC_MappingList::iterator         _TEEC_MappingIterator;
+
+static pthread_mutex_t      _TEEC_mappingsLock = PTHREAD_MUTEX_INITIALIZER;
+static _TEEC_MappingList    _TEEC_mappings;
+
 //------------------------------------------------------------------------------
 //Local satic functions
 static void _libUuidToArray(
@@ -101,6 +121,193 @@ static void _libUuidToArray(
     }
 }
 
+//------------------------------------------------------------------------------
+static bool _TEEC_SameSession(
+    const mcSessionHandle_t *a,
+    const mcSessionHandle_t *b)
+{
+    return (a->sessionId == b->sessionId) && (a->deviceId == b->deviceId);
+}
+
+//------------------------------------------------------------------------------
+// Unmaps the idle shared memory mappings of a session, to free mapping
+// resources for a new one. Called with _TEEC_mappingsLock held.
+static bool _TEEC_EvictIdleMappings(
+    mcSessionHandle_t   *handle)
+{
+    bool evicted = false;
+
+    _TEEC_MappingIterator it = _TEEC_mappings.begin();
+    while (it != _TEEC_mappings.end()) {
+        if (_TEEC_SameSession(&it->handle, handle) && it->shared && (it->users == 0)) {
+            mcUnmap(&it->handle, it->buffer, &it->mapInfo);
+            it = _TEEC_mappings.erase(it);
+            evicted = true;
+        } else {
+            ++it;
+        }
+    }
+
+    return evicted;
+}
+
+//------------------------------------------------------------------------------
+// Maps buffer to the session for an operation. Shared memory stays mapped
+// until it is released and later operations reuse the mapping. TEMP memrefs
+// may point to memory freed after the operation, so they get a mapping of
+// their own that ends with it. A buffer must not be mapped twice, so a
+// mapping overlapping a pending operation fails the new one, and an idle
+// shared memory mapping is replaced by one covering both as long as that
+// stays within MCP_MAP_MAX. A failed map is retried once after the idle
+// shared memory mappings of the session are released.
+static mcResult_t _TEEC_MapBuffer(
+    mcSessionHandle_t   *handle,
+    void                *buffer,
+    uint32_t            size,
+    bool                shared,
+    mcBulkMap_t         *mapInfo)
+{
+    uint8_t         *start = (uint8_t *)buffer;
+    mcResult_t      mcRet = MC_DRV_OK;
+    _TEEC_Mapping   *mapping = NULL;
+
+    pthread_mutex_lock(&_TEEC_mappingsLock);
+
+    for (_TEEC_MappingIterator it = _TEEC_mappings.begin(); it != _TEEC_mappings.end(); ++it) {
+        if (!_TEEC_SameSession(&it->handle, handle)) continue;
+        if ((start >= it->buffer + it->size) || (start + size <= it->buffer)) continue;
+        if (shared && it->shared && (start >= it->buffer) && (start + size <= it->buffer + it->size)) {
+            mapping = &*it;
+            break;
+        }
+        if (it->users != 0) {
+            LOG_E("%p overlaps a buffer mapped by a pending operation", buffer);
+            mcRet = MC_DRV_ERR_BUFFER_ALREADY_MAPPED;
+            break;
+        }
+    }
+
+    if ((mapping == NULL) && (mcRet == MC_DRV_OK)) {
+        // Only idle shared memory mappings are left in the way
+        uint8_t *end = start + size;
+        _TEEC_MappingIterator it = _TEEC_mappings.begin();
+        while (it != _TEEC_mappings.end()) {
+            if (_TEEC_SameSession(&it->handle, handle) &&
+                    (start < it->buffer + it->size) && (end > it->buffer)) {
+                uint8_t *unionStart = (it->buffer < start) ? it->buffer : start;
+                uint8_t *unionEnd = (it->buffer + it->size > end) ? it->buffer + it->size : end;
+                if (shared && ((uint32_t)(unionEnd - unionStart) <= MCP_MAP_MAX)) {
+                    start = unionStart;
+                    end = unionEnd;
+                }
+                mcUnmap(&it->handle, it->buffer, &it->mapInfo);
+                it = _TEEC_mappings.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        _TEEC_Mapping newMapping;
+        newMapping.handle = *handle;
+        newMapping.buffer = start;
+        newMapping.size = end - start;
+        newMapping.shared = shared;
+        newMapping.users = 0;
+        mcRet = mcMap(handle, start, newMapping.size, &newMapping.mapInfo);
+        if ((mcRet != MC_DRV_OK) && _TEEC_EvictIdleMappings(handle)) {
+            LOG_W("mcMap failed, mcRet=0x%08X, retrying without idle mappings", mcRet);
+            mcRet = mcMap(handle, start, newMapping.size, &newMapping.mapInfo);
+        }
+        if (mcRet == MC_DRV_OK) {
+            _TEEC_mappings.push_back(newMapping);
+            mapping = &_TEEC_mappings.back();
+        }
+    }
+
+    if (mapping != NULL) {
+        mapping->users++;
+
+        mapInfo->sVirtualAddr = (uint8_t *)mapping->mapInfo.sVirtualAddr + ((uint8_t *)buffer - mapping->buffer);
+        mapInfo->sVirtualLen = size;
+    }
+
+    pthread_mutex_unlock(&_TEEC_mappingsLock);
+
+    return mcRet;
+}
+
+//------------------------------------------------------------------------------
+// Ends the use of a mapping by an operation. TEMP memref mappings are
+// unmapped with it, shared memory mappings when the memory is released.
+static void _TEEC_UnmapBuffer(
+    mcSessionHandle_t   *handle,
+    void                *buffer,
+    uint32_t            size)
+{
+    uint8_t *start = (uint8_t *)buffer;
+
+    pthread_mutex_lock(&_TEEC_mappingsLock);
+
+    for (_TEEC_MappingIterator it = _TEEC_mappings.begin(); it != _TEEC_mappings.end(); ++it) {
+        if (!_TEEC_SameSession(&it->handle, handle) || (it->users == 0)) continue;
+        if ((start >= it->buffer) && (start + size <= it->buffer + it->size)) {
+            it->users--;
+            if (!it->shared && (it->users == 0)) {
+                mcUnmap(&it->handle, it->buffer, &it->mapInfo);
+                _TEEC_mappings.erase(it);
+            }
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&_TEEC_mappingsLock);
+}
+
+//------------------------------------------------------------------------------
+// Forgets the mappings of a session, closing the session unmaps them
+static void _TEEC_ForgetSessionMappings(
+    mcSessionHandle_t   *handle)
+{
+    pthread_mutex_lock(&_TEEC_mappingsLock);
+
+    _TEEC_MappingIterator it = _TEEC_mappings.begin();
+    while (it != _TEEC_mappings.end()) {
+        if (_TEEC_SameSession(&it->handle, handle)) {
+            it = _TEEC_mappings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    pthread_mutex_unlock(&_TEEC_mappingsLock);
+}
+
+//------------------------------------------------------------------------------
+// Unmaps a shared memory from all sessions
+static void _TEEC_UnmapSharedMemory(
+    TEEC_SharedMemory   *sharedMem)
+{
+    uint8_t *start = (uint8_t *)sharedMem->buffer;
+
+    pthread_mutex_lock(&_TEEC_mappingsLock);
+
+    _TEEC_MappingIterator it = _TEEC_mappings.begin();
+    while (it != _TEEC_mappings.end()) {
+        if (it->shared && (it->buffer < start + sharedMem->size) &&
+                (it->buffer + it->size > start)) {
+            if (it->users != 0) {
+                LOG_W("shared memory %p released while in use", sharedMem->buffer);
+            }
+            mcUnmap(&it->handle, it->buffer, &it->mapInfo);
+            it = _TEEC_mappings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    pthread_mutex_unlock(&_TEEC_mappingsLock);
+}
+
 //------------------------------------------------------------------------------
 static TEEC_Result _TEEC_SetupOperation(
     _TEEC_TCI           *tci,
@@ -126,6 +333,11 @@ static TEEC_Result _TEEC_SetupOperation(
         //implementations of the C library malloc, in which is valid to allocate a zero byte buffer and receive a non-
         //NULL pointer which may not be de-referenced in return.
 
+        // An unwind after an error must not release mappings of parameters
+        // that have not been set up
+        for (i = 0; i < _TEEC_PARAMETER_NUMBER; i++) {
+            tci->operation.params[i].memref.mapInfo.sVirtualLen = 0;
+        }
 
         for (i = 0; i < _TEEC_PARAMETER_NUMBER; i++) {
             imp = &tci->operation.params[i];
@@ -152,7 +364,7 @@ static TEEC_Result _TEEC_SetupOperation(
                 LOG_I("  cycle %d, TEEC_TEMP_IN*", i);
                 imp->memref.mapInfo.sVirtualLen = 0;
                 if ((ext->tmpref.size) && (ext->tmpref.buffer)) {
-                    mcRet = mcMap(handle, ext->tmpref.buffer, ext->tmpref.size, &imp->memref.mapInfo);
+                    mcRet = _TEEC_MapBuffer(handle, ext->tmpref.buffer, ext->tmpref.size, false, &imp->memref.mapInfo);
                     if (mcRet != MC_DRV_OK) {
                         LOG_E("mcMap failed, mcRet=0x%08X", mcRet);
                         *returnOrigin = TEEC_ORIGIN_COMMS;
@@ -167,7 +379,7 @@ static TEEC_Result _TEEC_SetupOperation(
                 LOG_I("  cycle %d, TEEC_MEMREF_WHOLE", i);
                 imp->memref.mapInfo.sVirtualLen = 0;
                 if (ext->memref.parent->size) {
-                    mcRet = mcMap(handle, ext->memref.parent->buffer, ext->memref.parent->size, &imp->memref.mapInfo);
+                    mcRet = _TEEC_MapBuffer(handle, ext->memref.parent->buffer, ext->memref.parent->size, true, &imp->memref.mapInfo);
                     if (mcRet != MC_DRV_OK) {
                         LOG_E("mcMap failed, mcRet=0x%08X", mcRet);
                         *returnOrigin = TEEC_ORIGIN_COMMS;
@@ -201,7 +413,19 @@ static TEEC_Result _TEEC_SetupOperation(
                 }
                 imp->memref.mapInfo.sVirtualLen = 0;
                 if (ext->memref.size) {
-                    mcRet = mcMap(handle, (uint8_t *)ext->memref.parent->buffer + ext->memref.offset, ext->memref.size, &imp->memref.mapInfo);
+                    // Map the whole shared memory once, the partial memref is
+                    // an offset into that mapping. Shared memory too large
+                    // for one MCP map only gets the referenced range mapped.
+                    if (ext->memref.parent->size <= MCP_MAP_MAX) {
+                        mcRet = _TEEC_MapBuffer(handle, ext->memref.parent->buffer, ext->memref.parent->size, true, &imp->memref.mapInfo);
+                        if (mcRet == MC_DRV_OK) {
+                            imp->memref.mapInfo.sVirtualAddr = (uint8_t *)imp->memref.mapInfo.sVirtualAddr + ext->memref.offset;
+                            imp->memref.mapInfo.sVirtualLen = ext->memref.size;
+                        }
+                    } else {
+                        mcRet = _TEEC_MapBuffer(handle, (uint8_t *)ext->memref.parent->buffer + ext->memref.offset,
+                                                ext->memref.size, true, &imp->memref.mapInfo);
+                    }
                     if (mcRet != MC_DRV_OK) {
                         LOG_E("mcMap failed, mcRet=0x%08X", mcRet);
                         *returnOrigin = TEEC_ORIGIN_COMMS;
@@ -262,6 +486,7 @@ static TEEC_Result _TEEC_UnwindOperation(
     //mcResult_t                  mcRet = MC_DRV_OK;
     //bool                        doUnmap = false;
     uint8_t                     *buffer;
+    TEEC_Result                 teecResult = TEEC_SUCCESS;
 
     //operation can be NULL
     if (operation == NULL) return  TEEC_SUCCESS;
@@ -270,13 +495,15 @@ static TEEC_Result _TEEC_UnwindOperation(
 
     operation->started = 2;
 
-    // Some sanity checks
+    // Some sanity checks, the mappings are released anyway
     if (tci->returnOrigin == 0 ||
             ((tci->returnOrigin != TEEC_ORIGIN_TRUSTED_APP) && (tci->returnStatus != TEEC_SUCCESS))) {
         *returnOrigin = TEEC_ORIGIN_COMMS;
-        return TEEC_ERROR_COMMUNICATION;
+        teecResult = TEEC_ERROR_COMMUNICATION;
+        copyValues = false;
+    } else {
+        *returnOrigin = tci->returnOrigin;
     }
-    *returnOrigin = tci->returnOrigin;
 
     //Clear sVirtualLen to unMap further
     for (i = 0; i < _TEEC_PARAMETER_NUMBER; i++) {
@@ -335,11 +562,11 @@ static TEEC_Result _TEEC_UnwindOperation(
         }
 
         if ((buffer != NULL) && (imp->memref.mapInfo.sVirtualLen != 0)) {
-            // This function assumes that we cannot handle error of mcUnmap
-            mcUnmap(handle, buffer, &imp->memref.mapInfo);
+            _TEEC_UnmapBuffer(handle, buffer, imp->memref.mapInfo.sVirtualLen);
         }
     }
 
+    if (teecResult != TEEC_SUCCESS) return teecResult;
     return tci->returnStatus;
 }
 
@@ -466,6 +693,7 @@ end:
             LOG_E("mcCloseSession failed (%08x)", mcRet);
             /* continue even in case of error */;
         }
+        _TEEC_ForgetSessionMappings(&session->imp.handle);
         session->imp.active = false;
         if (teecError == TEEC_ERROR_COMMUNICATION) {
             *returnOrigin = TEEC_ORIGIN_COMMS;
@@ -702,6 +930,7 @@ void TEEC_CloseSession(TEEC_Session *session)
                 LOG_E("mcCloseSession failed (%08x)", mcRet);
                 /* ignore error and also there shouldn't be one */
             }
+            _TEEC_ForgetSessionMappings(&session->imp.handle);
         }
         pthread_mutex_unlock(&session->imp.mutex_tci);
     }
@@ -787,6 +1016,11 @@ void TEEC_ReleaseSharedMemory (
         return;
     }
 
+    // Drop the mappings kept for the shared memory
+    if (sharedMem->buffer) {
+        _TEEC_UnmapSharedMemory(sharedMem);
+    }
+
     //For a memory buffer allocated using TEEC_AllocateSharedMemory the Implementation
     //MUST free the underlying memory
     if (sharedMem->imp.implementation_allocated) {
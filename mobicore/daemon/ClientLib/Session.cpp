@@ -47,6 +47,7 @@ Session::Session(
     this->sessionId = sessionId;
     this->mcKMod = mcKMod;
     this->notificationConnection = connection;
+    this->tciWsm = NULL;
 
     sessionInfo.lastErr = SESSION_ERR_NO;
     sessionInfo.state = SESSION_STATE_INITIAL;
@@ -99,6 +99,7 @@ private:
 public:
     uint32_t sessionId;
     Connection *notificationConnection;
+    addr_t tciWsm; /**< Contiguous WSM used as TCI, NULL if none */
 
     Session(uint32_t sessionId, CMcKMod *mcKMod, Connection *connection);
 
@@ -166,6 +166,32 @@ typedef struct {
     uint32_t sVirtualLen;       /**< Length of the mapped Bulk buffer */
 } mcBulkMap_t;
 
+#define MC_STATS_MCP_COMMANDS      16 /**< MCP latencies, indexed by MCP command ID */
+
+/** Latency of one MCP command, see mcGetDaemonStats(). */
+typedef struct {
+    uint32_t count;             /**< Answered commands */
+    uint32_t timeouts;          /**< Commands MobiCore did not answer */
+    uint32_t p50Us;             /**< Median latency, upper bound of its bucket */
+    uint32_t p99Us;             /**< 99th percentile, upper bound of its bucket */
+    uint32_t maxUs;             /**< Longest latency */
+} mcMcpLatencyStats_t;
+
+/** Debug statistics of the daemon, see mcGetDaemonStats(). */
+typedef struct {
+    mcMcpLatencyStats_t mcpLatency[MC_STATS_MCP_COMMANDS];
+    uint32_t schedYields;       /**< Yields of the scheduler to MobiCore */
+    uint32_t schedNsiqs;        /**< N-SIQs forced at the end of a timeslice */
+    uint32_t schedBackoffs;     /**< Yields without progress followed by a pause */
+    uint32_t schedBoosts;       /**< Priority boosts for waiting clients */
+    uint32_t schedSecureTimeMs; /**< Time the scheduler spent in MobiCore */
+    uint32_t schedTimesliceUs;  /**< Current MobiCore time between N-SIQs */
+    uint32_t blobCacheHits;     /**< Registry blob cache hits */
+    uint32_t blobCacheMisses;   /**< Registry blob cache misses */
+    uint32_t blobCacheEntries;  /**< Blobs in the registry cache */
+    uint32_t blobCacheSize;     /**< Bytes in the registry cache */
+} mcDaemonStats_t;
+
 
 #define MC_DEVICE_ID_DEFAULT       0 /**< The default device ID */
 #define MC_INFINITE_TIMEOUT        ((int32_t)(-1)) /**< Wait infinite for a response of the MC. */
@@ -268,6 +294,37 @@ __MC_CLIENT_LIB_API mcResult_t mcOpenTrustlet(
     uint32_t           tciLen
 );
 
+/** Open a new session to a Trustlet. The trustlet will be loaded from a file
+ * descriptor
+ *
+ * Same as mcOpenTrustlet(), but the trustlet binary is not streamed over the
+ * daemon socket: the descriptor is passed instead and the daemon reads the first
+ * tLen bytes of the file into its own memory.
+ *
+ * @param [in,out] session On success, the session data will be returned. Note that session.deviceId has to be the device id of an opened device.
+ * @param [in] spid Service Provider ID(for Service provider trustlets otherwise ignored)
+ * @param [in] fd File or memfd descriptor holding the trustlet binary, still owned by the caller.
+ * @param [in] tLen length of the trustlet binary
+ * @param [in] tci TCI buffer for communicating with the trustlet.
+ * @param [in] tciLen Length of the TCI buffer. Maximum allowed value is MC_MAX_TCI_LEN.
+ *
+ * @return MC_DRV_OK if operation has been successfully completed.
+ * @return MC_DRV_INVALID_PARAMETER if session parameter or fd is invalid.
+ * @return MC_DRV_ERR_UNKNOWN_DEVICE when device id is invalid.
+ * @return MC_DRV_ERR_DAEMON_UNREACHABLE when problems with daemon socket occur.
+ * @return MC_DRV_ERR_UNKNOWN_DEVICE when daemon returns an error.
+ *
+ * Uses a Mutex.
+ */
+__MC_CLIENT_LIB_API mcResult_t mcOpenTrustletFd(
+    mcSessionHandle_t  *session,
+    mcSpid_t           spid,
+    int                fd,
+    uint32_t           tLen,
+    uint8_t            *tci,
+    uint32_t           tciLen
+);
+
 
 /** Close a Trustlet session.
  *
@@ -495,6 +552,23 @@ __MC_CLIENT_LIB_API mcResult_t mcGetMobiCoreVersion(
     uint32_t  deviceId,
     mcVersionInfo_t *versionInfo
 );
+
+/**
+ * Get debug statistics of the daemon serving a device: MCP command
+ * latencies, scheduler and registry blob cache counters.
+ *
+ * @param [in] deviceId of an open device.
+ * @param [out] stats Daemon statistics.
+ *
+ * @return MC_DRV_OK if operation has been successfully completed.
+ * @return MC_DRV_ERR_UNKNOWN_DEVICE when device is not open.
+ * @return MC_DRV_INVALID_PARAMETER if a parameter is invalid.
+ * @return MC_DRV_ERR_DAEMON_UNREACHABLE when problems with daemon occur.
+ */
+__MC_CLIENT_LIB_API mcResult_t mcGetDaemonStats(
+    uint32_t  deviceId,
+    mcDaemonStats_t *stats
+);
 #pragma GCC visibility pop
 #endif /** MCDRIVER_H_ */
 
@@ -39,7 +39,16 @@
 CSemaphore::CSemaphore(int size) : m_waiters_count(0), m_count(size)
 {
     pthread_mutex_init(&m_mutex, NULL);
+#ifdef HAVE_PTHREAD_COND_TIMEDWAIT_MONOTONIC
     pthread_cond_init(&m_cond, NULL);
+#else
+    // Timed waits must not be affected by changes of the wall clock
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&m_cond, &attr);
+    pthread_condattr_destroy(&attr);
+#endif
 }
 
 
@@ -65,24 +74,50 @@ void CSemaphore::wait()
 
 //------------------------------------------------------------------------------
 bool CSemaphore::wait(int sec)
+{
+    if (sec < 0) {
+        wait();
+        return true;
+    }
+    if (sec > INT_MAX / 1000)
+        sec = INT_MAX / 1000;
+    return waitMs(sec * 1000);
+}
+
+//------------------------------------------------------------------------------
+bool CSemaphore::waitMs(int32_t timeout)
 {
     int rc = 0;
     struct timespec tm;
-    if (sec < 0)
-        sec = LONG_MAX;
-    clock_gettime(CLOCK_REALTIME, &tm);
-    tm.tv_sec += sec;
+
+    if (timeout < 0) {
+        wait();
+        return true;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &tm);
+    tm.tv_sec += timeout / 1000;
+    tm.tv_nsec += (timeout % 1000) * 1000000L;
+    if (tm.tv_nsec >= 1000000000L) {
+        tm.tv_sec++;
+        tm.tv_nsec -= 1000000000L;
+    }
 
     pthread_mutex_lock(&m_mutex);
     m_waiters_count ++;
-    if ( m_count == 0 ) {
+    while ( m_count == 0 && rc == 0 ) {
+#ifdef HAVE_PTHREAD_COND_TIMEDWAIT_MONOTONIC
+        rc = pthread_cond_timedwait_monotonic_np(&m_cond, &m_mutex, &tm);
+#else
         rc = pthread_cond_timedwait(&m_cond, &m_mutex, &tm);
+#endif
     }
     m_waiters_count --;
-    // Decrement only if waiting actually succeeded, otherwise we
-    // just timed out
-    if (!rc)
+    // Also take a signal that arrived just as the wait timed out
+    if ( m_count > 0 ) {
         m_count --;
+        rc = 0;
+    }
     pthread_mutex_unlock(&m_mutex);
     return (rc == 0);
 }
@@ -34,6 +34,7 @@
 #define CSEMAPHORE_H_
 
 #include "pthread.h"
+#include <stdint.h>
 
 /**
  * Could inherit from CMutex, or use CMutex internally.
@@ -53,6 +54,13 @@ public:
     void wait(void);
     bool wait(int sec);
 
+    /** Waits at most timeout milliseconds, measured on the monotonic clock.
+     *
+     * @param timeout Time to wait in milliseconds, negative waits forever.
+     * @return true if signaled, false on timeout.
+     */
+    bool waitMs(int32_t timeout);
+
     bool wouldWait(void);
 
     void signal(void);
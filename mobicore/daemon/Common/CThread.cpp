@@ -85,7 +85,7 @@ void CThread::exit(
 )
 {
     setExiting();
-    pthread_exit((void *)exitcode);
+    pthread_exit((void *)(intptr_t)exitcode);
 }
 
 
@@ -44,6 +44,9 @@
 //#define LOG_VERBOSE
 #include "log.h"
 
+/** Descriptors readFd() takes off the socket at once, the extra ones to close them. */
+#define MAX_RECEIVED_FDS    8
+
 
 //------------------------------------------------------------------------------
 Connection::Connection(void)
@@ -51,6 +54,7 @@ Connection::Connection(void)
     connectionData = NULL;
     // Set invalid socketDescriptor
     socketDescriptor = -1;
+    messageTimeout = -1;
 }
 
 
@@ -63,6 +67,7 @@ Connection::Connection(int socketDescriptor, sockaddr_un *remote)
     this->socketDescriptor = socketDescriptor;
     this->remote = *remote;
     connectionData = NULL;
+    messageTimeout = -1;
 }
 
 
@@ -109,58 +114,49 @@ bool Connection::connect(const char *dest)
 //------------------------------------------------------------------------------
 size_t Connection::readData(void *buffer, uint32_t len)
 {
-    return readData(buffer, len, -1);
+    return readData(buffer, len, messageTimeout);
 }
 
 
 //------------------------------------------------------------------------------
 size_t Connection::readData(void *buffer, uint32_t len, int32_t timeout)
 {
-    size_t ret = 0;
-    struct timeval tv;
-    struct timeval *ptv = NULL;
-    fd_set readfds;
+    uint32_t done = 0;
 
     assert(NULL != buffer);
     assert(socketDescriptor != -1);
 
-    if (timeout >= 0) {
-        // Calculate timeout value
-        tv.tv_sec = timeout / 1000;
-        tv.tv_usec = (timeout - (tv.tv_sec * 1000)) * 1000;
-        ptv = &tv;
-    }
-
-    FD_ZERO(&readfds);
-    FD_SET(socketDescriptor, &readfds);
-    ret = select(socketDescriptor + 1, &readfds, NULL, NULL, ptv);
-
-    // check for read error
-    if ((int)ret == -1) {
-        LOG_ERRNO("select");
-        return -1;
-    }
-
-    // Handle case of no descriptor ready
-    if (ret == 0) {
-        LOG_W(" Timeout during select() / No more notifications.");
-        return -2;
-    }
-
-    // one or more descriptors are ready
-
-    // finally check if fd has been selected -> must socketDescriptor
-    if (!FD_ISSET(socketDescriptor, &readfds)) {
-        LOG_ERRNO("no fd is set, select");
-        return ret;
-    }
-
-    ret = recv(socketDescriptor, buffer, len, MSG_DONTWAIT);
-    if (ret == 0) {
-        LOG_V(" readData(): peer orderly closed connection.");
+    // Never block in recv(): a peer that stops in the middle of a message
+    // must not hold the reading thread for longer than the timeout.
+    while (done < len) {
+        ssize_t ret = recv(socketDescriptor, (char *)buffer + done, len - done,
+                           MSG_DONTWAIT);
+        if (ret > 0) {
+            done += ret;
+            continue;
+        }
+        if (ret == 0) {
+            LOG_V(" readData(): peer orderly closed connection.");
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            LOG_ERRNO("recv");
+            return -1;
+        }
+
+        int waitRet = waitData(timeout);
+        if (waitRet == -2) {
+            LOG_W(" Timeout during poll() / No more notifications.");
+        }
+        if (waitRet < 0) {
+            return waitRet;
+        }
     }
 
-    return ret;
+    return done;
 }
 
 
@@ -182,33 +178,128 @@ size_t Connection::writeData(void *buffer, uint32_t len)
 
 
 //------------------------------------------------------------------------------
-int Connection::waitData(int32_t timeout)
+bool Connection::writeFd(int fd)
 {
-    size_t ret;
-    struct timeval tv;
-    struct timeval *ptv = NULL;
-    fd_set readfds;
+    char marker = 0;
+    struct iovec iov;
+    struct msghdr msg;
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
 
     assert(socketDescriptor != -1);
 
-    if (timeout >= 0) {
-        // Calculate timeout value
-        tv.tv_sec = timeout / 1000;
-        tv.tv_usec = (timeout - (tv.tv_sec * 1000)) * 1000;
-        ptv = &tv;
+    iov.iov_base = &marker;
+    iov.iov_len = sizeof(marker);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    if (sendmsg(socketDescriptor, &msg, 0) != sizeof(marker)) {
+        LOG_ERRNO("sendmsg");
+        return false;
     }
 
-    FD_ZERO(&readfds);
-    FD_SET(socketDescriptor, &readfds);
-    ret = select(socketDescriptor + 1, &readfds, NULL, NULL, ptv);
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+bool Connection::readFd(int *fd)
+{
+    char marker;
+    struct iovec iov;
+    struct msghdr msg;
+    // Room for more descriptors than expected, so that any a client adds
+    // are received and closed here instead of leaking into the daemon
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(MAX_RECEIVED_FDS * sizeof(int))];
+    } control;
+    int fds[MAX_RECEIVED_FDS];
+    size_t count = 0;
+
+    assert(fd != NULL);
+    assert(socketDescriptor != -1);
+
+    iov.iov_base = &marker;
+    iov.iov_len = sizeof(marker);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    if (waitData(messageTimeout) < 0) {
+        LOG_E("no file descriptor received in time");
+        return false;
+    }
+
+    ssize_t ret = recvmsg(socketDescriptor, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+    if (ret < 0) {
+        LOG_ERRNO("recvmsg");
+        return false;
+    }
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+            cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if ((cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS)) {
+            continue;
+        }
+        size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; (i < n) && (count < MAX_RECEIVED_FDS); i++) {
+            memcpy(&fds[count++], CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+        }
+    }
+
+    // Exactly one descriptor with the marker, anything else is rejected
+    // with all of the descriptors that came with it
+    if ((ret != sizeof(marker)) || (msg.msg_flags & MSG_CTRUNC) || (count != 1)) {
+        LOG_E("expected one file descriptor, received %zu", count);
+        for (size_t i = 0; i < count; i++) {
+            close(fds[i]);
+        }
+        return false;
+    }
+    *fd = fds[0];
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+int Connection::waitData(int32_t timeout)
+{
+    struct pollfd pfd;
+    int ret;
+
+    assert(socketDescriptor != -1);
+
+    pfd.fd = socketDescriptor;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    do {
+        ret = poll(&pfd, 1, timeout);
+    } while (ret < 0 && errno == EINTR);
 
     // check for read error
-    if ((int)ret == -1) {
-        LOG_ERRNO("select");
-        return ret;
-    } else if (ret == 0) {
-        LOG_E("select() timed out");
+    if (ret < 0) {
+        LOG_ERRNO("poll");
         return -1;
+    } else if (ret == 0) {
+        return -2;
     }
 
     return 0;
@@ -235,7 +326,7 @@ bool Connection::isConnectionAlive(void)
 bool Connection::getPeerCredentials(struct ucred &cr)
 {
     struct ucred cred;
-    int len = sizeof (cred);
+    socklen_t len = sizeof (cred);
     assert(socketDescriptor != -1);
     getsockopt(socketDescriptor, SOL_SOCKET, SO_PEERCRED, &cred, &len);
     if (len == sizeof(cred)) {
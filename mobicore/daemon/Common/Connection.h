@@ -50,6 +50,7 @@ public:
     int32_t socketDescriptor; /**< Local socket descriptor */
     void *connectionData; /**< reference to data related with the connection */
     bool detached; /**< Connection state */
+    int32_t messageTimeout; /**< Longest wait in milliseconds for the rest of a message, -1 for none */
 
     Connection(void);
 
@@ -66,19 +67,22 @@ public:
     virtual bool connect(const char *dest);
 
     /**
-     * Read bytes from the connection.
+     * Read len bytes from the connection. The socket is only read without
+     * blocking; in between, the call waits at most timeout milliseconds
+     * for more data to arrive.
      *
      * @param buffer    Pointer to destination buffer.
      * @param len       Number of bytes to read.
-     * @param timeout   Timeout in milliseconds
-     * @return Number of bytes read.
-     * @return -1 if select() failed (returned -1)
-     * @return -2 if no data available, i.e. timeout
+     * @param timeout   Timeout in milliseconds, -1 to wait forever
+     * @return Number of bytes read, less than len if the peer closed.
+     * @return -1 if poll() or recv() failed
+     * @return -2 if no data arrived in time
      */
     virtual size_t readData(void *buffer, uint32_t len, int32_t timeout);
 
     /**
-     * Read bytes from the connection.
+     * Read len bytes from the connection, waiting at most messageTimeout
+     * for each part of them.
      *
      * @param buffer    Pointer to destination buffer.
      * @param len       Number of bytes to read.
@@ -96,12 +100,31 @@ public:
      */
     virtual size_t writeData(void *buffer, uint32_t len);
 
+    /**
+     * Pass a file descriptor to the peer. A single marker byte carries
+     * the descriptor as SCM_RIGHTS ancillary data.
+     *
+     * @param fd        Descriptor to pass, still owned by the caller.
+     * @return true on success.
+     */
+    virtual bool writeFd(int fd);
+
+    /**
+     * Receive a file descriptor sent with writeFd(), waiting at most
+     * messageTimeout for it.
+     *
+     * @param fd        Receives the descriptor, owned by the caller.
+     * @return true on success.
+     */
+    virtual bool readFd(int *fd);
+
     /**
      * Wait for data to be available.
      *
-     * @param timeout   Timeout in milliseconds
+     * @param timeout   Timeout in milliseconds, -1 to wait forever
      * @return 0 if data is available
-     * @return error code if otherwise
+     * @return -1 if poll() failed
+     * @return -2 on timeout
      */
     virtual int waitData(int32_t timeout);
 
@@ -20,5 +20,6 @@ LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(DEVICE_PATH) \
 LOCAL_SRC_FILES += $(DEVICE_PATH)/DeviceIrqHandler.cpp \
 	$(DEVICE_PATH)/DeviceScheduler.cpp \
 	$(DEVICE_PATH)/MobiCoreDevice.cpp \
+	$(DEVICE_PATH)/McpLatency.cpp \
 	$(DEVICE_PATH)/NotificationQueue.cpp \
 	$(DEVICE_PATH)/TrustletSession.cpp
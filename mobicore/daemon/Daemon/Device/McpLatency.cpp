@@ -0,0 +1,66 @@
+/** @addtogroup MCD_MCDIMPL_DAEMON_DEV
+ * @{
+ * @file
+ *
+ * <!-- Copyright Giesecke & Devrient GmbH 2009 - 2012 -->
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "McpLatency.h"
+
+//------------------------------------------------------------------------------
+void mcpLatencyAdd(mcpLatency_t *latency, uint32_t us)
+{
+    uint32_t bucket = 0;
+
+    while ((bucket < MCP_LATENCY_BUCKETS - 1) && ((us >> (bucket + 1)) != 0)) {
+        bucket++;
+    }
+
+    latency->count++;
+    latency->buckets[bucket]++;
+    if (us > latency->maxUs) {
+        latency->maxUs = us;
+    }
+}
+
+//------------------------------------------------------------------------------
+uint32_t mcpLatencyPercentile(const mcpLatency_t *latency, uint32_t percent)
+{
+    uint32_t rank = (uint32_t)(((uint64_t)latency->count * percent + 99) / 100);
+    uint32_t seen = 0;
+
+    for (uint32_t bucket = 0; bucket < MCP_LATENCY_BUCKETS; bucket++) {
+        seen += latency->buckets[bucket];
+        if ((seen >= rank) && (seen != 0)) {
+            uint32_t upper = (bucket >= 31) ? 0xFFFFFFFF : (2U << bucket) - 1;
+            return (upper < latency->maxUs) ? upper : latency->maxUs;
+        }
+    }
+    return 0;
+}
+
+/** @} */
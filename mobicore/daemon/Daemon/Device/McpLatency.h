@@ -0,0 +1,59 @@
+/** @addtogroup MCD_MCDIMPL_DAEMON_DEV
+ * @{
+ * @file
+ *
+ * Latency histograms of MCP commands.
+ *
+ * <!-- Copyright Giesecke & Devrient GmbH 2009 - 2012 -->
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef MCPLATENCY_H_
+#define MCPLATENCY_H_
+
+#include <stdint.h>
+
+#define MCP_LATENCY_BUCKETS     32      /**< Bucket i counts latencies in [2^i, 2^(i+1)) us */
+
+/** Latency histogram of one MCP command. */
+typedef struct {
+    uint32_t count;
+    uint32_t timeouts;
+    uint32_t maxUs;
+    uint32_t buckets[MCP_LATENCY_BUCKETS];
+} mcpLatency_t;
+
+/** Adds an answered command that took us microseconds. */
+void mcpLatencyAdd(mcpLatency_t *latency, uint32_t us);
+
+/**
+ * Returns the upper bound of the bucket holding the given percentile, but
+ * no more than the longest latency. Returns 0 for an empty histogram.
+ */
+uint32_t mcpLatencyPercentile(const mcpLatency_t *latency, uint32_t percent);
+
+#endif /* MCPLATENCY_H_ */
+
+/** @} */
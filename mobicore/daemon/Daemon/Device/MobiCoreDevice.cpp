@@ -32,7 +32,9 @@
  */
 
 #include <cstdlib>
+#include <cstring>
 #include <pthread.h>
+#include <time.h>
 #include "McTypes.h"
 
 #include "DeviceScheduler.h"
@@ -54,6 +56,14 @@
 MobiCoreDevice::MobiCoreDevice()
 {
     mcFault = false;
+    mcpQueueNext = 0;
+    mcpQueueServing = 0;
+    mcpCommandId = MC_MCP_CMD_ID_INVALID;
+    mcpCommandStartUs = 0;
+    memset(mcpLatency, 0, sizeof(mcpLatency));
+    pendingInvocations = 0;
+    pthread_mutex_init(&mcpQueueMutex, NULL);
+    pthread_cond_init(&mcpQueueCond, NULL);
 }
 
 //------------------------------------------------------------------------------
@@ -61,20 +71,48 @@ MobiCoreDevice::~MobiCoreDevice()
 {
     delete mcVersionInfo;
     mcVersionInfo = NULL;
+    pthread_cond_destroy(&mcpQueueCond);
+    pthread_mutex_destroy(&mcpQueueMutex);
+}
+
+//------------------------------------------------------------------------------
+void MobiCoreDevice::lockMcp(void)
+{
+    pthread_mutex_lock(&mcpQueueMutex);
+    uint32_t ticket = mcpQueueNext++;
+    while (ticket != mcpQueueServing) {
+        pthread_cond_wait(&mcpQueueCond, &mcpQueueMutex);
+    }
+    pthread_mutex_unlock(&mcpQueueMutex);
+}
+
+//------------------------------------------------------------------------------
+void MobiCoreDevice::unlockMcp(void)
+{
+    pthread_mutex_lock(&mcpQueueMutex);
+    mcpQueueServing++;
+    pthread_cond_broadcast(&mcpQueueCond);
+    pthread_mutex_unlock(&mcpQueueMutex);
 }
 
 //------------------------------------------------------------------------------
 TrustletSession *MobiCoreDevice::getTrustletSession(uint32_t sessionId)
 {
+    TrustletSession *ts = NULL;
+
+    sessionsMutex.lock();
     for (trustletSessionIterator_t session = trustletSessions.begin();
             session != trustletSessions.end();
             ++session) {
         TrustletSession *tsTmp = *session;
         if (tsTmp->sessionId == sessionId) {
-            return tsTmp;
+            ts = tsTmp;
+            break;
         }
     }
-    return NULL;
+    sessionsMutex.unlock();
+
+    return ts;
 }
 
 
@@ -91,34 +129,73 @@ void MobiCoreDevice::cleanSessionBuffers(TrustletSession *session)
 //------------------------------------------------------------------------------
 void MobiCoreDevice::removeTrustletSession(uint32_t sessionId)
 {
+    sessionsMutex.lock();
     for (trustletSessionIterator_t session = trustletSessions.begin();
             session != trustletSessions.end();
             ++session) {
         if ((*session)->sessionId == sessionId) {
             cleanSessionBuffers(*session);
             trustletSessions.erase(session);
-            return;
+            break;
         }
     }
+    sessionsMutex.unlock();
 }
 //------------------------------------------------------------------------------
-Connection *MobiCoreDevice::getSessionConnection(uint32_t sessionId, notification_t *notification)
+void MobiCoreDevice::putTrustletSession(TrustletSession *session)
 {
-    Connection *con = NULL;
-    TrustletSession *ts = NULL;
+    sessionsMutex.lock();
+    bool last = (--session->references == 0);
+    sessionsMutex.unlock();
 
-    ts = getTrustletSession(sessionId);
-    if (ts == NULL) {
-        return NULL;
+    if (last) {
+        invocationAnswered(session);
+        delete session;
+    }
+}
+//------------------------------------------------------------------------------
+void MobiCoreDevice::invocationSent(TrustletSession *session)
+{
+    // Counted once per session however often its client notifies, so a
+    // trustlet that does not answer every notification can't make the
+    // count drift
+    if (__sync_bool_compare_and_swap(&session->invocationPending, 0, 1)) {
+        __sync_fetch_and_add(&pendingInvocations, 1);
     }
+}
+//------------------------------------------------------------------------------
+void MobiCoreDevice::invocationAnswered(TrustletSession *session)
+{
+    if (__sync_bool_compare_and_swap(&session->invocationPending, 1, 0)) {
+        __sync_fetch_and_sub(&pendingInvocations, 1);
+    }
+}
+//------------------------------------------------------------------------------
+TrustletSession *MobiCoreDevice::getNotificationSession(uint32_t sessionId, notification_t *notification)
+{
+    TrustletSession *ts = NULL;
 
-    con = ts->notificationConnection;
-    if (con == NULL) {
-        ts->queueNotification(notification);
-        return NULL;
+    // Queue or reference under the lock, closing the session may not delete
+    // it or its notification connection meanwhile
+    sessionsMutex.lock();
+    for (trustletSessionIterator_t session = trustletSessions.begin();
+            session != trustletSessions.end();
+            ++session) {
+        if ((*session)->sessionId != sessionId) {
+            continue;
+        }
+        invocationAnswered(*session);
+        if ((*session)->notificationConnection == NULL) {
+            (*session)->queueNotification(notification);
+        } else {
+            ts = *session;
+            ts->references++;
+        }
+        break;
     }
+    sessionsMutex.unlock();
 
-    return con;
+    return ts;
 }
 
 
@@ -142,24 +219,27 @@ bool MobiCoreDevice::open(Connection *connection)
 void MobiCoreDevice::close(Connection *connection)
 {
     trustletSessionList_t::reverse_iterator interator;
-    static CMutex mutex;
+    std::vector<uint32_t> sessionIds;
     // 1. Iterate through device session to find connection
     // 2. Decide what to do with open Trustlet sessions
     // 3. Remove & delete deviceSession from vector
 
-    // Enter critical section
-    mutex.lock();
+    // Collect the sessions first, closing them takes the MCP buffer
+    sessionsMutex.lock();
     for (interator = trustletSessions.rbegin();
             interator != trustletSessions.rend();
             interator++) {
         TrustletSession *ts = *interator;
 
         if (ts->deviceConnection == connection) {
-            closeSession(connection, ts->sessionId);
+            sessionIds.push_back(ts->sessionId);
         }
     }
-    // Leave critical section
-    mutex.unlock();
+    sessionsMutex.unlock();
+
+    for (size_t i = 0; i < sessionIds.size(); i++) {
+        closeSession(connection, sessionIds[i]);
+    }
 
     // After the trustlet is done make sure to tell the driver to cleanup
     // all the orphaned drivers
@@ -196,34 +276,81 @@ void MobiCoreDevice::signalMcpNotification(void)
 }
 
 
+//------------------------------------------------------------------------------
+uint64_t MobiCoreDevice::getMonotonicUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//------------------------------------------------------------------------------
+void MobiCoreDevice::sendMcpCommand(void)
+{
+    mcpCommandId = mcpMessage->cmdHeader.cmdId;
+    mcpCommandStartUs = getMonotonicUs();
+    notify(SID_MCP);
+}
+
+//------------------------------------------------------------------------------
+void MobiCoreDevice::recordMcpLatency(bool answered)
+{
+    uint64_t latency = getMonotonicUs() - mcpCommandStartUs;
+    uint32_t us = (latency > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)latency;
+
+    mcpLatencyMutex.lock();
+    mcpLatency_t *latencyStats = &mcpLatency[mcpCommandId % MC_STATS_MCP_COMMANDS];
+    if (answered) {
+        mcpLatencyAdd(latencyStats, us);
+    } else {
+        latencyStats->timeouts++;
+    }
+    mcpLatencyMutex.unlock();
+}
+
+//------------------------------------------------------------------------------
+void MobiCoreDevice::getMcpLatencyStats(mcMcpLatencyStats_t stats[MC_STATS_MCP_COMMANDS])
+{
+    mcpLatencyMutex.lock();
+    for (uint32_t i = 0; i < MC_STATS_MCP_COMMANDS; i++) {
+        stats[i].count = mcpLatency[i].count;
+        stats[i].timeouts = mcpLatency[i].timeouts;
+        stats[i].p50Us = mcpLatencyPercentile(&mcpLatency[i], 50);
+        stats[i].p99Us = mcpLatencyPercentile(&mcpLatency[i], 99);
+        stats[i].maxUs = mcpLatency[i].maxUs;
+    }
+    mcpLatencyMutex.unlock();
+}
+
 //------------------------------------------------------------------------------
 bool MobiCoreDevice::waitMcpNotification(void)
 {
-    int counter = 5;
-    while (1) {
+    uint64_t deadline = getMonotonicUs() + (uint64_t)MCP_TIMEOUT_MS * 1000;
+
+    for (;;) {
         // In case of fault just return, nothing to do here
         if (mcFault) {
+            recordMcpLatency(false);
             return false;
         }
-        // Wait 10 seconds for notification
-        if (mcpSessionNotification.wait(10) == false) {
-            // No MCP answer received and mobicore halted, dump mobicore status
-            // then throw exception
-            LOG_I("No MCP answer received in 2 seconds.");
-            if (getMobicoreStatus() == MC_STATUS_HALT) {
-                dumpMobicoreStatus();
-                mcFault = true;
-                return false;
-            } else {
-                counter--;
-                if (counter < 1) {
-                    mcFault = true;
-                    return false;
-                }
-            }
-        } else {
+        // Wake up as soon as the answer is there, check on MobiCore meanwhile
+        if (mcpSessionNotification.waitMs(MCP_STATUS_POLL_MS)) {
+            recordMcpLatency(true);
             break;
         }
+        if (getMobicoreStatus() == MC_STATUS_HALT) {
+            LOG_E("MobiCore halted while waiting for an MCP answer.");
+            dumpMobicoreStatus();
+            mcFault = true;
+            recordMcpLatency(false);
+            return false;
+        }
+        if (getMonotonicUs() >= deadline) {
+            LOG_E("No MCP answer received in %d ms.", MCP_TIMEOUT_MS);
+            mcFault = true;
+            recordMcpLatency(false);
+            return false;
+        }
     }
 
     // Check healthiness state of the device
@@ -255,12 +382,22 @@ mcResult_t MobiCoreDevice::openSession(
     uint32_t                        tciOffset,
     mcDrvRspOpenSessionPayload_ptr  pRspOpenSessionPayload)
 {
+    McpLock mcp(this);
+
     do {
         addr_t tci;
         uint32_t len;
 
         // Check if we have a cont WSM or normal one
         if (findContiguousWsm(tciHandle, deviceConnection->socketDescriptor, &tci, &len)) {
+            // The client lib may carve the TCI from a larger contiguous WSM,
+            // the offset is the one inside the WSM then.
+            if (tciOffset >= len) {
+                LOG_E("Invalid TCI offset %u in contiguous WSM of %u bytes", tciOffset, len);
+                return MC_DRV_ERR_TCI_GREATER_THAN_WSM;
+            }
+            tci = (addr_t)((uint8_t *)tci + tciOffset);
+            len -= tciOffset;
             mcpMessage->cmdOpen.wsmTypeTci = WSM_CONTIGUOUS;
             mcpMessage->cmdOpen.adrTciBuffer = (uint32_t)(tci);
             mcpMessage->cmdOpen.ofsTciBuffer = 0;
@@ -308,7 +445,7 @@ mcResult_t MobiCoreDevice::openSession(
         // seen in openSession never happens elsewhere
         notifications = std::queue<notification_t>();
         // Notify MC about a new command inside the MCP buffer
-        notify(SID_MCP);
+        sendMcpCommand();
 
         // Wait till response from MC is available
         if (!waitMcpNotification()) {
@@ -345,17 +482,19 @@ mcResult_t MobiCoreDevice::openSession(
         pRspOpenSessionPayload->deviceSessionId = (uint32_t)trustletSession;
         pRspOpenSessionPayload->sessionMagic = trustletSession->sessionMagic;
 
-        trustletSessions.push_back(trustletSession);
-
         trustletSession->addBulkBuff(new CWsm((void *)pLoadDataOpenSession->offs, pLoadDataOpenSession->len, tciHandle, 0));
 
         // We have some queued notifications and we need to send them to them
-        // trustlet session
+        // trustlet session, before the notification thread can find it
         while (!notifications.empty()) {
             trustletSession->queueNotification(&notifications.front());
             notifications.pop();
         }
 
+        sessionsMutex.lock();
+        trustletSessions.push_back(trustletSession);
+        sessionsMutex.unlock();
+
     } while (0);
     return MC_DRV_OK;
 }
@@ -373,6 +512,7 @@ TrustletSession *MobiCoreDevice::registerTrustletConnection(
           cmdNqConnect->sessionId,
           cmdNqConnect->sessionMagic);
 
+    sessionsMutex.lock();
     for (trustletSessionIterator_t iterator = trustletSessions.begin();
             iterator != trustletSessions.end();
             ++iterator) {
@@ -388,11 +528,14 @@ TrustletSession *MobiCoreDevice::registerTrustletConnection(
         }
 
         ts->notificationConnection = connection;
+        ts->references++;
+        sessionsMutex.unlock();
 
         LOG_I(" Found Service session, registered connection.");
 
         return ts;
     }
+    sessionsMutex.unlock();
 
     LOG_I("registerTrustletConnection(): search failed");
     return NULL;
@@ -404,12 +547,14 @@ mcResult_t MobiCoreDevice::closeSession(uint32_t sessionId)
 {
     LOG_I(" Write MCP CLOSE message to MCI, notify and wait");
 
+    McpLock mcp(this);
+
     // Write MCP close message to buffer
     mcpMessage->cmdClose.cmdHeader.cmdId = MC_MCP_CMD_CLOSE_SESSION;
     mcpMessage->cmdClose.sessionId = sessionId;
 
     // Notify MC about the availability of a new command inside the MCP buffer
-    notify(SID_MCP);
+    sendMcpCommand();
 
     // Wait till response from MSH is available
     if (!waitMcpNotification()) {
@@ -459,7 +604,7 @@ mcResult_t MobiCoreDevice::closeSession(Connection *deviceConnection, uint32_t s
 
     // remove objects
     removeTrustletSession(sessionId);
-    delete ts;
+    putTrustletSession(ts);
 
     return MC_DRV_OK;
 }
@@ -482,6 +627,9 @@ mcResult_t MobiCoreDevice::mapBulk(Connection *deviceConnection, uint32_t sessio
 
     // TODO-2012-09-06-haenellu: Think about not ignoring the error case, ClientLib does not allow this.
     ts->addBulkBuff(new CWsm((void *)offsetPayload, lenBulkMem, handle, (void *)pAddrL2));
+
+    McpLock mcp(this);
+
     // Write MCP map message to buffer
     mcpMessage->cmdMap.cmdHeader.cmdId = MC_MCP_CMD_MAP;
     mcpMessage->cmdMap.sessionId = sessionId;
@@ -491,7 +639,7 @@ mcResult_t MobiCoreDevice::mapBulk(Connection *deviceConnection, uint32_t sessio
     mcpMessage->cmdMap.lenBuffer = lenBulkMem;
 
     // Notify MC about the availability of a new command inside the MCP buffer
-    notify(SID_MCP);
+    sendMcpCommand();
 
     // Wait till response from MC is available
     if (!waitMcpNotification()) {
@@ -531,6 +679,8 @@ mcResult_t MobiCoreDevice::unmapBulk(Connection *deviceConnection, uint32_t sess
         return MC_DRV_ERR_DAEMON_UNKNOWN_SESSION;
     }
 
+    McpLock mcp(this);
+
     // Write MCP unmap command to buffer
     mcpMessage->cmdUnmap.cmdHeader.cmdId = MC_MCP_CMD_UNMAP;
     mcpMessage->cmdUnmap.sessionId = sessionId;
@@ -539,7 +689,7 @@ mcResult_t MobiCoreDevice::unmapBulk(Connection *deviceConnection, uint32_t sess
     mcpMessage->cmdUnmap.lenVirtualBuffer = lenBulkMem;
 
     // Notify MC about the availability of a new command inside the MCP buffer
-    notify(SID_MCP);
+    sendMcpCommand();
 
     // Wait till response from MC is available
     if (!waitMcpNotification()) {
@@ -587,6 +737,8 @@ void MobiCoreDevice::donateRam(const uint32_t donationSize)
           numPages,
           ramType);
 
+    McpLock mcp(this);
+
     do {
         // Write MCP open message to buffer
         mcpMessage->cmdDonateRam.cmdHeader.cmdId = MC_MCP_CMD_DONATE_RAM;
@@ -595,7 +747,7 @@ void MobiCoreDevice::donateRam(const uint32_t donationSize)
         mcpMessage->cmdDonateRam.ramType = ramType;
 
         // Notify MC about a new command inside the MCP buffer
-        notify(SID_MCP);
+        sendMcpCommand();
 
         // Wait till response from MC is available
         if (!waitMcpNotification()) {
@@ -625,6 +777,8 @@ mcResult_t MobiCoreDevice::getMobiCoreVersion(
     mcDrvRspGetMobiCoreVersionPayload_ptr pRspGetMobiCoreVersionPayload
 )
 {
+    McpLock mcp(this);
+
     // If MobiCore version info already fetched.
     if (mcVersionInfo != NULL) {
         pRspGetMobiCoreVersionPayload->versionInfo = *mcVersionInfo;
@@ -635,7 +789,7 @@ mcResult_t MobiCoreDevice::getMobiCoreVersion(
         mcpMessage->cmdGetMobiCoreVersion.cmdHeader.cmdId = MC_MCP_CMD_GET_MOBICORE_VERSION;
 
         // Notify MC about the availability of a new command inside the MCP buffer
-        notify(SID_MCP);
+        sendMcpCommand();
 
         // Wait till response from MC is available
         if (!waitMcpNotification()) {
@@ -51,29 +51,47 @@ void NotificationQueue::putNotification(
     notification_t *notification
 )
 {
+    volatile notificationQueueHeader_t *hdr = &out->hdr;
+
     mutex.lock();
-    if ((out->hdr.writeCnt - out->hdr.readCnt) < out->hdr.queueSize) {
-        out->notification[out->hdr.writeCnt & (out->hdr.queueSize - 1)]
-        = *notification;
-        out->hdr.writeCnt++;
+    uint32_t writeCnt = hdr->writeCnt;
+    if ((writeCnt - hdr->readCnt) < hdr->queueSize) {
+        // The element must be visible before MobiCore sees the new counter
+        out->notification[writeCnt & (hdr->queueSize - 1)] = *notification;
+        __sync_synchronize();
+        hdr->writeCnt = writeCnt + 1;
     }
     mutex.unlock();
 }
 
 
 //------------------------------------------------------------------------------
-notification_t *NotificationQueue::getNotification(
-    void
+uint32_t NotificationQueue::getNotifications(
+    notification_t *notifications,
+    uint32_t maxCount
 )
 {
-    notification_t *ret = NULL;
-    mutex.lock();
-    if ((in->hdr.writeCnt - in->hdr.readCnt) > 0) {
-        ret = &(in->notification[in->hdr.readCnt & (in->hdr.queueSize - 1)]);
-        in->hdr.readCnt++;
+    volatile notificationQueueHeader_t *hdr = &in->hdr;
+    uint32_t readCnt = hdr->readCnt;
+    uint32_t count = hdr->writeCnt - readCnt;
+
+    if (count > maxCount) {
+        count = maxCount;
     }
-    mutex.unlock();
-    return ret;
+    if (count == 0) {
+        return 0;
+    }
+
+    // Read the elements only after the counter, and copy them out before
+    // handing the slots back to MobiCore
+    __sync_synchronize();
+    for (uint32_t i = 0; i < count; i++) {
+        notifications[i] = in->notification[(readCnt + i) & (hdr->queueSize - 1)];
+    }
+    __sync_synchronize();
+    hdr->readCnt = readCnt + count;
+
+    return count;
 }
 
 /** @} */
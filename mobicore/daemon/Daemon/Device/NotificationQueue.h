@@ -58,6 +58,9 @@ public:
     );
 
     /** Places an element to the outgoing queue.
+     *
+     * Daemon threads are serialized against each other, MobiCore reads the
+     * queue without a lock.
      *
      * @param notification Data to be placed in queue.
      */
@@ -65,13 +68,18 @@ public:
         notification_t *notification
     );
 
-    /** Retrieves the first element from the queue.
+    /** Retrieves pending elements from the incoming queue.
+     *
+     * Must only be called by a single thread, MobiCore writes the queue
+     * without a lock.
      *
-     * @return first notification Queue element.
-     * @return NULL if the queue is empty.
+     * @param notifications Buffer the elements are copied to.
+     * @param maxCount Number of elements fitting in the buffer.
+     * @return number of elements copied, 0 if the queue is empty.
      */
-    notification_t *getNotification(
-        void
+    uint32_t getNotifications(
+        notification_t *notifications,
+        uint32_t maxCount
     );
 
 private:
@@ -32,9 +32,12 @@
  */
 
 #include <cstdlib>
+#include <cstring>
 #include <stdio.h>
 #include <inttypes.h>
 #include <list>
+#include <unistd.h>
+#include <sys/resource.h>
 
 #include "mc_linux.h"
 #include "McTypes.h"
@@ -72,7 +75,10 @@ TrustZoneDevice::TrustZoneDevice(
     void
 )
 {
-    // nothing to do
+    memset(&schedulerStats, 0, sizeof(schedulerStats));
+    schedulerStats.timesliceUs = SCHEDULING_TIMESLICE_MAX_US / 2;
+    ssiqCount = 0;
+    pendingCommands = 0;
 }
 
 //------------------------------------------------------------------------------
@@ -253,8 +259,12 @@ void TrustZoneDevice::notify(
         }
 
         LOG_I(" Sending notification for session %d to MobiCore", sessionId);
+        invocationSent(ts);
     } else {
         LOG_I(" Sending MCP notification to MobiCore");
+        // Only MCP commands are answered by exactly one notification, see
+        // handleIrq(). Counted before the answer can arrive.
+        __sync_fetch_and_add(&pendingCommands, 1);
     }
 
     // Notify MobiCore about new data
@@ -540,40 +550,155 @@ bool TrustZoneDevice::schedulerAvailable(void)
 }
 
 //------------------------------------------------------------------------------
-//TODO Schedulerthread to be switched off if MC is idle. Will be woken up when
-//     driver is called again.
+/**
+ * Drops one from count unless it is 0 already, the scheduler may have
+ * reset it meanwhile.
+ */
+static void decrementIfPositive(
+    volatile int32_t *count
+)
+{
+    int32_t value;
+
+    do {
+        value = *count;
+    } while ((value > 0) && !__sync_bool_compare_and_swap(count, value, value - 1));
+}
+
+//------------------------------------------------------------------------------
+/**
+ * Hands the CPU to MobiCore while it is not idle. MobiCore runs until the
+ * next NWd interrupt on each yield. Once it used up its timeslice an N-SIQ
+ * forces its internal scheduling decision. The timeslice follows how long
+ * MobiCore keeps the CPU per yield: SCHEDULING_TIMESLICE_YIELDS yields of
+ * average residency, within SCHEDULING_TIMESLICE_MIN_US and _MAX_US.
+ * Yields that return almost immediately without an S-SIQ mean MobiCore is
+ * waiting for something, so the scheduler pauses for exponentially longer
+ * times then. While an MCP command or a trustlet invocation waits for its
+ * answer the scheduler thread runs boosted.
+ */
 void TrustZoneDevice::schedule(void)
 {
-    uint32_t timeslice = SCHEDULING_FREQ;
+    uint64_t sliceUs = 0;
+    uint32_t timesliceUs = SCHEDULING_TIMESLICE_MAX_US / 2;
+    uint32_t avgResidencyUs = timesliceUs / SCHEDULING_TIMESLICE_YIELDS;
+    uint32_t backoffUs = 0;
+    uint32_t lastSsiqCount = ssiqCount;
+    pid_t tid = gettid();
+    int normalNice = getpriority(PRIO_PROCESS, tid);
+    bool boostAvailable = true;
+    bool boosted = false;
+
     // loop forever
     for (;;) {
+        // Read before the IDLE check, see below
+        int32_t commands = pendingCommands;
+        __sync_synchronize();
+        bool idle = (MC_FLAG_SCHEDULE_IDLE == mcFlags->schedule);
+
+        // Boost while clients wait for MobiCore
+        bool boost = boostAvailable && !idle &&
+                     ((commands > 0) || (pendingInvocations > 0));
+        if (boost != boosted) {
+            if (setpriority(PRIO_PROCESS, tid, boost ? SCHEDULING_BOOST_NICE : normalNice) != 0) {
+                LOG_ERRNO("setpriority");
+                LOG_W("Scheduler priority boost disabled");
+                boostAvailable = false;
+            } else {
+                boosted = boost;
+                if (boosted) {
+                    statsMutex.lock();
+                    schedulerStats.boosts++;
+                    statsMutex.unlock();
+                }
+            }
+        }
+
         // Scheduling decision
-        if (MC_FLAG_SCHEDULE_IDLE == mcFlags->schedule) {
+        if (idle) {
             // MobiCore is IDLE
+            backoffUs = 0;
+
+            // Nothing can be pending then. Drop answers lost to a timed out
+            // MCP command, so that they don't boost the scheduler forever.
+            // A command sent since the count was read stays counted.
+            __sync_bool_compare_and_swap(&pendingCommands, commands, 0);
 
             // Prevent unnecessary consumption of CPU cycles -> Wait until S-SIQ received
             schedSync.wait();
+            lastSsiqCount = ssiqCount;
 
         } else {
             // MobiCore is not IDLE (anymore)
+            bool sliceExpired = (sliceUs >= timesliceUs);
+            uint64_t start = getMonotonicUs();
 
-            // Check timeslice
-            if (timeslice == 0) {
+            if (sliceExpired) {
                 // Slice expired, so force MC internal scheduling decision
-                timeslice = SCHEDULING_FREQ;
                 if (!nsiq()) {
                     break;
                 }
             } else {
                 // Slice not used up, simply hand over control to the MC
-                timeslice--;
                 if (!yield()) {
                     break;
                 }
             }
+
+            uint32_t residencyUs = (uint32_t)(getMonotonicUs() - start);
+            sliceUs = sliceExpired ? 0 : sliceUs + residencyUs;
+
+            uint32_t ssiqs = ssiqCount;
+            bool progress = (ssiqs != lastSsiqCount) ||
+                            (residencyUs >= SCHEDULING_MIN_RESIDENCY_US);
+            lastSsiqCount = ssiqs;
+
+            // Yields without progress say nothing about MobiCore's bursts
+            if (progress) {
+                avgResidencyUs = (avgResidencyUs * 7 + residencyUs) / 8;
+                uint64_t targetUs = (uint64_t)avgResidencyUs * SCHEDULING_TIMESLICE_YIELDS;
+                if (targetUs < SCHEDULING_TIMESLICE_MIN_US) {
+                    targetUs = SCHEDULING_TIMESLICE_MIN_US;
+                } else if (targetUs > SCHEDULING_TIMESLICE_MAX_US) {
+                    targetUs = SCHEDULING_TIMESLICE_MAX_US;
+                }
+                timesliceUs = (uint32_t)targetUs;
+            }
+
+            statsMutex.lock();
+            if (sliceExpired) {
+                schedulerStats.nsiqs++;
+            } else {
+                schedulerStats.yields++;
+            }
+            schedulerStats.secureTimeUs += residencyUs;
+            schedulerStats.timesliceUs = timesliceUs;
+            if (!progress) {
+                schedulerStats.backoffs++;
+            }
+            statsMutex.unlock();
+
+            if (progress) {
+                backoffUs = 0;
+            } else {
+                backoffUs = (backoffUs == 0) ? SCHEDULING_BACKOFF_MIN_US : backoffUs * 2;
+                if (backoffUs > SCHEDULING_BACKOFF_MAX_US) {
+                    backoffUs = SCHEDULING_BACKOFF_MAX_US;
+                }
+                usleep(backoffUs);
+            }
         }
     } //for (;;)
 }
+
+//------------------------------------------------------------------------------
+void TrustZoneDevice::getSchedulerStats(schedulerStats_t *stats)
+{
+    statsMutex.lock();
+    *stats = schedulerStats;
+    statsMutex.unlock();
+}
+
 //------------------------------------------------------------------------------
 void TrustZoneDevice::handleIrq(
     void
@@ -587,29 +712,54 @@ void TrustZoneDevice::handleIrq(
             break;
         }
         LOG_V("S-SIQ received");
+        ssiqCount++;
 
-        // Save all the
+        // Drain the queue in batches
         for (;;) {
-            notification_t *notification = nq->getNotification();
-            if (NULL == notification) {
+            notification_t notifications[NQ_NUM_ELEMS];
+            TrustletSession *sessions[NQ_NUM_ELEMS];
+            uint32_t count = nq->getNotifications(notifications, NQ_NUM_ELEMS);
+            if (count == 0) {
                 break;
             }
 
-            // check if the notification belongs to the MCP session
-            if (notification->sessionId == SID_MCP) {
-                LOG_I(" Found MCP notification, payload=%d",
-                      notification->payload);
+            for (uint32_t i = 0; i < count; i++) {
+                notification_t *notification = &notifications[i];
+                sessions[i] = NULL;
+
+                // check if the notification belongs to the MCP session
+                if (notification->sessionId == SID_MCP) {
+                    LOG_I(" Found MCP notification, payload=%d",
+                          notification->payload);
+
+                    decrementIfPositive(&pendingCommands);
+
+                    // Signal main thread of the driver to continue after MCP
+                    // command has been processed by the MC
+                    signalMcpNotification();
+                    continue;
+                }
 
-                // Signal main thread of the driver to continue after MCP
-                // command has been processed by the MC
-                signalMcpNotification();
-            } else {
                 LOG_I(" Found notification for session %d, payload=%d",
                       notification->sessionId, notification->payload);
 
-                // Get the NQ connection for the session ID
-                Connection *connection = getSessionConnection(notification->sessionId, notification);
-                if (connection == NULL) {
+                // Sessions often notify several times per burst, reuse the
+                // session found for an earlier notification
+                for (uint32_t j = 0; j < i; j++) {
+                    if ((sessions[j] != NULL) &&
+                            (notifications[j].sessionId == notification->sessionId)) {
+                        sessions[i] = sessions[j];
+                        break;
+                    }
+                }
+                if (sessions[i] != NULL) {
+                    continue;
+                }
+
+                // Get the session with its NQ connection for the session ID,
+                // it stays valid until put even if it gets closed meanwhile
+                sessions[i] = getNotificationSession(notification->sessionId, notification);
+                if (sessions[i] == NULL) {
                     /* Couldn't find the session for this notifications
                      * In practice this only means one thing: there is
                      * a race condition between RTM and the Daemon and
@@ -618,14 +768,32 @@ void TrustZoneDevice::handleIrq(
                      */
                     LOG_W("Notification for unknown session ID");
                     queueUnknownNotification(*notification);
-                } else {
-                    LOG_I(" Forward notification to McClient.");
-                    // Forward session ID and additional payload of
-                    // notification to the TLC/Application layer
-                    connection->writeData((void *)notification,
-                                          sizeof(notification_t));
                 }
             }
+
+            // Forward session ID and additional payload of the
+            // notifications to the TLC/Application layer, with a single
+            // write per session
+            for (uint32_t i = 0; i < count; i++) {
+                TrustletSession *session = sessions[i];
+                if (session == NULL) {
+                    continue;
+                }
+
+                notification_t pending[NQ_NUM_ELEMS];
+                uint32_t pendingCount = 0;
+                for (uint32_t j = i; j < count; j++) {
+                    if (sessions[j] == session) {
+                        pending[pendingCount++] = notifications[j];
+                        sessions[j] = NULL;
+                    }
+                }
+
+                LOG_I(" Forward %d notification(s) to McClient.", pendingCount);
+                session->notificationConnection->writeData((void *)pending,
+                        pendingCount * sizeof(notification_t));
+                putTrustletSession(session);
+            }
         }
 
         // Wake up scheduler
@@ -48,7 +48,13 @@
 #include "MobiCoreDevice.h"
 
 
-#define SCHEDULING_FREQ     5   /**< N-SIQ every n-th time */
+#define SCHEDULING_TIMESLICE_YIELDS 5       /**< Yields of average MobiCore residency per timeslice */
+#define SCHEDULING_TIMESLICE_MIN_US 2000    /**< Shortest MobiCore time between N-SIQs */
+#define SCHEDULING_TIMESLICE_MAX_US 20000   /**< Longest MobiCore time between N-SIQs */
+#define SCHEDULING_MIN_RESIDENCY_US 50      /**< Shorter yields without S-SIQ made no progress */
+#define SCHEDULING_BACKOFF_MIN_US   500     /**< First pause after a yield without progress */
+#define SCHEDULING_BACKOFF_MAX_US   2000    /**< Longest pause between yields */
+#define SCHEDULING_BOOST_NICE       -10     /**< Scheduler priority while clients wait */
 
 class TrustZoneDevice : public MobiCoreDevice
 {
@@ -59,6 +65,10 @@ protected:
     CMcKMod_ptr  pMcKMod; /**< kernel module */
     CWsm_ptr     pWsmMcp; /**< WSM use for MCP */
     CWsm_ptr     mobicoreInDDR;  /**< WSM used for Mobicore binary */
+    CMutex       statsMutex; /**< Protects schedulerStats */
+    schedulerStats_t schedulerStats;
+    volatile uint32_t ssiqCount; /**< S-SIQs received by the IRQ handler */
+    volatile int32_t pendingCommands; /**< MCP commands sent and not yet answered, reset when MobiCore is idle */
 
     /** Access functions to the MC Linux kernel module
      */
@@ -135,6 +145,8 @@ public:
 
     void schedule(void);
 
+    void getSchedulerStats(schedulerStats_t *stats);
+
     void handleIrq(void);
 };
 
@@ -41,6 +41,8 @@ TrustletSession::TrustletSession(Connection *deviceConnection, uint32_t sessionI
 {
     this->deviceConnection = deviceConnection;
     this->notificationConnection = NULL;
+    this->references = 1;
+    this->invocationPending = 0;
     this->sessionId = sessionId;
     sessionMagic = rand();
 }
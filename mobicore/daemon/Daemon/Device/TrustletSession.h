@@ -49,6 +49,8 @@ public:
     uint32_t sessionMagic; // Random data
     Connection *deviceConnection;
     Connection *notificationConnection;
+    uint32_t references; /**< Session list and lookups holding it, under MobiCoreDevice::sessionsMutex */
+    volatile int32_t invocationPending; /**< Notified by its client and not answered yet, see MobiCoreDevice::invocationSent() */
 
     TrustletSession(Connection *deviceConnection, uint32_t sessionId);
 
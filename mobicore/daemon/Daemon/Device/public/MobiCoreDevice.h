@@ -47,6 +47,7 @@
 #include "MobiCoreDriverCmd.h"
 
 #include "Connection.h"
+#include "CMutex.h"
 #include "CWsm.h"
 
 #include "ExcDevice.h"
@@ -54,6 +55,7 @@
 #include "DeviceIrqHandler.h"
 #include "NotificationQueue.h"
 #include "TrustletSession.h"
+#include "McpLatency.h"
 #include "mcVersionInfo.h"
 
 
@@ -66,6 +68,18 @@ typedef struct {
     mclfHeader_ptr tlHeader; /**< Pointer to trustlet header. */
 } loadDataOpenSession_t, *loadDataOpenSession_ptr;
 
+/** Statistics of the scheduler thread. */
+typedef struct {
+    uint32_t yields;        /**< Yields to MobiCore. */
+    uint32_t nsiqs;         /**< N-SIQs forced at the end of a timeslice. */
+    uint32_t backoffs;      /**< Yields without progress that were followed by a pause. */
+    uint32_t boosts;        /**< Priority boosts for pending MCP commands and invocations. */
+    uint64_t secureTimeUs;  /**< Time spent in MobiCore by the scheduler. */
+    uint32_t timesliceUs;   /**< Current MobiCore time between N-SIQs. */
+} schedulerStats_t;
+
+#define MCP_TIMEOUT_MS          50000   /**< Time MobiCore has to answer an MCP command */
+#define MCP_STATUS_POLL_MS      1000    /**< Interval of MobiCore halt checks while waiting */
 /**
  * Factory method to return the platform specific MobiCore device.
  * Implemented in the platform specific *Device.cpp
@@ -101,6 +115,58 @@ protected:
      */
     std::queue<notification_t> notifications; /**<  Notifications queue for open session notification */
 
+    /* Commands that go through the single MCP buffer are serialized in the
+     * order they arrive. Everything else, notifications in particular, only
+     * takes sessionsMutex for the session lookup and runs concurrently.
+     */
+    pthread_mutex_t     mcpQueueMutex;
+    pthread_cond_t      mcpQueueCond;
+    uint32_t            mcpQueueNext; /**< Next ticket to hand out */
+    uint32_t            mcpQueueServing; /**< Ticket that owns the MCP buffer */
+    CMutex              sessionsMutex; /**< Protects trustletSessions */
+
+    uint32_t            mcpCommandId; /**< MCP command in flight, under the MCP lock */
+    uint64_t            mcpCommandStartUs; /**< Time it was sent */
+    mcpLatency_t        mcpLatency[MC_STATS_MCP_COMMANDS]; /**< Indexed by MCP command ID */
+    CMutex              mcpLatencyMutex; /**< Protects mcpLatency */
+
+    volatile int32_t    pendingInvocations; /**< Sessions notified by their client and not answered yet */
+
+    /** Marks a client notification of session as waiting for an answer. */
+    void invocationSent(TrustletSession *session);
+
+    /** Any notification from session answers its pending invocation. */
+    void invocationAnswered(TrustletSession *session);
+
+    /** Current time of the monotonic clock in microseconds. */
+    static uint64_t getMonotonicUs(void);
+
+    /** Notifies MobiCore about the command in the MCP buffer. */
+    void sendMcpCommand(void);
+
+    /** Accounts the command sent last, with its latency unless it timed out. */
+    void recordMcpLatency(bool answered);
+
+    /** Wait for our turn at the MCP buffer. */
+    void lockMcp(void);
+
+    /** Hand the MCP buffer to the next command in line. */
+    void unlockMcp(void);
+
+    /** Holds the MCP buffer for the lifetime of the object. */
+    class McpLock
+    {
+    public:
+        McpLock(MobiCoreDevice *device) : device(device) {
+            device->lockMcp();
+        }
+        ~McpLock() {
+            device->unlockMcp();
+        }
+    private:
+        MobiCoreDevice *device;
+    };
+
     MobiCoreDevice();
 
     void signalMcpNotification(void);
@@ -117,12 +183,25 @@ private:
 public:
     virtual ~MobiCoreDevice();
 
+    /**
+     * Looks up a session without taking a reference. Only the connection
+     * owning the session may close it, so the result stays valid for the
+     * command of that connection and must not be used anywhere else.
+     */
     TrustletSession *getTrustletSession(uint32_t sessionId);
 
     void cleanSessionBuffers(TrustletSession *session);
     void removeTrustletSession(uint32_t sessionId);
 
-    Connection *getSessionConnection(uint32_t sessionId, notification_t *notification);
+    /** Drops a reference, the last one deletes the session. */
+    void putTrustletSession(TrustletSession *session);
+
+    /**
+     * Returns the session with a reference, for writing to its notification
+     * connection, or queues the notification if that is not connected yet.
+     * Returns NULL if the notification was not forwarded.
+     */
+    TrustletSession *getNotificationSession(uint32_t sessionId, notification_t *notification);
 
     bool open(Connection *connection);
 
@@ -135,6 +214,7 @@ public:
                            uint32_t                        tciOffset,
                            mcDrvRspOpenSessionPayload_ptr  pRspOpenSessionPayload);
 
+    /** Returns the session with a reference, see putTrustletSession(). */
     TrustletSession *registerTrustletConnection(Connection *connection,
             MC_DRV_CMD_NQ_CONNECT_struct  *cmdNqConnect);
 
@@ -159,6 +239,9 @@ public:
 
     mcResult_t getMobiCoreVersion(mcDrvRspGetMobiCoreVersionPayload_ptr pRspGetMobiCoreVersionPayload);
 
+    /** Latency statistics of MCP commands, indexed by MCP command ID. */
+    void getMcpLatencyStats(mcMcpLatencyStats_t stats[MC_STATS_MCP_COMMANDS]);
+
     bool getMcFault() {
         return mcFault;
     }
@@ -173,6 +256,8 @@ public:
 
     virtual void schedule(void) = 0;
 
+    virtual void getSchedulerStats(schedulerStats_t *stats) = 0;
+
     virtual void handleIrq(void) = 0;
 
     //virtual bool freeWsm(CWsm_ptr pWsm) = 0;
@@ -34,8 +34,10 @@
 
 #include <cstdlib>
 #include <signal.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "MobiCoreDriverApi.h"
 #include "MobiCoreDriverCmd.h"
@@ -294,7 +296,7 @@ bool MobiCoreDriverDaemon::loadDeviceDriver(
         pWsm = NULL;
 
         // Free memory occupied by Trustlet data
-        free(regObj);
+        mcRegistryFreeServiceBlob(regObj);
         regObj = NULL;
 
         if (mcRet != MC_MCP_RET_OK) {
@@ -314,7 +316,7 @@ bool MobiCoreDriverDaemon::loadDeviceDriver(
             }
         }
         // No matter if we free NULL objects
-        free(regObj);
+        mcRegistryFreeServiceBlob(regObj);
 
         if (conn != NULL) {
             delete conn;
@@ -428,14 +430,16 @@ void MobiCoreDriverDaemon::processOpenSession(Connection *connection)
     MobiCoreDevice  *device = (MobiCoreDevice *) (connection->connectionData);
     CHECK_DEVICE(device, connection);
 
-    // Get service blob from registry
+    // Get service blob from registry, not while a registry write replaces it
+    registryMutex.lock();
     regObject_t *regObj = mcRegistryGetServiceBlob(&cmdOpenSession.uuid);
+    registryMutex.unlock();
     if (NULL == regObj) {
         writeResult(connection, MC_DRV_ERR_TRUSTLET_NOT_FOUND);
         return;
     }
     if (regObj->len == 0) {
-        free(regObj);
+        mcRegistryFreeServiceBlob(regObj);
         writeResult(connection, MC_DRV_ERR_TRUSTLET_NOT_FOUND);
         return;
     }
@@ -474,7 +478,7 @@ void MobiCoreDriverDaemon::processOpenSession(Connection *connection)
     }
 
     // Free memory occupied by Trustlet data
-    free(regObj);
+    mcRegistryFreeServiceBlob(regObj);
 
     if (ret != MC_DRV_OK) {
         LOG_E("Service could not be loaded.");
@@ -513,8 +517,10 @@ void MobiCoreDriverDaemon::processOpenTrustlet(Connection *connection)
         return;
     }
 
-    // Get service blob from registry
+    // Get service blob from registry, which appends the SP container
+    registryMutex.lock();
     regObject_t *regObj = mcRegistryMemGetServiceBlob(cmdOpenTrustlet.spid, (uint8_t*)payload, len);
+    registryMutex.unlock();
 
     // Free the payload object no matter what
     free(payload);
@@ -524,7 +530,7 @@ void MobiCoreDriverDaemon::processOpenTrustlet(Connection *connection)
     }
 
     if (regObj->len == 0) {
-        free(regObj);
+        mcRegistryFreeServiceBlob(regObj);
         writeResult(connection, MC_DRV_ERR_TRUSTLET_NOT_FOUND);
         return;
     }
@@ -536,20 +542,158 @@ void MobiCoreDriverDaemon::processOpenTrustlet(Connection *connection)
         writeResult(connection, MC_DRV_ERR_DAEMON_KMOD_ERROR);
         return;
     }
+
+    openTrustletSession(connection, device, pWsm, regObj->value, regObj->len,
+                        regObj->tlStartOffset, cmdOpenTrustlet.handle,
+                        cmdOpenTrustlet.len, cmdOpenTrustlet.tci);
+
+    // Free memory occupied by Trustlet data
+    mcRegistryFreeServiceBlob(regObj);
+}
+
+
+//------------------------------------------------------------------------------
+void MobiCoreDriverDaemon::processOpenTrustletFd(Connection *connection)
+{
+    MC_DRV_CMD_OPEN_TRUSTLET_FD_struct cmdOpenTrustlet;
+    RECV_PAYLOAD_FROM_CLIENT(connection, &cmdOpenTrustlet);
+
+    // The descriptor follows the command, take it off the socket first
+    int fd;
+    if (!connection->readFd(&fd)) {
+        LOG_E("reading trustlet descriptor from Client failed");
+        writeResult(connection, MC_DRV_ERR_DAEMON_SOCKET);
+        return;
+    }
+
+    // Device required
+    MobiCoreDevice  *device = (MobiCoreDevice *) (connection->connectionData);
+    if (device == NULL) {
+        close(fd);
+    }
+    CHECK_DEVICE(device, connection);
+
+    // Read the trustlet binary into memory of our own. A mapping of the
+    // client's file could be truncated or rewritten under the registry
+    // checks and the Secure World.
+    uint32_t len = cmdOpenTrustlet.trustlet_len;
+    uint8_t *trustlet = NULL;
+    if (len < sizeof(mclfHeaderV2_t) || len > MAX_TL_SIZE) {
+        LOG_E("invalid trustlet length %u", len);
+    } else if ((trustlet = (uint8_t *)malloc(len)) == NULL) {
+        LOG_E("no memory for a %u byte trustlet", len);
+    } else {
+        uint32_t done = 0;
+        while (done < len) {
+            ssize_t ret = pread(fd, trustlet + done, len - done, done);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ret <= 0) {
+                LOG_E("trustlet file shorter than %u bytes", len);
+                free(trustlet);
+                trustlet = NULL;
+                break;
+            }
+            done += ret;
+        }
+    }
+    close(fd);
+    if (trustlet == NULL) {
+        writeResult(connection, MC_DRV_ERR_TRUSTLET_NOT_FOUND);
+        return;
+    }
+
+    mclfHeaderV2_t *pHeader = (mclfHeaderV2_t *)trustlet;
+    if (pHeader->intro.magic != MC_SERVICE_HEADER_MAGIC_BE) {
+        LOG_E("wrong trustlet header magic value: %d", pHeader->intro.magic);
+        free(trustlet);
+        writeResult(connection, MC_DRV_ERR_TRUSTLET_NOT_FOUND);
+        return;
+    }
+
+    regObject_t *regObj = NULL;
+    CWsm_ptr pWsm = NULL;
+
+    // Drivers and system trustlets are loaded as they are, so share the
+    // buffer itself with the Secure World.
+    if (pHeader->serviceType == SERVICE_TYPE_DRIVER ||
+            pHeader->serviceType == SERVICE_TYPE_SYSTEM_TRUSTLET) {
+        pWsm = device->registerWsmL2((addr_t)trustlet, len, 0);
+        if (pWsm == NULL) {
+            LOG_E("allocating WSM for Trustlet failed");
+            free(trustlet);
+            writeResult(connection, MC_DRV_ERR_DAEMON_KMOD_ERROR);
+            return;
+        }
+        LOG_I(" Sharing Service loaded at %p with Secure World", trustlet);
+        openTrustletSession(connection, device, pWsm, trustlet, len, 0,
+                            cmdOpenTrustlet.handle, cmdOpenTrustlet.len,
+                            cmdOpenTrustlet.tci);
+        free(trustlet);
+        return;
+    }
+
+    // Service provider trustlets need their containers appended, which
+    // takes a copy. The registry also validates the header and size.
+    registryMutex.lock();
+    regObj = mcRegistryMemGetServiceBlob(cmdOpenTrustlet.spid, trustlet, len);
+    registryMutex.unlock();
+    free(trustlet);
+    if (regObj == NULL) {
+        writeResult(connection, MC_DRV_ERR_TRUSTLET_NOT_FOUND);
+        return;
+    }
+    if (regObj->len == 0) {
+        mcRegistryFreeServiceBlob(regObj);
+        writeResult(connection, MC_DRV_ERR_TRUSTLET_NOT_FOUND);
+        return;
+    }
+    LOG_I(" Sharing Service loaded at %p with Secure World", (addr_t)(regObj->value));
+
+    pWsm = device->registerWsmL2((addr_t)(regObj->value), regObj->len, 0);
+    if (pWsm == NULL) {
+        LOG_E("allocating WSM for Trustlet failed");
+        mcRegistryFreeServiceBlob(regObj);
+        writeResult(connection, MC_DRV_ERR_DAEMON_KMOD_ERROR);
+        return;
+    }
+
+    openTrustletSession(connection, device, pWsm, regObj->value, regObj->len,
+                        regObj->tlStartOffset, cmdOpenTrustlet.handle,
+                        cmdOpenTrustlet.len, cmdOpenTrustlet.tci);
+
+    mcRegistryFreeServiceBlob(regObj);
+}
+
+
+//------------------------------------------------------------------------------
+void MobiCoreDriverDaemon::openTrustletSession(
+    Connection      *connection,
+    MobiCoreDevice  *device,
+    CWsm_ptr        pWsm,
+    uint8_t         *blob,
+    uint32_t        blobLen,
+    uint32_t        tlStartOffset,
+    uint32_t        handle,
+    uint32_t        len,
+    uint32_t        tci
+)
+{
     // Initialize information data of open session command
     loadDataOpenSession_t loadDataOpenSession;
     loadDataOpenSession.baseAddr = pWsm->physAddr;
-    loadDataOpenSession.offs = ((uint32_t) regObj->value) & 0xFFF;
-    loadDataOpenSession.len = regObj->len;
-    loadDataOpenSession.tlHeader = (mclfHeader_ptr) (regObj->value + regObj->tlStartOffset);
+    loadDataOpenSession.offs = ((uint32_t) blob) & 0xFFF;
+    loadDataOpenSession.len = blobLen;
+    loadDataOpenSession.tlHeader = (mclfHeader_ptr) (blob + tlStartOffset);
 
     mcDrvRspOpenSession_t rspOpenSession;
     mcResult_t ret = device->openSession(
                          connection,
                          &loadDataOpenSession,
-                         cmdOpenTrustlet.handle,
-                         cmdOpenTrustlet.len,
-                         cmdOpenTrustlet.tci,
+                         handle,
+                         len,
+                         tci,
                          &rspOpenSession.payload);
 
     // Unregister physical memory from kernel module.
@@ -562,9 +706,6 @@ void MobiCoreDriverDaemon::processOpenTrustlet(Connection *connection)
         return;
     }
 
-    // Free memory occupied by Trustlet data
-    free(regObj);
-
     if (ret != MC_DRV_OK) {
         LOG_E("Service could not be loaded.");
         writeResult(connection, ret);
@@ -638,6 +779,7 @@ void MobiCoreDriverDaemon::processNqConnect(Connection *connection)
 
     writeResult(connection, MC_DRV_OK);
     ts->processQueuedNotifications();
+    device->putTrustletSession(ts);
 }
 
 
@@ -790,6 +932,38 @@ void MobiCoreDriverDaemon::processGetMobiCoreVersion(
         sizeof(rspGetMobiCoreVersion));
 }
 
+//------------------------------------------------------------------------------
+void MobiCoreDriverDaemon::processGetStats(
+    Connection  *connection
+)
+{
+    // there is no payload to read
+
+    mcDrvRspGetStats_t rspGetStats;
+    memset(&rspGetStats, 0, sizeof(rspGetStats));
+
+    mobiCoreDevice->getMcpLatencyStats(rspGetStats.payload.mcpLatency);
+
+    schedulerStats_t schedulerStats;
+    mobiCoreDevice->getSchedulerStats(&schedulerStats);
+    rspGetStats.payload.schedYields = schedulerStats.yields;
+    rspGetStats.payload.schedNsiqs = schedulerStats.nsiqs;
+    rspGetStats.payload.schedBackoffs = schedulerStats.backoffs;
+    rspGetStats.payload.schedBoosts = schedulerStats.boosts;
+    rspGetStats.payload.schedSecureTimeMs = (uint32_t)(schedulerStats.secureTimeUs / 1000);
+    rspGetStats.payload.schedTimesliceUs = schedulerStats.timesliceUs;
+
+    regBlobCacheStats_t blobCacheStats;
+    mcRegistryGetBlobCacheStats(&blobCacheStats);
+    rspGetStats.payload.blobCacheHits = blobCacheStats.hits;
+    rspGetStats.payload.blobCacheMisses = blobCacheStats.misses;
+    rspGetStats.payload.blobCacheEntries = blobCacheStats.entries;
+    rspGetStats.payload.blobCacheSize = blobCacheStats.size;
+
+    rspGetStats.header.responseId = MC_DRV_OK;
+    connection->writeData(&rspGetStats, sizeof(rspGetStats));
+}
+
 //------------------------------------------------------------------------------
 void MobiCoreDriverDaemon::processRegistryReadData(uint32_t commandId, Connection  *connection)
 {
@@ -946,7 +1120,6 @@ bool MobiCoreDriverDaemon::handleConnection(
 )
 {
     bool ret = false;
-    static CMutex mutex;
 
     /* In case of RTM fault do not try to signal anything to MobiCore
      * just answer NO to all incoming connections! */
@@ -955,7 +1128,12 @@ bool MobiCoreDriverDaemon::handleConnection(
         return false;
     }
 
-    mutex.lock();
+    /* Commands of different connections run concurrently. The device
+     * serializes the ones that need the MCP buffer (open/close session,
+     * map/unmap, version) in arrival order, notifications only look up
+     * their session, and registry commands are serialized here since they
+     * touch the same files.
+     */
     LOG_I("handleConnection()==== %p", connection);
     do {
         // Read header
@@ -996,6 +1174,10 @@ bool MobiCoreDriverDaemon::handleConnection(
             processOpenTrustlet(connection);
             break;
             //-----------------------------------------
+        case MC_DRV_CMD_OPEN_TRUSTLET_FD:
+            processOpenTrustletFd(connection);
+            break;
+            //-----------------------------------------
         case MC_DRV_CMD_CLOSE_SESSION:
             processCloseSession(connection);
             break;
@@ -1024,6 +1206,10 @@ bool MobiCoreDriverDaemon::handleConnection(
             processGetMobiCoreVersion(connection);
             break;
             //-----------------------------------------
+        case MC_DRV_CMD_GET_STATS:
+            processGetStats(connection);
+            break;
+            //-----------------------------------------
         /* Registry functionality */
         // Write Registry Data
         case MC_DRV_REG_STORE_AUTH_TOKEN:
@@ -1031,7 +1217,10 @@ bool MobiCoreDriverDaemon::handleConnection(
         case MC_DRV_REG_WRITE_SP_CONT:
         case MC_DRV_REG_WRITE_TL_CONT:
         case MC_DRV_REG_WRITE_SO_DATA:
+            registryMutex.lock();
             processRegistryWriteData(mcDrvCommandHeader.commandId, connection);
+            mcRegistryInvalidateBlobCache();
+            registryMutex.unlock();
             break;
             //-----------------------------------------
         // Read Registry Data
@@ -1039,7 +1228,9 @@ bool MobiCoreDriverDaemon::handleConnection(
         case MC_DRV_REG_READ_ROOT_CONT:
         case MC_DRV_REG_READ_SP_CONT:
         case MC_DRV_REG_READ_TL_CONT:
+            registryMutex.lock();
             processRegistryReadData(mcDrvCommandHeader.commandId, connection);
+            registryMutex.unlock();
             break;
             //-----------------------------------------
         // Delete registry data
@@ -1047,7 +1238,10 @@ bool MobiCoreDriverDaemon::handleConnection(
         case MC_DRV_REG_DELETE_ROOT_CONT:
         case MC_DRV_REG_DELETE_SP_CONT:
         case MC_DRV_REG_DELETE_TL_CONT:
+            registryMutex.lock();
             processRegistryDeleteData(mcDrvCommandHeader.commandId, connection);
+            mcRegistryInvalidateBlobCache();
+            registryMutex.unlock();
             break;
             //-----------------------------------------
         default:
@@ -1058,7 +1252,6 @@ bool MobiCoreDriverDaemon::handleConnection(
             break;
         }
     } while (0);
-    mutex.unlock();
     LOG_I("handleConnection()<-------");
 
     return ret;
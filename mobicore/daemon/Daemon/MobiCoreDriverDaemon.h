@@ -113,6 +113,8 @@ private:
     driverResourcesList_t driverResources;
     /**< List of servers processing connections */
     Server *servers[MAX_SERVERS];
+    /**< Serializes the registry commands */
+    CMutex registryMutex;
 
     bool checkPermission(Connection *connection);
 
@@ -160,6 +162,38 @@ private:
      */
     void processOpenTrustlet(Connection *connection);
 
+    /**
+     * Open Trustlet command with the binary passed as a file descriptor
+     *
+     * @param connection Connection object
+     */
+    void processOpenTrustletFd(Connection *connection);
+
+    /**
+     * Open a session to a trustlet blob registered as pWsm and send the
+     * response. pWsm is unregistered before returning.
+     *
+     * @param connection Connection object
+     * @param device MobiCore device of the connection
+     * @param pWsm WSM of the blob
+     * @param blob Start of the blob
+     * @param blobLen Length of the blob
+     * @param tlStartOffset Offset of the MCLF header in the blob
+     * @param handle Handle of the TCI buffer
+     * @param len Length of the TCI
+     * @param tci Offset of the TCI in its first page
+     */
+    void openTrustletSession(
+        Connection      *connection,
+        MobiCoreDevice  *device,
+        CWsm_ptr        pWsm,
+        uint8_t         *blob,
+        uint32_t        blobLen,
+        uint32_t        tlStartOffset,
+        uint32_t        handle,
+        uint32_t        len,
+        uint32_t        tci);
+
     /**
      * NQ Connect command
      *
@@ -216,6 +250,13 @@ private:
      */
     void processGetMobiCoreVersion(Connection *connection);
 
+    /**
+     * Get debug statistics command
+     *
+     * @param connection Connection object
+     */
+    void processGetStats(Connection *connection);
+
     /**
      * Generic Registry read command
      *
@@ -36,20 +36,57 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
 
 //#define LOG_VERBOSE
 #include "log.h"
 
+//------------------------------------------------------------------------------
+/**
+ * Worker thread of the server, see Server::processConnections().
+ */
+class ServerWorker: public CThread
+{
+public:
+    ServerWorker(Server *server) : server(server) {}
+
+    virtual void run(void) {
+        server->processConnections();
+    }
+
+private:
+    Server *server;
+};
+
+
 //------------------------------------------------------------------------------
 Server::Server(
     ConnectionHandler *connectionHandler,
     const char *localAddr
-) : socketAddr(localAddr)
+) : serverSock(-1), socketAddr(localAddr), epollFd(-1)
 {
     this->connectionHandler = connectionHandler;
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ * Check whether a socket has unread data or a pending hangup, without
+ * blocking. Used to tell a real event from a stale one and to drain an
+ * edge-triggered socket command by command.
+ */
+static bool hasPendingInput(
+    int sock
+)
+{
+    char c;
+    ssize_t ret = recv(sock, &c, sizeof(c), MSG_PEEK | MSG_DONTWAIT);
+
+    return !(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+
 //------------------------------------------------------------------------------
 void Server::run(
     void
@@ -83,109 +120,81 @@ void Server::run(
             break;
         }
 
+        // The server socket is drained with accept() until EAGAIN
+        int flags = fcntl(serverSock, F_GETFL, 0);
+        if (flags < 0 || fcntl(serverSock, F_SETFL, flags | O_NONBLOCK) < 0) {
+            LOG_ERRNO("fcntl");
+            break;
+        }
+
+        epollFd = epoll_create(SERVER_MAX_EVENTS);
+        if (epollFd < 0) {
+            LOG_ERRNO("epoll_create");
+            break;
+        }
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = serverSock;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, serverSock, &event) < 0) {
+            LOG_ERRNO("epoll_ctl");
+            break;
+        }
+
+        for (int i = 0; i < SERVER_WORKERS; i++) {
+            CThread *worker = new ServerWorker(this);
+            worker->start();
+            workers.push_back(worker);
+        }
+
         LOG_I("\n********* successfully initialized Daemon *********\n");
 
         for (;;) {
-            fd_set fdReadSockets;
-
-            // Clear FD for select()
-            FD_ZERO(&fdReadSockets);
-
-            // Select server socket descriptor
-            FD_SET(serverSock, &fdReadSockets);
-            int maxSocketDescriptor = serverSock;
-
-            // Select socket descriptor of all connections
-            for (connectionIterator_t iterator = peerConnections.begin();
-                    iterator != peerConnections.end();
-                    ++iterator) {
-                Connection *connection = (*iterator);
-                int peerSocket = connection->socketDescriptor;
-                FD_SET(peerSocket, &fdReadSockets);
-                if (peerSocket > maxSocketDescriptor) {
-                    maxSocketDescriptor = peerSocket;
-                }
-            }
+            struct epoll_event events[SERVER_MAX_EVENTS];
 
-            // Wait for activities, select() returns the number of sockets
+            // Wait for activities, epoll_wait() returns the number of sockets
             // which require processing
             LOG_V(" Server: waiting on sockets");
-            int numSockets = select(
-                                 maxSocketDescriptor + 1,
-                                 &fdReadSockets,
-                                 NULL, NULL, NULL);
+            int numSockets = epoll_wait(epollFd, events, SERVER_MAX_EVENTS, -1);
 
-            // Check if select failed
+            // Check if epoll_wait failed
             if (numSockets < 0) {
-                LOG_ERRNO("select");
+                if (errno == EINTR) {
+                    continue;
+                }
+                LOG_ERRNO("epoll_wait");
                 break;
             }
 
-            // actually, this should not happen.
-            if (0 == numSockets) {
-                LOG_W(" Server: select() returned 0, spurious event?.");
-                continue;
-            }
-
             LOG_V(" Server: events on %d socket(s).", numSockets);
 
-            // Check if a new client connected to the server socket
-            if (FD_ISSET(serverSock, &fdReadSockets)) {
-                do {
-                    LOG_V(" Server: new connection attempt.");
-                    numSockets--;
-
-                    struct sockaddr_un clientAddr;
-                    socklen_t clientSockLen = sizeof(clientAddr);
-                    int clientSock = accept(
-                                         serverSock,
-                                         (struct sockaddr *) &clientAddr,
-                                         &clientSockLen);
-
-                    if (clientSock <= 0) {
-                        LOG_ERRNO("accept");
-                        break;
-                    }
-
-                    Connection *connection = new Connection(clientSock, &clientAddr);
-                    peerConnections.push_back(connection);
-                    LOG_I(" Server: new socket connection established and start listening.");
-                } while (false);
-
-                // we can ignore any errors from accepting a new connection.
-                // If this fail, the client has to deal with it, we are done
-                // and nothing has changed.
-            }
+            for (int i = 0; i < numSockets; i++) {
+                int sock = events[i].data.fd;
 
-            // Handle traffic on existing client connections
-            connectionIterator_t iterator = peerConnections.begin();
-            while ( (iterator != peerConnections.end())
-                    && (numSockets > 0) ) {
-                Connection *connection = (*iterator);
-                int peerSocket = connection->socketDescriptor;
-
-                if (!FD_ISSET(peerSocket, &fdReadSockets)) {
-                    ++iterator;
+                // Check if a new client connected to the server socket
+                if (sock == serverSock) {
+                    acceptConnections();
                     continue;
                 }
 
-                numSockets--;
-
-                // the connection will be terminated if command processing
-                // fails
-                if (!connectionHandler->handleConnection(connection)) {
-                    LOG_I(" Server: dropping connection.");
-
-                    //Inform the driver
-                    connectionHandler->dropConnection(connection);
-
-                    // Remove connection from list
-                    delete connection;
-                    iterator = peerConnections.erase(iterator);
+                // The connection may have been dropped or detached while
+                // handling an earlier event of this batch
+                connectionsMutex.lock();
+                Connection *connection = NULL;
+                if (sock >= 0 && (size_t)sock < peerConnections.size()) {
+                    connection = peerConnections[sock];
+                }
+                connectionsMutex.unlock();
+                if (connection == NULL) {
                     continue;
                 }
 
-                ++iterator;
+                // The socket stays disarmed until a worker has drained it
+                readyMutex.lock();
+                readyConnections.push(connection);
+                readyMutex.unlock();
+                readySemaphore.signal();
             }
         }
 
@@ -196,22 +205,173 @@ void Server::run(
 
 
 //------------------------------------------------------------------------------
-void Server::detachConnection(
+void Server::acceptConnections(
+    void
+)
+{
+    for (;;) {
+        LOG_V(" Server: new connection attempt.");
+
+        struct sockaddr_un clientAddr;
+        socklen_t clientSockLen = sizeof(clientAddr);
+        int clientSock = accept(
+                             serverSock,
+                             (struct sockaddr *) &clientAddr,
+                             &clientSockLen);
+
+        // we can ignore any errors from accepting a new connection.
+        // If this fail, the client has to deal with it, we are done
+        // and nothing has changed.
+        if (clientSock < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERRNO("accept");
+            }
+            break;
+        }
+
+        connectionsMutex.lock();
+        if ((size_t)clientSock >= peerConnections.size()) {
+            peerConnections.resize(clientSock + 1, NULL);
+        }
+        Connection *newConnection = new Connection(clientSock, &clientAddr);
+        newConnection->messageTimeout = SERVER_MESSAGE_TIMEOUT;
+        peerConnections[clientSock] = newConnection;
+        connectionsMutex.unlock();
+
+        // One shot: a socket is handed to one worker at a time
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+        event.data.fd = clientSock;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSock, &event) < 0) {
+            LOG_ERRNO("epoll_ctl");
+            connectionsMutex.lock();
+            Connection *connection = peerConnections[clientSock];
+            peerConnections[clientSock] = NULL;
+            connectionsMutex.unlock();
+            delete connection;
+            continue;
+        }
+
+        LOG_I(" Server: new socket connection established and start listening.");
+    }
+}
+
+
+//------------------------------------------------------------------------------
+void Server::serviceConnection(
     Connection *connection
 )
 {
-    LOG_V(" Stopping to listen on notification socket.");
+    int sock = connection->socketDescriptor;
+
+    // The socket is edge triggered, so process every command it holds.
+    // Stop when the handler detached the connection.
+    while (hasPendingInput(sock)) {
+        // the connection will be terminated if command processing
+        // fails
+        if (!connectionHandler->handleConnection(connection)) {
+            LOG_I(" Server: dropping connection.");
+
+            //Inform the driver
+            connectionHandler->dropConnection(connection);
+
+            // Remove connection from the table
+            removeConnection(connection);
+            delete connection;
+            return;
+        }
+
+        // A detached connection belongs to its new owner and may already
+        // be gone, so only compare the pointer
+        if (!isWatched(sock, connection)) {
+            return;
+        }
+    }
+
+    // Re-arm the socket, data that arrived since the last check is
+    // reported right away
+    connectionsMutex.lock();
+    if ((size_t)sock < peerConnections.size() && peerConnections[sock] == connection) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+        event.data.fd = sock;
+        if (epoll_ctl(epollFd, EPOLL_CTL_MOD, sock, &event) < 0) {
+            LOG_ERRNO("epoll_ctl");
+        }
+    }
+    connectionsMutex.unlock();
+}
+
+
+//------------------------------------------------------------------------------
+void Server::processConnections(
+    void
+)
+{
+    for (;;) {
+        readySemaphore.wait();
 
-    for (connectionIterator_t iterator = peerConnections.begin();
-            iterator != peerConnections.end();
-            ++iterator) {
-        Connection *tmpConnection = (*iterator);
-        if (tmpConnection == connection) {
-            peerConnections.erase(iterator);
-            LOG_I(" Stopped listening on notification socket.");
+        readyMutex.lock();
+        Connection *connection = readyConnections.front();
+        readyConnections.pop();
+        readyMutex.unlock();
+
+        if (connection == NULL) {
             break;
         }
+
+        serviceConnection(connection);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+bool Server::isWatched(
+    int sock,
+    Connection *connection
+)
+{
+    bool watched;
+
+    connectionsMutex.lock();
+    watched = sock >= 0 && (size_t)sock < peerConnections.size() &&
+              peerConnections[sock] == connection;
+    connectionsMutex.unlock();
+
+    return watched;
+}
+
+
+//------------------------------------------------------------------------------
+void Server::removeConnection(
+    Connection *connection
+)
+{
+    int sock = connection->socketDescriptor;
+
+    connectionsMutex.lock();
+    if (sock >= 0 && (size_t)sock < peerConnections.size() &&
+            peerConnections[sock] == connection) {
+        if (epoll_ctl(epollFd, EPOLL_CTL_DEL, sock, NULL) < 0) {
+            LOG_ERRNO("epoll_ctl");
+        }
+        peerConnections[sock] = NULL;
     }
+    connectionsMutex.unlock();
+}
+
+
+//------------------------------------------------------------------------------
+void Server::detachConnection(
+    Connection *connection
+)
+{
+    LOG_V(" Stopping to listen on notification socket.");
+
+    removeConnection(connection);
+    LOG_I(" Stopped listening on notification socket.");
 }
 
 
@@ -220,16 +380,30 @@ Server::~Server(
     void
 )
 {
+    // Stop the workers
+    for (size_t i = 0; i < workers.size(); i++) {
+        readyMutex.lock();
+        readyConnections.push(NULL);
+        readyMutex.unlock();
+        readySemaphore.signal();
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i]->join();
+        delete workers[i];
+    }
+    workers.clear();
+
     // Shut down the server socket
     close(serverSock);
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
 
     // Destroy all client connections
-    connectionIterator_t iterator = peerConnections.begin();
-    while (iterator != peerConnections.end()) {
-        Connection *tmpConnection = (*iterator);
-        delete tmpConnection;
-        iterator = peerConnections.erase(iterator);
+    for (size_t i = 0; i < peerConnections.size(); i++) {
+        delete peerConnections[i];
     }
+    peerConnections.clear();
 }
 
 /** @} */
@@ -6,7 +6,11 @@
  *
  * Handles incoming socket connections from clients using the MobiCore driver.
  *
- * Iterative socket server using UNIX domain stream protocol.
+ * Socket server using UNIX domain stream protocol. Sockets are watched with
+ * an edge-triggered epoll set and connections are looked up in a table
+ * indexed by socket descriptor. Ready connections are handed to a pool of
+ * worker threads, so a slow command of one client does not hold up the
+ * others; the commands of a single connection are still handled in order.
  *
  * <!-- Copyright Giesecke & Devrient GmbH 2009 - 2012 -->
  *
@@ -43,13 +47,26 @@
 #include <string>
 #include <cstdio>
 #include <vector>
+#include <queue>
 #include "CThread.h"
+#include "CMutex.h"
+#include "CSemaphore.h"
 #include "ConnectionHandler.h"
 
 /** Number of incoming connections that can be queued.
  * Additional clients will generate the error ECONNREFUSED. */
 #define LISTEN_QUEUE_LEN    (16)
 
+/** Maximum number of socket events handled per epoll_wait() call. */
+#define SERVER_MAX_EVENTS   (32)
+
+/** Number of threads processing client commands. */
+#define SERVER_WORKERS      (4)
+
+/** Longest wait in milliseconds for the rest of a command once its first
+ * bytes arrived. A client that stalls longer is dropped. */
+#define SERVER_MESSAGE_TIMEOUT  (1000)
+
 
 class Server: public CThread
 {
@@ -99,7 +116,60 @@ protected:
     ConnectionHandler   *connectionHandler; /**< Connection handler registered to the server */
 
 private:
-    connectionList_t    peerConnections; /**< Connections to devices */
+    friend class ServerWorker;
+
+    /**
+     * Accept all pending connections on the server socket.
+     */
+    void acceptConnections(
+        void
+    );
+
+    /**
+     * Process the commands pending on a client socket.
+     *
+     * @param connection The connection with socket activity.
+     */
+    void serviceConnection(
+        Connection *connection
+    );
+
+    /**
+     * Stop watching a connection and forget it.
+     *
+     * @param connection The connection to remove.
+     */
+    void removeConnection(
+        Connection *connection
+    );
+
+    /**
+     * Check whether a connection is still handled by the server. The
+     * connection is not dereferenced, it may have been freed.
+     *
+     * @param sock The socket the connection was watched on.
+     * @param connection The connection to look for.
+     */
+    bool isWatched(
+        int sock,
+        Connection *connection
+    );
+
+    /**
+     * Worker thread body, services queued connections until a NULL one is
+     * queued.
+     */
+    void processConnections(
+        void
+    );
+
+    int epollFd; /**< epoll set of the server and client sockets */
+    std::vector<Connection *> peerConnections; /**< Connections to devices, indexed by socket */
+    CMutex connectionsMutex; /**< Protects peerConnections */
+    std::vector<CThread *> workers; /**< Threads running processConnections() */
+    std::queue<Connection *> readyConnections; /**< Connections waiting for a worker */
+    CMutex readyMutex; /**< Protects readyConnections */
+    CSemaphore readySemaphore; /**< Counts readyConnections */
 
 };
 
@@ -35,6 +35,7 @@
 
 #include "mcUuid.h"
 #include "mcVersionInfo.h"
+#include "MobiCoreDriverApi.h"
 
 #define SOCK_PATH "#mcdaemon"
 
@@ -52,6 +53,8 @@ typedef enum {
     MC_DRV_CMD_GET_VERSION          = 10,
     MC_DRV_CMD_GET_MOBICORE_VERSION = 11,
     MC_DRV_CMD_OPEN_TRUSTLET        = 12,
+    MC_DRV_CMD_OPEN_TRUSTLET_FD     = 13,
+    MC_DRV_CMD_GET_STATS            = 14,
 
     // Registry Commands
 
@@ -149,6 +152,20 @@ typedef struct {
     mcDrvRspOpenTrustletPayload_t  payload;
 } mcDrvRspOpenTrustlet_t;
 
+//--------------------------------------------------------------
+// The trustlet binary is not sent inline: the command is followed by one
+// byte carrying a descriptor of the file or memfd that holds it (SCM_RIGHTS).
+// The response is the one of MC_DRV_CMD_OPEN_TRUSTLET.
+struct MC_DRV_CMD_OPEN_TRUSTLET_FD_struct {
+    uint32_t  commandId;
+    uint32_t  deviceId;
+    mcSpid_t  spid;
+    uint32_t  trustlet_len;
+    uint32_t  tci;
+    uint32_t  handle;
+    uint32_t  len;
+};
+
 //--------------------------------------------------------------
 struct MC_DRV_CMD_CLOSE_SESSION_struct {
     uint32_t  commandId;
@@ -239,6 +256,17 @@ typedef struct {
     mcDrvRspGetMobiCoreVersionPayload_t payload;
 } mcDrvRspGetMobiCoreVersion_t;
 
+//--------------------------------------------------------------
+// Debug statistics of the daemon, see mcGetDaemonStats()
+struct MC_DRV_CMD_GET_STATS_struct {
+    uint32_t  commandId;
+};
+
+typedef struct {
+    mcDrvResponseHeader_t       header;
+    mcDaemonStats_t             payload;
+} mcDrvRspGetStats_t;
+
 //--------------------------------------------------------------
 typedef union {
     mcDrvCommandHeader_t                header;
@@ -246,6 +274,7 @@ typedef union {
     MC_DRV_CMD_CLOSE_DEVICE_struct      mcDrvCmdCloseDevice;
     MC_DRV_CMD_OPEN_SESSION_struct      mcDrvCmdOpenSession;
     MC_DRV_CMD_OPEN_TRUSTLET_struct     mcDrvCmdOpenTrustlet;
+    MC_DRV_CMD_OPEN_TRUSTLET_FD_struct  mcDrvCmdOpenTrustletFd;
     MC_DRV_CMD_CLOSE_SESSION_struct     mcDrvCmdCloseSession;
     MC_DRV_CMD_NQ_CONNECT_struct        mcDrvCmdNqConnect;
     MC_DRV_CMD_NOTIFY_struct            mcDrvCmdNotify;
@@ -253,6 +282,7 @@ typedef union {
     MC_DRV_CMD_UNMAP_BULK_BUF_struct    mcDrvCmdUnmapBulkMem;
     MC_DRV_CMD_GET_VERSION_struct       mcDrvCmdGetVersion;
     MC_DRV_CMD_GET_MOBICORE_VERSION_struct  mcDrvCmdGetMobiCoreVersion;
+    MC_DRV_CMD_GET_STATS_struct         mcDrvCmdGetStats;
 } mcDrvCommand_t, *mcDrvCommand_ptr;
 
 typedef union {
@@ -266,6 +296,7 @@ typedef union {
     mcDrvRspUnmapBulkMem_t       mcDrvRspUnmapBulkMem;
     mcDrvRspGetVersion_t         mcDrvRspGetVersion;
     mcDrvRspGetMobiCoreVersion_t mcDrvRspGetMobiCoreVersion;
+    mcDrvRspGetStats_t           mcDrvRspGetStats;
 } mcDrvResponse_t, *mcDrvResponse_ptr;
 
 #endif /* MCDAEMON_H_ */
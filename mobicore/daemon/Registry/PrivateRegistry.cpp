@@ -45,6 +45,8 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <list>
 
 #include "mcLoadFormat.h"
 #include "mcSpid.h"
@@ -55,10 +57,12 @@
 
 #include "log.h"
 
-/** Maximum size of a trustlet in bytes. */
-#define MAX_TL_SIZE       (1 * 1024 * 1024)
 /** Maximum size of a shared object container in bytes. */
 #define MAX_SO_CONT_SIZE  (512)
+/** Registry object values start on a page of this size. */
+#define REG_PAGE_SIZE     (4096)
+/** Maximum memory held by the service blob cache in bytes. */
+#define MAX_BLOB_CACHE_SIZE (4 * 1024 * 1024)
 
 // Asserts expression at compile-time (to be used within a function body).
 #define ASSERT_STATIC(e) do { enum { assert_static__ = 1 / (e) }; } while (0)
@@ -77,6 +81,35 @@ static const string DATA_CONT_FILE_EXT = ".datacont";
 
 static const string ENV_MC_AUTH_TOKEN_PATH = "MC_AUTH_TOKEN_PATH";
 
+/**
+ * Registry objects are anonymous mappings. The object ends the first page,
+ * so its value is page aligned, and the mapping starts with this header.
+ */
+typedef struct {
+    size_t   mapLen;
+    uint32_t refs;
+} regObjectMapping_t;
+
+/** Validated service blob loaded from a registry file. */
+typedef struct {
+    string      path;
+    dev_t       dev;
+    ino_t       ino;
+    timespec    mtime;
+    timespec    ctime;
+    off_t       size;
+    regObject_t *regobj;
+} blobCacheEntry_t;
+
+typedef list<blobCacheEntry_t>          blobCache_t;
+typedef blobCache_t::iterator           blobCacheIterator_t;
+
+static pthread_mutex_t blobCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static blobCache_t blobCache; // most recently used first
+static size_t blobCacheSize;
+static uint32_t blobCacheGeneration;
+static regBlobCacheStats_t blobCacheStats;
+
 //------------------------------------------------------------------------------
 static string byteArrayToString(const void *bytes, size_t elems)
 {
@@ -662,6 +695,190 @@ mcResult_t mcRegistryCleanupRoot(void)
     return MC_DRV_OK;
 }
 
+//------------------------------------------------------------------------------
+static regObjectMapping_t *getRegObjectMapping(regObject_t *regobj)
+{
+    return (regObjectMapping_t *)((uint8_t *)regobj + sizeof(regObject_t) - REG_PAGE_SIZE);
+}
+
+
+//------------------------------------------------------------------------------
+static regObject_t *allocRegObject(size_t valueSize)
+{
+    ASSERT_STATIC(sizeof(regObjectMapping_t) + sizeof(regObject_t) <= REG_PAGE_SIZE);
+
+    size_t mapLen = REG_PAGE_SIZE + ((valueSize + REG_PAGE_SIZE - 1) & ~(REG_PAGE_SIZE - 1));
+    void *base = mmap(NULL, mapLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+
+    regObjectMapping_t *mapping = (regObjectMapping_t *)base;
+    mapping->mapLen = mapLen;
+    mapping->refs = 1;
+
+    return (regObject_t *)((uint8_t *)base + REG_PAGE_SIZE - sizeof(regObject_t));
+}
+
+
+//------------------------------------------------------------------------------
+// Called with blobCacheMutex held.
+static void releaseRegObject(regObject_t *regobj)
+{
+    regObjectMapping_t *mapping = getRegObjectMapping(regobj);
+
+    if (--mapping->refs == 0) {
+        munmap(mapping, mapping->mapLen);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Called with blobCacheMutex held.
+static void blobCacheDrop(blobCacheIterator_t it)
+{
+    blobCacheSize -= getRegObjectMapping(it->regobj)->mapLen;
+    releaseRegObject(it->regobj);
+    blobCache.erase(it);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ * Whether the file is still the one the entry was loaded from. The times
+ * are compared to the nanosecond, and the change time also catches a
+ * rewrite that restored the modification time.
+ */
+static bool blobCacheMatches(const blobCacheEntry_t *entry, const struct stat *sb)
+{
+    return entry->dev == sb->st_dev && entry->ino == sb->st_ino &&
+           entry->size == sb->st_size &&
+           entry->mtime.tv_sec == sb->st_mtim.tv_sec &&
+           entry->mtime.tv_nsec == sb->st_mtim.tv_nsec &&
+           entry->ctime.tv_sec == sb->st_ctim.tv_sec &&
+           entry->ctime.tv_nsec == sb->st_ctim.tv_nsec;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ * Returns the cached blob of file path if it is unchanged since it was
+ * loaded. generation receives the cache generation to pass to
+ * blobCachePut() after a miss.
+ */
+static regObject_t *blobCacheGet(const char *path, const struct stat *sb, uint32_t *generation)
+{
+    regObject_t *regobj = NULL;
+
+    pthread_mutex_lock(&blobCacheMutex);
+    for (blobCacheIterator_t it = blobCache.begin(); it != blobCache.end(); ++it) {
+        if (it->path != path) {
+            continue;
+        }
+        if (!blobCacheMatches(&*it, sb)) {
+            LOG_I("%s changed, dropping cached blob", path);
+            blobCacheDrop(it);
+            break;
+        }
+        regobj = it->regobj;
+        getRegObjectMapping(regobj)->refs++;
+        blobCache.splice(blobCache.begin(), blobCache, it);
+        break;
+    }
+    if (regobj != NULL) {
+        blobCacheStats.hits++;
+    } else {
+        blobCacheStats.misses++;
+    }
+    *generation = blobCacheGeneration;
+    pthread_mutex_unlock(&blobCacheMutex);
+
+    return regobj;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ * Adds the blob loaded from file path. It is not cached if the registry
+ * was written since blobCacheGet() returned generation.
+ */
+static void blobCachePut(const char *path, const struct stat *sb, regObject_t *regobj, uint32_t generation)
+{
+    size_t mapLen = getRegObjectMapping(regobj)->mapLen;
+    if (mapLen > MAX_BLOB_CACHE_SIZE) {
+        return;
+    }
+
+    pthread_mutex_lock(&blobCacheMutex);
+    if (generation == blobCacheGeneration) {
+        for (blobCacheIterator_t it = blobCache.begin(); it != blobCache.end(); ++it) {
+            if (it->path == path) {
+                blobCacheDrop(it);
+                break;
+            }
+        }
+        while (blobCacheSize + mapLen > MAX_BLOB_CACHE_SIZE) {
+            blobCacheDrop(--blobCache.end());
+            blobCacheStats.evictions++;
+        }
+
+        blobCacheEntry_t entry;
+        entry.path = path;
+        entry.dev = sb->st_dev;
+        entry.ino = sb->st_ino;
+        entry.mtime = sb->st_mtim;
+        entry.ctime = sb->st_ctim;
+        entry.size = sb->st_size;
+        entry.regobj = regobj;
+        getRegObjectMapping(regobj)->refs++;
+        blobCache.push_front(entry);
+        blobCacheSize += mapLen;
+    }
+    pthread_mutex_unlock(&blobCacheMutex);
+}
+
+
+//------------------------------------------------------------------------------
+void mcRegistryFreeServiceBlob(regObject_t *regobj)
+{
+    if (regobj == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&blobCacheMutex);
+    releaseRegObject(regobj);
+    pthread_mutex_unlock(&blobCacheMutex);
+}
+
+
+//------------------------------------------------------------------------------
+void mcRegistryInvalidateBlobCache(void)
+{
+    pthread_mutex_lock(&blobCacheMutex);
+    blobCacheGeneration++;
+    // Only service provider trustlets carry registry containers
+    for (blobCacheIterator_t it = blobCache.begin(); it != blobCache.end();) {
+        blobCacheIterator_t cur = it++;
+        if (cur->regobj->tlStartOffset != 0) {
+            blobCacheDrop(cur);
+            blobCacheStats.invalidations++;
+        }
+    }
+    pthread_mutex_unlock(&blobCacheMutex);
+}
+
+
+//------------------------------------------------------------------------------
+void mcRegistryGetBlobCacheStats(regBlobCacheStats_t *stats)
+{
+    pthread_mutex_lock(&blobCacheMutex);
+    *stats = blobCacheStats;
+    stats->entries = blobCache.size();
+    stats->size = blobCacheSize;
+    pthread_mutex_unlock(&blobCacheMutex);
+}
+
+
 //------------------------------------------------------------------------------
 regObject_t *mcRegistryMemGetServiceBlob(mcSpid_t spid, void *trustlet, uint32_t tlSize)
 {
@@ -703,7 +920,7 @@ regObject_t *mcRegistryMemGetServiceBlob(mcSpid_t spid, void *trustlet, uint32_t
     // If loadable driver or system trustlet.
     if (pHeader->serviceType == SERVICE_TYPE_DRIVER  || pHeader->serviceType == SERVICE_TYPE_SYSTEM_TRUSTLET) {
         // Take trustlet blob 'as is'.
-        if (NULL == (regobj = (regObject_t *) (malloc(sizeof(regObject_t) + tlSize)))) {
+        if (NULL == (regobj = allocRegObject(tlSize))) {
             LOG_E("mcRegistryGetServiceBlob() failed: Out of memory");
             return NULL;
         }
@@ -717,7 +934,7 @@ regObject_t *mcRegistryMemGetServiceBlob(mcSpid_t spid, void *trustlet, uint32_t
         size_t regObjValueSize = tlSize + sizeof(mcBlobLenInfo_t) + 3 * MAX_SO_CONT_SIZE;
 
         // Prepare registry object.
-        if (NULL == (regobj = (regObject_t *) malloc(sizeof(regObject_t) + regObjValueSize))) {
+        if (NULL == (regobj = allocRegObject(regObjValueSize))) {
             LOG_E("mcRegistryGetServiceBlob() failed: Out of memory");
             return NULL;
         }
@@ -789,7 +1006,7 @@ regObject_t *mcRegistryMemGetServiceBlob(mcSpid_t spid, void *trustlet, uint32_t
 
         if (MC_DRV_OK != ret) {
             LOG_E("mcRegistryGetServiceBlob() failed: Error code: %d", ret);
-            free(regobj);
+            mcRegistryFreeServiceBlob(regobj);
             return NULL;
         }
         // Now we know the sizes for all containers so set the correct size
@@ -810,6 +1027,7 @@ regObject_t *mcRegistryFileGetServiceBlob(const char* trustlet)
 {
     struct stat sb;
     regObject_t *regobj = NULL;
+    uint32_t generation;
     void *buffer;
 
     // Ensure that a file name is provided.
@@ -818,6 +1036,16 @@ regObject_t *mcRegistryFileGetServiceBlob(const char* trustlet)
         return NULL;
     }
 
+    // Reuse the blob loaded before unless the file changed since
+    if (stat(trustlet, &sb) == -1) {
+        LOG_E("Cannot stat %s", trustlet);
+        return NULL;
+    }
+    regobj = blobCacheGet(trustlet, &sb, &generation);
+    if (regobj != NULL) {
+        return regobj;
+    }
+
     int fd = open(trustlet, O_RDONLY);
     if (fd == -1) {
         LOG_E("Cannot open %s", trustlet);
@@ -842,6 +1070,10 @@ regObject_t *mcRegistryFileGetServiceBlob(const char* trustlet)
         LOG_E("mcRegistryGetServiceBlob(): Failed to unmap memory");
     }
 
+    if (regobj != NULL) {
+        blobCachePut(trustlet, &sb, regobj, generation);
+    }
+
 error:
     if (close(fd)) {
         LOG_E("mcRegistryGetServiceBlob(): Failed to close file %s", trustlet);
@@ -884,7 +1116,7 @@ regObject_t *mcRegistryGetDriverBlob(const char *filename)
     if (pHeader->serviceType != SERVICE_TYPE_DRIVER) {
         LOG_E("mcRegistryGetServiceBlob() failed: Unsupported service type %u", pHeader->serviceType);
         pHeader = NULL;
-        free(regobj);
+        mcRegistryFreeServiceBlob(regobj);
         regobj = NULL;
     }
 
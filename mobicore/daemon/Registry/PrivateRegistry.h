@@ -39,6 +39,9 @@
 #include "MobiCoreDriverApi.h"
 #include "mcContainer.h"
 
+/** Maximum size of a trustlet in bytes. */
+#define MAX_TL_SIZE       (1 * 1024 * 1024)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -52,6 +55,18 @@ extern "C" {
         uint8_t value[];
     } regObject_t;
 
+    /**
+     * Statistics of the service blob cache.
+     */
+    typedef struct {
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t evictions;
+        uint32_t invalidations;
+        uint32_t entries;
+        uint32_t size;
+    } regBlobCacheStats_t;
+
 //-----------------------------------------------------------------
 
     /** Stores an authentication token in registry.
@@ -166,27 +181,44 @@ extern "C" {
      * @param trustlet buffer with trustlet binary
      * @param tlSize buffer size
      * @return Registry object.
-     * @note It is the responsibility of the caller to free the registry object
-     * allocated by this function.
+     * @note It is the responsibility of the caller to release the registry object
+     * with mcRegistryFreeServiceBlob().
      */
     regObject_t *mcRegistryMemGetServiceBlob(mcSpid_t spid, void *trustlet, uint32_t tlSize);
 
     /** Returns a registry object for a given service.
      * @param uuid service UUID
      * @return Registry object.
-     * @note It is the responsibility of the caller to free the registry object
-     * allocated by this function.
+     * @note It is the responsibility of the caller to release the registry object
+     * with mcRegistryFreeServiceBlob().
      */
     regObject_t *mcRegistryGetServiceBlob(const mcUuid_t  *uuid);
 
     /** Returns a registry object for a given service.
      * @param driverFilename driver filename
      * @return Registry object.
-     * @note It is the responsibility of the caller to free the registry object
-     * allocated by this function.
+     * @note It is the responsibility of the caller to release the registry object
+     * with mcRegistryFreeServiceBlob().
      */
     regObject_t *mcRegistryGetDriverBlob(const char *filename);
 
+    /** Releases a registry object returned by one of the functions above.
+     * Blobs loaded from registry files stay cached until their file changes,
+     * the registry is written or they are evicted.
+     * @param regobj Registry object, may be NULL.
+     */
+    void mcRegistryFreeServiceBlob(regObject_t *regobj);
+
+    /** Drops the cached blobs that embed registry containers. To be called
+     * after the registry has been written.
+     */
+    void mcRegistryInvalidateBlobCache(void);
+
+    /** Returns the statistics of the service blob cache.
+     * @param stats Receives the statistics.
+     */
+    void mcRegistryGetBlobCacheStats(regBlobCacheStats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,46 @@
+# =============================================================================
+#
+# MobiCore daemon host tools and tests
+#
+# =============================================================================
+
+LOCAL_PATH := $(call my-dir)
+
+# Socket server load generator, on the host
+# =============================================================================
+include $(CLEAR_VARS)
+LOCAL_MODULE := mcDriverDaemon_server_load
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -DLOG_TAG=\"McLoad\" -DLOG_ANDROID -DNDEBUG
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/../Common \
+	$(LOCAL_PATH)/../Daemon/Server/public \
+	$(LOCAL_PATH)/../../common/LogWrapper
+LOCAL_SRC_FILES := \
+	server_load.cpp \
+	../Daemon/Server/Server.cpp \
+	../Common/Connection.cpp \
+	../Common/CThread.cpp \
+	../Common/CMutex.cpp \
+	../Common/CSemaphore.cpp
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS := -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
+
+# Semaphore and MCP latency histogram tests, on the host
+# =============================================================================
+include $(CLEAR_VARS)
+LOCAL_MODULE := mcDriverDaemon_test
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -DLOG_TAG=\"McTest\" -DLOG_ANDROID
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/../Common \
+	$(LOCAL_PATH)/../Daemon/Device \
+	$(LOCAL_PATH)/../../common/LogWrapper
+LOCAL_SRC_FILES := \
+	semaphore_test.cpp \
+	mcp_latency_test.cpp \
+	../Common/CSemaphore.cpp \
+	../Daemon/Device/McpLatency.cpp
+LOCAL_LDLIBS := -lpthread -lrt
+include $(BUILD_HOST_NATIVE_TEST)
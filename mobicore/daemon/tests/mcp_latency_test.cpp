@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * MCP latency histograms: power of two buckets and the percentiles
+ * reported by the GET_STATS command.
+ */
+
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "McpLatency.h"
+
+class McpLatencyTest : public testing::Test {
+    protected:
+        McpLatencyTest()
+        {
+            memset(&mLatency, 0, sizeof(mLatency));
+        }
+
+        void add(uint32_t us, uint32_t times = 1)
+        {
+            for (uint32_t i = 0; i < times; i++)
+                mcpLatencyAdd(&mLatency, us);
+        }
+
+        mcpLatency_t mLatency;
+};
+
+TEST_F(McpLatencyTest, EmptyHistogramHasNoPercentiles)
+{
+    EXPECT_EQ(0u, mcpLatencyPercentile(&mLatency, 50));
+    EXPECT_EQ(0u, mcpLatencyPercentile(&mLatency, 99));
+}
+
+TEST_F(McpLatencyTest, BucketsArePowersOfTwo)
+{
+    add(0);
+    add(1);
+    add(2);
+    add(3);
+    add(4);
+    add(1023);
+    add(1024);
+
+    EXPECT_EQ(7u, mLatency.count);
+    EXPECT_EQ(1024u, mLatency.maxUs);
+    EXPECT_EQ(2u, mLatency.buckets[0]);
+    EXPECT_EQ(2u, mLatency.buckets[1]);
+    EXPECT_EQ(1u, mLatency.buckets[2]);
+    EXPECT_EQ(1u, mLatency.buckets[9]);
+    EXPECT_EQ(1u, mLatency.buckets[10]);
+}
+
+TEST_F(McpLatencyTest, PercentileIsTheBucketUpperBound)
+{
+    add(10, 99);            /* [8, 16) */
+    add(100);               /* [64, 128) */
+    add(3000);              /* [2048, 4096) */
+
+    EXPECT_EQ(15u, mcpLatencyPercentile(&mLatency, 50));
+    EXPECT_EQ(15u, mcpLatencyPercentile(&mLatency, 98));
+    EXPECT_EQ(127u, mcpLatencyPercentile(&mLatency, 99));
+    /* the top bucket is bounded by the longest latency */
+    EXPECT_EQ(3000u, mcpLatencyPercentile(&mLatency, 100));
+}
+
+TEST_F(McpLatencyTest, PercentileNeverExceedsTheLongestLatency)
+{
+    add(10, 4);
+
+    EXPECT_EQ(10u, mcpLatencyPercentile(&mLatency, 50));
+    EXPECT_EQ(10u, mcpLatencyPercentile(&mLatency, 99));
+}
+
+TEST_F(McpLatencyTest, RankRoundsUp)
+{
+    add(1);
+    add(1000);
+
+    EXPECT_EQ(1u, mcpLatencyPercentile(&mLatency, 50));
+    EXPECT_EQ(1000u, mcpLatencyPercentile(&mLatency, 51));
+}
+
+TEST_F(McpLatencyTest, LongestLatencyGoesToTheLastBucket)
+{
+    add(0xFFFFFFFF);
+
+    EXPECT_EQ(1u, mLatency.buckets[MCP_LATENCY_BUCKETS - 1]);
+    EXPECT_EQ(0xFFFFFFFFu, mcpLatencyPercentile(&mLatency, 50));
+}
+
+TEST_F(McpLatencyTest, LargeCountsDoNotOverflowTheRank)
+{
+    mLatency.count = 100000000;
+    mLatency.buckets[3] = 99000000;
+    mLatency.buckets[6] = 1000000;
+    mLatency.maxUs = 100;
+
+    EXPECT_EQ(15u, mcpLatencyPercentile(&mLatency, 99));
+    EXPECT_EQ(100u, mcpLatencyPercentile(&mLatency, 100));
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * CSemaphore::waitMs() on the monotonic clock: timeouts, signals that
+ * arrive before and during a wait, and counting.
+ */
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "CSemaphore.h"
+
+static int64_t nowMs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void *signalLater(void *arg)
+{
+    usleep(20000);
+    ((CSemaphore *)arg)->signal();
+    return NULL;
+}
+
+TEST(SemaphoreTest, WaitTimesOut)
+{
+    CSemaphore sem;
+    int64_t start = nowMs();
+
+    EXPECT_FALSE(sem.waitMs(50));
+    int64_t elapsed = nowMs() - start;
+    EXPECT_GE(elapsed, 50);
+    EXPECT_LT(elapsed, 1000);
+}
+
+TEST(SemaphoreTest, TimeoutsCarryIntoSeconds)
+{
+    CSemaphore sem;
+    int64_t start = nowMs();
+
+    EXPECT_FALSE(sem.waitMs(1100));
+    int64_t elapsed = nowMs() - start;
+    EXPECT_GE(elapsed, 1100);
+    EXPECT_LT(elapsed, 2000);
+}
+
+TEST(SemaphoreTest, ZeroTimeoutPolls)
+{
+    CSemaphore sem;
+
+    EXPECT_FALSE(sem.waitMs(0));
+    sem.signal();
+    EXPECT_TRUE(sem.waitMs(0));
+    EXPECT_FALSE(sem.waitMs(0));
+}
+
+TEST(SemaphoreTest, SignalsAreCounted)
+{
+    CSemaphore sem(1);
+
+    sem.signal();
+    EXPECT_TRUE(sem.waitMs(1000));
+    EXPECT_TRUE(sem.waitMs(1000));
+    EXPECT_FALSE(sem.waitMs(0));
+}
+
+TEST(SemaphoreTest, SignalWakesWaiter)
+{
+    CSemaphore sem;
+    pthread_t thread;
+    int64_t start = nowMs();
+
+    ASSERT_EQ(0, pthread_create(&thread, NULL, signalLater, &sem));
+    EXPECT_TRUE(sem.waitMs(5000));
+    EXPECT_LT(nowMs() - start, 5000);
+    pthread_join(thread, NULL);
+}
+
+TEST(SemaphoreTest, NegativeTimeoutWaitsForSignal)
+{
+    CSemaphore sem;
+    pthread_t thread;
+
+    ASSERT_EQ(0, pthread_create(&thread, NULL, signalLater, &sem));
+    EXPECT_TRUE(sem.waitMs(-1));
+    pthread_join(thread, NULL);
+}
@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Load generator for the daemon socket server. Runs Server with a handler
+ * that reads a small command and answers it, then drives it from the same
+ * process with:
+ *
+ *  - busy clients sending commands back to back, whose round trip
+ *    latency is reported,
+ *  - stalled clients that send a command header and never its payload,
+ *    which must be dropped after SERVER_MESSAGE_TIMEOUT without holding
+ *    up the busy clients for longer,
+ *  - idle clients that only stay connected, enough of them to put the
+ *    busy sockets above FD_SETSIZE.
+ *
+ * usage: mcDriverDaemon_server_load [seconds] [busy clients] [idle clients]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <vector>
+#include <algorithm>
+
+#include "Server.h"
+
+#include "log.h"
+
+#define STALLED_CLIENTS     2
+#define PAYLOAD_LEN         64
+#define SERVICE_US          20      /* handler time per command */
+
+struct LoadCommand {
+    uint32_t id;
+    uint32_t payloadLen;
+};
+
+static int64_t nowUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static volatile bool stopping;
+
+
+//------------------------------------------------------------------------------
+/**
+ * Answers each command with its id, after reading its payload.
+ */
+class LoadHandler: public ConnectionHandler
+{
+public:
+    LoadHandler() : dropped(0) {}
+
+    virtual bool handleConnection(Connection *connection) {
+        LoadCommand cmd;
+        uint8_t payload[PAYLOAD_LEN];
+
+        if (connection->readData(&cmd, sizeof(cmd)) != sizeof(cmd)) {
+            return false;
+        }
+        if (cmd.payloadLen > sizeof(payload) ||
+                connection->readData(payload, cmd.payloadLen) != cmd.payloadLen) {
+            return false;
+        }
+
+        int64_t start = nowUs();
+        while (nowUs() - start < SERVICE_US);
+
+        return connection->writeData(&cmd.id, sizeof(cmd.id)) == sizeof(cmd.id);
+    }
+
+    virtual void dropConnection(Connection *) {
+        __sync_fetch_and_add(&dropped, 1);
+    }
+
+    int dropped;
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ * Sends commands back to back and records their round trip times.
+ */
+class BusyClient: public CThread
+{
+public:
+    BusyClient(const char *addr) : addr(addr), failed(false) {}
+
+    virtual void run(void) {
+        Connection connection;
+        uint8_t buffer[sizeof(LoadCommand) + PAYLOAD_LEN];
+        LoadCommand *cmd = (LoadCommand *)buffer;
+
+        if (!connection.connect(addr)) {
+            failed = true;
+            return;
+        }
+        connection.messageTimeout = 5000;
+
+        memset(buffer, 0, sizeof(buffer));
+        cmd->payloadLen = PAYLOAD_LEN;
+        for (uint32_t id = 1; !stopping; id++) {
+            uint32_t answer = 0;
+            cmd->id = id;
+
+            int64_t start = nowUs();
+            if (connection.writeData(buffer, sizeof(buffer)) != sizeof(buffer) ||
+                    connection.readData(&answer, sizeof(answer)) != sizeof(answer) ||
+                    answer != id) {
+                failed = true;
+                return;
+            }
+            samples.push_back(nowUs() - start);
+        }
+    }
+
+    const char *addr;
+    bool failed;
+    std::vector<int64_t> samples;
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ * Sends a command header without its payload, again each time the server
+ * drops the connection, and records how long the server waited.
+ */
+class StalledClient: public CThread
+{
+public:
+    StalledClient(const char *addr) : addr(addr), failed(false) {}
+
+    virtual void run(void) {
+        while (!stopping) {
+            Connection connection;
+            LoadCommand cmd = { 1, PAYLOAD_LEN };
+            uint32_t answer;
+
+            if (!connection.connect(addr)) {
+                failed = true;
+                return;
+            }
+
+            int64_t start = nowUs();
+            if (connection.writeData(&cmd, sizeof(cmd)) != sizeof(cmd)) {
+                failed = true;
+                return;
+            }
+            // The server closes the connection, readData() returns 0
+            if (connection.readData(&answer, sizeof(answer),
+                                    4 * SERVER_MESSAGE_TIMEOUT) != 0) {
+                failed = true;
+                return;
+            }
+            drops.push_back(nowUs() - start);
+        }
+    }
+
+    const char *addr;
+    bool failed;
+    std::vector<int64_t> drops;
+};
+
+
+//------------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 5;
+    int busyCount = argc > 2 ? atoi(argv[2]) : 32;
+    int idleCount = argc > 3 ? atoi(argv[3]) : FD_SETSIZE;
+    char addr[64];
+    int ret = 0;
+
+    if (seconds <= 0)
+        seconds = 5;
+    if (busyCount <= 0)
+        busyCount = 32;
+    if (idleCount < 0)
+        idleCount = 0;
+
+    // Both ends of every connection live in this process
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        rlim_t needed = 2 * (idleCount + busyCount + STALLED_CLIENTS) + 64;
+        if (limit.rlim_cur < needed) {
+            limit.rlim_cur = std::min(needed, limit.rlim_max);
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+        if (limit.rlim_cur < needed) {
+            rlim_t pairs = limit.rlim_cur > 64 ? (limit.rlim_cur - 64) / 2 : 0;
+            idleCount = std::max((int)pairs - busyCount - STALLED_CLIENTS, 0);
+            printf("fd limit %lu, using %d idle clients\n",
+                   (unsigned long)limit.rlim_cur, idleCount);
+        }
+    }
+
+    // Server and Connection drop the first character for the abstract namespace
+    snprintf(addr, sizeof(addr), "#mcdaemon_load_%d", getpid());
+
+    LoadHandler handler;
+    Server *server = new Server(&handler, addr);
+    server->start();
+
+    // Wait for the server socket
+    Connection probe;
+    for (int i = 0; !probe.connect(addr); i++) {
+        if (i == 100) {
+            fprintf(stderr, "server did not start\n");
+            return 1;
+        }
+        usleep(10000);
+    }
+
+    std::vector<Connection *> idle;
+    for (int i = 0; i < idleCount; i++) {
+        Connection *connection = new Connection();
+        if (!connection->connect(addr)) {
+            delete connection;
+            break;
+        }
+        idle.push_back(connection);
+    }
+
+    std::vector<BusyClient *> busy;
+    for (int i = 0; i < busyCount; i++) {
+        busy.push_back(new BusyClient(addr));
+        busy.back()->start();
+    }
+    std::vector<StalledClient *> stalled;
+    for (int i = 0; i < STALLED_CLIENTS; i++) {
+        stalled.push_back(new StalledClient(addr));
+        stalled.back()->start();
+    }
+
+    sleep(seconds);
+    stopping = true;
+
+    std::vector<int64_t> samples;
+    for (size_t i = 0; i < busy.size(); i++) {
+        busy[i]->join();
+        if (busy[i]->failed) {
+            fprintf(stderr, "busy client %zu failed\n", i);
+            ret = 1;
+        }
+        samples.insert(samples.end(), busy[i]->samples.begin(), busy[i]->samples.end());
+    }
+
+    std::vector<int64_t> drops;
+    for (size_t i = 0; i < stalled.size(); i++) {
+        stalled[i]->join();
+        if (stalled[i]->failed) {
+            fprintf(stderr, "stalled client %zu was not dropped\n", i);
+            ret = 1;
+        }
+        drops.insert(drops.end(), stalled[i]->drops.begin(), stalled[i]->drops.end());
+    }
+
+    printf("%d busy, %d stalled and %zu idle clients, %d workers, %d s\n",
+           busyCount, STALLED_CLIENTS, idle.size(), SERVER_WORKERS, seconds);
+
+    if (samples.empty()) {
+        fprintf(stderr, "no command completed\n");
+        return 1;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    printf("commands %zu  %.0f/s  p50 %lld us  p90 %lld us  p99 %lld us  max %lld us\n",
+           n, (double)n / seconds, (long long)samples[n / 2],
+           (long long)samples[n * 9 / 10], (long long)samples[n * 99 / 100],
+           (long long)samples[n - 1]);
+
+    if (!drops.empty()) {
+        std::sort(drops.begin(), drops.end());
+        printf("stalled commands dropped %zu  after %lld ms to %lld ms\n",
+               drops.size(), (long long)drops[0] / 1000,
+               (long long)drops[drops.size() - 1] / 1000);
+    }
+    printf("connections dropped by the server %d\n", handler.dropped);
+
+    // The server thread never returns from run(), leave without tearing down
+    fflush(stdout);
+    _exit(ret);
+}